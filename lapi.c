@@ -607,6 +607,37 @@ LUA_API char *lua_toblob (lua_State *L, int idx, size_t *len) {
 }
 #endif
 
+#if defined(LUAGLM_EXT_STRBUF)
+LUA_API char *lua_reallocbuff (lua_State *L, char *buff, size_t osize,
+                                                         size_t nsize) {
+  char *b;
+  lua_lock(L);
+  b = luaS_reallocbuff(L, buff, osize, nsize);
+  lua_unlock(L);
+  return b;
+}
+
+LUA_API const char *lua_pushbuffstring (lua_State *L, char *buff,
+                                        size_t size, size_t len, int blob) {
+  TString *ts;
+  int tag = LUA_VLNGSTR;
+  lua_lock(L);
+#if defined(LUAGLM_EXT_BLOB)
+  if (blob)
+    tag = LUA_VBLOBSTR;
+#else
+  api_check(L, !blob, "blobs are not enabled");
+#endif
+  api_check(L, buff != NULL && len <= size, "invalid string buffer");
+  ts = luaS_newbuffstr(L, buff, size, len, tag);
+  setsvalue2s(L, L->top, ts);
+  api_incr_top(L);
+  luaC_checkGC(L);
+  lua_unlock(L);
+  return getstr(ts);
+}
+#endif
+
 
 LUA_API const char *lua_pushvfstring (lua_State *L, const char *fmt,
                                       va_list argp) {
@@ -933,6 +964,88 @@ LUA_API void lua_compacttable (lua_State *L, int idx) {
   lua_unlock(L);
 }
 
+/*
+** Ensure the array part of a table holds 'narray' elements and, with
+** LUAGLM_EXT_TABLEHINT, keep that as its minimum size on rehashes.
+*/
+LUA_API void lua_reservetable (lua_State *L, int idx, int narray) {
+  const TValue *o;
+  lua_lock(L);
+  o = index2value(L, idx);
+  api_check(L, ttistable(o), "table expected");
+  api_check(L, narray >= 0, "negative array size");
+  luaH_reserve(L, hvalue(o), cast_uint(narray));
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+/*
+** Number of full table rehashes and of array parts grown by appends
+** since the state was created (or the counters were last reset).
+*/
+LUA_API void lua_tablestats (lua_State *L, lua_Integer *nrehash,
+                             lua_Integer *ngrow, int reset) {
+  global_State *g = G(L);
+  lua_lock(L);
+  if (nrehash) *nrehash = l_castU2S(g->tabrehash);
+  if (ngrow) *ngrow = l_castU2S(g->tabgrow);
+  if (reset)
+    g->tabrehash = g->tabgrow = 0;
+  lua_unlock(L);
+}
+
+/*
+** Sort 't[1 .. n]' of the table at 'idx' directly on its array part, by
+** the function at stack index 'comp' or, when 'comp' is 0, by '<'.
+** Returns 0 without changing the table when the elements are not all
+** in the array part or, without a function, when they are not all
+** integers, all floats, or all strings.
+*/
+LUA_API int lua_sortarray (lua_State *L, int idx, lua_Integer n, int comp) {
+  const TValue *o;
+  StkId func = NULL;
+  int res = 0;
+  lua_lock(L);
+  o = index2value(L, idx);
+  api_check(L, ttistable(o), "table expected");
+#if defined(LUAGLM_EXT_READONLY)
+  readonly_api_check(L, hvalue(o));
+#endif
+  if (comp != 0) {
+    func = index2stack(L, comp);
+    api_check(L, ttisfunction(s2v(func)), "function expected");
+  }
+  if (0 <= n && l_castS2U(n) <= luaH_realasize(hvalue(o)))
+    res = luaH_sort(L, hvalue(o), cast_uint(n), func);
+  lua_unlock(L);
+  return res;
+}
+
+/*
+** Sort 't[1 .. n]' of the table at 'idx' directly on its array part by
+** the keys at the same positions of the array part of the table at
+** 'keys' (all numbers or all strings), keeping the order of equal keys
+** when 'stable'. Returns 0 without changing the table when its elements
+** are not all in the array part.
+*/
+LUA_API int lua_sortby (lua_State *L, int idx, int keys, lua_Integer n,
+                                      int stable) {
+  const TValue *o, *k;
+  int res = 0;
+  lua_lock(L);
+  o = index2value(L, idx);
+  k = index2value(L, keys);
+  api_check(L, ttistable(o) && ttistable(k), "table expected");
+#if defined(LUAGLM_EXT_READONLY)
+  readonly_api_check(L, hvalue(o));
+#endif
+  if (0 <= n && l_castS2U(n) <= luaH_realasize(hvalue(o)) &&
+                l_castS2U(n) <= luaH_realasize(hvalue(k)))
+    res = luaH_sortby(L, hvalue(o), hvalue(k), cast_uint(n), stable);
+  lua_unlock(L);
+  return res;
+}
+
 LUA_API void lua_clonetable (lua_State *L, int fromidx, int toidx) {
   const TValue *from, *to;
   lua_lock(L);
@@ -1386,6 +1499,10 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
       int data = va_arg(argp, int);
       l_mem debt = 1;  /* =1 to signal that it did an actual step */
       lu_byte oldstp = g->gcstp;
+#if defined(LUAGLM_EXT_GCBUDGET)
+      lu_mem oldbudget = g->gcbudget;
+      g->gcbudget = 0;  /* explicit steps are measured in work */
+#endif
       g->gcstp = 0;  /* allow GC to run (GCSTPGC must be zero here) */
       if (data == 0) {
         luaE_setdebt(g, 0);  /* do a basic step */
@@ -1397,6 +1514,9 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
         luaC_checkGC(L);
       }
       g->gcstp = oldstp;  /* restore previous state */
+#if defined(LUAGLM_EXT_GCBUDGET)
+      g->gcbudget = oldbudget;
+#endif
       if (debt > 0 && g->gcstate == GCSpause)  /* end of cycle? */
         res = 1;  /* signal it */
       break;
@@ -1442,6 +1562,39 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
       luaC_changemode(L, KGC_INC);
       break;
     }
+#if defined(LUAGLM_EXT_GCBUDGET)
+    case LUA_GCBUDGET: {
+      int us = va_arg(argp, int);
+      res = cast_int(g->gcbudget);  /* set from an int */
+      if (us >= 0)  /* negative values only query the budget */
+        g->gcbudget = cast(lu_mem, us);
+      break;
+    }
+    case LUA_GCIDLE: {
+      int us = va_arg(argp, int);
+      lu_byte oldstp = g->gcstp;
+      g->gcstp = 0;  /* allow GC to run (GCSTPGC must be zero here) */
+      res = luaC_idle(L, (us > 0) ? cast(lu_mem, us) : 0);
+      g->gcstp = oldstp;  /* restore previous state */
+      break;
+    }
+    case LUA_GCPAUSES: {
+      int stat = va_arg(argp, int);
+      lu_mem v = luaC_pausestat(g, stat);
+      res = cast_int((v < cast(lu_mem, MAX_INT)) ? v : cast(lu_mem, MAX_INT));
+      break;
+    }
+#endif
+    case LUA_GCASYNC: {
+      int on = va_arg(argp, int);
+#if defined(LUA_USE_ASYNCFREE)
+      res = luaC_asyncfree(L, on);
+#else
+      UNUSED(on);
+      res = 0;  /* not available */
+#endif
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   va_end(argp);
@@ -1549,11 +1702,40 @@ LUA_API lua_Alloc lua_getallocf (lua_State *L, void **ud) {
 
 
 LUA_API void lua_setallocf (lua_State *L, lua_Alloc f, void *ud) {
+#if defined(LUA_USE_ASYNCFREE)
+  int async;
+#endif
   lua_lock(L);
+#if defined(LUA_USE_ASYNCFREE)
+  /* the background thread releases its blocks with the old allocator */
+  async = (G(L)->asyncfree != NULL);
+  if (async)
+    luaC_asyncfree(L, 0);
+#endif
   G(L)->ud = ud;
   G(L)->frealloc = f;
+#if defined(LUA_USE_ASYNCFREE)
+  if (async)  /* restart it with the new one */
+    luaC_asyncfree(L, 1);
+#endif
+  lua_unlock(L);
+}
+
+
+#if defined(LUA_USE_LOCK)
+LUA_API void lua_lockstats (lua_State *L, lua_Integer *nlock,
+                            lua_Integer *ncontended, lua_Integer *waitns,
+                            int reset) {
+  l_Lock *lk = &G(L)->lock;
+  lua_lock(L);
+  if (nlock) *nlock = l_castU2S(lk->nlock);
+  if (ncontended) *ncontended = l_castU2S(lk->ncontended);
+  if (waitns) *waitns = l_castU2S(lk->waitns);
+  if (reset)
+    lk->nlock = lk->ncontended = lk->waitns = 0;
   lua_unlock(L);
 }
+#endif
 
 
 void lua_setwarnf (lua_State *L, lua_WarnFunction f, void *ud) {
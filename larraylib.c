@@ -0,0 +1,500 @@
+/*
+** $Id: larraylib.c $
+** Typed arrays: homogeneous numeric sequences with compact storage
+** See Copyright Notice in lua.h
+*/
+
+#define larraylib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+#include "lgritlib.h"
+
+
+/*
+** A typed array is a full userdata that mimics a sequence: integer keys
+** in [1, #a] are elements; writing to #a + 1 appends and assigning nil
+** to #a removes the last element, so the functions of the table library
+** (insert, remove, sort, concat, unpack, move) and ipairs work on it.
+** Elements are stored without tags in a separate userdata, anchored as
+** the first user value, that is replaced when the array grows.
+*/
+#define LUA_ARRAYHANDLE		"array"
+
+
+/* element types */
+enum ArrayKind {
+  ARR_INT8, ARR_UINT8, ARR_INT16, ARR_UINT16, ARR_INT32, ARR_UINT32,
+  ARR_INT64, ARR_FLOAT32, ARR_FLOAT64, ARR_VEC2, ARR_VEC3, ARR_VEC4
+};
+
+static const char *const kindnames[] = {
+  "int8", "uint8", "int16", "uint16", "int32", "uint32",
+  "int64", "float32", "float64", "vec2", "vec3", "vec4", NULL
+};
+
+static const size_t kindsizes[] = {
+  sizeof(int8_t), sizeof(uint8_t), sizeof(int16_t), sizeof(uint16_t),
+  sizeof(int32_t), sizeof(uint32_t), sizeof(int64_t), sizeof(float),
+  sizeof(double), 2 * sizeof(lua_VecF), 3 * sizeof(lua_VecF),
+  4 * sizeof(lua_VecF)
+};
+
+
+typedef struct TypedArray {
+  int kind;  /* element type */
+  size_t elsize;  /* size of an element in bytes */
+  lua_Integer size;  /* number of elements */
+  lua_Integer capacity;  /* number of elements 'data' can hold */
+  char *data;  /* storage, anchored as the first user value */
+} TypedArray;
+
+
+#define checkarray(L,i)	((TypedArray *)luaL_checkudata(L, i, LUA_ARRAYHANDLE))
+
+#define element(a,i)	((a)->data + (size_t)((i) - 1) * (a)->elsize)
+
+#if !defined(MAX_SIZET)
+#define MAX_SIZET	((size_t)(~(size_t)0))
+#endif
+
+/* maximum number of elements, such that byte sizes fit in a size_t */
+#define MAXELEMS(a) \
+  ((lua_Integer)((MAX_SIZET / (a)->elsize) < (size_t)LUA_MAXINTEGER \
+                 ? (MAX_SIZET / (a)->elsize) : (size_t)LUA_MAXINTEGER))
+
+
+/*
+** Reallocate the storage of the array (at index 'arg') to hold 'n'
+** elements.
+*/
+static void setcapacity (lua_State *L, int arg, TypedArray *a,
+                                                lua_Integer n) {
+  char *data;
+  luaL_argcheck(L, n <= MAXELEMS(a), arg, "array too large");
+  data = (char *)lua_newuserdatauv(L, (size_t)n * a->elsize, 0);
+  if (a->size > 0)
+    memcpy(data, a->data, (size_t)(n < a->size ? n : a->size) * a->elsize);
+  lua_setiuservalue(L, arg, 1);
+  a->data = data;
+  a->capacity = n;
+  if (a->size > n)
+    a->size = n;
+}
+
+
+/*
+** Ensure capacity for one more element, growing the storage by half of
+** its size (at least four elements).
+*/
+static void growarray (lua_State *L, int arg, TypedArray *a) {
+  if (a->size == a->capacity) {
+    lua_Integer limit = MAXELEMS(a);
+    lua_Integer n = a->capacity + (a->capacity >> 1);
+    if (n < 4)
+      n = 4;
+    if (n > limit || n < a->capacity)  /* overflow? */
+      n = limit;
+    if (a->size == n)
+      luaL_error(L, "array overflow");
+    setcapacity(L, arg, a, n);
+  }
+}
+
+
+static void pushelement (lua_State *L, TypedArray *a, lua_Integer i) {
+  const char *p = element(a, i);
+  switch (a->kind) {
+    case ARR_INT8: lua_pushinteger(L, *(const int8_t *)p); break;
+    case ARR_UINT8: lua_pushinteger(L, *(const uint8_t *)p); break;
+    case ARR_INT16: lua_pushinteger(L, *(const int16_t *)p); break;
+    case ARR_UINT16: lua_pushinteger(L, *(const uint16_t *)p); break;
+    case ARR_INT32: lua_pushinteger(L, *(const int32_t *)p); break;
+    case ARR_UINT32: lua_pushinteger(L, (lua_Integer)*(const uint32_t *)p); break;
+    case ARR_INT64: lua_pushinteger(L, (lua_Integer)*(const int64_t *)p); break;
+    case ARR_FLOAT32: lua_pushnumber(L, (lua_Number)*(const float *)p); break;
+    case ARR_FLOAT64: lua_pushnumber(L, (lua_Number)*(const double *)p); break;
+    case ARR_VEC2: case ARR_VEC3: case ARR_VEC4: {
+      static const int variants[] = { LUA_VVECTOR2, LUA_VVECTOR3, LUA_VVECTOR4 };
+      const int dims = a->kind - ARR_VEC2 + 2;
+      lua_Float4 f4;
+      memset(&f4, 0, sizeof(f4));
+      memcpy(f4.raw, p, (size_t)dims * sizeof(lua_VecF));
+      lua_pushvector(L, f4, variants[a->kind - ARR_VEC2]);
+      break;
+    }
+  }
+}
+
+
+/*
+** Convert the value at index 'arg' to the element type of 'a' and store
+** it at 'p'. Integers are truncated to the width of the element type
+** (as C casts do).
+*/
+static void setelement (lua_State *L, TypedArray *a, char *p, int arg) {
+  switch (a->kind) {
+    case ARR_INT8: *(int8_t *)p = (int8_t)luaL_checkinteger(L, arg); break;
+    case ARR_UINT8: *(uint8_t *)p = (uint8_t)luaL_checkinteger(L, arg); break;
+    case ARR_INT16: *(int16_t *)p = (int16_t)luaL_checkinteger(L, arg); break;
+    case ARR_UINT16: *(uint16_t *)p = (uint16_t)luaL_checkinteger(L, arg); break;
+    case ARR_INT32: *(int32_t *)p = (int32_t)luaL_checkinteger(L, arg); break;
+    case ARR_UINT32: *(uint32_t *)p = (uint32_t)luaL_checkinteger(L, arg); break;
+    case ARR_INT64: *(int64_t *)p = (int64_t)luaL_checkinteger(L, arg); break;
+    case ARR_FLOAT32: *(float *)p = (float)luaL_checknumber(L, arg); break;
+    case ARR_FLOAT64: *(double *)p = (double)luaL_checknumber(L, arg); break;
+    case ARR_VEC2: {
+      lua_VecF *v = (lua_VecF *)p;
+      lua_checkvector2(L, arg, &v[0], &v[1]);
+      break;
+    }
+    case ARR_VEC3: {
+      lua_VecF *v = (lua_VecF *)p;
+      lua_checkvector3(L, arg, &v[0], &v[1], &v[2]);
+      break;
+    }
+    case ARR_VEC4: {
+      lua_VecF *v = (lua_VecF *)p;
+      lua_checkvector4(L, arg, &v[0], &v[1], &v[2], &v[3]);
+      break;
+    }
+  }
+}
+
+
+/*
+** Set the elements in [i, j] to the value at index 'arg'.
+*/
+static void fillarray (lua_State *L, TypedArray *a, lua_Integer i,
+                                     lua_Integer j, int arg) {
+  if (i <= j) {
+    char *first = element(a, i);
+    char *p;
+    setelement(L, a, first, arg);
+    for (p = first + a->elsize; p <= element(a, j); p += a->elsize)
+      memcpy(p, first, a->elsize);
+  }
+}
+
+
+/*
+** Create an array with 'n' (zeroed) elements of type 'kind', leaving it
+** on the top of the stack.
+*/
+static TypedArray *newarray (lua_State *L, int kind, lua_Integer n) {
+  TypedArray *a = (TypedArray *)lua_newuserdatauv(L, sizeof(TypedArray), 1);
+  a->kind = kind;
+  a->elsize = kindsizes[kind];
+  a->size = a->capacity = 0;
+  a->data = NULL;
+  luaL_setmetatable(L, LUA_ARRAYHANDLE);
+  luaL_argcheck(L, 0 <= n && n <= MAXELEMS(a), 2, "invalid array size");
+  setcapacity(L, lua_gettop(L), a, n);
+  if (n > 0)
+    memset(a->data, 0, (size_t)n * a->elsize);
+  a->size = n;
+  return a;
+}
+
+
+/*
+** {======================================================
+** Library functions
+** =======================================================
+*/
+
+static int arr_new (lua_State *L) {
+  int kind = luaL_checkoption(L, 1, NULL, kindnames);
+  lua_Integer n = luaL_optinteger(L, 2, 0);
+  TypedArray *a;
+  lua_settop(L, 3);
+  a = newarray(L, kind, n);
+  if (!lua_isnil(L, 3))
+    fillarray(L, a, 1, n, 3);
+  return 1;
+}
+
+
+/*
+** array.from(type, t [, i [, j]]): copy the elements t[i], ..., t[j] of a
+** table (or an object that behaves like one) into a new array.
+*/
+static int arr_from (lua_State *L) {
+  int kind = luaL_checkoption(L, 1, NULL, kindnames);
+  lua_Integer i = luaL_optinteger(L, 3, 1);
+  lua_Integer e = luaL_opt(L, luaL_checkinteger, 4, luaL_len(L, 2));
+  lua_Integer n = (i <= e) ? e - i + 1 : 0;
+  TypedArray *a;
+  lua_Integer k;
+  luaL_argcheck(L, i > 0 || e < LUA_MAXINTEGER + i, 4, "too many elements");
+  a = newarray(L, kind, n);
+  for (k = 0; k < n; k++) {
+    lua_geti(L, 2, i + k);
+    setelement(L, a, element(a, k + 1), -1);
+    lua_pop(L, 1);
+  }
+  return 1;
+}
+
+
+/*
+** array.type(v): element type of a typed array; fail otherwise.
+*/
+static int arr_type (lua_State *L) {
+  TypedArray *a;
+  luaL_checkany(L, 1);
+  a = (TypedArray *)luaL_testudata(L, 1, LUA_ARRAYHANDLE);
+  if (a == NULL)
+    luaL_pushfail(L);
+  else
+    lua_pushstring(L, kindnames[a->kind]);
+  return 1;
+}
+
+
+static const luaL_Reg arr_funcs[] = {
+  {"new", arr_new},
+  {"from", arr_from},
+  {"type", arr_type},
+  {NULL, NULL}
+};
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Methods
+** =======================================================
+*/
+
+/*
+** a:resize(n [, v]): change the number of elements; new elements are
+** set to 'v' (zero by default).
+*/
+static int m_resize (lua_State *L) {
+  TypedArray *a = checkarray(L, 1);
+  lua_Integer n = luaL_checkinteger(L, 2);
+  lua_Integer old = a->size;
+  luaL_argcheck(L, 0 <= n && n <= MAXELEMS(a), 2, "invalid array size");
+  if (n > a->capacity)
+    setcapacity(L, 1, a, n);
+  a->size = n;
+  if (n > old) {
+    memset(element(a, old + 1), 0, (size_t)(n - old) * a->elsize);
+    if (!lua_isnoneornil(L, 3))
+      fillarray(L, a, old + 1, n, 3);
+  }
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+/*
+** a:reserve(n): ensure storage for 'n' elements without changing the
+** size; a:reserve() releases unused storage.
+*/
+static int m_reserve (lua_State *L) {
+  TypedArray *a = checkarray(L, 1);
+  lua_Integer n = luaL_optinteger(L, 2, a->size);
+  luaL_argcheck(L, 0 <= n && n <= MAXELEMS(a), 2, "invalid array size");
+  if (n > a->capacity || (lua_isnoneornil(L, 2) && n < a->capacity))
+    setcapacity(L, 1, a, n);
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+/*
+** a:fill(v [, i [, j]])
+*/
+static int m_fill (lua_State *L) {
+  TypedArray *a = checkarray(L, 1);
+  lua_Integer i = luaL_optinteger(L, 3, 1);
+  lua_Integer j = luaL_optinteger(L, 4, a->size);
+  luaL_checkany(L, 2);
+  luaL_argcheck(L, 1 <= i, 3, "index out of bounds");
+  luaL_argcheck(L, j <= a->size, 4, "index out of bounds");
+  fillarray(L, a, i, j, 2);
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+/*
+** a:totable([i [, j]]): copy elements into a new sequence.
+*/
+static int m_totable (lua_State *L) {
+  TypedArray *a = checkarray(L, 1);
+  lua_Integer i = luaL_optinteger(L, 2, 1);
+  lua_Integer j = luaL_optinteger(L, 3, a->size);
+  lua_Integer k;
+  luaL_argcheck(L, 1 <= i, 2, "index out of bounds");
+  luaL_argcheck(L, j <= a->size, 3, "index out of bounds");
+  lua_createtable(L, (i <= j && j - i < INT_MAX) ? (int)(j - i + 1) : 0, 0);
+  for (k = i; k <= j; k++) {
+    pushelement(L, a, k);
+    lua_rawseti(L, -2, k - i + 1);
+  }
+  return 1;
+}
+
+
+static const luaL_Reg arr_meth[] = {
+  {"resize", m_resize},
+  {"reserve", m_reserve},
+  {"fill", m_fill},
+  {"totable", m_totable},
+  {NULL, NULL}
+};
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Metamethods
+** =======================================================
+*/
+
+/*
+** Get the key at index 2 as an element index. As in tables, floats with
+** an integral value are valid indices; strings are not converted.
+*/
+static int arraykey (lua_State *L, lua_Integer *i) {
+  if (lua_isinteger(L, 2)) {
+    *i = lua_tointeger(L, 2);
+    return 1;
+  }
+  else if (lua_type(L, 2) == LUA_TNUMBER) {
+    int isint;
+    *i = lua_tointegerx(L, 2, &isint);
+    return isint;
+  }
+  return 0;
+}
+
+
+/*
+** __index: elements by integer keys (nil outside [1, #a]); other keys
+** are looked up in the method table (first upvalue).
+*/
+static int mm_index (lua_State *L) {
+  TypedArray *a = checkarray(L, 1);
+  lua_Integer i;
+  if (arraykey(L, &i)) {
+    if (l_likely(1 <= i && i <= a->size))
+      pushelement(L, a, i);
+    else
+      lua_pushnil(L);
+  }
+  else if (lua_type(L, 2) == LUA_TSTRING)
+    lua_rawget(L, lua_upvalueindex(1));
+  else
+    lua_pushnil(L);
+  return 1;
+}
+
+
+static int mm_newindex (lua_State *L) {
+  TypedArray *a = checkarray(L, 1);
+  lua_Integer i;
+  if (l_unlikely(!arraykey(L, &i)))
+    return luaL_error(L, "invalid key to typed array");
+  else if (lua_isnil(L, 3)) {  /* remove an element? */
+    if (1 <= i && i == a->size)
+      a->size--;
+    else if (i < 1 || i > a->size)
+      return 0;  /* absent already */
+    else
+      return luaL_error(L, "cannot remove element %I of typed array "
+                           "(only the last one)", (LUAI_UACINT)i);
+  }
+  else if (l_likely(1 <= i && i <= a->size))
+    setelement(L, a, element(a, i), 3);
+  else if (i == a->size + 1) {  /* append */
+    growarray(L, 1, a);
+    setelement(L, a, element(a, i), 3);
+    a->size = i;
+  }
+  else
+    return luaL_error(L, "index %I out of bounds of typed array",
+                         (LUAI_UACINT)i);
+  return 0;
+}
+
+
+static int mm_len (lua_State *L) {
+  lua_pushinteger(L, checkarray(L, 1)->size);
+  return 1;
+}
+
+
+static int arr_ipairsaux (lua_State *L) {
+  TypedArray *a = checkarray(L, 1);
+  lua_Integer i = luaL_checkinteger(L, 2);
+  if (i < a->size) {
+    lua_pushinteger(L, i + 1);
+    pushelement(L, a, i + 1);
+    return 2;
+  }
+  return 0;
+}
+
+
+static int mm_pairs (lua_State *L) {
+  checkarray(L, 1);
+  lua_pushcfunction(L, arr_ipairsaux);  /* iteration function */
+  lua_pushvalue(L, 1);  /* state */
+  lua_pushinteger(L, 0);  /* initial value */
+  return 3;
+}
+
+
+static int mm_tostring (lua_State *L) {
+  TypedArray *a = checkarray(L, 1);
+  lua_pushfstring(L, "%s[%I]: %p", kindnames[a->kind], (LUAI_UACINT)a->size,
+                                   lua_topointer(L, 1));
+  return 1;
+}
+
+
+static const luaL_Reg arr_metameth[] = {
+  {"__index", NULL},  /* place holder */
+  {"__newindex", mm_newindex},
+  {"__len", mm_len},
+  {"__pairs", mm_pairs},
+  {"__tostring", mm_tostring},
+  {NULL, NULL}
+};
+
+/* }====================================================== */
+
+
+static void arr_createmeta (lua_State *L) {
+  luaL_newmetatable(L, LUA_ARRAYHANDLE);  /* metatable for typed arrays */
+  luaL_setfuncs(L, arr_metameth, 0);  /* add metamethods to new metatable */
+  luaL_newlibtable(L, arr_meth);  /* create method table */
+  luaL_setfuncs(L, arr_meth, 0);  /* add methods to method table */
+  lua_pushcclosure(L, mm_index, 1);  /* method table is an upvalue */
+  lua_setfield(L, -2, "__index");  /* metatable.__index = mm_index */
+  lua_pop(L, 1);  /* pop metatable */
+}
+
+
+LUAMOD_API int luaopen_array (lua_State *L) {
+  luaL_newlib(L, arr_funcs);
+  arr_createmeta(L);
+  return 1;
+}
+
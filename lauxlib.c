@@ -774,6 +774,251 @@ static int skipcomment (LoadF *lf, int *cp) {
 }
 
 
+/*
+** {======================================================
+** Chunk cache: when a cache directory is configured (registry field
+** LUA_CHUNKCACHEKEY or environment variable LUA_CHUNKCACHEENV),
+** 'luaL_loadfilex' stores the precompiled form of each source file it
+** loads and, on later loads, reuses it instead of parsing the source.
+** An entry is valid only for the same path, modification time, size,
+** content hash, and build configuration.
+** =======================================================
+*/
+#if defined(LUA_USE_CHUNKCACHE)
+
+#include <sys/stat.h>
+
+#if !defined(LUA_CHUNKCACHEKEY)
+#define LUA_CHUNKCACHEKEY	"_CHUNKCACHE"
+#endif
+
+#if !defined(LUA_CHUNKCACHEENV)
+#define LUA_CHUNKCACHEENV	"LUA_CHUNKCACHE"
+#endif
+
+/*
+** Options that change the meaning or encoding of compiled chunks;
+** entries written by a build with a different set are ignored.
+*/
+static const char *const cachetags[] = {
+  LUA_RELEASE,
+#if defined(LUAI_CHUNKCACHETAG)
+  LUAI_CHUNKCACHETAG,
+#endif
+#if defined(LUAGLM_NUMBER_TYPE)
+  "NUMBER_TYPE",
+#endif
+#if defined(LUAGLM_COMPAT_IPAIRS)
+  "COMPAT_IPAIRS",
+#endif
+#if defined(LUAGLM_EXT_API)
+  "API",
+#endif
+#if defined(LUAGLM_EXT_BLOB)
+  "BLOB",
+#endif
+#if defined(LUAGLM_EXT_CCOMMENT)
+  "CCOMMENT",
+#endif
+#if defined(LUAGLM_EXT_COMPOUND)
+  "COMPOUND",
+#endif
+#if defined(LUAGLM_EXT_DEFER)
+  "DEFER",
+#endif
+#if defined(LUAGLM_EXT_DEFER_OLD)
+  "DEFER_OLD",
+#endif
+#if defined(LUAGLM_EXT_EACH)
+  "EACH",
+#endif
+#if defined(LUAGLM_EXT_INTABLE)
+  "INTABLE",
+#endif
+#if defined(LUAGLM_EXT_JOAAT)
+  "JOAAT",
+#endif
+#if defined(LUAGLM_EXT_LAMBDA)
+  "LAMBDA",
+#endif
+#if defined(LUAGLM_EXT_READONLY)
+  "READONLY",
+#endif
+#if defined(LUAGLM_EXT_SAFENAV)
+  "SAFENAV",
+#endif
+#if defined(LUAGLM_EXT_SCOPE_RESOLUTION)
+  "SCOPE_RESOLUTION",
+#endif
+#if defined(LUAGLM_EXT_TABINIT)
+  "TABINIT",
+#endif
+  NULL
+};
+
+
+/* FNV-1a */
+static lua_Unsigned cachehash (const char *s, size_t l) {
+  lua_Unsigned h = (lua_Unsigned)14695981039346656037u;
+  for (; l > 0; l--, s++)
+    h = (h ^ (unsigned char)*s) * (lua_Unsigned)1099511628211u;
+  return h;
+}
+
+
+static int cachewriter (lua_State *L, const void *b, size_t size, void *ud) {
+  (void)L;  /* not used */
+  return (fwrite(b, 1, size, (FILE *)ud) != size);
+}
+
+
+/*
+** Push the header identifying a valid cache entry for 'filename'.
+*/
+static void pushcacheheader (lua_State *L, const char *filename,
+                             const struct stat *st, const char *src,
+                             size_t l) {
+  luaL_Buffer b;
+  int i;
+  luaL_buffinit(L, &b);
+  luaL_addstring(&b, "LUACACHE");
+  for (i = 0; cachetags[i] != NULL; i++) {
+    luaL_addchar(&b, ' ');
+    luaL_addstring(&b, cachetags[i]);
+  }
+  lua_pushfstring(L, "\n%d %d %d\n%I %I %I\n%s\n",
+                  (int)sizeof(lua_Integer), (int)sizeof(lua_Number),
+                  (int)sizeof(lua_VecF), (LUAI_UACINT)st->st_mtime,
+                  (LUAI_UACINT)l, (LUAI_UACINT)cachehash(src, l), filename);
+  luaL_addvalue(&b);
+  luaL_pushresult(&b);
+}
+
+
+/*
+** Read the whole file 'filename' and push its contents; returns 0 (and
+** pushes nothing) on errors.
+*/
+static int pushfilecontents (lua_State *L, const char *filename) {
+  luaL_Buffer b;
+  size_t nr;
+  int err;
+  FILE *f = fopen(filename, "rb");
+  if (f == NULL) return 0;
+  luaL_buffinit(L, &b);
+  do {
+    char *p = luaL_prepbuffer(&b);
+    nr = fread(p, 1, LUAL_BUFFERSIZE, f);
+    luaL_addsize(&b, nr);
+  } while (nr == LUAL_BUFFERSIZE);
+  err = ferror(f);
+  fclose(f);
+  luaL_pushresult(&b);
+  if (err) {
+    lua_pop(L, 1);
+    return 0;
+  }
+  return 1;
+}
+
+
+/*
+** Try to load 'filename' through the chunk cache. Returns -1, leaving
+** the stack unchanged, when the cache does not apply (no cache
+** directory, restricted 'mode', binary or unreadable file); otherwise
+** returns the status of the load, as 'luaL_loadfilex'.
+*/
+static int loadcached (lua_State *L, const char *filename, const char *mode) {
+  const char *dir, *src, *body, *header, *cachename;
+  char key[2 * sizeof(lua_Unsigned) + 1];
+  size_t l, hl;
+  struct stat st;
+  FILE *f;
+  int status;
+  int base = lua_gettop(L);
+  if (mode != NULL && (strchr(mode, 'b') == NULL || strchr(mode, 't') == NULL))
+    return -1;  /* cached chunks are binary; sources are text */
+#if defined(LUAGLM_EXT_OPTIMIZE)
+  if (mode != NULL && strchr(mode, 'O') != NULL)
+    return -1;  /* cache holds unoptimized chunks */
+#endif
+  lua_getfield(L, LUA_REGISTRYINDEX, LUA_CHUNKCACHEKEY);
+  dir = lua_tostring(L, -1);
+  if (dir == NULL) dir = getenv(LUA_CHUNKCACHEENV);
+  if (dir == NULL || *dir == '\0' || stat(filename, &st) != 0
+                  || !pushfilecontents(L, filename)) {
+    lua_settop(L, base);
+    return -1;
+  }
+  src = lua_tolstring(L, -1, &l);
+  body = src;
+  if (l >= 3 && memcmp(body, "\xEF\xBB\xBF", 3) == 0)
+    body += 3;  /* skip BOM */
+  if (*body == '#') {  /* skip first line (keeping its end of line) */
+    const char *nl = (const char *)memchr(body, '\n', l - (body - src));
+    body = (nl != NULL) ? nl : src + l;
+  }
+  if (body[*body == '\n'] == LUA_SIGNATURE[0]) {  /* binary file? */
+    lua_settop(L, base);
+    return -1;
+  }
+  pushcacheheader(L, filename, &st, src, l);
+  header = lua_tolstring(L, -1, &hl);
+  l_sprintf(key, sizeof(key), "%016" LUA_INTEGER_FRMLEN "x",
+            (LUAI_UACINT)cachehash(filename, strlen(filename)));
+  cachename = lua_pushfstring(L, "%s/%s.luac", dir, key);
+  lua_pushfstring(L, "@%s", filename);  /* chunk name */
+  /* stack: ... dir src header cachename chunkname */
+  if ((f = fopen(cachename, "rb")) != NULL) {  /* cached? */
+    LoadF lf;
+    size_t i, n;
+    int match = 1;
+    lf.f = f;
+    for (i = 0; match && i < hl; i += n) {  /* compare header by parts */
+      n = (hl - i < sizeof(lf.buff)) ? hl - i : sizeof(lf.buff);
+      match = (fread(lf.buff, 1, n, f) == n &&
+               memcmp(lf.buff, header + i, n) == 0);
+    }
+    if (match) {
+      lf.n = 0;  /* header matched: load what follows it */
+      status = lua_load(L, getF, &lf, lua_tostring(L, -1), "b");
+      if (status == LUA_OK && !ferror(f)) {
+        fclose(f);
+        lua_replace(L, base + 1);
+        lua_settop(L, base + 1);
+        return LUA_OK;
+      }
+    }
+    fclose(f);  /* stale or damaged entry: recompile */
+    lua_settop(L, base + 5);
+  }
+  status = luaL_loadbufferx(L, body, l - (size_t)(body - src),
+                               lua_tostring(L, -1), mode);
+  if (status == LUA_OK) {  /* store compiled chunk */
+    const char *tmpname = lua_pushfstring(L, "%s.%p.tmp", cachename, (void *)L);
+    if ((f = fopen(tmpname, "wb")) != NULL) {
+      int ok = (fwrite(header, 1, hl, f) == hl);
+      lua_pushvalue(L, -2);  /* function to dump */
+      ok = ok && lua_dump(L, cachewriter, f, 0) == 0;
+      lua_pop(L, 1);
+      ok = (fclose(f) == 0) && ok;
+#if defined(_WIN32)
+      if (ok) remove(cachename);  /* 'rename' does not replace files */
+#endif
+      if (!ok || rename(tmpname, cachename) != 0)
+        remove(tmpname);
+    }
+    lua_pop(L, 1);  /* remove 'tmpname' */
+  }
+  lua_replace(L, base + 1);  /* function or error message */
+  lua_settop(L, base + 1);
+  return status;
+}
+
+#endif
+/* }====================================================== */
+
+
 LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
                                              const char *mode) {
   LoadF lf;
@@ -785,6 +1030,11 @@ LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
     lf.f = stdin;
   }
   else {
+#if defined(LUA_USE_CHUNKCACHE)
+    status = loadcached(L, filename, mode);
+    if (status >= 0)
+      return status;
+#endif
     lua_pushfstring(L, "@%s", filename);
     lf.f = fopen(filename, "r");
     if (lf.f == NULL) return errfile(L, "open", fnameindex);
@@ -1024,6 +1274,185 @@ static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
 }
 
 
+#if defined(LUA_USE_POOLALLOC)
+#if defined(LUA_USE_ASYNCFREE)
+#error "LUA_USE_POOLALLOC is not thread-safe and cannot be used with LUA_USE_ASYNCFREE"
+#endif
+
+/*
+** {======================================================
+** Size-class allocator
+** =======================================================
+*/
+
+/*
+** Blocks of at most LUAI_POOLMAXSIZE bytes are carved from slabs owned by
+** the state and recycled through per-class free lists; anything larger
+** falls through to realloc/free. With the default parameters all of
+** TString headers (and most short strings), Table, UpVal, small LClosure
+** and CClosure objects, GCMatrix, and the Node arrays of small tables are
+** served from the pool. Lua always passes the original size of a block
+** when resizing or freeing it, so blocks need no header. Freed blocks
+** stay in their free lists and slabs are only returned to the system
+** when the state is closed (a full collection does not shrink the pool).
+*/
+#if !defined(LUAI_POOLGRAIN)
+#define LUAI_POOLGRAIN		16
+#endif
+
+#if !defined(LUAI_POOLMAXSIZE)
+#define LUAI_POOLMAXSIZE	256
+#endif
+
+#if !defined(LUAI_POOLSLABSIZE)
+#define LUAI_POOLSLABSIZE	(64 * 1024)
+#endif
+
+#define POOL_NCLASSES	(LUAI_POOLMAXSIZE / LUAI_POOLGRAIN)
+
+/* size class of a (pooled) block size */
+#define poolclass(sz)	((((sz) + LUAI_POOLGRAIN - 1) / LUAI_POOLGRAIN) - 1)
+#define classsize(c)	(((size_t)(c) + 1) * LUAI_POOLGRAIN)
+#define ispooled(sz)	((sz) != 0 && (sz) <= LUAI_POOLMAXSIZE)
+
+
+typedef union PoolBlock {
+  union PoolBlock *next;  /* next free block of the same class */
+  LUAI_MAXALIGN;
+} PoolBlock;
+
+
+typedef union PoolSlab {
+  union PoolSlab *next;  /* list of all slabs owned by the pool */
+  LUAI_MAXALIGN;
+} PoolSlab;
+
+
+typedef struct Pool {
+  PoolBlock *freeblocks[POOL_NCLASSES];
+  char *top;  /* first unused byte of the current slab */
+  char *limit;  /* end of the current slab */
+  PoolSlab *slabs;
+  size_t nblocks;  /* number of live blocks, pooled or not */
+  int *released;  /* set when the pool is destroyed (see luaL_newstate) */
+} Pool;
+
+
+static void pooldestroy (Pool *p) {
+  PoolSlab *s = p->slabs;
+  while (s != NULL) {
+    PoolSlab *next = s->next;
+    free(s);
+    s = next;
+  }
+  if (p->released != NULL)
+    *p->released = 1;
+  free(p);
+}
+
+
+static void *poolnew (Pool *p, size_t nsize) {
+  void *block;
+  if (!ispooled(nsize))
+    block = l_alloc(NULL, NULL, 0, nsize);
+  else {
+    int c = poolclass(nsize);
+    size_t sz = classsize(c);
+    if (p->freeblocks[c] != NULL) {  /* recycle a free block */
+      PoolBlock *b = p->freeblocks[c];
+      p->freeblocks[c] = b->next;
+      block = b;
+    }
+    else {
+      if ((size_t)(p->limit - p->top) < sz) {  /* slab exhausted? */
+        size_t rest = (size_t)(p->limit - p->top);
+        PoolSlab *s = (PoolSlab *)malloc(LUAI_POOLSLABSIZE);
+        if (s == NULL)
+          return NULL;
+        if (rest >= LUAI_POOLGRAIN) {  /* keep the tail of the old slab */
+          PoolBlock *b = (PoolBlock *)p->top;
+          int rc = (int)(rest / LUAI_POOLGRAIN) - 1;
+          b->next = p->freeblocks[rc];
+          p->freeblocks[rc] = b;
+        }
+        s->next = p->slabs;
+        p->slabs = s;
+        p->top = (char *)(s + 1);
+        p->limit = (char *)s + LUAI_POOLSLABSIZE;
+      }
+      block = p->top;
+      p->top += sz;
+    }
+  }
+  if (block != NULL)
+    p->nblocks++;
+  return block;
+}
+
+
+static void poolfree (Pool *p, void *ptr, size_t osize) {
+  if (ispooled(osize)) {
+    PoolBlock *b = (PoolBlock *)ptr;
+    int c = poolclass(osize);
+    b->next = p->freeblocks[c];
+    p->freeblocks[c] = b;
+  }
+  else
+    l_alloc(NULL, ptr, osize, 0);
+  if (--p->nblocks == 0)  /* freed the main block of a closed state? */
+    pooldestroy(p);
+}
+
+
+static void *l_poolalloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  Pool *p = (Pool *)ud;
+  if (ptr == NULL)
+    osize = 0;  /* 'osize' is the type of the new object */
+  if (nsize == 0) {
+    if (ptr != NULL)
+      poolfree(p, ptr, osize);
+    return NULL;
+  }
+  else if (ptr == NULL)
+    return poolnew(p, nsize);
+  else if (!ispooled(osize) && !ispooled(nsize))
+    return l_alloc(NULL, ptr, osize, nsize);
+  else if (ispooled(osize) && ispooled(nsize)
+                           && poolclass(osize) == poolclass(nsize))
+    return ptr;  /* block still fits its size class */
+  else {
+    void *block = poolnew(p, nsize);
+    if (block != NULL) {
+      memcpy(block, ptr, (osize < nsize) ? osize : nsize);
+      poolfree(p, ptr, osize);
+    }
+    return block;
+  }
+}
+
+
+static lua_State *newpoolstate (void) {
+  lua_State *L;
+  int released = 0;
+  Pool *p = (Pool *)malloc(sizeof(Pool));
+  if (p == NULL)
+    return NULL;
+  memset(p, 0, sizeof(Pool));
+  p->released = &released;
+  L = lua_newstate(l_poolalloc, p);
+  if (!released) {  /* pool still alive? */
+    if (L != NULL)
+      p->released = NULL;
+    else
+      pooldestroy(p);  /* main block never allocated */
+  }
+  return L;
+}
+
+/* }====================================================== */
+#endif
+
+
 static int panic (lua_State *L) {
   const char *msg = lua_tostring(L, -1);
   if (msg == NULL) msg = "error object is not a string";
@@ -1091,7 +1520,11 @@ static void warnfon (void *ud, const char *message, int tocont) {
 
 
 LUALIB_API lua_State *luaL_newstate (void) {
+#if defined(LUA_USE_POOLALLOC)
+  lua_State *L = newpoolstate();
+#else
   lua_State *L = lua_newstate(l_alloc, NULL);
+#endif
   if (l_likely(L)) {
     lua_atpanic(L, &panic);
     lua_setwarnf(L, warnfoff, L);  /* default is warnings off */
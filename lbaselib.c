@@ -218,10 +218,18 @@ static int pushmode (lua_State *L, int oldmode) {
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
     "count", "step", "setpause", "setstepmul",
-    "isrunning", "generational", "incremental", NULL};
+    "isrunning", "generational", "incremental",
+#if defined(LUAGLM_EXT_GCBUDGET)
+    "budget", "idle", "pausestats",
+#endif
+    NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
-    LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC};
+    LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC,
+#if defined(LUAGLM_EXT_GCBUDGET)
+    LUA_GCBUDGET, LUA_GCIDLE, LUA_GCPAUSES,
+#endif
+  };
   int o = optsnum[luaL_checkoption(L, 1, "collect", opts)];
   switch (o) {
     case LUA_GCCOUNT: {
@@ -263,6 +271,36 @@ static int luaB_collectgarbage (lua_State *L) {
       int stepsize = (int)luaL_optinteger(L, 4, 0);
       return pushmode(L, lua_gc(L, o, pause, stepmul, stepsize));
     }
+#if defined(LUAGLM_EXT_GCBUDGET)
+    case LUA_GCBUDGET: {
+      lua_Integer us = luaL_optinteger(L, 2, -1);  /* default: query */
+      int previous = lua_gc(L, o, (int)(us < 0 ? -1 : (us > INT_MAX ? INT_MAX : us)));
+      checkvalres(previous);
+      lua_pushinteger(L, previous);
+      return 1;
+    }
+    case LUA_GCIDLE: {
+      lua_Integer us = luaL_checkinteger(L, 2);
+      int res = lua_gc(L, o, (int)(us < 0 ? 0 : (us > INT_MAX ? INT_MAX : us)));
+      checkvalres(res);
+      lua_pushboolean(L, res);
+      return 1;
+    }
+    case LUA_GCPAUSES: {
+      int reset = lua_toboolean(L, 2);
+      int i;
+      for (i = 0; i < 4; i++) {  /* count, last, max, average */
+        int v = lua_gc(L, o, i);
+        checkvalres(v);
+        lua_pushinteger(L, v);
+      }
+      if (i < 4)  /* invalid call (inside a finalizer) */
+        break;
+      if (reset)
+        lua_gc(L, o, -1);
+      return 4;
+    }
+#endif
     default: {
       int res = lua_gc(L, o);
       checkvalres(res);
@@ -14,6 +14,7 @@
 #include <limits.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "lua.h"
 
@@ -21,6 +22,7 @@
 #include "ldebug.h"
 #include "ldo.h"
 #include "lgc.h"
+#include "lglm_core.h"
 #include "llex.h"
 #include "lmem.h"
 #include "lobject.h"
@@ -102,6 +104,12 @@ int luaK_exp2const (FuncState *fs, const expdesc *e, TValue *v) {
       setobj(fs->ls->L, v, const2val(fs, e));
       return 1;
     }
+#if defined(LUAGLM_EXT_VECCONST)
+    case VKVEC: {
+      setvvalue(v, e->u.kvec.v, e->u.kvec.tt);
+      return 1;
+    }
+#endif
     default: return tonumeral(e, v);
   }
 }
@@ -531,20 +539,34 @@ static void freeexps (FuncState *fs, expdesc *e1, expdesc *e2) {
 }
 
 
+/*
+** Table caching the position of constants. Folded vector constructors
+** remove their constants ('luaK_discard'), so the constants that follow
+** take other positions than in the enclosing functions sharing the
+** scanner's table, which then duplicate them: with vector constants,
+** each function has a table of its own.
+*/
+#if defined(LUAGLM_EXT_VECCONST)
+#define kcache(fs)	((fs)->kcache)
+#else
+#define kcache(fs)	((fs)->ls->h)
+#endif
+
+
 /*
 ** Add constant 'v' to prototype's list of constants (field 'k').
 ** Use scanner's table to cache position of constants in constant list
 ** and try to reuse constants. Because some values should not be used
 ** as keys (nil cannot be a key, integer keys can collapse with float
 ** keys), the caller must provide a useful 'key' for indexing the cache.
-** Note that all functions share the same table, so entering or exiting
-** a function can make some indices wrong.
+** Note that all functions share the same table (see 'kcache'), so
+** entering or exiting a function can make some indices wrong.
 */
 static int addk (FuncState *fs, TValue *key, TValue *v) {
   TValue val;
   lua_State *L = fs->ls->L;
   Proto *f = fs->f;
-  const TValue *idx = luaH_get(fs->ls->h, key);  /* query scanner table */
+  const TValue *idx = luaH_get(kcache(fs), key);  /* query scanner table */
   int k, oldsize;
   if (ttisinteger(idx)) {  /* is there an index there? */
     k = cast_int(ivalue(idx));
@@ -559,7 +581,7 @@ static int addk (FuncState *fs, TValue *key, TValue *v) {
   /* numerical value does not need GC barrier;
      table has no metatable, so it does not need to invalidate cache */
   setivalue(&val, k);
-  luaH_finishset(L, fs->ls->h, key, idx, &val);
+  luaH_finishset(L, kcache(fs), key, idx, &val);
   luaM_growvector(L, f->k, k, f->sizek, TValue, MAXARG_Ax, "constants");
   while (oldsize < f->sizek) setnilvalue(&f->k[oldsize++]);
   setobj(L, &f->k[k], v);
@@ -646,11 +668,23 @@ static int nilK (FuncState *fs) {
   TValue k, v;
   setnilvalue(&v);
   /* cannot use nil as key; instead use table itself to represent nil */
-  sethvalue(fs->ls->L, &k, fs->ls->h);
+  sethvalue(fs->ls->L, &k, kcache(fs));
   return addk(fs, &k, &v);
 }
 
 
+#if defined(LUAGLM_EXT_VECCONST)
+/*
+** Add a vector to list of constants and return its index.
+*/
+static int vectorK (FuncState *fs, expdesc *e) {
+  TValue o;
+  setvvalue(&o, e->u.kvec.v, e->u.kvec.tt);
+  return addk(fs, &o, &o);  /* use vector itself as key */
+}
+#endif
+
+
 /*
 ** Check whether 'i' can be stored in an 'sC' operand. Equivalent to
 ** (0 <= int2sC(i) && int2sC(i) <= MAXARG_C) but without risk of
@@ -712,6 +746,12 @@ static void const2exp (TValue *v, expdesc *e) {
     case LUA_VSHRSTR:  case LUA_VLNGSTR:
       e->k = VKSTR; e->u.strval = tsvalue(v);
       break;
+#if defined(LUAGLM_EXT_VECCONST)
+    case LUA_VVECTOR2: case LUA_VVECTOR3:
+    case LUA_VVECTOR4: case LUA_VQUAT:
+      e->k = VKVEC; e->u.kvec.v = vvalue(v); e->u.kvec.tt = ttypetag(v);
+      break;
+#endif
     default: lua_assert(0);
   }
 }
@@ -866,6 +906,12 @@ static void discharge2reg (FuncState *fs, expdesc *e, int reg) {
       luaK_int(fs, reg, e->u.ival);
       break;
     }
+#if defined(LUAGLM_EXT_VECCONST)
+    case VKVEC: {
+      luaK_codek(fs, reg, vectorK(fs, e));
+      break;
+    }
+#endif
     case VRELOC: {
       Instruction *pc = &getinstruction(fs, e);
       SETARG_A(*pc, reg);  /* instruction will put result in 'reg' */
@@ -1153,7 +1199,11 @@ void luaK_goiftrue (FuncState *fs, expdesc *e) {
       pc = e->u.info;  /* save jump position */
       break;
     }
-    case VK: case VKFLT: case VKINT: case VKSTR: case VTRUE: {
+    case VK: case VKFLT: case VKINT: case VKSTR: case VTRUE:
+#if defined(LUAGLM_EXT_VECCONST)
+    case VKVEC:
+#endif
+    {
       pc = NO_JUMP;  /* always true; do nothing */
       break;
     }
@@ -1203,7 +1253,11 @@ static void codenot (FuncState *fs, expdesc *e) {
       e->k = VTRUE;  /* true == not nil == not false */
       break;
     }
-    case VK: case VKFLT: case VKINT: case VKSTR: case VTRUE: {
+    case VK: case VKFLT: case VKINT: case VKSTR: case VTRUE:
+#if defined(LUAGLM_EXT_VECCONST)
+    case VKVEC:
+#endif
+    {
       e->k = VFALSE;  /* false == not "x" == not 0.5 == not 1 == not true */
       break;
     }
@@ -1340,6 +1394,112 @@ static int validop (int op, TValue *v1, TValue *v2) {
 }
 
 
+#if defined(LUAGLM_EXT_VECCONST)
+/*
+** {======================================================================
+** Vector constants
+** =======================================================================
+*/
+
+/* vector constant that may be folded with another operand */
+#define isKvec(e)	((e)->k == VKVEC && !hasjumps(e))
+
+
+/*
+** Make 'e' the vector constant 'v' of variant 'tt'. Like floats, vectors
+** with NaN (or infinite) components are invalid table keys and vectors
+** with -0.0 components are equal to their 0.0 counterparts, so neither
+** becomes a constant. Return 1 iff successful.
+*/
+int luaK_vector (expdesc *e, const lua_Float4 *v, int tt) {
+  grit_length_t i, n = glm_dimensions(cast_byte(tt));
+  lua_Float4 f4 = f4_zero();
+  for (i = 0; i < n; i++) {
+    lua_VecF c = v->raw[i];
+    if (!isfinite(c) || (c == 0 && signbit(c)))
+      return 0;
+    f4.raw[i] = c;
+  }
+  e->f = e->t = NO_JUMP;
+  e->k = VKVEC;
+  e->u.kvec.v = f4;
+  e->u.kvec.tt = cast_byte(tt);
+  return 1;
+}
+
+
+/*
+** Discard the instructions and the constants generated after 'pc' and
+** 'nk' (e.g., a call replaced by its result). No jump may target them.
+*/
+void luaK_discard (FuncState *fs, int pc, int nk) {
+  int abs = 0;
+  lua_assert(fs->lasttarget <= pc);
+  while (fs->pc > pc) {
+    abs |= (fs->f->lineinfo[fs->pc - 1] == ABSLINEINFO);
+    removelastinstruction(fs);
+  }
+  if (abs)  /* 'previousline' may be stale: */
+    fs->iwthabs = MAXIWTHABS + 1;  /* force next line info to be absolute */
+  while (fs->nk > nk)
+    setnilvalue(&fs->f->k[--fs->nk]);
+}
+
+
+/*
+** Try to fold an arithmetic operation with a vector operand, following
+** the semantics of its metamethods: component-wise operations between
+** vectors of the same variant, or between a vector and a number (cast to
+** the vector float type). Quaternions are not folded. Return 1 iff
+** successful.
+*/
+static int vecfolding (int op, expdesc *e1, const expdesc *e2) {
+  const lua_Float4 *a = NULL, *b = NULL;
+  lua_VecF s = 0;
+  lua_Float4 r = f4_zero();
+  TValue v;
+  int i, n, tt;
+  if (isKvec(e1)) {
+    a = &e1->u.kvec.v;
+    tt = e1->u.kvec.tt;
+    if (isKvec(e2) && e2->u.kvec.tt == tt)
+      b = &e2->u.kvec.v;
+    else if (tonumeral(e2, &v))
+      s = cast(lua_VecF, nvalue(&v));
+    else
+      return 0;
+  }
+  else if (isKvec(e2) && tonumeral(e1, &v)) {  /* number op vector */
+    b = &e2->u.kvec.v;
+    tt = e2->u.kvec.tt;
+    s = cast(lua_VecF, nvalue(&v));
+  }
+  else
+    return 0;
+  if (tt == LUA_VQUAT)
+    return 0;
+  n = cast_int(glm_dimensions(cast_byte(tt)));
+  for (i = 0; i < n; i++) {
+    lua_VecF x = (a != NULL) ? a->raw[i] : s;
+    lua_VecF y = (b != NULL) ? b->raw[i] : s;
+    switch (op) {
+      case LUA_OPADD: r.raw[i] = x + y; break;
+      case LUA_OPSUB: r.raw[i] = x - y; break;
+      case LUA_OPMUL: r.raw[i] = x * y; break;
+      case LUA_OPDIV: r.raw[i] = x / y; break;
+      case LUA_OPUNM: r.raw[i] = -x; break;
+      default: return 0;
+    }
+  }
+  return luaK_vector(e1, &r, tt);
+}
+
+/* }====================================================================== */
+#else
+#define isKvec(e)	0
+#endif
+
+
 /*
 ** Try to "constant-fold" an operation; return 1 iff successful.
 ** (In this case, 'e1' has the final result.)
@@ -1347,6 +1507,10 @@ static int validop (int op, TValue *v1, TValue *v2) {
 static int constfolding (FuncState *fs, int op, expdesc *e1,
                                         const expdesc *e2) {
   TValue v1, v2, res;
+#if defined(LUAGLM_EXT_VECCONST)
+  if (e1->k == VKVEC || e2->k == VKVEC)
+    return vecfolding(op, e1, e2);
+#endif
   if (!tonumeral(e1, &v1) || !tonumeral(e2, &v2) || !validop(op, &v1, &v2))
     return 0;  /* non-numeric operands or not safe to fold */
   /*
@@ -1629,7 +1793,7 @@ void luaK_infix (FuncState *fs, BinOpr op, expdesc *v) {
     case OPR_MOD: case OPR_POW:
     case OPR_BAND: case OPR_BOR: case OPR_BXOR:
     case OPR_SHL: case OPR_SHR: {
-      if (!tonumeral(v, NULL))
+      if (!tonumeral(v, NULL) && !isKvec(v))
         luaK_exp2anyreg(fs, v);
       /* else keep numeral, which may be folded with 2nd operand */
       break;
@@ -1850,3 +2014,490 @@ void luaK_finish (FuncState *fs) {
     }
   }
 }
+
+
+#if defined(LUAGLM_EXT_OPTIMIZE)
+/*
+** {======================================================================
+** Optimizer: an optional second pass over the code of a finished
+** function ('load' mode "O", 'luac -O'):
+**
+** (1) Globals read in the body of a numeric 'for' loop are loaded once,
+** before its first iteration, into new registers; the body then only
+** moves them. Bodies with calls, allocations, or assignments to '_ENV'
+** are not changed, nor are globals the body may assign. This assumes
+** that metamethods run by the body do not assign these globals and that
+** reading them has no side effects ('__index' of '_ENV').
+**
+** (2) Loads and moves overwritten by the next instruction, moves that
+** undo the previous move, and jumps to the next instruction are removed.
+** =======================================================================
+*/
+
+/* maximum number of globals loaded before a loop */
+#if !defined(LUAI_MAXHOIST)
+#define LUAI_MAXHOIST	8
+#endif
+
+
+typedef struct OptState {
+  lua_State *L;
+  Proto *f;
+  Mbuffer *buff;  /* scratch memory for the arrays below */
+  AbsLineInfo *abslineinfo;  /* new absolute line information */
+  int *newpc;  /* new position of each instruction */
+  int *line;  /* line of each new instruction */
+  Instruction *code;  /* new code */
+  ls_byte *lineinfo;  /* new line information */
+  lu_byte *dead;  /* instructions to be removed */
+  lu_byte *target;  /* instructions that are targets of jumps */
+} OptState;
+
+
+/*
+** Prepare scratch arrays for the code of 'f' plus 'nins' instructions.
+*/
+static void openscratch (OptState *os, int nins) {
+  int n = os->f->sizecode;
+  int m = n + nins;
+  size_t sz = m * (sizeof(AbsLineInfo) + sizeof(int) + sizeof(Instruction) +
+                   sizeof(ls_byte)) + (n + 1) * sizeof(int) + 2 * n;
+  char *p;
+  if (luaZ_sizebuffer(os->buff) < sz)
+    luaZ_resizebuffer(os->L, os->buff, sz);
+  p = luaZ_buffer(os->buff);
+  os->abslineinfo = cast(AbsLineInfo *, p); p += m * sizeof(AbsLineInfo);
+  os->newpc = cast(int *, p); p += (n + 1) * sizeof(int);
+  os->line = cast(int *, p); p += m * sizeof(int);
+  os->code = cast(Instruction *, p); p += m * sizeof(Instruction);
+  os->lineinfo = cast(ls_byte *, p); p += m;
+  os->dead = cast(lu_byte *, p); p += n;
+  os->target = cast(lu_byte *, p);
+  memset(os->dead, 0, 2 * n);
+}
+
+
+/*
+** Return the destination of jump instruction 'pc', or -1 if it is not
+** a jump. (The destination of a 'for' preparation is its loop
+** instruction.)
+*/
+static int jumpdest (const Instruction *code, int pc) {
+  Instruction i = code[pc];
+  switch (GET_OPCODE(i)) {
+    case OP_JMP: return pc + 1 + GETARG_sJ(i);
+    case OP_FORPREP: case OP_TFORPREP: return pc + 1 + GETARG_Bx(i);
+    case OP_FORLOOP: case OP_TFORLOOP: return pc + 1 - GETARG_Bx(i);
+    default: return -1;
+  }
+}
+
+
+/*
+** Fix jump instruction 'i', now at position 'pc', to jump to 'dest'.
+*/
+static void fixdest (Instruction *i, int pc, int dest) {
+  switch (GET_OPCODE(*i)) {
+    case OP_JMP: SETARG_sJ(*i, dest - (pc + 1)); break;
+    case OP_FORPREP: case OP_TFORPREP: SETARG_Bx(*i, dest - (pc + 1)); break;
+    case OP_FORLOOP: case OP_TFORLOOP: SETARG_Bx(*i, (pc + 1) - dest); break;
+    default: lua_assert(0);
+  }
+}
+
+
+static void marktargets (OptState *os) {
+  int pc;
+  for (pc = 0; pc < os->f->sizecode; pc++) {
+    int dest = jumpdest(os->f->code, pc);
+    if (dest >= 0)
+      os->target[dest] = 1;
+  }
+}
+
+
+/*
+** True if instruction 'pc' may be skipped by (or must follow) its
+** predecessor, so that neither can be moved apart.
+*/
+static int isskipped (const Instruction *code, int pc) {
+  switch (GET_OPCODE(code[pc])) {
+    case OP_MMBIN: case OP_MMBINI: case OP_MMBINK: case OP_EXTRAARG:
+      return 1;
+    default: {
+      OpCode prev = (pc > 0) ? GET_OPCODE(code[pc - 1]) : OP_MOVE;
+      return testTMode(prev) || prev == OP_LFALSESKIP || prev == OP_TFORCALL;
+    }
+  }
+}
+
+
+/*
+** Rebuild the code of 'f' without the instructions marked as dead and
+** with the 'nins' instructions 'ins' inserted before instruction 'at'
+** (using the line of the instruction before it). Jumps, line
+** information, and the ranges of local variables are remapped. A jump
+** to a removed instruction goes to whatever follows it; a jump to
+** instruction 'at' skips the inserted instructions.
+*/
+static void recode (OptState *os, const Instruction *ins, int nins, int at) {
+  lua_State *L = os->L;
+  Proto *f = os->f;
+  int n = f->sizecode;
+  int hasline = (f->lineinfo != NULL);
+  int pc, m, i, nabs = 0;
+  for (pc = 0, m = 0; pc < n; pc++) {
+    if (pc == at) m += nins;
+    os->newpc[pc] = m;
+    if (!os->dead[pc]) m++;
+  }
+  os->newpc[n] = m;
+  for (pc = 0, m = 0; pc < n; pc++) {
+    if (pc == at) {
+      for (i = 0; i < nins; i++) {
+        if (hasline) os->line[m] = luaG_getfuncline(f, at - 1);
+        os->code[m++] = ins[i];
+      }
+    }
+    if (!os->dead[pc]) {
+      int dest = jumpdest(f->code, pc);
+      os->code[m] = f->code[pc];
+      if (dest >= 0)
+        fixdest(&os->code[m], m, os->newpc[dest]);
+      if (hasline) os->line[m] = luaG_getfuncline(f, pc);
+      m++;
+    }
+  }
+  if (hasline) {  /* encode lines as 'savelineinfo' does */
+    int previousline = f->linedefined;
+    int iwthabs = 0;
+    for (pc = 0; pc < m; pc++) {
+      int linedif = os->line[pc] - previousline;
+      if (abs(linedif) >= LIMLINEDIFF || iwthabs++ >= MAXIWTHABS) {
+        os->abslineinfo[nabs].pc = pc;
+        os->abslineinfo[nabs++].line = os->line[pc];
+        linedif = ABSLINEINFO;
+        iwthabs = 1;
+      }
+      os->lineinfo[pc] = cast(ls_byte, linedif);
+      previousline = os->line[pc];
+    }
+  }
+  f->code = luaM_reallocvector(L, f->code, f->sizecode, m, Instruction);
+  f->sizecode = m;
+  memcpy(f->code, os->code, m * sizeof(Instruction));
+  if (hasline) {
+    f->lineinfo = luaM_reallocvector(L, f->lineinfo, f->sizelineinfo, m,
+                                        ls_byte);
+    f->sizelineinfo = m;
+    memcpy(f->lineinfo, os->lineinfo, m * sizeof(ls_byte));
+    f->abslineinfo = luaM_reallocvector(L, f->abslineinfo,
+                                f->sizeabslineinfo, nabs, AbsLineInfo);
+    f->sizeabslineinfo = nabs;
+    if (nabs > 0)
+      memcpy(f->abslineinfo, os->abslineinfo, nabs * sizeof(AbsLineInfo));
+  }
+  for (i = 0; i < f->sizelocvars; i++) {
+    f->locvars[i].startpc = os->newpc[f->locvars[i].startpc];
+    f->locvars[i].endpc = os->newpc[f->locvars[i].endpc];
+  }
+}
+
+
+#define shiftreg(r,thr,n)	((r) >= (thr) ? (r) + (n) : (r))
+
+/*
+** Add 'n' to all registers used by instruction 'i' that are not below
+** 'thr'.
+*/
+static void shiftregs (Instruction *i, int thr, int n) {
+  OpCode op = GET_OPCODE(*i);
+  switch (op) {
+    case OP_JMP: case OP_EXTRAARG: case OP_VARARGPREP:
+    case OP_SETTABUP:  /* A is not a register */
+      break;
+    default:
+      SETARG_A(*i, shiftreg(GETARG_A(*i), thr, n));
+  }
+  switch (op) {  /* register in B */
+    case OP_MOVE: case OP_GETTABLE: case OP_GETI: case OP_GETFIELD:
+    case OP_SETTABLE: case OP_SELF: case OP_ADDI: case OP_ADDK:
+    case OP_SUBK: case OP_MULK: case OP_MODK: case OP_POWK: case OP_DIVK:
+    case OP_IDIVK: case OP_BANDK: case OP_BORK: case OP_BXORK:
+    case OP_SHRI: case OP_SHLI: case OP_ADD: case OP_SUB: case OP_MUL:
+    case OP_MOD: case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND:
+    case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR: case OP_MMBIN:
+    case OP_UNM: case OP_BNOT: case OP_NOT: case OP_LEN: case OP_EQ:
+    case OP_LT: case OP_LE: case OP_TESTSET:
+      SETARG_B(*i, shiftreg(GETARG_B(*i), thr, n));
+      break;
+    default: break;
+  }
+  switch (op) {  /* register in C */
+    case OP_SETTABUP: case OP_SETTABLE: case OP_SETI: case OP_SETFIELD:
+    case OP_SELF:
+      if (GETARG_k(*i))  /* constant? */
+        break;
+      /* FALLTHROUGH */
+    case OP_GETTABLE: case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD:
+    case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR:
+    case OP_BXOR: case OP_SHL: case OP_SHR:
+      SETARG_C(*i, shiftreg(GETARG_C(*i), thr, n));
+      break;
+    default: break;
+  }
+}
+
+
+/*
+** Check whether upvalue 'up' of 'f' is '_ENV'.
+*/
+static int isenv (const Proto *f, int up) {
+  TString *name = f->upvalues[up].name;
+  return (name != NULL && strcmp(getstr(name), LUA_ENV) == 0);
+}
+
+
+/*
+** Index of the global read by 'i' in the list 'h', or -1.
+*/
+static int findhoisted (const Instruction *h, int nh, Instruction i) {
+  int j;
+  for (j = 0; j < nh; j++) {
+    if (GETARG_B(h[j]) == GETARG_B(i) && GETARG_C(h[j]) == GETARG_C(i))
+      return j;
+  }
+  return -1;
+}
+
+
+/*
+** Check whether instruction 'i' of 'f' keeps the globals read in its
+** loop from being hoisted: calls, allocations (which may run
+** finalizers), assignments to '_ENV', and stores with keys that may be
+** global names into tables that may be '_ENV'. Arithmetic, comparisons,
+** and table reads may run metamethods; these are assumed not to assign
+** the hoisted globals, as reads of '_ENV' are assumed to have no side
+** effects.
+*/
+static int nohoist (const Proto *f, Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: case OP_LOADI: case OP_LOADF: case OP_LOADK:
+    case OP_LOADKX: case OP_LOADFALSE: case OP_LFALSESKIP:
+    case OP_LOADTRUE: case OP_LOADNIL: case OP_GETUPVAL: case OP_GETTABUP:
+    case OP_GETTABLE: case OP_GETI: case OP_GETFIELD: case OP_SETTABUP:
+    case OP_SETI: case OP_SETFIELD: case OP_ADDI: case OP_ADDK:
+    case OP_SUBK: case OP_MULK: case OP_MODK: case OP_POWK: case OP_DIVK:
+    case OP_IDIVK: case OP_BANDK: case OP_BORK: case OP_BXORK:
+    case OP_SHRI: case OP_SHLI: case OP_ADD: case OP_SUB: case OP_MUL:
+    case OP_MOD: case OP_POW: case OP_DIV: case OP_IDIV: case OP_BAND:
+    case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR: case OP_MMBIN:
+    case OP_MMBINI: case OP_MMBINK: case OP_UNM: case OP_BNOT: case OP_NOT:
+    case OP_LEN: case OP_JMP: case OP_EQ: case OP_LT: case OP_LE:
+    case OP_EQK: case OP_EQI: case OP_LTI: case OP_LEI: case OP_GTI:
+    case OP_GEI: case OP_TEST: case OP_TESTSET: case OP_RETURN0:
+    case OP_RETURN1: case OP_FORPREP: case OP_FORLOOP: case OP_EXTRAARG:
+      return 0;
+    case OP_SETUPVAL:  /* assignments to '_ENV' change every global */
+      return isenv(f, GETARG_B(i));
+    default:
+      return 1;
+  }
+}
+
+
+/*
+** Remove from the list 'h' the global that store 'i' may assign: its
+** key (a constant string) names a field of a table that may be '_ENV'.
+** Return the new size of the list.
+*/
+static int unhoist (const Proto *f, Instruction *h, int nh, Instruction i) {
+  const TValue *key = &f->k[GETARG_B(i)];
+  int j;
+  for (j = 0; j < nh; j++) {
+    if (luaV_rawequalobj(&f->k[GETARG_C(h[j])], key)) {
+      h[j] = h[--nh];  /* it is not invariant */
+      break;
+    }
+  }
+  return nh;
+}
+
+
+/*
+** Load the globals read in the body of the numeric loop 'prep'-'loop'
+** into new registers just above its control variable; all registers
+** of the body move up. Return how many positions the loop instruction
+** moved.
+*/
+static int hoistloop (OptState *os, int prep, int loop) {
+  lua_State *L = os->L;
+  Proto *f = os->f;
+  Instruction *code = f->code;
+  Instruction h[LUAI_MAXHOIST];  /* loads of the hoisted globals */
+  int thr = GETARG_A(code[prep]) + 4;  /* first register of the body */
+  int maxh = MAXREGS - f->maxstacksize;
+  int nh = 0, pc, j;
+  for (pc = prep + 1; pc < loop; pc++) {  /* collect globals */
+    Instruction i = code[pc];
+    if (nohoist(f, i))
+      return 0;  /* globals may change during the loop */
+    else if (GET_OPCODE(i) == OP_LOADNIL) {
+      int a = GETARG_A(i);
+      if (a < thr && a + GETARG_B(i) >= thr)
+        return 0;  /* range would be split */
+    }
+    else if (GET_OPCODE(i) == OP_GETTABUP && isenv(f, GETARG_B(i)) &&
+             nh < LUAI_MAXHOIST && nh < maxh && findhoisted(h, nh, i) < 0)
+      h[nh++] = i;
+  }
+  for (pc = prep + 1; pc < loop && nh > 0; pc++) {  /* remove assigned ones */
+    Instruction i = code[pc];
+    if (GET_OPCODE(i) == OP_SETTABUP || GET_OPCODE(i) == OP_SETFIELD)
+      nh = unhoist(f, h, nh, i);
+  }
+  if (nh == 0)
+    return 0;
+  for (j = 0; j < nh; j++)  /* renumber registers */
+    SETARG_A(h[j], thr + j);
+  openscratch(os, nh);
+  for (pc = prep + 1; pc < loop; pc++) {
+    Instruction *i = &code[pc];
+    shiftregs(i, thr, nh);
+    if (GET_OPCODE(*i) == OP_GETTABUP && (j = findhoisted(h, nh, *i)) >= 0)
+      *i = CREATE_ABCk(OP_MOVE, GETARG_A(*i), thr + j, 0, 0);
+  }
+  f->maxstacksize = cast_byte(f->maxstacksize + nh);
+  recode(os, h, nh, prep + 1);
+  if (f->sizelocvars > 0) {  /* declare new registers after control var. */
+    int start = os->newpc[prep + 1];
+    int end = os->newpc[loop];
+    int k = 0;
+    while (k < f->sizelocvars && f->locvars[k].startpc <= start)
+      k++;
+    f->locvars = luaM_reallocvector(L, f->locvars, f->sizelocvars,
+                                       f->sizelocvars + nh, LocVar);
+    memmove(f->locvars + k + nh, f->locvars + k,
+            (f->sizelocvars - k) * sizeof(LocVar));
+    f->sizelocvars += nh;
+    for (j = 0; j < nh; j++) {
+      TString *name = tsvalue(&f->k[GETARG_C(h[j])]);  /* global name */
+      f->locvars[k + j].varname = name;
+      f->locvars[k + j].startpc = start;
+      f->locvars[k + j].endpc = end;
+    }
+  }
+  return os->newpc[loop] - loop;
+}
+
+
+/*
+** Copy propagation: if instruction 'i' reads register 'r' only as its
+** operand B and overwrites it, make it read register 'b' (of which 'r'
+** is a copy) instead. Return true if it did.
+*/
+static int propagate (Instruction *i, int r, int b) {
+  switch (GET_OPCODE(*i)) {
+    case OP_GETTABLE:
+      if (GETARG_C(*i) == r)
+        return 0;
+      /* FALLTHROUGH */
+    case OP_GETI: case OP_GETFIELD: case OP_UNM: case OP_BNOT: case OP_NOT:
+    case OP_LEN:
+      if (GETARG_A(*i) != r || GETARG_B(*i) != r)
+        return 0;
+      SETARG_B(*i, b);
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+
+/*
+** Remove useless moves, loads, and jumps, and moves whose copy is only
+** read by the next instruction. Return true if anything changed.
+*/
+static int peephole (OptState *os) {
+  Proto *f = os->f;
+  Instruction *code = f->code;
+  int n = f->sizecode;
+  int pc, changed = 0;
+  openscratch(os, 0);
+  marktargets(os);
+  for (pc = 0; pc < n; pc++) {
+    Instruction i = code[pc];
+    if (os->dead[pc] || isskipped(code, pc))
+      continue;
+    switch (GET_OPCODE(i)) {
+      case OP_JMP: {
+        if (GETARG_sJ(i) == 0)  /* jump to next instruction? */
+          os->dead[pc] = changed = 1;
+        break;
+      }
+      case OP_MOVE: {
+        if (GETARG_A(i) == GETARG_B(i))
+          os->dead[pc] = changed = 1;
+        else if (pc + 1 < n && !os->target[pc + 1] &&
+                 GET_OPCODE(code[pc + 1]) == OP_MOVE &&
+                 GETARG_A(code[pc + 1]) == GETARG_B(i) &&
+                 GETARG_B(code[pc + 1]) == GETARG_A(i))
+          os->dead[pc + 1] = changed = 1;  /* undoes this move */
+        else if (pc + 1 < n && !os->target[pc + 1] && !os->dead[pc + 1] &&
+                 propagate(&code[pc + 1], GETARG_A(i), GETARG_B(i)))
+          os->dead[pc] = changed = 1;
+      }  /* FALLTHROUGH */
+      case OP_LOADI: case OP_LOADF: case OP_LOADK: case OP_LOADFALSE:
+      case OP_LOADTRUE: case OP_LOADNIL: case OP_GETUPVAL: {
+        Instruction next = (pc + 1 < n) ? code[pc + 1] : i;
+        if (os->dead[pc] || pc + 1 >= n || os->dead[pc + 1] ||
+            GETARG_A(next) != GETARG_A(i) ||
+            (GET_OPCODE(i) == OP_LOADNIL && GETARG_B(i) != 0))
+          break;
+        switch (GET_OPCODE(next)) {  /* overwrites this result? */
+          case OP_MOVE:
+            if (GETARG_B(next) == GETARG_A(i))
+              break;  /* reads it */
+            /* FALLTHROUGH */
+          case OP_LOADI: case OP_LOADF: case OP_LOADK: case OP_LOADFALSE:
+          case OP_LOADTRUE: case OP_GETUPVAL:
+            os->dead[pc] = changed = 1;
+            break;
+          case OP_LOADNIL:
+            if (GETARG_B(next) == 0)
+              os->dead[pc] = changed = 1;
+            break;
+          default: break;
+        }
+        break;
+      }
+      default: break;
+    }
+  }
+  if (changed)
+    recode(os, NULL, 0, -1);
+  return changed;
+}
+
+
+/*
+** Optimize the code of 'f' and of its nested functions, using 'buff'
+** as scratch memory.
+*/
+void luaK_optimize (lua_State *L, Proto *f, Mbuffer *buff) {
+  OptState os;
+  int pc;
+  for (pc = 0; pc < f->sizep; pc++)
+    luaK_optimize(L, f->p[pc], buff);
+  os.L = L;
+  os.f = f;
+  os.buff = buff;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    if (GET_OPCODE(f->code[pc]) == OP_FORLOOP)  /* inner loops come first */
+      pc += hoistloop(&os, jumpdest(f->code, pc) - 1, pc);
+  }
+  while (peephole(&os)) { /* repeat while it finds something */ }
+}
+
+/* }====================================================================== */
+#endif
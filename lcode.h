@@ -99,6 +99,13 @@ LUAI_FUNC void luaK_settablesize (FuncState *fs, int pc,
 LUAI_FUNC void luaK_setlist (FuncState *fs, int base, int nelems, int tostore);
 LUAI_FUNC void luaK_finish (FuncState *fs);
 LUAI_FUNC l_noret luaK_semerror (LexState *ls, const char *msg);
+#if defined(LUAGLM_EXT_VECCONST)
+LUAI_FUNC int luaK_vector (expdesc *e, const lua_Float4 *v, int tt);
+LUAI_FUNC void luaK_discard (FuncState *fs, int pc, int nk);
+#endif
+#if defined(LUAGLM_EXT_OPTIMIZE)
+LUAI_FUNC void luaK_optimize (lua_State *L, Proto *f, Mbuffer *buff);
+#endif
 
 
 #endif
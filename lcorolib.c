@@ -25,6 +25,11 @@ static lua_State *getco (lua_State *L) {
 }
 
 
+#if defined(LUA_USE_THREADPOOL)
+static void auxreuse (lua_State *L, lua_State *co);
+#endif
+
+
 /*
 ** Resumes a coroutine. Returns the number of results for non-error
 ** cases or -1 for errors.
@@ -95,6 +100,16 @@ static int luaB_auxwrap (lua_State *L) {
 static int luaB_cocreate (lua_State *L) {
   lua_State *NL;
   luaL_checktype(L, 1, LUA_TFUNCTION);
+#if defined(LUA_USE_THREADPOOL)
+  if (!lua_isnoneornil(L, 2)) {  /* reuse a dead coroutine? */
+    NL = lua_tothread(L, 2);
+    luaL_argexpected(L, NL, 2, "thread");
+    lua_settop(L, 2);
+    lua_pushvalue(L, 1);
+    auxreuse(L, NL);
+    return 1;  /* return the same coroutine */
+  }
+#endif
   NL = lua_newthread(L);
   lua_pushvalue(L, 1);  /* move function to top */
   lua_xmove(L, NL, 1);  /* move function from L to NL */
@@ -103,6 +118,21 @@ static int luaB_cocreate (lua_State *L) {
 
 
 static int luaB_cowrap (lua_State *L) {
+#if defined(LUA_USE_THREADPOOL)
+  if (lua_tocfunction(L, 2) == luaB_auxwrap) {  /* reuse a wrapped one? */
+    lua_State *co;
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lua_settop(L, 2);
+    lua_getupvalue(L, 2, 1);
+    co = lua_tothread(L, -1);
+    lua_pop(L, 1);  /* still anchored by the wrapper */
+    lua_pushvalue(L, 1);
+    auxreuse(L, co);
+    return 1;  /* return the same wrapper */
+  }
+  luaL_argexpected(L, lua_isnoneornil(L, 2) || lua_isthread(L, 2), 2,
+                      "wrap function or thread");
+#endif
   luaB_cocreate(L);
   lua_pushcclosure(L, luaB_auxwrap, 1);
   return 1;
@@ -146,6 +176,24 @@ static int auxstatus (lua_State *L, lua_State *co) {
 }
 
 
+#if defined(LUA_USE_THREADPOOL)
+/*
+** Rearm a dead coroutine with the function on the top of 'L', keeping
+** its thread (and stack). Pending to-be-closed variables of a coroutine
+** that died by an error are closed first; errors are discarded.
+*/
+static void auxreuse (lua_State *L, lua_State *co) {
+  int status = auxstatus(L, co);
+  if (l_unlikely(status != COS_DEAD))
+    luaL_error(L, "cannot reuse a %s coroutine", statname[status]);
+  if (lua_status(co) != LUA_OK)  /* died by an error? */
+    lua_resetthread(co);
+  lua_settop(co, 0);
+  lua_xmove(L, co, 1);  /* move function from L to co */
+}
+#endif
+
+
 static int luaB_costatus (lua_State *L) {
   lua_State *co = getco(L);
   lua_pushstring(L, statname[auxstatus(L, co)]);
@@ -455,6 +455,18 @@ static int db_traceback (lua_State *L) {
 }
 
 
+#if defined(LUA_USE_LOCK)
+static int db_lockstats (lua_State *L) {
+  lua_Integer nlock, ncontended, waitns;
+  lua_lockstats(L, &nlock, &ncontended, &waitns, lua_toboolean(L, 1));
+  lua_pushinteger(L, nlock);
+  lua_pushinteger(L, ncontended);
+  lua_pushinteger(L, waitns);
+  return 3;
+}
+#endif
+
+
 #if !defined(LUA_SANDBOX_DBLIB)
 static int db_setcstacklimit (lua_State *L) {
   int limit = (int)luaL_checkinteger(L, 1);
@@ -488,6 +500,9 @@ static const luaL_Reg dblib[] = {
   {"traceback", db_traceback},
 #if !defined(LUA_SANDBOX_DBLIB)
   {"setcstacklimit", db_setcstacklimit},
+#endif
+#if defined(LUA_USE_LOCK)
+  {"lockstats", db_lockstats},
 #endif
   {NULL, NULL}
 };
@@ -17,6 +17,7 @@
 #include "lua.h"
 
 #include "lapi.h"
+#include "lcode.h"
 #include "lgritlib.h"
 #include "ldebug.h"
 #include "ldo.h"
@@ -1072,6 +1073,10 @@ static void f_parser (lua_State *L, void *ud) {
   else {
     checkmode(L, p->mode, "text");
     cl = luaY_parser(L, p->z, &p->buff, &p->dyd, p->name, c);
+#if defined(LUAGLM_EXT_OPTIMIZE)
+    if (p->mode && strchr(p->mode, 'O') != NULL)  /* optimize? */
+      luaK_optimize(L, cl->p, &p->buff);
+#endif
   }
   lua_assert(cl->nupvalues == cl->p->sizeupvalues);
   luaF_initupvals(L, cl);
@@ -11,9 +11,12 @@
 
 
 #include <stddef.h>
+#include <string.h>
 
 #include "lua.h"
 
+#include "ldo.h"
+#include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
 #include "lundump.h"
@@ -32,9 +35,17 @@ int luaU_dump(lua_State *L, const Proto *f, lua_Writer w, void *data, int strip)
 
 typedef struct {
   lua_State *L;
+  const Proto *f;  /* main function */
   lua_Writer writer;
   void *data;
   int strip;
+  int nolines;  /* drop only line information */
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  int lazy;
+  char *buff;  /* dumps of nested functions not yet written */
+  size_t n;  /* number of bytes in use in 'buff' */
+  size_t size;  /* size of 'buff' */
+#endif
   int status;
 } DumpState;
 
@@ -69,14 +80,20 @@ static void dumpByte (DumpState *D, int y) {
 /* dumpInt Buff Size */
 #define DIBS    ((sizeof(size_t) * 8 / 7) + 1)
 
-static void dumpSize (DumpState *D, size_t x) {
-  lu_byte buff[DIBS];
+static int encodeSize (lu_byte *buff, size_t x) {
   int n = 0;
   do {
     buff[DIBS - (++n)] = x & 0x7f;  /* fill buffer in reverse order */
     x >>= 7;
   } while (x != 0);
   buff[DIBS - 1] |= 0x80;  /* mark last byte */
+  return n;
+}
+
+
+static void dumpSize (DumpState *D, size_t x) {
+  lu_byte buff[DIBS];
+  int n = encodeSize(buff, x);
   dumpVector(D, buff + DIBS - n, n);
 }
 
@@ -179,12 +196,84 @@ static void dumpConstants (DumpState *D, const Proto *f) {
 }
 
 
+#if defined(LUAGLM_EXT_LAZYLOAD)
+static void buffReserve (DumpState *D, size_t size) {
+  if (D->size - D->n < size) {
+    size_t newsize = D->size + (D->size >> 1);
+    if (newsize - D->n < size)
+      newsize = D->n + size;
+    if (newsize < LUA_MINBUFFER)
+      newsize = LUA_MINBUFFER;
+    D->buff = luaM_reallocvchar(D->L, D->buff, D->size, newsize);
+    D->size = newsize;
+  }
+}
+
+
+static int buffWriter (lua_State *L, const void *b, size_t size, void *ud) {
+  DumpState *D = (DumpState *)ud;
+  lua_lock(L);  /* 'dumpBlock' unlocked the state */
+  buffReserve(D, size);
+  lua_unlock(L);
+  memcpy(D->buff + D->n, b, size);
+  D->n += size;
+  return 0;
+}
+
+
+/*
+** Nested functions of a lazy dump are prefixed by their size, so that
+** the loader can keep them undecoded. Each function is dumped once at
+** the end of the buffer; once its size is known, the size is inserted
+** before it (nested function) or both are given to the writer (function
+** nested in the main one). Functions that were themselves loaded lazily
+** and never used are decoded first.
+*/
+static void dumpLazyProto (DumpState *D, Proto *f, TString *psource) {
+  lua_Writer writer = D->writer;
+  void *data = D->data;
+  size_t start = D->n;
+  size_t size;
+  if (f->lazychunk != NULL)
+    luaU_loadlazy(D->L, f);
+  D->writer = buffWriter;
+  D->data = D;
+  dumpFunction(D, f, psource);
+  D->writer = writer;
+  D->data = data;
+  size = D->n - start;
+  if (writer == buffWriter) {  /* nested in another buffered function? */
+    lu_byte buff[DIBS];
+    int n = encodeSize(buff, size);
+    buffReserve(D, n);  /* insert size in front of the dump */
+    memmove(D->buff + start + n, D->buff + start, size);
+    memcpy(D->buff + start, buff + DIBS - n, n);
+    D->n += n;
+  }
+  else {
+    dumpSize(D, size);
+    dumpBlock(D, D->buff + start, size);
+    D->n = start;
+  }
+}
+#endif
+
+
 static void dumpProtos (DumpState *D, const Proto *f) {
   int i;
   int n = f->sizep;
   dumpInt(D, n);
-  for (i = 0; i < n; i++)
+  for (i = 0; i < n; i++) {
+#if defined(LUAGLM_EXT_LAZYLOAD)
+    if (D->lazy) {
+      dumpLazyProto(D, f->p[i], f->source);
+      continue;
+    }
+    else if (f->p[i]->lazychunk != NULL)
+      luaU_loadlazy(D->L, f->p[i]);
+#endif
     dumpFunction(D, f->p[i], f->source);
+  }
 }
 
 
@@ -201,10 +290,10 @@ static void dumpUpvalues (DumpState *D, const Proto *f) {
 
 static void dumpDebug (DumpState *D, const Proto *f) {
   int i, n;
-  n = (D->strip) ? 0 : f->sizelineinfo;
+  n = (D->strip || D->nolines) ? 0 : f->sizelineinfo;
   dumpInt(D, n);
   dumpVector(D, f->lineinfo, n);
-  n = (D->strip) ? 0 : f->sizeabslineinfo;
+  n = (D->strip || D->nolines) ? 0 : f->sizeabslineinfo;
   dumpInt(D, n);
   for (i = 0; i < n; i++) {
     dumpInt(D, f->abslineinfo[i].pc);
@@ -245,7 +334,11 @@ static void dumpFunction (DumpState *D, const Proto *f, TString *psource) {
 static void dumpHeader (DumpState *D) {
   dumpLiteral(D, LUA_SIGNATURE);
   dumpByte(D, LUAC_VERSION);
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  dumpByte(D, D->lazy ? LUAC_FORMAT_LAZY : LUAC_FORMAT);
+#else
   dumpByte(D, LUAC_FORMAT);
+#endif
   dumpLiteral(D, LUAC_DATA);
   dumpByte(D, sizeof(Instruction));
   dumpByte(D, sizeof(lua_Integer));
@@ -255,6 +348,15 @@ static void dumpHeader (DumpState *D) {
 }
 
 
+static void dumpMain (lua_State *L, void *ud) {
+  DumpState *D = (DumpState *)ud;
+  UNUSED(L);
+  dumpHeader(D);
+  dumpByte(D, D->f->sizeupvalues);
+  dumpFunction(D, D->f, NULL);
+}
+
+
 /*
 ** dump Lua function as precompiled chunk
 */
@@ -262,13 +364,26 @@ int luaU_dump(lua_State *L, const Proto *f, lua_Writer w, void *data,
               int strip) {
   DumpState D;
   D.L = L;
+  D.f = f;
   D.writer = w;
   D.data = data;
-  D.strip = strip;
+  D.strip = (strip & ~LUA_DUMPFLAGS) != 0;
+  D.nolines = (strip & LUA_DUMPNOLINES) != 0;
   D.status = 0;
-  dumpHeader(&D);
-  dumpByte(&D, f->sizeupvalues);
-  dumpFunction(&D, f, NULL);
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  D.lazy = (strip & LUA_DUMPLAZY) != 0;
+  if (D.lazy) {  /* buffer of nested functions must be freed on errors */
+    int status;
+    D.buff = NULL;
+    D.n = D.size = 0;
+    status = luaD_rawrunprotected(L, dumpMain, &D);
+    luaM_freemem(L, D.buff, D.size);
+    if (l_unlikely(status != LUA_OK))
+      luaD_throw(L, status);  /* propagate error */
+    return D.status;
+  }
+#endif
+  dumpMain(L, &D);
   return D.status;
 }
 
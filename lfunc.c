@@ -297,6 +297,10 @@ Proto *luaF_newproto (lua_State *L) {
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  f->lazychunk = NULL;
+  f->lazyoff = f->lazylen = 0;
+#endif
   return f;
 }
 
@@ -260,8 +260,17 @@ void luaC_fix (lua_State *L, GCObject *o) {
 ** it to 'allgc' list.
 */
 GCObject *luaC_newobj (lua_State *L, int tt, size_t sz) {
+  return luaC_adoptobj(L, tt, luaM_newobject(L, novariant(tt), sz));
+}
+
+
+/*
+** turn a block allocated by the 'luaM_' functions into a new collectable
+** object; the block is now owned by the collector.
+*/
+GCObject *luaC_adoptobj (lua_State *L, int tt, void *block) {
   global_State *g = G(L);
-  GCObject *o = cast(GCObject *, luaM_newobject(L, novariant(tt), sz));
+  GCObject *o = cast(GCObject *, block);
   o->marked = luaC_white(g);
   o->tt = tt;
   o->next = g->allgc;
@@ -580,6 +589,9 @@ static int traverseudata (global_State *g, Udata *u) {
 static int traverseproto (global_State *g, Proto *f) {
   int i;
   markobjectN(g, f->source);
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  markobjectN(g, f->lazychunk);
+#endif
   for (i = 0; i < f->sizek; i++)  /* mark literals */
     markvalue(g, &f->k[i]);
   for (i = 0; i < f->sizeupvalues; i++)  /* mark upvalue names */
@@ -820,6 +832,281 @@ static void freeobj (lua_State *L, GCObject *o) {
 }
 
 
+/*
+** {======================================================
+** Asynchronous free
+** =======================================================
+*/
+
+#if defined(LUA_USE_ASYNCFREE)
+
+#include <pthread.h>
+
+/*
+** Maximum number of blocks handed to the background thread at once.
+*/
+#if !defined(LUAI_ASYNCFREEBATCH)
+#define LUAI_ASYNCFREEBATCH	256
+#endif
+
+/*
+** Maximum number of batches waiting for the background thread. Past
+** this limit the mutator releases its batch itself, so a thread that
+** falls behind cannot retain an unbounded amount of memory.
+*/
+#if !defined(LUAI_ASYNCFREEMAXPENDING)
+#define LUAI_ASYNCFREEMAXPENDING	64
+#endif
+
+
+/* Memory blocks released by a sweep */
+typedef struct FreeBatch {
+  struct FreeBatch *next;
+  int n;  /* number of blocks in use */
+  struct {
+    void *block;
+    size_t osize;
+  } blocks[LUAI_ASYNCFREEBATCH];
+} FreeBatch;
+
+
+/*
+** State shared between the mutator and the background thread. Only
+** 'current' is private to the mutator; everything else is protected
+** by 'lock'. The structure and its batches are allocated directly with
+** the allocator of the state when the thread started ('frealloc', which
+** also releases the blocks) and are not accounted in 'GCdebt'. Changing
+** the allocator restarts the thread ('lua_setallocf').
+*/
+typedef struct AsyncFree {
+  lua_Alloc frealloc;
+  void *ud;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t work;  /* signals new batches or a stop request */
+  pthread_cond_t idle;  /* signals that all batches were released */
+  FreeBatch *pending;  /* batches waiting to be released */
+  FreeBatch *spare;  /* released batches, available for reuse */
+  FreeBatch *current;  /* batch being filled by the sweep */
+  int npending;  /* number of batches in 'pending' */
+  int busy;  /* true while the thread is releasing a batch */
+  int stop;  /* true when the thread must exit */
+} AsyncFree;
+
+
+static void releasebatch (AsyncFree *af, FreeBatch *b) {
+  int i;
+  for (i = 0; i < b->n; i++)
+    (*af->frealloc)(af->ud, b->blocks[i].block, b->blocks[i].osize, 0);
+  b->n = 0;
+}
+
+
+static void *asyncworker (void *ud) {
+  AsyncFree *af = (AsyncFree *)ud;
+  pthread_mutex_lock(&af->lock);
+  for (;;) {
+    FreeBatch *b = af->pending;
+    if (b == NULL) {  /* nothing to do? */
+      pthread_cond_broadcast(&af->idle);
+      if (af->stop)
+        break;
+      pthread_cond_wait(&af->work, &af->lock);
+      continue;
+    }
+    af->pending = b->next;
+    af->npending--;
+    af->busy = 1;
+    pthread_mutex_unlock(&af->lock);
+    releasebatch(af, b);
+    pthread_mutex_lock(&af->lock);
+    af->busy = 0;
+    b->next = af->spare;
+    af->spare = b;
+  }
+  pthread_mutex_unlock(&af->lock);
+  return NULL;
+}
+
+
+/*
+** Hand the batch being filled to the background thread. (When the
+** thread is too far behind, release it here and keep it as 'current'.)
+*/
+static void submitbatch (AsyncFree *af) {
+  FreeBatch *b = af->current;
+  if (b != NULL && b->n > 0) {
+    pthread_mutex_lock(&af->lock);
+    if (af->npending < LUAI_ASYNCFREEMAXPENDING) {
+      af->current = NULL;
+      b->next = af->pending;
+      af->pending = b;
+      af->npending++;
+      pthread_cond_signal(&af->work);
+      b = NULL;
+    }
+    pthread_mutex_unlock(&af->lock);
+    if (b != NULL)
+      releasebatch(af, b);
+  }
+}
+
+
+/*
+** Wait until the background thread has released every submitted
+** block.
+*/
+static void waitbatches (AsyncFree *af) {
+  pthread_mutex_lock(&af->lock);
+  while (af->pending != NULL || af->busy)
+    pthread_cond_wait(&af->idle, &af->lock);
+  pthread_mutex_unlock(&af->lock);
+}
+
+
+/*
+** Queue 'block' to be released by the background thread. (Called by
+** 'luaM_free_' while 'gcdeferfree' is set.) If no batch can be
+** allocated, the block is released synchronously.
+*/
+void luaC_deferfree (global_State *g, void *block, size_t osize) {
+  AsyncFree *af = g->asyncfree;
+  FreeBatch *b = af->current;
+  if (b == NULL) {  /* get a new batch */
+    pthread_mutex_lock(&af->lock);
+    if ((b = af->spare) != NULL)
+      af->spare = b->next;
+    pthread_mutex_unlock(&af->lock);
+    if (b == NULL) {
+      b = cast(FreeBatch *, (*af->frealloc)(af->ud, NULL, 0, sizeof(FreeBatch)));
+      if (l_unlikely(b == NULL)) {  /* cannot defer? */
+        (*af->frealloc)(af->ud, block, osize, 0);
+        return;
+      }
+    }
+    b->n = 0;
+    af->current = b;
+  }
+  b->blocks[b->n].block = block;
+  b->blocks[b->n].osize = osize;
+  if (++b->n == LUAI_ASYNCFREEBATCH)
+    submitbatch(af);
+}
+
+
+static void freebatches (AsyncFree *af, FreeBatch *b) {
+  while (b != NULL) {
+    FreeBatch *next = b->next;
+    (*af->frealloc)(af->ud, b, sizeof(FreeBatch), 0);
+    b = next;
+  }
+}
+
+
+static int startasyncfree (global_State *g) {
+  AsyncFree *af = cast(AsyncFree *,
+                       (*g->frealloc)(g->ud, NULL, 0, sizeof(AsyncFree)));
+  if (af == NULL)
+    return 0;
+  af->frealloc = g->frealloc;
+  af->ud = g->ud;
+  af->pending = af->spare = af->current = NULL;
+  af->npending = af->busy = af->stop = 0;
+  if (pthread_mutex_init(&af->lock, NULL) != 0)
+    goto fail;
+  if (pthread_cond_init(&af->work, NULL) != 0)
+    goto faillock;
+  if (pthread_cond_init(&af->idle, NULL) != 0)
+    goto failwork;
+  if (pthread_create(&af->thread, NULL, asyncworker, af) != 0)
+    goto failidle;
+  g->asyncfree = af;
+  return 1;
+failidle:
+  pthread_cond_destroy(&af->idle);
+failwork:
+  pthread_cond_destroy(&af->work);
+faillock:
+  pthread_mutex_destroy(&af->lock);
+fail:
+  (*g->frealloc)(g->ud, af, sizeof(AsyncFree), 0);
+  return 0;
+}
+
+
+static void stopasyncfree (global_State *g) {
+  AsyncFree *af = g->asyncfree;
+  lua_assert(!g->gcdeferfree);
+  submitbatch(af);
+  pthread_mutex_lock(&af->lock);
+  af->stop = 1;
+  pthread_cond_signal(&af->work);
+  pthread_mutex_unlock(&af->lock);
+  pthread_join(af->thread, NULL);  /* thread drains 'pending' before exit */
+  lua_assert(af->pending == NULL);
+  if (af->current != NULL) {  /* batch released by 'submitbatch' itself? */
+    af->current->next = af->spare;
+    af->spare = af->current;
+  }
+  freebatches(af, af->spare);
+  pthread_cond_destroy(&af->idle);
+  pthread_cond_destroy(&af->work);
+  pthread_mutex_destroy(&af->lock);
+  (*af->frealloc)(af->ud, af, sizeof(AsyncFree), 0);
+  g->asyncfree = NULL;
+}
+
+
+/*
+** Start ('on' true) or stop the background release of swept blocks.
+** The allocator must then accept frees from another thread concurrently
+** with the other calls made by the state. Returns whether the
+** background release is active.
+*/
+int luaC_asyncfree (lua_State *L, int on) {
+  global_State *g = G(L);
+  if (on && g->asyncfree == NULL)
+    return startasyncfree(g);
+  else if (!on && g->asyncfree != NULL)
+    stopasyncfree(g);
+  return (g->asyncfree != NULL);
+}
+
+
+/*
+** Block until all deferred blocks were given back to the allocator,
+** e.g., before an emergency collection.
+*/
+void luaC_syncfree (global_State *g) {
+  if (g->asyncfree != NULL) {
+    submitbatch(g->asyncfree);
+    waitbatches(g->asyncfree);
+  }
+}
+
+
+/*
+** Sweeps defer the release of dead objects only outside emergency
+** collections: these must return memory before the allocation that
+** triggered them is retried.
+*/
+#define beginsweepfree(g)  \
+	((g)->gcdeferfree = ((g)->asyncfree != NULL && !(g)->gcemergency))
+
+#define endsweepfree(g)  \
+	{ if ((g)->gcdeferfree) { (g)->gcdeferfree = 0; \
+	                          submitbatch((g)->asyncfree); } }
+
+#else
+
+#define beginsweepfree(g)	((void)0)
+#define endsweepfree(g)		((void)0)
+
+#endif
+
+/* }====================================================== */
+
+
 /*
 ** sweep at most 'countin' elements from a list of GCObjects erasing dead
 ** objects, where a dead object is one marked with the old (non current)
@@ -833,6 +1120,7 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, int countin,
   int ow = otherwhite(g);
   int i;
   int white = luaC_white(g);  /* current white */
+  beginsweepfree(g);
   for (i = 0; *p != NULL && i < countin; i++) {
     GCObject *curr = *p;
     int marked = curr->marked;
@@ -845,6 +1133,7 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, int countin,
       p = &curr->next;  /* go to next element */
     }
   }
+  endsweepfree(g);
   if (countout)
     *countout = i;  /* number of elements traversed */
   return (*p == NULL) ? NULL : p;
@@ -1067,6 +1356,7 @@ static void setpause (global_State *g);
 static void sweep2old (lua_State *L, GCObject **p) {
   GCObject *curr;
   global_State *g = G(L);
+  beginsweepfree(g);
   while ((curr = *p) != NULL) {
     if (iswhite(curr)) {  /* is 'curr' dead? */
       lua_assert(isdead(g, curr));
@@ -1086,6 +1376,7 @@ static void sweep2old (lua_State *L, GCObject **p) {
       p = &curr->next;  /* go to next element */
     }
   }
+  endsweepfree(g);
 }
 
 
@@ -1113,6 +1404,7 @@ static GCObject **sweepgen (lua_State *L, global_State *g, GCObject **p,
   };
   int white = luaC_white(g);
   GCObject *curr;
+  beginsweepfree(g);
   while ((curr = *p) != limit) {
     if (iswhite(curr)) {  /* is 'curr' dead? */
       lua_assert(!isold(curr) && isdead(g, curr));
@@ -1132,6 +1424,7 @@ static GCObject **sweepgen (lua_State *L, global_State *g, GCObject **p,
       p = &curr->next;  /* go to next element */
     }
   }
+  endsweepfree(g);
   return p;
 }
 
@@ -1663,6 +1956,133 @@ void luaC_runtilstate (lua_State *L, int statesmask) {
 }
 
 
+/*
+** {======================================================
+** Time-bounded steps
+** =======================================================
+*/
+
+#if defined(LUAGLM_EXT_GCBUDGET)
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(LUA_USE_POSIX)
+#include <time.h>
+#else
+#include <time.h>
+#define l_gcclockfallback
+#endif
+
+/*
+** Monotonic clock, in microseconds, used to bound collector steps.
+*/
+static lu_mem gcclock (void) {
+#if defined(_WIN32)
+  static LARGE_INTEGER freq;  /* constant after system boot */
+  LARGE_INTEGER now;
+  if (freq.QuadPart == 0)
+    QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return cast(lu_mem, (now.QuadPart / freq.QuadPart) * 1000000 +
+                      (now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart);
+#elif defined(l_gcclockfallback)
+  return cast(lu_mem, (double)clock() * (1000000.0 / CLOCKS_PER_SEC));
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return cast(lu_mem, ts.tv_sec) * 1000000 + cast(lu_mem, ts.tv_nsec / 1000);
+#endif
+}
+
+
+/*
+** Account the duration of a collector step started at 'start'.
+*/
+static void recordpause (global_State *g, lu_mem start) {
+  lu_mem d = gcclock() - start;
+  g->gcpausecount++;
+  g->gcpausetotal += d;
+  g->gcpauselast = d;
+  if (d > g->gcpausemax)
+    g->gcpausemax = d;
+}
+
+
+/*
+** Performs single steps until 'budget' microseconds have elapsed since
+** 'start' or the cycle finishes (always doing at least one step). As
+** work is not measured, the next step is scheduled after allocating
+** one step size of memory.
+*/
+static void budgetstep (lua_State *L, global_State *g, lu_mem start,
+                                                       lu_mem budget) {
+  do {
+    singlestep(L);
+  } while (g->gcstate != GCSpause && gcclock() - start < budget);
+  if (g->gcstate == GCSpause)
+    setpause(g);  /* pause until next cycle */
+  else {
+    l_mem stepsize = (g->gcstepsize <= log2maxs(l_mem))
+                   ? (cast(l_mem, 1) << g->gcstepsize)
+                   : MAX_LMEM;  /* overflow; keep maximum value */
+    luaE_setdebt(g, -stepsize);
+  }
+}
+
+
+/*
+** Opportunistic collection work (e.g., at the end of a frame): advance
+** an incremental cycle for at most 'us' microseconds. A new cycle is
+** only started if the collector is in debt. In generational mode, a
+** collection cannot be split, so a pending one is done as a whole.
+** Returns true if no collection work is pending afterwards.
+*/
+int luaC_idle (lua_State *L, lu_mem us) {
+  global_State *g = G(L);
+  if (isdecGCmodegen(g)) {
+    if (us > 0 && g->GCdebt > 0) {
+      lu_mem start = gcclock();
+      genstep(L, g);
+      recordpause(g, start);
+    }
+    return 1;
+  }
+  else {
+    if (us > 0 && (g->gcstate != GCSpause || g->GCdebt > 0)) {
+      lu_mem start = gcclock();
+      budgetstep(L, g, start, us);
+      recordpause(g, start);
+    }
+    return (g->gcstate == GCSpause);
+  }
+}
+
+
+/*
+** Statistics on measured collector steps (automatic and idle ones);
+** 'what' selects the number of steps (0), the last (1), longest (2), or
+** average (3) duration in microseconds. Any other value resets them.
+*/
+lu_mem luaC_pausestat (global_State *g, int what) {
+  switch (what) {
+    case 0: return g->gcpausecount;
+    case 1: return g->gcpauselast;
+    case 2: return g->gcpausemax;
+    case 3: return (g->gcpausecount == 0) ? 0
+                                          : g->gcpausetotal / g->gcpausecount;
+    default: {
+      g->gcpausecount = g->gcpausetotal = 0;
+      g->gcpauselast = g->gcpausemax = 0;
+      return 0;
+    }
+  }
+}
+
+#endif
+
+/* }====================================================== */
+
 
 /*
 ** Performs a basic incremental step. The debt and step size are
@@ -1677,6 +2097,12 @@ static void incstep (lua_State *L, global_State *g) {
   l_mem stepsize = (g->gcstepsize <= log2maxs(l_mem))
                  ? ((cast(l_mem, 1) << g->gcstepsize) / WORK2MEM) * stepmul
                  : MAX_LMEM;  /* overflow; keep maximum value */
+#if defined(LUAGLM_EXT_GCBUDGET)
+  if (g->gcbudget > 0) {  /* bounded by time instead of work? */
+    budgetstep(L, g, gcclock(), g->gcbudget);
+    return;
+  }
+#endif
   do {  /* repeat until pause or enough "credit" (negative debt) */
     lu_mem work = singlestep(L);  /* perform one single step */
     debt -= work;
@@ -1696,10 +2122,16 @@ void luaC_step (lua_State *L) {
   global_State *g = G(L);
   lua_assert(!g->gcemergency);
   if (gcrunning(g)) {  /* running? */
+#if defined(LUAGLM_EXT_GCBUDGET)
+    lu_mem start = gcclock();
+#endif
     if(isdecGCmodegen(g))
       genstep(L, g);
     else
       incstep(L, g);
+#if defined(LUAGLM_EXT_GCBUDGET)
+    recordpause(g, start);
+#endif
   }
 }
 
@@ -1732,12 +2164,19 @@ static void fullinc (lua_State *L, global_State *g) {
 void luaC_fullgc (lua_State *L, int isemergency) {
   global_State *g = G(L);
   lua_assert(!g->gcemergency);
+#if defined(LUA_USE_ASYNCFREE)
+  if (isemergency)  /* previously swept blocks must be released first */
+    luaC_syncfree(g);
+#endif
   g->gcemergency = isemergency;  /* set flag */
   if (g->gckind == KGC_INC)
     fullinc(L, g);
   else
     fullgen(L, g);
   g->gcemergency = 0;
+#if defined(LUA_USE_THREADPOOL)
+  luaE_freethreadpool(L);  /* release the memory of pooled threads */
+#endif
 }
 
 /* }====================================================== */
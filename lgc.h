@@ -190,10 +190,20 @@ LUAI_FUNC void luaC_step (lua_State *L);
 LUAI_FUNC void luaC_runtilstate (lua_State *L, int statesmask);
 LUAI_FUNC void luaC_fullgc (lua_State *L, int isemergency);
 LUAI_FUNC GCObject *luaC_newobj (lua_State *L, int tt, size_t sz);
+LUAI_FUNC GCObject *luaC_adoptobj (lua_State *L, int tt, void *block);
 LUAI_FUNC void luaC_barrier_ (lua_State *L, GCObject *o, GCObject *v);
 LUAI_FUNC void luaC_barrierback_ (lua_State *L, GCObject *o);
 LUAI_FUNC void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt);
 LUAI_FUNC void luaC_changemode (lua_State *L, int newmode);
+#if defined(LUAGLM_EXT_GCBUDGET)
+LUAI_FUNC int luaC_idle (lua_State *L, lu_mem us);
+LUAI_FUNC lu_mem luaC_pausestat (global_State *g, int what);
+#endif
+#if defined(LUA_USE_ASYNCFREE)
+LUAI_FUNC int luaC_asyncfree (lua_State *L, int on);
+LUAI_FUNC void luaC_syncfree (global_State *g);
+LUAI_FUNC void luaC_deferfree (global_State *g, void *block, size_t osize);
+#endif
 
 
 #endif
@@ -0,0 +1,38 @@
+--[[
+================================================================================
+Allocation benchmark: short-lived small tables, strings, and closures, the
+workload LUA_USE_POOLALLOC is meant for. Compare two interpreters, one built
+with -DLUA_POOL_ALLOC=ON and one without:
+
+    lua alloc.lua [runs] [iterations]
+
+Prints the minimum and the median time of 'runs' runs (default 11).
+
+@LICENSE
+    See Copyright Notice in lua.h
+--]]
+local runs = tonumber(arg and arg[1]) or 11
+local iterations = tonumber(arg and arg[2]) or 2000000
+
+local function workload(n)
+  local keep = {}
+  for i = 1, n do
+    local t = { i, i + 1, x = i }
+    local s = "k" .. (i % 1000)
+    local f = function() return t, s end
+    keep[i % 256 + 1] = f
+  end
+  return #keep
+end
+
+local times = {}
+for r = 1,runs do
+  collectgarbage()
+  local t0 = os.clock()
+  workload(iterations)
+  times[r] = os.clock() - t0
+end
+
+table.sort(times)
+print(string.format("alloc: min %.3fs median %.3fs (%d runs of %d)",
+  times[1], times[(runs + 1) // 2], runs, iterations))
@@ -0,0 +1,59 @@
+--[[
+================================================================================
+Single-threaded cost of LUA_USE_LOCK. Run it with two interpreters, one built
+with -DLUA_LOCK=ON and one without, preferably alternating them:
+
+    lua lock.lua [runs]
+
+Prints the minimum and the median time of 'runs' runs (default 11) of each
+case.
+
+@LICENSE
+    See Copyright Notice in lua.h
+--]]
+local runs = tonumber(arg and arg[1]) or 11
+
+local abs = math.abs
+
+local cases = {
+  { "3e7 loop iterations (s = s + i % 7)", function()
+    local s = 0
+    for i = 1, 3e7 do s = s + i % 7 end
+    return s
+  end },
+  { "1e7 Lua calls", function()
+    local function f(x) return x end
+    local s = 0
+    for i = 1, 1e7 do s = f(i) end
+    return s
+  end },
+  { "1e7 C calls (math.abs)", function()
+    local s = 0
+    for i = 1, 1e7 do s = abs(-i) end
+    return s
+  end },
+  { "3e6 table constructors", function()
+    local t
+    for i = 1, 3e6 do t = { i, i } end
+    return t
+  end },
+  { "1e6 string concatenations", function()
+    local s
+    for i = 1, 1e6 do s = "x" .. i .. "y" end
+    return s
+  end },
+}
+
+for _,case in ipairs(cases) do
+  local name, f = case[1], case[2]
+  local times = {}
+  for r = 1,runs do
+    collectgarbage()
+    local t0 = os.clock()
+    f()
+    times[r] = os.clock() - t0
+  end
+  table.sort(times)
+  print(string.format("%-40s min %.3fs median %.3fs", name, times[1],
+    times[(runs + 1) // 2]))
+end
@@ -53,6 +53,24 @@ static const luaL_Reg loadedlibs[] = {
   {LUA_MATHLIBNAME, luaopen_math},
   {LUA_UTF8LIBNAME, luaopen_utf8},
   {LUA_DBLIBNAME, luaopen_debug},
+#if defined(LUAGLM_EXT_ARRAY)
+  {LUA_ARRAYLIBNAME, luaopen_array},
+#endif
+#if defined(LUAGLM_EXT_JSON)
+  {LUA_JSONLIBNAME, luaopen_json},
+#endif
+#if defined(LUAGLM_EXT_SERIALIZE)
+  {LUA_SERIALIZELIBNAME, luaopen_serialize},
+#endif
+#if defined(LUA_USE_SHARED)
+  {LUA_SHAREDLIBNAME, luaopen_shared},
+#endif
+#if defined(LUA_USE_CHANNELS)
+  {LUA_CHANNELLIBNAME, luaopen_channel},
+#endif
+#if defined(LUA_USE_PARALLEL)
+  {LUA_PARALLELLIBNAME, luaopen_parallel},
+#endif
 #if defined(LUA_INCLUDE_LIBGLM)
   {LUA_GLMLIBNAME, luaopen_glm},
 #endif
@@ -12,6 +12,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,6 +22,7 @@
 
 #include "lauxlib.h"
 #include "lualib.h"
+#include "lgritlib.h"
 
 
 
@@ -160,10 +162,22 @@ typedef luaL_Stream LStream;
 #define isclosed(p)	((p)->closef == NULL)
 
 
+#if defined(LUA_USE_MMAP)
+#define LUA_MMAPHANDLE	"MMAP*"
+
+static int io_mmap (lua_State *L);
+#endif
+
+
 static int io_type (lua_State *L) {
   LStream *p;
   luaL_checkany(L, 1);
   p = (LStream *)luaL_testudata(L, 1, LUA_FILEHANDLE);
+#if defined(LUA_USE_MMAP)
+  if (p == NULL && luaL_testudata(L, 1, LUA_MMAPHANDLE) != NULL)
+    lua_pushliteral(L, "mapped file");  /* open or closed */
+  else
+#endif
   if (p == NULL)
     luaL_pushfail(L);  /* not a file */
   else if (isclosed(p))
@@ -269,8 +283,15 @@ static void opencheck (lua_State *L, const char *fname, const char *mode) {
 static int io_open (lua_State *L) {
   const char *filename = luaL_checkstring(L, 1);
   const char *mode = luaL_optstring(L, 2, "r");
-  LStream *p = newfile(L);
+  LStream *p;
   const char *md = mode;  /* to traverse/check mode */
+#if defined(LUA_USE_MMAP)
+  if (mode[0] == 'm' && mode[1] == '\0') {  /* read-only mapping? */
+    lua_settop(L, 1);
+    return io_mmap(L);
+  }
+#endif
+  p = newfile(L);
   luaL_argcheck(L, l_checkmode(md), 2, "invalid mode");
   p->f = fopen(filename, mode);
   return (p->f == NULL) ? luaL_fileresult(L, 0, filename) : 1;
@@ -426,12 +447,24 @@ static int io_lines (lua_State *L) {
 /* auxiliary structure used by 'read_number' */
 typedef struct {
   FILE *f;  /* file being read */
+#if defined(LUA_USE_MMAP)
+  const char *s;  /* current position in mapping (when 'f' is NULL) */
+  const char *e;  /* end of mapping */
+#endif
   int c;  /* current character (look ahead) */
   int n;  /* number of elements in buffer 'buff' */
   char buff[L_MAXLENNUM + 1];  /* +1 for ending '\0' */
 } RN;
 
 
+#if defined(LUA_USE_MMAP)
+#define rn_getc(rn)  ((rn)->f != NULL ? l_getc((rn)->f) \
+                      : ((rn)->s < (rn)->e ? (unsigned char)*(rn)->s++ : EOF))
+#else
+#define rn_getc(rn)  l_getc((rn)->f)
+#endif
+
+
 /*
 ** Add current char to buffer (if not out of space) and read next one
 */
@@ -442,7 +475,7 @@ static int nextc (RN *rn) {
   }
   else {
     rn->buff[rn->n++] = rn->c;  /* save current char */
-    rn->c = l_getc(rn->f);  /* read next one */
+    rn->c = rn_getc(rn);  /* read next one */
     return 1;
   }
 }
@@ -470,36 +503,37 @@ static int readdigits (RN *rn, int hex) {
 
 
 /*
-** Read a number: first reads a valid prefix of a numeral into a buffer.
-** Then it calls 'lua_stringtonumber' to check whether the format is
-** correct and to convert it to a Lua number.
+** Read a valid prefix of a numeral into the buffer of 'rn'; its
+** look-ahead character must be the first one after leading spaces.
 */
-static int read_number (lua_State *L, FILE *f) {
-  RN rn;
+static void readnumeral (RN *rn) {
   int count = 0;
   int hex = 0;
   char decp[2];
-  rn.f = f; rn.n = 0;
   decp[0] = lua_getlocaledecpoint();  /* get decimal point from locale */
   decp[1] = '.';  /* always accept a dot */
-  l_lockfile(rn.f);
-  do { rn.c = l_getc(rn.f); } while (isspace(rn.c));  /* skip spaces */
-  test2(&rn, "-+");  /* optional sign */
-  if (test2(&rn, "00")) {
-    if (test2(&rn, "xX")) hex = 1;  /* numeral is hexadecimal */
+  test2(rn, "-+");  /* optional sign */
+  if (test2(rn, "00")) {
+    if (test2(rn, "xX")) hex = 1;  /* numeral is hexadecimal */
     else count = 1;  /* count initial '0' as a valid digit */
   }
-  count += readdigits(&rn, hex);  /* integral part */
-  if (test2(&rn, decp))  /* decimal point? */
-    count += readdigits(&rn, hex);  /* fractional part */
-  if (count > 0 && test2(&rn, (hex ? "pP" : "eE"))) {  /* exponent mark? */
-    test2(&rn, "-+");  /* exponent sign */
-    readdigits(&rn, 0);  /* exponent digits */
+  count += readdigits(rn, hex);  /* integral part */
+  if (test2(rn, decp))  /* decimal point? */
+    count += readdigits(rn, hex);  /* fractional part */
+  if (count > 0 && test2(rn, (hex ? "pP" : "eE"))) {  /* exponent mark? */
+    test2(rn, "-+");  /* exponent sign */
+    readdigits(rn, 0);  /* exponent digits */
   }
-  ungetc(rn.c, rn.f);  /* unread look-ahead char */
-  l_unlockfile(rn.f);
-  rn.buff[rn.n] = '\0';  /* finish string */
-  if (l_likely(lua_stringtonumber(L, rn.buff)))
+}
+
+
+/*
+** Call 'lua_stringtonumber' to check whether the numeral read into 'rn'
+** is correct and to convert it to a Lua number.
+*/
+static int pushnumeral (lua_State *L, RN *rn) {
+  rn->buff[rn->n] = '\0';  /* finish string */
+  if (l_likely(lua_stringtonumber(L, rn->buff)))
     return 1;  /* ok, it is a valid number */
   else {  /* invalid format */
    lua_pushnil(L);  /* "result" to be removed */
@@ -508,6 +542,23 @@ static int read_number (lua_State *L, FILE *f) {
 }
 
 
+/*
+** Read a number: first reads a valid prefix of a numeral into a buffer.
+** Then it calls 'lua_stringtonumber' to check whether the format is
+** correct and to convert it to a Lua number.
+*/
+static int read_number (lua_State *L, FILE *f) {
+  RN rn;
+  rn.f = f; rn.n = 0;
+  l_lockfile(rn.f);
+  do { rn.c = l_getc(rn.f); } while (isspace(rn.c));  /* skip spaces */
+  readnumeral(&rn);
+  ungetc(rn.c, rn.f);  /* unread look-ahead char */
+  l_unlockfile(rn.f);
+  return pushnumeral(L, &rn);
+}
+
+
 static int test_eof (lua_State *L, FILE *f) {
   int c = getc(f);
   ungetc(c, f);  /* no-op when c == EOF */
@@ -735,6 +786,1052 @@ static int f_flush (lua_State *L) {
 }
 
 
+/*
+** {======================================================
+** Vector I/O: 'file:readvec' and 'file:writevec' stream vectors,
+** quaternions, and matrices as little-endian 32-bit floats, encoding
+** through a fixed buffer instead of one string per value.
+** =======================================================
+*/
+#if defined(LUAGLM_EXT_IOVEC)
+
+/* size (in bytes) of the buffer used to batch reads and writes */
+#if !defined(LUAI_IOVECBUFFER)
+#define LUAI_IOVECBUFFER	4096
+#endif
+
+static const char *const vecformats[] = {
+  "vec2", "vec3", "vec4", "quat",
+  "mat2x2", "mat2x3", "mat2x4",
+  "mat3x2", "mat3x3", "mat3x4",
+  "mat4x2", "mat4x3", "mat4x4", NULL
+};
+
+#define VECFMT_QUAT	3
+#define VECFMT_MAT	4  /* first matrix format */
+
+/* on-disk layout of one element */
+typedef struct VecFmt {
+  int fmt;  /* index into 'vecformats' */
+  int cols;  /* matrix columns; 1 for vectors */
+  int rows;  /* matrix rows; vector dimensions */
+  size_t size;  /* bytes per element */
+} VecFmt;
+
+
+static void setvecfmt (VecFmt *vf, int fmt) {
+  vf->fmt = fmt;
+  if (fmt < VECFMT_MAT) {
+    vf->cols = 1;
+    vf->rows = (fmt == VECFMT_QUAT) ? 4 : fmt + 2;
+  }
+  else {
+    vf->cols = (fmt - VECFMT_MAT) / 3 + 2;
+    vf->rows = (fmt - VECFMT_MAT) % 3 + 2;
+  }
+  vf->size = (size_t)(vf->cols * vf->rows) * 4;
+}
+
+
+/*
+** Format of the value at index 'idx'; -1 if it is not a vector or
+** matrix.
+*/
+static int valuefmt (lua_State *L, int idx) {
+  int type;
+  switch (lua_isvector(L, idx)) {
+    case LUA_VVECTOR2: return 0;
+    case LUA_VVECTOR3: return 1;
+    case LUA_VVECTOR4: return 2;
+    case LUA_VQUAT: return VECFMT_QUAT;
+    default: break;
+  }
+  if (lua_ismatrix(L, idx, &type))
+    return VECFMT_MAT + (LUAGLM_MATRIX_COLS(type) - 2) * 3
+                      + (LUAGLM_MATRIX_ROWS(type) - 2);
+  return -1;
+}
+
+
+static const union {
+  int dummy;
+  char little;  /* true iff machine is little endian */
+} ionativeendian = {1};
+
+
+static void putfloat (char *p, lua_VecF v) {
+  float f = (float)v;
+  memcpy(p, &f, 4);
+  if (!ionativeendian.little) {
+    char t = p[0]; p[0] = p[3]; p[3] = t;
+    t = p[1]; p[1] = p[2]; p[2] = t;
+  }
+}
+
+
+static lua_VecF getfloat (const char *p) {
+  float f;
+  char b[4];
+  memcpy(b, p, 4);
+  if (!ionativeendian.little) {
+    char t = b[0]; b[0] = b[3]; b[3] = t;
+    t = b[1]; b[1] = b[2]; b[2] = t;
+  }
+  memcpy(&f, b, 4);
+  return (lua_VecF)f;
+}
+
+
+/* pointer to column 'c' of a matrix with 'rows' rows */
+static lua_VecF *matcolumn (lua_Mat4 *m, int c, int rows) {
+  switch (rows) {
+    case 2: return m->m.m2[c];
+    case 3: return m->m.m3[c];
+    default: return m->m.m4[c];
+  }
+}
+
+
+/*
+** Encode the value at index 'idx' (element 'i' of the source) into 'p'.
+*/
+static void encodevec (lua_State *L, int idx, const VecFmt *vf, char *p,
+                                              lua_Integer i) {
+  int c, r;
+  if (l_unlikely(valuefmt(L, idx) != vf->fmt))
+    luaL_error(L, "bad element #%I to 'writevec' (%s expected, got %s)",
+               (LUAI_UACINT)i, vecformats[vf->fmt], luaglm_typename(L, idx));
+  if (vf->fmt == VECFMT_QUAT) {  /* stored as x, y, z, w */
+    lua_VecF w, x, y, z;
+    lua_checkquat(L, idx, &w, &x, &y, &z);
+    putfloat(p, x); putfloat(p + 4, y); putfloat(p + 8, z);
+    putfloat(p + 12, w);
+  }
+  else if (vf->fmt < VECFMT_MAT) {
+    lua_Float4 f4;
+    lua_tovector(L, idx, &f4);
+    for (r = 0; r < vf->rows; r++, p += 4)
+      putfloat(p, f4.raw[r]);
+  }
+  else {  /* column-major matrix */
+    lua_Mat4 m;
+    lua_tomatrix(L, idx, &m);
+    for (c = 0; c < vf->cols; c++) {
+      const lua_VecF *col = matcolumn(&m, c, vf->rows);
+      for (r = 0; r < vf->rows; r++, p += 4)
+        putfloat(p, col[r]);
+    }
+  }
+}
+
+
+/*
+** Push the element encoded at 'p'.
+*/
+static void decodevec (lua_State *L, const VecFmt *vf, const char *p) {
+  static const int variants[] = { LUA_VVECTOR2, LUA_VVECTOR3, LUA_VVECTOR4 };
+  int c, r;
+  if (vf->fmt == VECFMT_QUAT)
+    lua_pushquat(L, getfloat(p + 12), getfloat(p), getfloat(p + 4),
+                    getfloat(p + 8));
+  else if (vf->fmt < VECFMT_MAT) {
+    lua_Float4 f4;
+    memset(&f4, 0, sizeof(f4));
+    for (r = 0; r < vf->rows; r++, p += 4)
+      f4.raw[r] = getfloat(p);
+    lua_pushvector(L, f4, variants[vf->fmt]);
+  }
+  else {
+    lua_Mat4 m;
+    memset(&m, 0, sizeof(m));
+    m.dimensions = LUAGLM_MATRIX_TYPE(vf->cols, vf->rows);
+    for (c = 0; c < vf->cols; c++) {
+      lua_VecF *col = matcolumn(&m, c, vf->rows);
+      for (r = 0; r < vf->rows; r++, p += 4)
+        col[r] = getfloat(p);
+    }
+    lua_pushmatrix(L, &m);
+  }
+}
+
+
+/*
+** file:writevec(src [, format]): write a vector/matrix, or the sequence
+** of a table of them; the format defaults to the one of the first
+** element.
+*/
+static int f_writevec (lua_State *L) {
+  FILE *f = tofile(L);
+  char buff[LUAI_IOVECBUFFER];
+  size_t used = 0;
+  int status = 1;
+  int istable = lua_istable(L, 2);
+  lua_Integer i, n = istable ? (lua_Integer)lua_rawlen(L, 2) : 1;
+  VecFmt vf;
+  luaL_checkany(L, 2);
+  if (!lua_isnoneornil(L, 3))
+    setvecfmt(&vf, luaL_checkoption(L, 3, NULL, vecformats));
+  else {
+    int fmt;
+    if (istable) lua_rawgeti(L, 2, 1); else lua_pushvalue(L, 2);
+    fmt = valuefmt(L, -1);
+    lua_pop(L, 1);
+    if (fmt < 0) {
+      if (n == 0) {  /* nothing to write */
+        lua_settop(L, 1);
+        return 1;
+      }
+      return luaL_argerror(L, 2, "vector or matrix expected");
+    }
+    setvecfmt(&vf, fmt);
+  }
+  for (i = 1; i <= n && status; i++) {
+    if (istable) lua_rawgeti(L, 2, i); else lua_pushvalue(L, 2);
+    encodevec(L, -1, &vf, buff + used, i);
+    lua_pop(L, 1);
+    used += vf.size;
+    if (used + vf.size > sizeof(buff)) {  /* no room for another element? */
+      status = (fwrite(buff, sizeof(char), used, f) == used);
+      used = 0;
+    }
+  }
+  if (status && used > 0)
+    status = (fwrite(buff, sizeof(char), used, f) == used);
+  if (l_likely(status)) {
+    lua_settop(L, 1);
+    return 1;  /* return file */
+  }
+  else return luaL_fileresult(L, status, NULL);
+}
+
+
+/*
+** file:readvec(n, format [, t]): read up to 'n' elements into the table
+** 't' (or a new table); returns the table and the number of elements
+** read, or fail at end of file. A trailing partial element is consumed
+** and discarded.
+*/
+static int f_readvec (lua_State *L) {
+  FILE *f = tofile(L);
+  char buff[LUAI_IOVECBUFFER];
+  lua_Integer n = luaL_checkinteger(L, 2);
+  lua_Integer count = 0;
+  VecFmt vf;
+  size_t perchunk;
+  luaL_argcheck(L, n >= 0, 2, "non-negative count expected");
+  setvecfmt(&vf, luaL_checkoption(L, 3, NULL, vecformats));
+  perchunk = sizeof(buff) / vf.size;
+  if (lua_isnoneornil(L, 4)) {
+    lua_settop(L, 3);
+    lua_createtable(L, (n < INT_MAX) ? (int)n : INT_MAX, 0);
+  }
+  else {
+    luaL_checktype(L, 4, LUA_TTABLE);
+    lua_settop(L, 4);
+  }
+  clearerr(f);
+  while (count < n) {
+    size_t i, want = ((lua_Unsigned)(n - count) < perchunk)
+                   ? (size_t)(n - count) : perchunk;
+    size_t nr = fread(buff, vf.size, want, f);
+    for (i = 0; i < nr; i++) {
+      decodevec(L, &vf, buff + i * vf.size);
+      lua_rawseti(L, 4, ++count);
+    }
+    if (nr < want)
+      break;  /* end of file (or error) */
+  }
+  if (ferror(f))
+    return luaL_fileresult(L, 0, NULL);
+  if (count == 0 && n > 0) {
+    luaL_pushfail(L);
+    return 1;
+  }
+  lua_pushinteger(L, count);
+  return 2;
+}
+
+#endif
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Mapped files: 'io.mmap' maps a whole file read-only into memory and
+** reads from the mapping directly, without going through a 'FILE'
+** buffer and a 'luaL_Buffer'.
+** =======================================================
+*/
+#if defined(LUA_USE_MMAP)
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+typedef struct LMap {
+  const char *data;  /* start of mapping (NULL for empty files) */
+  size_t size;  /* size of mapping */
+  size_t pos;  /* current read position */
+  int closed;
+#if defined(_WIN32)
+  HANDLE hmap;  /* file-mapping object */
+#endif
+} LMap;
+
+
+#define tolmap(L)	((LMap *)luaL_checkudata(L, 1, LUA_MMAPHANDLE))
+
+/* number of bytes available after current position */
+#define mavail(m)	((m)->pos < (m)->size ? (m)->size - (m)->pos : 0)
+
+
+static LMap *tomap (lua_State *L) {
+  LMap *m = tolmap(L);
+  if (l_unlikely(m->closed))
+    luaL_error(L, "attempt to use a closed mapped file");
+  return m;
+}
+
+
+static void l_unmap (LMap *m) {
+  if (m->data != NULL) {
+#if defined(_WIN32)
+    UnmapViewOfFile((LPCVOID)m->data);
+    CloseHandle(m->hmap);
+#else
+    munmap((void *)m->data, m->size);
+#endif
+  }
+  m->data = NULL;
+  m->size = m->pos = 0;
+  m->closed = 1;
+}
+
+
+/*
+** Map file 'fname' into 'm'. Returns 0 and sets 'errno' on failure.
+*/
+static int l_map (LMap *m, const char *fname) {
+  int ok = 0;
+#if defined(_WIN32)
+  struct _stati64 st;
+  int fd = _open(fname, _O_RDONLY | _O_BINARY);
+  if (fd < 0) return 0;
+  if (_fstati64(fd, &st) == 0 && (unsigned __int64)st.st_size <= (size_t)~0) {
+    m->size = (size_t)st.st_size;
+    if (m->size == 0) ok = 1;
+    else {
+      HANDLE hf = (HANDLE)_get_osfhandle(fd);
+      m->hmap = CreateFileMappingA(hf, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (m->hmap != NULL) {
+        m->data = (const char *)MapViewOfFile(m->hmap, FILE_MAP_READ, 0, 0, 0);
+        if (m->data != NULL) ok = 1;
+        else CloseHandle(m->hmap);
+      }
+      if (!ok) errno = ENOMEM;
+    }
+  }
+  else if (errno == 0) errno = EFBIG;
+  _close(fd);
+#else
+  struct stat st;
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0) return 0;
+  if (fstat(fd, &st) == 0) {
+    if ((unsigned long long)st.st_size > (size_t)~(size_t)0)
+      errno = EFBIG;
+    else if ((m->size = (size_t)st.st_size) == 0)
+      ok = 1;  /* empty file: nothing to map */
+    else {
+      void *p = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+#if defined(MADV_SEQUENTIAL)
+        madvise(p, m->size, MADV_SEQUENTIAL);
+#endif
+        m->data = (const char *)p;
+        ok = 1;
+      }
+    }
+  }
+  close(fd);  /* mapping stays valid after closing descriptor */
+#endif
+  if (!ok) m->size = 0;
+  return ok;
+}
+
+
+static int io_mmap (lua_State *L) {
+  const char *filename = luaL_checkstring(L, 1);
+  LMap *m = (LMap *)lua_newuserdatauv(L, sizeof(LMap), 0);
+  m->data = NULL; m->size = m->pos = 0;
+  m->closed = 1;  /* mark as 'closed' until the mapping succeeds */
+  luaL_setmetatable(L, LUA_MMAPHANDLE);
+  if (!l_map(m, filename))
+    return luaL_fileresult(L, 0, filename);
+  m->closed = 0;
+  return 1;
+}
+
+
+static int m_close (lua_State *L) {
+  l_unmap(tomap(L));
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
+static int m_gc (lua_State *L) {
+  LMap *m = tolmap(L);
+  if (!m->closed)
+    l_unmap(m);
+  return 0;
+}
+
+
+static int m_tostring (lua_State *L) {
+  LMap *m = tolmap(L);
+  if (m->closed)
+    lua_pushliteral(L, "mapped file (closed)");
+  else
+    lua_pushfstring(L, "mapped file (%p)", (const void *)m->data);
+  return 1;
+}
+
+
+static int m_len (lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)tomap(L)->size);
+  return 1;
+}
+
+
+/*
+** Read a line using 'memchr' over the mapping; the result is copied
+** once, straight from the mapping into the new string.
+*/
+static int mread_line (lua_State *L, LMap *m, int chop) {
+  size_t avail = mavail(m);
+  const char *s = m->data + m->pos;
+  const char *nl = (avail > 0) ? (const char *)memchr(s, '\n', avail) : NULL;
+  size_t l = (nl != NULL) ? (size_t)(nl - s) : avail;
+  lua_pushlstring(L, s, (nl != NULL && !chop) ? l + 1 : l);
+  m->pos += (nl != NULL) ? l + 1 : l;
+  return (nl != NULL || l > 0);
+}
+
+
+static int mread_number (lua_State *L, LMap *m) {
+  RN rn;
+  rn.f = NULL; rn.n = 0;
+  rn.s = m->data + m->pos; rn.e = rn.s + mavail(m);
+  do { rn.c = rn_getc(&rn); } while (isspace(rn.c));  /* skip spaces */
+  readnumeral(&rn);
+  if (rn.c != EOF) rn.s--;  /* unread look-ahead char */
+  m->pos = (size_t)(rn.s - m->data);
+  return pushnumeral(L, &rn);
+}
+
+
+static int mread_chars (lua_State *L, LMap *m, size_t n) {
+  size_t avail = mavail(m);
+  if (n > avail) n = avail;
+  lua_pushlstring(L, m->data + m->pos, n);
+  m->pos += n;
+  return (n > 0);
+}
+
+
+static int mg_read (lua_State *L, LMap *m, int first) {
+  int nargs = lua_gettop(L) - 1;
+  int n, success;
+  if (nargs == 0) {  /* no arguments? */
+    success = mread_line(L, m, 1);
+    n = first + 1;  /* to return 1 result */
+  }
+  else {
+    luaL_checkstack(L, nargs+LUA_MINSTACK, "too many arguments");
+    success = 1;
+    for (n = first; nargs-- && success; n++) {
+      if (lua_type(L, n) == LUA_TNUMBER) {
+        size_t l = (size_t)luaL_checkinteger(L, n);
+        if (l == 0) {  /* test eof */
+          lua_pushliteral(L, "");
+          success = (mavail(m) > 0);
+        }
+        else
+          success = mread_chars(L, m, l);
+      }
+      else {
+        const char *p = luaL_checkstring(L, n);
+        if (*p == '*') p++;  /* skip optional '*' (for compatibility) */
+        switch (*p) {
+          case 'n':  /* number */
+            success = mread_number(L, m);
+            break;
+          case 'l':  /* line */
+            success = mread_line(L, m, 1);
+            break;
+          case 'L':  /* line with end-of-line */
+            success = mread_line(L, m, 0);
+            break;
+          case 'a':  /* rest of mapping */
+            mread_chars(L, m, mavail(m));
+            success = 1; /* always success */
+            break;
+          default:
+            return luaL_argerror(L, n, "invalid format");
+        }
+      }
+    }
+  }
+  if (!success) {
+    lua_pop(L, 1);  /* remove last result */
+    luaL_pushfail(L);  /* push nil instead */
+  }
+  return n - first;
+}
+
+
+static int m_read (lua_State *L) {
+  return mg_read(L, tomap(L), 2);
+}
+
+
+/*
+** Iteration function for 'm:lines'. Upvalues are the same as the ones
+** of 'io_readline'; a mapping is never closed by its iterator.
+*/
+static int m_readline (lua_State *L) {
+  LMap *m = (LMap *)lua_touserdata(L, lua_upvalueindex(1));
+  int i;
+  int n = (int)lua_tointeger(L, lua_upvalueindex(2));
+  if (m->closed)  /* mapping is already closed? */
+    return luaL_error(L, "file is already closed");
+  if (n == 0) {  /* common case: plain lines */
+    lua_settop(L, 0);
+    return mread_line(L, m, 1);  /* no result at end of mapping */
+  }
+  lua_settop(L , 1);
+  luaL_checkstack(L, n, "too many arguments");
+  for (i = 1; i <= n; i++)  /* push arguments to 'mg_read' */
+    lua_pushvalue(L, lua_upvalueindex(3 + i));
+  n = mg_read(L, m, 2);  /* 'n' is number of results */
+  lua_assert(n > 0);  /* should return at least a nil */
+  return lua_toboolean(L, -n) ? n : 0;
+}
+
+
+static int m_lines (lua_State *L) {
+  int n;
+  tomap(L);  /* check that it's a valid mapping */
+  n = lua_gettop(L) - 1;  /* number of arguments to read */
+  luaL_argcheck(L, n <= MAXARGLINE, MAXARGLINE + 2, "too many arguments");
+  lua_pushvalue(L, 1);  /* mapping */
+  lua_pushinteger(L, n);  /* number of arguments to read */
+  lua_pushboolean(L, 0);  /* never closed by the iterator */
+  lua_rotate(L, 2, 3);  /* move the three values to their positions */
+  lua_pushcclosure(L, m_readline, 3 + n);
+  return 1;
+}
+
+
+static int m_seek (lua_State *L) {
+  static const char *const modenames[] = {"set", "cur", "end", NULL};
+  LMap *m = tomap(L);
+  int op = luaL_checkoption(L, 2, "cur", modenames);
+  lua_Integer offset = luaL_optinteger(L, 3, 0);
+  lua_Integer base = (op == 0) ? 0
+                   : (op == 1) ? (lua_Integer)m->pos : (lua_Integer)m->size;
+  if (l_unlikely((offset < 0) ? (base < -offset)
+                              : (offset > LUA_MAXINTEGER - base))) {
+    errno = EINVAL;
+    return luaL_fileresult(L, 0, NULL);  /* error */
+  }
+  m->pos = (size_t)(base + offset);
+  lua_pushinteger(L, (lua_Integer)m->pos);
+  return 1;
+}
+
+
+/* translate a relative initial position, as in 'string.sub' */
+static size_t m_posrelat (lua_Integer pos, size_t len) {
+  if (pos > 0)
+    return (size_t)pos;
+  else if (pos == 0)
+    return 1;
+  else if (pos < -(lua_Integer)len)  /* inverted comparison */
+    return 1;  /* clip to 1 */
+  else return len + (size_t)pos + 1;
+}
+
+
+/*
+** m:sub(i [, j]): copy bytes i..j of the mapping into a string, with
+** the same index rules as 'string.sub'; it does not move the position.
+*/
+static int m_sub (lua_State *L) {
+  LMap *m = tomap(L);
+  size_t l = m->size;
+  size_t start = m_posrelat(luaL_checkinteger(L, 2), l);
+  lua_Integer j = luaL_optinteger(L, 3, -1);
+  size_t end = (j > (lua_Integer)l) ? l
+             : (j >= 0) ? (size_t)j
+             : (j < -(lua_Integer)l) ? 0 : l + (size_t)j + 1;
+  if (start <= end)
+    lua_pushlstring(L, m->data + start - 1, (end - start) + 1);
+  else lua_pushliteral(L, "");
+  return 1;
+}
+
+
+/*
+** m:find(s [, init]): plain search of 's' in the mapping, returning
+** the start and end indices of the first match or fail.
+*/
+static int m_find (lua_State *L) {
+  LMap *m = tomap(L);
+  size_t lp;
+  const char *p = luaL_checklstring(L, 2, &lp);
+  size_t init = m_posrelat(luaL_optinteger(L, 3, 1), m->size) - 1;
+  if (init > m->size) {  /* start after the end? */
+    luaL_pushfail(L);
+    return 1;
+  }
+  else if (lp == 0) {  /* empty strings are always found */
+    lua_pushinteger(L, (lua_Integer)init + 1);
+    lua_pushinteger(L, (lua_Integer)init);
+    return 2;
+  }
+  else {
+    const char *s = m->data + init;
+    size_t ls = m->size - init;
+    while (ls >= lp) {
+      const char *f = (const char *)memchr(s, *p, ls - lp + 1);
+      if (f == NULL)
+        break;
+      if (memcmp(f + 1, p + 1, lp - 1) == 0) {
+        lua_pushinteger(L, (lua_Integer)(f - m->data) + 1);
+        lua_pushinteger(L, (lua_Integer)(f - m->data) + (lua_Integer)lp);
+        return 2;
+      }
+      ls -= (size_t)(f + 1 - s);
+      s = f + 1;
+    }
+    luaL_pushfail(L);
+    return 1;
+  }
+}
+
+
+static const luaL_Reg mmeth[] = {
+  {"read", m_read},
+  {"lines", m_lines},
+  {"seek", m_seek},
+  {"sub", m_sub},
+  {"find", m_find},
+  {"close", m_close},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg mmetameth[] = {
+  {"__index", NULL},  /* place holder */
+  {"__gc", m_gc},
+  {"__close", m_gc},
+  {"__len", m_len},
+  {"__tostring", m_tostring},
+  {NULL, NULL}
+};
+
+
+static void createmapmeta (lua_State *L) {
+  luaL_newmetatable(L, LUA_MMAPHANDLE);  /* metatable for mappings */
+  luaL_setfuncs(L, mmetameth, 0);
+  luaL_newlibtable(L, mmeth);  /* create method table */
+  luaL_setfuncs(L, mmeth, 0);
+  lua_setfield(L, -2, "__index");  /* metatable.__index = method table */
+  lua_pop(L, 1);  /* pop metatable */
+}
+
+#endif
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Asynchronous I/O: 'io.async' runs whole-file reads and writes on a
+** pool of worker threads. A coroutine that issues a request is
+** suspended (lua_yieldk) and resumed, with the results of the request,
+** by the 'io.async.poll' call that harvests its completion. The host
+** is expected to call 'poll' regularly from its main loop.
+** =======================================================
+*/
+#if defined(LUA_USE_ASYNCIO)
+
+#include <pthread.h>
+
+/* number of worker threads */
+#if !defined(LUAI_ASYNCIOTHREADS)
+#define LUAI_ASYNCIOTHREADS	2
+#endif
+
+#define AIO_POOL	"IO_ASYNC*"
+
+enum { AIO_READ, AIO_WRITE, AIO_APPEND };
+
+typedef struct AIORequest {
+  struct AIORequest *next;
+  int op;
+  int err;  /* 'errno' of a failed request; 0 on success */
+  char *path;
+  char *data;  /* read result or data to write */
+  size_t len;  /* length of 'data' */
+  size_t n;  /* maximum number of bytes to read; (size_t)-1 for all */
+  long offset;  /* offset of a read */
+} AIORequest;
+
+typedef struct AIOPool {
+  pthread_mutex_t lock;
+  pthread_cond_t work;  /* signals new requests or a stop request */
+  pthread_t threads[LUAI_ASYNCIOTHREADS];
+  int nthreads;  /* number of started workers */
+  int stop;
+  lua_Integer npending;  /* requests submitted and not yet harvested */
+  AIORequest *queue, *queuetail;  /* submitted requests */
+  AIORequest *done, *donetail;  /* completed requests */
+} AIOPool;
+
+
+static void aio_freereq (AIORequest *r) {
+  free(r->path);
+  free(r->data);
+  free(r);
+}
+
+
+/*
+** Perform request 'r' (on a worker, or inline when the caller cannot
+** yield). Only the C library is used here; never the Lua state.
+*/
+static void aio_perform (AIORequest *r) {
+  FILE *f;
+  errno = 0;
+  if (r->op == AIO_READ) {
+    f = fopen(r->path, "rb");
+    if (f != NULL && (r->offset == 0 || fseek(f, r->offset, SEEK_SET) == 0)) {
+      size_t nr, size = 0;
+      size_t cap = (r->n < LUAL_BUFFERSIZE) ? r->n : LUAL_BUFFERSIZE;
+      char *p = (char *)malloc(cap > 0 ? cap : 1);
+      while (p != NULL && size < r->n
+                       && (nr = fread(p + size, 1, cap - size, f)) > 0) {
+        size += nr;
+        if (size == cap && cap < r->n) {  /* buffer full: grow up to 'n' */
+          size_t ncap = (cap <= r->n / 2) ? cap * 2 : r->n;
+          char *np = (char *)realloc(p, ncap);
+          if (np == NULL) free(p);
+          p = np; cap = ncap;
+        }
+      }
+      if (p == NULL) r->err = ENOMEM;
+      else if (ferror(f)) { r->err = errno ? errno : EIO; free(p); }
+      else { r->data = p; r->len = size; }
+    }
+    else r->err = errno ? errno : EIO;
+  }
+  else {
+    f = fopen(r->path, (r->op == AIO_APPEND) ? "ab" : "wb");
+    if (f != NULL) {
+      if (fwrite(r->data, 1, r->len, f) != r->len)
+        r->err = errno ? errno : EIO;
+    }
+    else r->err = errno ? errno : EIO;
+  }
+  if (f != NULL && fclose(f) != 0 && r->err == 0)
+    r->err = errno ? errno : EIO;
+}
+
+
+static void *aio_worker (void *ud) {
+  AIOPool *pool = (AIOPool *)ud;
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    AIORequest *r;
+    while (pool->queue == NULL && !pool->stop)
+      pthread_cond_wait(&pool->work, &pool->lock);
+    if (pool->queue == NULL)  /* stop requested and nothing left to do */
+      break;
+    r = pool->queue;
+    if ((pool->queue = r->next) == NULL)
+      pool->queuetail = NULL;
+    pthread_mutex_unlock(&pool->lock);
+    aio_perform(r);
+    pthread_mutex_lock(&pool->lock);
+    r->next = NULL;
+    if (pool->donetail != NULL) pool->donetail->next = r;
+    else pool->done = r;
+    pool->donetail = r;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+
+/*
+** Push the results of request 'r' onto 'L'; returns their number.
+*/
+static int aio_pushresult (lua_State *L, AIORequest *r) {
+  if (r->err != 0) {
+    errno = r->err;
+    return luaL_fileresult(L, 0, r->path);
+  }
+  else if (r->op == AIO_READ) {
+    lua_pushlstring(L, r->data, r->len);
+    return 1;
+  }
+  else
+    return luaL_fileresult(L, 1, NULL);
+}
+
+
+/*
+** Continuation of a suspended request: 'poll' resumes the coroutine
+** with the request address followed by its results.
+*/
+static int aio_k (lua_State *L, int status, lua_KContext ctx) {
+  (void)status;
+  if (l_unlikely(lua_touserdata(L, 1) != (void *)ctx)) {
+    /* resumed by someone else: forget this coroutine */
+    lua_pushlightuserdata(L, (void *)ctx);
+    lua_pushnil(L);
+    lua_rawset(L, lua_upvalueindex(2));
+    return luaL_error(L, "coroutine resumed before its I/O completed");
+  }
+  return lua_gettop(L) - 1;
+}
+
+
+static int aio_submit (lua_State *L, AIORequest *r) {
+  AIOPool *pool = (AIOPool *)lua_touserdata(L, lua_upvalueindex(1));
+  int ok = 1;
+  if (!lua_isyieldable(L) || pool->stop) {  /* cannot wait: do it now */
+    int n;
+    aio_perform(r);
+    n = aio_pushresult(L, r);
+    aio_freereq(r);
+    return n;
+  }
+  pthread_mutex_lock(&pool->lock);
+  if (pool->nthreads < LUAI_ASYNCIOTHREADS) {  /* start another worker */
+    if (pthread_create(&pool->threads[pool->nthreads], NULL,
+                       aio_worker, pool) == 0)
+      pool->nthreads++;
+    else ok = (pool->nthreads > 0);
+  }
+  if (ok) {
+    r->next = NULL;
+    if (pool->queuetail != NULL) pool->queuetail->next = r;
+    else pool->queue = r;
+    pool->queuetail = r;
+    pool->npending++;
+    pthread_cond_signal(&pool->work);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  if (!ok) {
+    aio_freereq(r);
+    return luaL_error(L, "cannot start I/O worker thread");
+  }
+  lua_pushlightuserdata(L, (void *)r);  /* waiting-table[r] = coroutine */
+  lua_pushthread(L);
+  lua_rawset(L, lua_upvalueindex(2));
+  lua_settop(L, 0);
+  return lua_yieldk(L, 0, (lua_KContext)r, aio_k);
+}
+
+
+/*
+** Allocate a request, with a copy of 'path' and 'n' bytes of 's'.
+*/
+static AIORequest *aio_newreq (lua_State *L, int op, const char *path,
+                                             const char *s, size_t n) {
+  AIORequest *r = (AIORequest *)calloc(1, sizeof(AIORequest));
+  size_t lp = strlen(path) + 1;
+  if (r != NULL && (r->path = (char *)malloc(lp)) != NULL
+                && (s == NULL || (r->data = (char *)malloc(n + 1)) != NULL)) {
+    r->op = op;
+    memcpy(r->path, path, lp);
+    if (s != NULL) {
+      memcpy(r->data, s, n);
+      r->len = n;
+    }
+    return r;
+  }
+  if (r != NULL) aio_freereq(r);
+  luaL_error(L, "not enough memory");
+  return NULL;
+}
+
+
+/*
+** io.async.read(path [, offset [, n]])
+*/
+static int aio_read (lua_State *L) {
+  const char *path = luaL_checkstring(L, 1);
+  lua_Integer offset = luaL_optinteger(L, 2, 0);
+  lua_Integer n = luaL_optinteger(L, 3, -1);
+  AIORequest *r;
+  luaL_argcheck(L, 0 <= offset && offset <= LONG_MAX, 2, "out of range");
+  r = aio_newreq(L, AIO_READ, path, NULL, 0);
+  r->offset = (long)offset;
+  r->n = (n < 0) ? (size_t)-1 : (size_t)n;
+  return aio_submit(L, r);
+}
+
+
+/*
+** io.async.write(path, data [, append])
+*/
+static int aio_write (lua_State *L) {
+  size_t l;
+  const char *path = luaL_checkstring(L, 1);
+  const char *s = luaL_checklstring(L, 2, &l);
+  int op = lua_toboolean(L, 3) ? AIO_APPEND : AIO_WRITE;
+  return aio_submit(L, aio_newreq(L, op, path, s, l));
+}
+
+
+/*
+** io.async.poll([max]): resume the coroutines of up to 'max' completed
+** requests; returns the number of coroutines resumed. An error raised
+** by a resumed coroutine is propagated (remaining completions are kept
+** for the next call).
+*/
+static int aio_poll (lua_State *L) {
+  AIOPool *pool = (AIOPool *)lua_touserdata(L, lua_upvalueindex(1));
+  lua_Integer max = luaL_optinteger(L, 1, LUA_MAXINTEGER);
+  lua_Integer count = 0;
+  lua_settop(L, 0);
+  while (count < max) {
+    lua_State *co;
+    AIORequest *r;
+    int nargs, nres, status;
+    pthread_mutex_lock(&pool->lock);
+    if ((r = pool->done) != NULL) {
+      if ((pool->done = r->next) == NULL)
+        pool->donetail = NULL;
+      pool->npending--;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (r == NULL)
+      break;  /* nothing else completed */
+    lua_pushlightuserdata(L, (void *)r);
+    lua_rawget(L, lua_upvalueindex(2));  /* get waiting coroutine */
+    co = lua_tothread(L, -1);
+    lua_pushlightuserdata(L, (void *)r);
+    lua_pushnil(L);
+    lua_rawset(L, lua_upvalueindex(2));  /* waiting-table[r] = nil */
+    if (co == NULL || lua_status(co) != LUA_YIELD) {  /* abandoned? */
+      aio_freereq(r);
+      lua_settop(L, 0);
+      continue;
+    }
+    lua_pushlightuserdata(co, (void *)r);
+    nargs = 1 + aio_pushresult(co, r);
+    aio_freereq(r);
+    status = lua_resume(co, L, nargs, &nres);
+    count++;
+    if (l_likely(status == LUA_OK || status == LUA_YIELD))
+      lua_pop(co, nres);  /* discard values yielded/returned */
+    else {
+      lua_xmove(co, L, 1);  /* move error message */
+      return lua_error(L);  /* propagate error */
+    }
+    lua_settop(L, 0);
+  }
+  lua_pushinteger(L, count);
+  return 1;
+}
+
+
+/*
+** io.async.pending(): number of requests not yet harvested by 'poll'
+*/
+static int aio_pending (lua_State *L) {
+  AIOPool *pool = (AIOPool *)lua_touserdata(L, lua_upvalueindex(1));
+  lua_Integer n;
+  pthread_mutex_lock(&pool->lock);
+  n = pool->npending;
+  pthread_mutex_unlock(&pool->lock);
+  lua_pushinteger(L, n);
+  return 1;
+}
+
+
+/*
+** Stop the workers (after they drain the queue) and release all
+** requests; called when the state is closed.
+*/
+static int aio_gc (lua_State *L) {
+  AIOPool *pool = (AIOPool *)luaL_checkudata(L, 1, AIO_POOL);
+  int i;
+  AIORequest *r;
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  for (i = 0; i < pool->nthreads; i++)
+    pthread_join(pool->threads[i], NULL);
+  pool->nthreads = 0;
+  while ((r = pool->done) != NULL) {
+    pool->done = r->next;
+    aio_freereq(r);
+  }
+  pool->donetail = NULL;
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+  return 0;
+}
+
+
+static const luaL_Reg aiolib[] = {
+  {"read", aio_read},
+  {"write", aio_write},
+  {"poll", aio_poll},
+  {"pending", aio_pending},
+  {NULL, NULL}
+};
+
+
+/*
+** Create the 'io.async' table (on top of the stack); its functions
+** share the pool and the table of waiting coroutines as upvalues.
+*/
+static void createasync (lua_State *L) {
+  AIOPool *pool;
+  luaL_newlibtable(L, aiolib);
+  pool = (AIOPool *)lua_newuserdatauv(L, sizeof(AIOPool), 0);
+  memset(pool, 0, sizeof(AIOPool));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  if (luaL_newmetatable(L, AIO_POOL)) {
+    lua_pushcfunction(L, aio_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  lua_newtable(L);  /* coroutines waiting for requests */
+  luaL_setfuncs(L, aiolib, 2);
+}
+
+#endif
+/* }====================================================== */
+
+
 /*
 ** functions for 'io' library
 */
@@ -743,6 +1840,9 @@ static const luaL_Reg iolib[] = {
   {"flush", io_flush},
   {"input", io_input},
   {"lines", io_lines},
+#if defined(LUA_USE_MMAP)
+  {"mmap", io_mmap},
+#endif
   {"open", io_open},
   {"output", io_output},
   {"popen", io_popen},
@@ -765,6 +1865,10 @@ static const luaL_Reg meth[] = {
   {"seek", f_seek},
   {"close", f_close},
   {"setvbuf", f_setvbuf},
+#if defined(LUAGLM_EXT_IOVEC)
+  {"readvec", f_readvec},
+  {"writevec", f_writevec},
+#endif
   {NULL, NULL}
 };
 
@@ -819,6 +1923,13 @@ static void createstdfile (lua_State *L, FILE *f, const char *k,
 LUAMOD_API int luaopen_io (lua_State *L) {
   luaL_newlib(L, iolib);  /* new module */
   createmeta(L);
+#if defined(LUA_USE_MMAP)
+  createmapmeta(L);
+#endif
+#if defined(LUA_USE_ASYNCIO)
+  createasync(L);
+  lua_setfield(L, -2, "async");
+#endif
   /* create (and set) default files */
   createstdfile(L, stdin, IO_INPUT, "stdin");
   createstdfile(L, stdout, IO_OUTPUT, "stdout");
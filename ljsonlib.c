@@ -0,0 +1,1015 @@
+/*
+** $Id: ljsonlib.c $
+** JSON encoding and decoding
+** See Copyright Notice in lua.h
+*/
+
+#define ljsonlib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <float.h>
+#include <limits.h>
+#include <locale.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+#include "lgritlib.h"
+
+
+/* maximum nesting of arrays and objects */
+#if !defined(LUAI_MAXJSON)
+#define LUAI_MAXJSON	200
+#endif
+
+/* maximum length of a numeral */
+#define MAXNUMERAL	200
+
+/* size of a buffer for formatting numbers */
+#define JSON_MAXNUM	64
+
+
+/* how vectors are represented */
+enum VecMode { VEC_NONE, VEC_ARRAY, VEC_OBJECT };
+
+static const char *const vecmodes[] = {"none", "array", "object", NULL};
+
+/* JSON null is represented by a NULL light userdata ('json.null') */
+#define isnull(L,i) \
+  (lua_islightuserdata(L, i) && lua_touserdata(L, i) == NULL)
+
+/* quaternion and vector fields, in the order of their components */
+static const char *const quatfields[] = {"w", "x", "y", "z"};
+static const char *const vecfields[] = {"x", "y", "z", "w"};
+
+
+/*
+** {======================================================
+** Word-at-a-time scanning
+** =======================================================
+*/
+
+/*
+** Most of a JSON text is string contents, where only quotes, backslashes
+** and control characters matter. They are searched a machine word at a
+** time: 'hasless(w,n)' is nonzero iff some byte of 'w' is less than 'n'
+** (n <= 128), and 'hasbyte(w,c)' iff some byte of 'w' equals 'c'. False
+** positives only occur after a true one, so the exact position is found
+** by a byte loop from the start of the word.
+*/
+typedef size_t Word;
+
+#define ONES		(~(Word)0 / 0xff)
+#define HIGHS		(ONES * 0x80)
+#define hasless(w,n)	(((w) - ONES * (n)) & ~(w) & HIGHS)
+#define hasbyte(w,c)	hasless((w) ^ (ONES * (c)), 1)
+
+#define isplain(c) \
+  ((unsigned char)(c) >= 0x20 && (c) != '"' && (c) != '\\')
+
+
+/* return the first quote, backslash or control character in [p, end) */
+static const char *scanplain (const char *p, const char *end) {
+  while ((size_t)(end - p) >= sizeof(Word)) {
+    Word w;
+    memcpy(&w, p, sizeof(Word));
+    if ((hasless(w, 0x20) | hasbyte(w, '"') | hasbyte(w, '\\')) != 0)
+      break;
+    p += sizeof(Word);
+  }
+  while (p < end && isplain(*p))
+    p++;
+  return p;
+}
+
+
+static const char *skipws (const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+    p++;
+  return p;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Decoding
+** =======================================================
+*/
+
+/*
+** Decoding runs in two passes. The first one finds the structural
+** characters (brackets and commas outside strings) and records the
+** number of elements of every array and object, in the order they are
+** opened; the second one parses the text, creating each table with its
+** final size. Counts are only size hints: the second pass does all the
+** validation.
+*/
+typedef struct Parser {
+  lua_State *L;
+  const char *s;  /* text being decoded */
+  const char *p;  /* current position */
+  const char *end;
+  int *counts;  /* number of elements of each array and object */
+  size_t ncounts;
+  size_t nextcount;  /* count of the next array or object */
+  int vectors;  /* whether arrays or objects become vectors */
+  int depth;
+} Parser;
+
+
+static int parseerror (Parser *P, const char *msg) {
+  return luaL_error(P->L, "%s at position %I", msg,
+                    (LUAI_UACINT)(P->p - P->s) + 1);
+}
+
+
+/*
+** Index the containers of the text. The counts are kept in a userdata on
+** the top of the stack, replaced by a larger one when it fills up.
+*/
+static void structure (Parser *P) {
+  lua_State *L = P->L;
+  const char *p = P->s, *end = P->end;
+  size_t stack[LUAI_MAXJSON];  /* indices of the open containers */
+  int empty = 0;  /* innermost container has no elements so far */
+  int depth = 0;
+  size_t size = 16;
+  P->counts = (int *)lua_newuserdatauv(L, size * sizeof(int), 0);
+  P->ncounts = 0;
+  while (p < end) {
+    switch (*p++) {
+      case '"': {
+        for (;;) {
+          p = scanplain(p, end);
+          if (p >= end || *p == '"') break;
+          p += (*p == '\\' && end - p > 1) ? 2 : 1;  /* skip escape */
+        }
+        if (p < end) p++;  /* skip closing quote */
+        empty = 0;
+        break;
+      }
+      case '[': case '{': {
+        if (depth == LUAI_MAXJSON) {
+          P->p = p - 1;
+          parseerror(P, "nesting too deep");
+        }
+        if (P->ncounts == size) {  /* grow counts */
+          int *c = (int *)lua_newuserdatauv(L, 2 * size * sizeof(int), 0);
+          memcpy(c, P->counts, size * sizeof(int));
+          lua_replace(L, -2);
+          P->counts = c;
+          size *= 2;
+        }
+        P->counts[P->ncounts] = 0;
+        stack[depth++] = P->ncounts++;
+        empty = 1;
+        break;
+      }
+      case ',': {
+        if (depth > 0 && P->counts[stack[depth - 1]] < INT_MAX - 1)
+          P->counts[stack[depth - 1]]++;
+        break;
+      }
+      case ']': case '}': {
+        if (depth > 0) {
+          depth--;
+          if (!empty)  /* elements are one more than commas */
+            P->counts[stack[depth]]++;
+        }
+        empty = 0;
+        break;
+      }
+      case ' ': case '\n': case '\r': case '\t': break;
+      default: empty = 0; break;
+    }
+  }
+}
+
+
+static int nextcount (Parser *P) {
+  return (P->nextcount < P->ncounts) ? P->counts[P->nextcount++] : 0;
+}
+
+
+#define isdec(c)	((unsigned)((c) - '0') < 10u)
+
+
+/*
+** Return the end of the numeral starting at 'p', or NULL if it does not
+** follow the JSON grammar. Set 'isflt' if it has a fraction or exponent.
+*/
+static const char *numeral (const char *p, const char *end, int *isflt) {
+  *isflt = 0;
+  if (p < end && *p == '-') p++;
+  if (p < end && *p == '0') p++;
+  else if (p < end && isdec(*p)) {
+    while (p < end && isdec(*p)) p++;
+  }
+  else return NULL;
+  if (p < end && *p == '.') {
+    p++;
+    *isflt = 1;
+    if (!(p < end && isdec(*p))) return NULL;
+    while (p < end && isdec(*p)) p++;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    *isflt = 1;
+    if (p < end && (*p == '+' || *p == '-')) p++;
+    if (!(p < end && isdec(*p))) return NULL;
+    while (p < end && isdec(*p)) p++;
+  }
+  return p;
+}
+
+
+/* powers of ten that are exact as floats */
+static const lua_Number tenpow[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+  1e13, 1e14, 1e15
+};
+
+
+/*
+** Push a decimal numeral without exponent and with at most DIG digits
+** (the precision of a float): its digits and the power of ten are exact
+** floats, so their correctly rounded quotient is the value 'strtod'
+** would give. Return false for other numerals.
+*/
+static int pushdecimal (lua_State *L, const char *p, const char *e) {
+  const char *q = (*p == '-') ? p + 1 : p;
+  lua_Integer m = 0;
+  lua_Number r;
+  int ndigits = 0, nfrac = -1;
+  for (; q < e; q++) {
+    if (*q == '.')
+      nfrac = 0;
+    else if (isdec(*q)) {
+      m = m * 10 + (*q - '0');
+      if (m != 0) ndigits++;
+      if (nfrac >= 0) nfrac++;
+    }
+    else return 0;  /* exponent */
+    if (ndigits > l_floatatt(DIG) || nfrac > l_floatatt(DIG))
+      return 0;
+  }
+  r = (lua_Number)m / tenpow[nfrac];
+  lua_pushnumber(L, (*p == '-') ? -r : r);  /* keeps the sign of -0.0 */
+  return 1;
+}
+
+
+/* push the numeral at the current position and return its end */
+static const char *jsonnumeral (Parser *P, const char *p) {
+  int isflt;
+  const char *e = numeral(p, P->end, &isflt);
+  if (e == NULL) {
+    P->p = p;
+    parseerror(P, "invalid number");
+  }
+  if (!isflt && e - p <= 18) {  /* cannot overflow */
+    const char *q = (*p == '-') ? p + 1 : p;
+    lua_Integer i = 0;
+    for (; q < e; q++)
+      i = i * 10 + (*q - '0');
+    lua_pushinteger(P->L, (*p == '-') ? -i : i);
+  }
+  else if (!(isflt && pushdecimal(P->L, p, e))) {
+    char buff[MAXNUMERAL + 1];
+    if (e - p > MAXNUMERAL) {
+      P->p = p;
+      parseerror(P, "number too long");
+    }
+    memcpy(buff, p, e - p);
+    buff[e - p] = '\0';
+    lua_stringtonumber(P->L, buff);  /* grammar was checked */
+  }
+  return e;
+}
+
+
+static void addutf8 (luaL_Buffer *b, unsigned long x) {
+  char buff[4];
+  int n;
+  if (x < 0x80) {
+    buff[0] = (char)x; n = 1;
+  }
+  else if (x < 0x800) {
+    buff[0] = (char)(0xc0 | (x >> 6));
+    buff[1] = (char)(0x80 | (x & 0x3f)); n = 2;
+  }
+  else if (x < 0x10000) {
+    buff[0] = (char)(0xe0 | (x >> 12));
+    buff[1] = (char)(0x80 | ((x >> 6) & 0x3f));
+    buff[2] = (char)(0x80 | (x & 0x3f)); n = 3;
+  }
+  else {
+    buff[0] = (char)(0xf0 | (x >> 18));
+    buff[1] = (char)(0x80 | ((x >> 12) & 0x3f));
+    buff[2] = (char)(0x80 | ((x >> 6) & 0x3f));
+    buff[3] = (char)(0x80 | (x & 0x3f)); n = 4;
+  }
+  luaL_addlstring(b, buff, n);
+}
+
+
+static int readhex4 (Parser *P, const char *p, unsigned long *x) {
+  int i;
+  *x = 0;
+  if (P->end - p < 4) return 0;
+  for (i = 0; i < 4; i++) {
+    int c = (unsigned char)p[i];
+    if (isdec(c)) c -= '0';
+    else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') c = (c | 0x20) - 'a' + 10;
+    else return 0;
+    *x = (*x << 4) | (unsigned long)c;
+  }
+  return 1;
+}
+
+
+/* push the string whose opening quote was just read */
+static void parsestring (Parser *P) {
+  lua_State *L = P->L;
+  const char *p = P->p;
+  const char *q = scanplain(p, P->end);
+  luaL_Buffer b;
+  if (q < P->end && *q == '"') {  /* no escapes? */
+    lua_pushlstring(L, p, q - p);
+    P->p = q + 1;
+    return;
+  }
+  luaL_buffinit(L, &b);
+  for (;;) {
+    luaL_addlstring(&b, p, q - p);
+    P->p = q;
+    if (q >= P->end)
+      parseerror(P, "unfinished string");
+    else if (*q == '"')
+      break;
+    else if (*q != '\\')
+      parseerror(P, "control character in string");
+    else if (q + 1 >= P->end)
+      parseerror(P, "unfinished string");
+    switch (q[1]) {
+      case '"': case '\\': case '/': luaL_addchar(&b, q[1]); break;
+      case 'b': luaL_addchar(&b, '\b'); break;
+      case 'f': luaL_addchar(&b, '\f'); break;
+      case 'n': luaL_addchar(&b, '\n'); break;
+      case 'r': luaL_addchar(&b, '\r'); break;
+      case 't': luaL_addchar(&b, '\t'); break;
+      case 'u': {
+        unsigned long x, y;
+        if (!readhex4(P, q + 2, &x))
+          parseerror(P, "invalid unicode escape");
+        q += 4;
+        if (0xd800 <= x && x < 0xdc00 && P->end - q >= 8 && q[2] == '\\'
+            && q[3] == 'u' && readhex4(P, q + 4, &y)
+            && 0xdc00 <= y && y < 0xe000) {  /* surrogate pair */
+          x = 0x10000 + ((x - 0xd800) << 10) + (y - 0xdc00);
+          q += 6;
+        }
+        addutf8(&b, x);
+        break;
+      }
+      default: parseerror(P, "invalid escape sequence");
+    }
+    p = q + 2;
+    q = scanplain(p, P->end);
+  }
+  luaL_pushresult(&b);
+  P->p = q + 1;
+}
+
+
+static void pushvector (lua_State *L, const lua_Number *v, int n) {
+  lua_Float4 f4;
+  int i;
+  memset(&f4, 0, sizeof(f4));
+  for (i = 0; i < n; i++)
+    f4.raw[i] = (lua_VecF)v[i];
+  lua_pushvector(L, f4, n == 2 ? LUA_VVECTOR2
+                      : n == 3 ? LUA_VVECTOR3 : LUA_VVECTOR4);
+}
+
+
+/* read the number at 'p' into 'v'; return its end or NULL */
+static const char *readnumber (Parser *P, const char *p, lua_Number *v) {
+  int isflt;
+  if (numeral(skipws(p, P->end), P->end, &isflt) == NULL)
+    return NULL;
+  p = jsonnumeral(P, skipws(p, P->end));
+  *v = lua_tonumber(P->L, -1);
+  lua_pop(P->L, 1);
+  return skipws(p, P->end);
+}
+
+
+/*
+** Try to read the 'n' elements of the array opened at 'P->p' as the
+** components of a vector.
+*/
+static int arrayvector (Parser *P, int n) {
+  lua_Number v[4];
+  const char *p = P->p;
+  int i;
+  for (i = 0; i < n; i++) {
+    if ((p = readnumber(P, p, &v[i])) == NULL
+        || p >= P->end || *p != ((i < n - 1) ? ',' : ']'))
+      return 0;
+    p++;
+  }
+  pushvector(P->L, v, n);
+  P->p = p;
+  return 1;
+}
+
+
+/*
+** Try to read the 'n' members of the object opened at 'P->p' as the
+** fields of a vector: "x" and "y", and optionally "z" and then "w".
+*/
+static int objectvector (Parser *P, int n) {
+  lua_Number v[4];
+  int seen = 0;
+  const char *p = P->p;
+  int i;
+  for (i = 0; i < n; i++) {
+    int f;
+    p = skipws(p, P->end);
+    if (P->end - p < 4 || p[0] != '"' || p[2] != '"')
+      return 0;
+    switch (p[1]) {
+      case 'x': f = 0; break;
+      case 'y': f = 1; break;
+      case 'z': f = 2; break;
+      case 'w': f = 3; break;
+      default: return 0;
+    }
+    if (f >= n || (seen & (1 << f)))
+      return 0;
+    seen |= 1 << f;
+    p = skipws(p + 3, P->end);
+    if (p >= P->end || *p != ':'
+        || (p = readnumber(P, p + 1, &v[f])) == NULL
+        || p >= P->end || *p != ((i < n - 1) ? ',' : '}'))
+      return 0;
+    p++;
+  }
+  pushvector(P->L, v, n);
+  P->p = p;
+  return 1;
+}
+
+
+static void parsevalue (Parser *P);
+
+
+static void enter (Parser *P) {
+  if (++P->depth > LUAI_MAXJSON)
+    parseerror(P, "nesting too deep");
+  luaL_checkstack(P->L, 3, "nesting too deep");
+}
+
+
+/* expect ',' or the closing character 'close'; return true at the end */
+static int separator (Parser *P, int close) {
+  P->p = skipws(P->p, P->end);
+  if (P->p < P->end && *P->p == ',') {
+    P->p++;
+    return 0;
+  }
+  else if (P->p < P->end && *P->p == close) {
+    P->p++;
+    return 1;
+  }
+  return parseerror(P, (close == ']') ? "expected ',' or ']'"
+                                      : "expected ',' or '}'");
+}
+
+
+static void parsearray (Parser *P) {
+  lua_State *L = P->L;
+  int n = nextcount(P);
+  lua_Integer i = 0;
+  if (P->vectors == VEC_ARRAY && 2 <= n && n <= 4 && arrayvector(P, n))
+    return;
+  enter(P);
+  lua_createtable(L, n, 0);
+  P->p = skipws(P->p, P->end);
+  if (P->p < P->end && *P->p == ']')
+    P->p++;
+  else {
+    do {
+      parsevalue(P);
+      lua_rawseti(L, -2, ++i);
+    } while (!separator(P, ']'));
+  }
+  P->depth--;
+}
+
+
+static void parseobject (Parser *P) {
+  lua_State *L = P->L;
+  int n = nextcount(P);
+  if (P->vectors == VEC_OBJECT && 2 <= n && n <= 4 && objectvector(P, n))
+    return;
+  enter(P);
+  lua_createtable(L, 0, n);
+  P->p = skipws(P->p, P->end);
+  if (P->p < P->end && *P->p == '}')
+    P->p++;
+  else {
+    do {
+      P->p = skipws(P->p, P->end);
+      if (P->p >= P->end || *P->p != '"')
+        parseerror(P, "expected string key");
+      P->p++;
+      parsestring(P);
+      P->p = skipws(P->p, P->end);
+      if (P->p >= P->end || *P->p != ':')
+        parseerror(P, "expected ':'");
+      P->p++;
+      parsevalue(P);
+      lua_rawset(L, -3);
+    } while (!separator(P, '}'));
+  }
+  P->depth--;
+}
+
+
+static void literal (Parser *P, const char *word) {
+  size_t l = strlen(word);
+  if ((size_t)(P->end - P->p) < l || memcmp(P->p, word, l) != 0)
+    parseerror(P, "invalid value");
+  P->p += l;
+}
+
+
+static void parsevalue (Parser *P) {
+  lua_State *L = P->L;
+  P->p = skipws(P->p, P->end);
+  if (P->p >= P->end)
+    parseerror(P, "unexpected end of text");
+  switch (*P->p) {
+    case '{': P->p++; parseobject(P); break;
+    case '[': P->p++; parsearray(P); break;
+    case '"': P->p++; parsestring(P); break;
+    case 't': literal(P, "true"); lua_pushboolean(L, 1); break;
+    case 'f': literal(P, "false"); lua_pushboolean(L, 0); break;
+    case 'n': literal(P, "null"); lua_pushlightuserdata(L, NULL); break;
+    default: P->p = jsonnumeral(P, P->p); break;
+  }
+}
+
+
+static int vecoption (lua_State *L, int arg, int def) {
+  if (!lua_isnoneornil(L, arg)) {
+    luaL_checktype(L, arg, LUA_TTABLE);
+    if (lua_getfield(L, arg, "vectors") != LUA_TNIL) {
+      const char *name = lua_tostring(L, -1);
+      int i;
+      for (i = 0; vecmodes[i] != NULL; i++) {
+        if (name != NULL && strcmp(vecmodes[i], name) == 0) {
+          def = i;
+          break;
+        }
+      }
+      if (vecmodes[i] == NULL)
+        luaL_error(L, "invalid 'vectors' option '%s'", luaL_tolstring(L, -1,
+                                                                      NULL));
+    }
+    lua_pop(L, 1);
+  }
+  return def;
+}
+
+
+static int json_decode (lua_State *L) {
+  Parser P;
+  size_t len;
+  P.s = luaL_checklstring(L, 1, &len);
+  P.vectors = vecoption(L, 2, VEC_NONE);
+  P.L = L;
+  P.end = P.s + len;
+  P.nextcount = 0;
+  P.depth = 0;
+  structure(&P);
+  P.p = P.s;
+  parsevalue(&P);
+  P.p = skipws(P.p, P.end);
+  if (P.p != P.end)
+    parseerror(&P, "trailing characters");
+  return 1;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Encoding
+** =======================================================
+*/
+
+#define LUA_JSONBUFFER	"json.buffer"
+
+
+/*
+** The text is built in a block owned by a full userdata, because a
+** luaL_Buffer must stay on the top of the stack while table traversals
+** push keys and values.
+*/
+typedef struct JSONBuffer {
+  lua_State *L;
+  char *b;
+  size_t n;  /* number of bytes in use */
+  size_t size;  /* size of the block */
+  int vectors;
+  int depth;
+} JSONBuffer;
+
+
+static void freeblock (lua_State *L, JSONBuffer *E) {
+  void *ud;
+  lua_Alloc allocf = lua_getallocf(L, &ud);
+  if (E->b != NULL)
+    allocf(ud, E->b, E->size, 0);
+  E->b = NULL;
+  E->n = E->size = 0;
+}
+
+
+static int jsonbuffer_gc (lua_State *L) {
+  freeblock(L, (JSONBuffer *)luaL_checkudata(L, 1, LUA_JSONBUFFER));
+  return 0;
+}
+
+
+/* make room for 'sz' more bytes and return a pointer to them */
+static char *reservebytes (JSONBuffer *E, size_t sz) {
+  if (l_unlikely(sz > E->size - E->n)) {
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(E->L, &ud);
+    size_t newsize = (E->size > 0) ? E->size : 256;
+    char *b;
+    while (newsize - E->n < sz) {
+      if (newsize > ((size_t)~(size_t)0) / 2)
+        luaL_error(E->L, "text too large");
+      newsize *= 2;
+    }
+    b = (char *)allocf(ud, E->b, E->size, newsize);
+    if (b == NULL)
+      luaL_error(E->L, "not enough memory");
+    E->b = b;
+    E->size = newsize;
+  }
+  E->n += sz;
+  return E->b + E->n - sz;
+}
+
+
+#define addchar(E,c)	(*reservebytes(E, 1) = (c))
+
+static void addlstring (JSONBuffer *E, const char *s, size_t l) {
+  memcpy(reservebytes(E, l), s, l);
+}
+
+
+static void addstring (JSONBuffer *E, const char *s, size_t l) {
+  static const char hex[] = "0123456789abcdef";
+  const char *end = s + l;
+  addchar(E, '"');
+  for (;;) {
+    const char *q = scanplain(s, end);
+    addlstring(E, s, q - s);
+    if (q == end) break;
+    switch (*q) {
+      case '"': addlstring(E, "\\\"", 2); break;
+      case '\\': addlstring(E, "\\\\", 2); break;
+      case '\b': addlstring(E, "\\b", 2); break;
+      case '\f': addlstring(E, "\\f", 2); break;
+      case '\n': addlstring(E, "\\n", 2); break;
+      case '\r': addlstring(E, "\\r", 2); break;
+      case '\t': addlstring(E, "\\t", 2); break;
+      default: {
+        char *p = reservebytes(E, 6);
+        memcpy(p, "\\u00", 4);
+        p[4] = hex[(unsigned char)*q >> 4];
+        p[5] = hex[*q & 0xf];
+        break;
+      }
+    }
+    s = q + 1;
+  }
+  addchar(E, '"');
+}
+
+
+static void addinteger (JSONBuffer *E, lua_Integer i) {
+  char buff[JSON_MAXNUM];
+  char *p = buff + sizeof(buff);
+  lua_Unsigned u = (i < 0) ? 0u - (lua_Unsigned)i : (lua_Unsigned)i;
+  do {
+    *--p = (char)('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (i < 0)
+    *--p = '-';
+  addlstring(E, p, buff + sizeof(buff) - p);
+}
+
+
+/*
+** Add a float that is an integer with at most six decimal digits shifted
+** into its fraction (a common case) without 'sprintf': when the scaled
+** value is an exact integer and dividing it back gives 'n', 'strtod'
+** reads the decimal numeral back as 'n'. Integral values keep a fraction
+** so they are decoded as floats.
+*/
+static int adddecimal (JSONBuffer *E, lua_Number n) {
+  char buff[JSON_MAXNUM];
+  char *p = buff + sizeof(buff);
+  lua_Integer i;
+  lua_Unsigned u;
+  int k = 0;
+  for (k = 0; k <= 6; k++) {
+    lua_Number m = n * tenpow[k];
+    if (l_mathop(fabs)(m) < tenpow[15] && l_mathop(floor)(m) == m
+        && m / tenpow[k] == n && lua_numbertointeger(m, &i))
+      break;
+  }
+  if (k > 6)
+    return 0;
+  u = (i < 0) ? 0u - (lua_Unsigned)i : (lua_Unsigned)i;
+  if (k == 0)
+    *--p = '0';
+  for (; k > 0; k--) {
+    *--p = (char)('0' + u % 10);
+    u /= 10;
+  }
+  *--p = '.';
+  do {
+    *--p = (char)('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (signbit(n))  /* also for -0.0 */
+    *--p = '-';
+  addlstring(E, p, buff + sizeof(buff) - p);
+  return 1;
+}
+
+
+/*
+** Add a float with the fewest digits that convert back to the same
+** value ('single' for values read back as 32-bit floats).
+*/
+static void addfloat (JSONBuffer *E, lua_Number n, int single) {
+  char buff[JSON_MAXNUM];
+  int len;
+  char *p;
+  if (n != n || n - n != 0)
+    luaL_error(E->L, "cannot encode NaN or infinity");
+  if (adddecimal(E, n))
+    return;
+  if (single) {
+    len = l_sprintf(buff, sizeof(buff), "%.7g", (double)n);
+    if ((float)lua_str2number(buff, NULL) != (float)n)
+      len = l_sprintf(buff, sizeof(buff), "%.9g", (double)n);
+  }
+  else {
+    len = l_sprintf(buff, sizeof(buff), "%.15" LUA_NUMBER_FRMLEN "g",
+                    (LUAI_UACNUMBER)n);
+    if (lua_str2number(buff, NULL) != n)
+      len = l_sprintf(buff, sizeof(buff), "%.17" LUA_NUMBER_FRMLEN "g",
+                      (LUAI_UACNUMBER)n);
+  }
+  if ((p = strchr(buff, lua_getlocaledecpoint())) != NULL)
+    *p = '.';  /* JSON always uses a dot */
+  else if (buff[strspn(buff, "-0123456789")] == '\0') {  /* looks like an int? */
+    buff[len++] = '.';
+    buff[len++] = '0';  /* adds '.0' to result */
+  }
+  addlstring(E, buff, len);
+}
+
+
+static void addcomponents (JSONBuffer *E, const lua_VecF *v,
+                           const char *const *fields, int n) {
+  int single = (sizeof(lua_VecF) < sizeof(double));
+  int i;
+  addchar(E, (E->vectors == VEC_OBJECT) ? '{' : '[');
+  for (i = 0; i < n; i++) {
+    if (i > 0)
+      addchar(E, ',');
+    if (E->vectors == VEC_OBJECT) {
+      addstring(E, fields[i], 1);
+      addchar(E, ':');
+    }
+    addfloat(E, (lua_Number)v[i], single);
+  }
+  addchar(E, (E->vectors == VEC_OBJECT) ? '}' : ']');
+}
+
+
+static void jsonvalue (JSONBuffer *E, int idx);
+
+
+/*
+** A table is encoded as an array when its keys are exactly 1..#t (with
+** #t > 0) and as an object otherwise.
+*/
+static int isarray (lua_State *L, int idx, lua_Integer *n) {
+  lua_Integer count = 0;
+  *n = (lua_Integer)lua_rawlen(L, idx);
+  if (*n == 0)
+    return 0;
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    lua_pop(L, 1);
+    if (!lua_isinteger(L, -1) || (lua_Unsigned)lua_tointeger(L, -1) - 1u
+                                 >= (lua_Unsigned)*n) {
+      lua_pop(L, 1);
+      return 0;
+    }
+    count++;
+  }
+  return count == *n;
+}
+
+
+static void jsontable (JSONBuffer *E, int idx) {
+  lua_State *L = E->L;
+  lua_Integer i, n;
+  if (++E->depth > LUAI_MAXJSON)
+    luaL_error(L, "nesting too deep (cyclic table?)");
+  luaL_checkstack(L, 3, "nesting too deep");
+  if (isarray(L, idx, &n)) {
+    addchar(E, '[');
+    for (i = 1; i <= n; i++) {
+      if (i > 1)
+        addchar(E, ',');
+      lua_rawgeti(L, idx, i);
+      jsonvalue(E, lua_gettop(L));
+      lua_pop(L, 1);
+    }
+    addchar(E, ']');
+  }
+  else {
+    int first = 1;
+    addchar(E, '{');
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+      int top = lua_gettop(L);
+      if (!first)
+        addchar(E, ',');
+      first = 0;
+      switch (lua_type(L, top - 1)) {
+        case LUA_TSTRING: {
+          size_t l;
+          const char *s = lua_tolstring(L, top - 1, &l);
+          addstring(E, s, l);
+          break;
+        }
+        case LUA_TNUMBER: {  /* encoded as a string */
+          addchar(E, '"');
+          if (lua_isinteger(L, top - 1))
+            addinteger(E, lua_tointeger(L, top - 1));
+          else
+            addfloat(E, lua_tonumber(L, top - 1), 0);
+          addchar(E, '"');
+          break;
+        }
+        default:
+          luaL_error(L, "cannot encode a table key of type %s",
+                        luaL_typename(L, top - 1));
+      }
+      addchar(E, ':');
+      jsonvalue(E, top);
+      lua_pop(L, 1);
+    }
+    addchar(E, '}');
+  }
+  E->depth--;
+}
+
+
+static void jsonvalue (JSONBuffer *E, int idx) {
+  lua_State *L = E->L;
+  switch (lua_type(L, idx)) {
+    case LUA_TNIL: addlstring(E, "null", 4); break;
+    case LUA_TBOOLEAN: {
+      if (lua_toboolean(L, idx))
+        addlstring(E, "true", 4);
+      else
+        addlstring(E, "false", 5);
+      break;
+    }
+    case LUA_TNUMBER: {
+      if (lua_isinteger(L, idx))
+        addinteger(E, lua_tointeger(L, idx));
+      else
+        addfloat(E, lua_tonumber(L, idx), 0);
+      break;
+    }
+    case LUA_TSTRING: {
+      size_t l;
+      const char *s = lua_tolstring(L, idx, &l);
+      addstring(E, s, l);
+      break;
+    }
+    case LUA_TTABLE: jsontable(E, idx); break;
+    case LUA_TVECTOR: {
+      lua_Float4 f4;
+      switch (lua_tovector(L, idx, &f4)) {
+        case LUA_VVECTOR2: addcomponents(E, f4.raw, vecfields, 2); break;
+        case LUA_VVECTOR3: addcomponents(E, f4.raw, vecfields, 3); break;
+        case LUA_VVECTOR4: addcomponents(E, f4.raw, vecfields, 4); break;
+        default: {  /* quaternion */
+          lua_VecF q[4];
+          lua_checkquat(L, idx, &q[0], &q[1], &q[2], &q[3]);
+          addcomponents(E, q, quatfields, 4);
+          break;
+        }
+      }
+      break;
+    }
+    case LUA_TMATRIX: {  /* array of columns */
+      lua_Mat4 m;
+      int c, cols, rows;
+      lua_tomatrix(L, idx, &m);
+      cols = LUAGLM_MATRIX_COLS(m.dimensions);
+      rows = LUAGLM_MATRIX_ROWS(m.dimensions);
+      addchar(E, '[');
+      for (c = 0; c < cols; c++) {
+        if (c > 0)
+          addchar(E, ',');
+        addcomponents(E, (rows == 2) ? m.m.m2[c]
+                       : (rows == 3) ? m.m.m3[c] : m.m.m4[c], vecfields, rows);
+      }
+      addchar(E, ']');
+      break;
+    }
+    case LUA_TLIGHTUSERDATA: {
+      if (isnull(L, idx)) {
+        addlstring(E, "null", 4);
+        break;
+      }
+    }  /* FALLTHROUGH */
+    default:
+      luaL_error(L, "cannot encode a %s value", luaL_typename(L, idx));
+  }
+}
+
+
+static int json_encode (lua_State *L) {
+  JSONBuffer *E;
+  int vectors;
+  luaL_checkany(L, 1);
+  vectors = vecoption(L, 2, VEC_ARRAY);
+  luaL_argcheck(L, vectors != VEC_NONE, 2, "vectors must be encoded");
+  lua_settop(L, 2);
+  E = (JSONBuffer *)lua_newuserdatauv(L, sizeof(JSONBuffer), 0);
+  memset(E, 0, sizeof(JSONBuffer));
+  E->L = L;
+  E->vectors = vectors;
+  luaL_setmetatable(L, LUA_JSONBUFFER);
+  jsonvalue(E, 1);
+  lua_pushlstring(L, E->b, E->n);
+  freeblock(L, E);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+static const luaL_Reg json_funcs[] = {
+  {"encode", json_encode},
+  {"decode", json_decode},
+  /* placeholders */
+  {"null", NULL},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_json (lua_State *L) {
+  luaL_newlib(L, json_funcs);
+  lua_pushlightuserdata(L, NULL);
+  lua_setfield(L, -2, "null");
+  if (luaL_newmetatable(L, LUA_JSONBUFFER)) {
+    lua_pushcfunction(L, jsonbuffer_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_pop(L, 1);
+  return 1;
+}
+
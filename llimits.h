@@ -247,6 +247,13 @@ typedef l_uint32 Instruction;
 ** macros that are executed whenever program enters the Lua core
 ** ('lua_lock') and leaves the core ('lua_unlock')
 */
+#if defined(LUA_USE_LOCK) && !defined(lua_lock)
+#define lua_lock(L)	luaE_lock(L)
+#define lua_unlock(L)	luaE_unlock(L)
+#define luai_threadyield(L)	luaE_threadyield(L)
+#define LUAI_STATELOCK
+#endif
+
 #if !defined(lua_lock)
 #define lua_lock(L)	((void) 0)
 #define lua_unlock(L)	((void) 0)
@@ -132,6 +132,11 @@ l_noret luaM_toobig (lua_State *L) {
 void luaM_free_ (lua_State *L, void *block, size_t osize) {
   global_State *g = G(L);
   lua_assert((osize == 0) == (block == NULL));
+#if defined(LUA_USE_ASYNCFREE)
+  if (g->gcdeferfree && block != NULL)
+    luaC_deferfree(g, block, osize);
+  else
+#endif
   (*g->frealloc)(g->ud, block, osize, 0);
   g->GCdebt -= osize;
 }
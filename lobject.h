@@ -573,6 +573,11 @@ typedef struct Proto {
   LocVar *locvars;  /* information about local variables (debug information) */
   TString  *source;  /* used for debug information */
   GCObject *gclist;
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  TString *lazychunk;  /* undecoded dump of this function (NULL if loaded) */
+  size_t lazyoff;  /* offset of the dump in 'lazychunk' */
+  size_t lazylen;  /* length of the dump */
+#endif
 } Proto;
 
 /* }================================================================== */
@@ -743,6 +748,9 @@ typedef struct Table {
 #endif
   lu_byte lsizenode;  /* log2 of size of 'node' array */
   unsigned int alimit;  /* "limit" of 'array' array */
+#if defined(LUAGLM_EXT_TABLEHINT)
+  unsigned int asizehint;  /* minimum size of the array part on rehash */
+#endif
   TValue *array;  /* array part */
   Node *node;
   Node *lastfree;  /* any free position is before this position */
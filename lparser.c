@@ -767,6 +767,11 @@ static void open_func (LexState *ls, FuncState *fs, BlockCnt *bl) {
   fs->firstlocal = ls->dyd->actvar.n;
   fs->firstlabel = ls->dyd->label.n;
   fs->bl = NULL;
+#if defined(LUAGLM_EXT_VECCONST)
+  fs->kcache = luaH_new(ls->L);  /* create table for function */
+  sethvalue2s(ls->L, ls->L->top, fs->kcache);  /* anchor it */
+  luaD_inctop(ls->L);
+#endif
   f->source = ls->source;
   luaC_objbarrier(ls->L, f, f->source);
   f->maxstacksize = 2;  /* registers 0/1 are always valid */
@@ -791,6 +796,9 @@ static void close_func (LexState *ls) {
   luaM_shrinkvector(L, f->locvars, f->sizelocvars, fs->ndebugvars, LocVar);
   luaM_shrinkvector(L, f->upvalues, f->sizeupvalues, fs->nups, Upvaldesc);
   ls->fs = fs->prev;
+#if defined(LUAGLM_EXT_VECCONST)
+  L->top--;  /* pop kcache table */
+#endif
   luaC_checkGC(L);
 }
 
@@ -1124,10 +1132,188 @@ static int explist (LexState *ls, expdesc *v) {
 }
 
 
+/*
+** Code the call of function 'f' with arguments 'args'.
+*/
+static void codecall (FuncState *fs, expdesc *f, expdesc *args, int line) {
+  int base, nparams;
+  lua_assert(f->k == VNONRELOC);
+  base = f->u.info;  /* base register for call */
+  if (hasmultret(args->k))
+    nparams = LUA_MULTRET;  /* open call */
+  else {
+    if (args->k != VVOID)
+      luaK_exp2nextreg(fs, args);  /* close last argument */
+    nparams = fs->freereg - (base+1);
+  }
+  init_exp(f, VCALL, luaK_codeABC(fs, OP_CALL, base, nparams+1, 2));
+  luaK_fixline(fs, line);
+  fs->freereg = base+1;  /* call remove function and arguments and leaves
+                            (unless changed) one result */
+}
+
+
+#if defined(LUAGLM_EXT_VECCONST)
+/*
+** {======================================================================
+** Vector constructors: calls to the base library vector constructors
+** whose arguments are all numeric constants are replaced by the vector
+** they would create.
+** =======================================================================
+*/
+
+/* kinds of vector constructors */
+#define VECC_NONE	0
+#define VECC_VEC	1  /* vec(x, y, ...): dimensions from arguments */
+#define VECC_VEC2	2
+#define VECC_VEC3	3
+#define VECC_VEC4	4
+#define VECC_QUAT	5
+
+static const struct {
+  const char *name;
+  int kind;
+} vecconstructors[] = {
+  {"vec", VECC_VEC}, {"vector", VECC_VEC},
+  {"vec2", VECC_VEC2}, {"vector2", VECC_VEC2},
+  {"vec3", VECC_VEC3}, {"vector3", VECC_VEC3},
+  {"vec4", VECC_VEC4}, {"vector4", VECC_VEC4},
+  {"qua", VECC_QUAT}, {"quat", VECC_QUAT},
+  {NULL, VECC_NONE}
+};
+
+
+/*
+** Return the kind of vector constructor the (unloaded) variable 'v'
+** names: a global, i.e., a field of the '_ENV' upvalue of the main
+** function, named after a base library constructor. Any '_ENV'
+** declared as a local shadows it.
+*/
+static int vecconstructor (LexState *ls, const expdesc *v) {
+  FuncState *fs = ls->fs;
+  const TValue *name;
+  int i, idx;
+  if (v->k != VINDEXUP)
+    return VECC_NONE;
+  idx = v->u.ind.t;
+  if (!eqshrstr(fs->f->upvalues[idx].name, ls->envn))
+    return VECC_NONE;
+  for (; fs->prev != NULL; fs = fs->prev) {  /* find where it comes from */
+    if (fs->f->upvalues[idx].instack)  /* a local '_ENV'? */
+      return VECC_NONE;
+    idx = fs->f->upvalues[idx].idx;
+  }
+  if (idx != 0)  /* not the '_ENV' of the main function? */
+    return VECC_NONE;
+  name = &ls->fs->f->k[v->u.ind.idx];
+  if (!ttisshrstring(name))
+    return VECC_NONE;
+  for (i = 0; vecconstructors[i].name != NULL; i++) {
+    if (strcmp(getstr(tsvalue(name)), vecconstructors[i].name) == 0)
+      return vecconstructors[i].kind;
+  }
+  return VECC_NONE;
+}
+
+
+/*
+** Create, in 'e', the result of the constructor 'kind' called with the
+** 'n' numbers 'args'. Return 1 iff the call has a constant result.
+*/
+static int vecconstant (expdesc *e, int kind, const TValue *args, int n) {
+  lua_VecF c[4];
+  lua_Float4 v = f4_zero();
+  int i, tt;
+  for (i = 0; i < n; i++)  /* convert arguments as the constructors do */
+    c[i] = ttisinteger(&args[i]) ? cast(lua_VecF, ivalue(&args[i]))
+                                 : cast(lua_VecF, fltvalue(&args[i]));
+  switch (kind) {
+    case VECC_VEC: {  /* vec(x, y [, z [, w]]) */
+      if (n < 2)
+        return 0;
+      tt = glm_variant(cast(grit_length_t, n));
+      for (i = 0; i < n; i++) v.raw[i] = c[i];
+      break;
+    }
+    case VECC_VEC2: case VECC_VEC3: case VECC_VEC4: {
+      tt = glm_variant(cast(grit_length_t, kind));
+      if (n == 1) {  /* vecN(s) */
+        for (i = 0; i < kind; i++) v.raw[i] = c[0];
+      }
+      else if (n == kind) {  /* vecN(x, y, ...) */
+        for (i = 0; i < n; i++) v.raw[i] = c[i];
+      }
+      else if (n != 0)  /* not vecN()? */
+        return 0;
+      break;
+    }
+    case VECC_QUAT: {
+      tt = LUA_VQUAT;
+      if (n == 0)  /* quat(): identity */
+        c[0] = 1, c[1] = c[2] = c[3] = 0;
+      else if (n != 4)  /* not quat(w, x, y, z)? */
+        return 0;
+#if LUAGLM_QUAT_WXYZ
+      for (i = 0; i < 4; i++) v.raw[i] = c[i];
+#else
+      for (i = 0; i < 4; i++) v.raw[i] = c[(i + 1) % 4];
+#endif
+      break;
+    }
+    default: return 0;
+  }
+  return luaK_vector(e, &v, tt);
+}
+
+
+/*
+** Parse the arguments of a call to vector constructor 'kind' (already
+** in a register, coded after 'pc' and constant 'nk'); arguments are only
+** parsed as usual, with their values recorded when numeric constants.
+** When the call can be folded, its code is discarded.
+*/
+static void vecargs (LexState *ls, expdesc *f, int kind, int pc, int nk,
+                                                         int line) {
+  FuncState *fs = ls->fs;
+  TValue args[4];
+  expdesc e;
+  int n = 0, isk = 1;
+  luaX_next(ls);  /* skip '(' */
+  if (ls->t.token == ')')  /* arg list is empty? */
+    e.k = VVOID;
+  else {
+    for (;;) {
+      expr(ls, &e);
+      if (n < 4)
+        isk = isk && luaK_exp2const(fs, &e, &args[n]) && ttisnumber(&args[n]);
+      n++;
+      if (!testnext(ls, ','))
+        break;
+      luaK_exp2nextreg(fs, &e);
+    }
+    if (hasmultret(e.k))
+      luaK_setmultret(fs, &e);
+  }
+  check_match(ls, ')', '(', line);
+  if (isk && n <= 4) {
+    expdesc v;
+    if (vecconstant(&v, kind, args, n)) {
+      luaK_discard(fs, pc, nk);  /* remove the call */
+      fs->freereg = f->u.info;
+      *f = v;
+      return;
+    }
+  }
+  codecall(fs, f, &e, line);
+}
+
+/* }====================================================================== */
+#endif
+
+
 static void funcargs (LexState *ls, expdesc *f, int line) {
   FuncState *fs = ls->fs;
   expdesc args;
-  int base, nparams;
   switch (ls->t.token) {
     case '(': {  /* funcargs -> '(' [ explist ] ')' */
       luaX_next(ls);
@@ -1161,19 +1347,7 @@ static void funcargs (LexState *ls, expdesc *f, int line) {
       luaX_syntaxerror(ls, "function arguments expected");
     }
   }
-  lua_assert(f->k == VNONRELOC);
-  base = f->u.info;  /* base register for call */
-  if (hasmultret(args.k))
-    nparams = LUA_MULTRET;  /* open call */
-  else {
-    if (args.k != VVOID)
-      luaK_exp2nextreg(fs, &args);  /* close last argument */
-    nparams = fs->freereg - (base+1);
-  }
-  init_exp(f, VCALL, luaK_codeABC(fs, OP_CALL, base, nparams+1, 2));
-  luaK_fixline(fs, line);
-  fs->freereg = base+1;  /* call remove function and arguments and leaves
-                            (unless changed) one result */
+  codecall(fs, f, &args, line);
 }
 
 
@@ -1263,6 +1437,9 @@ static void suffixedexp (LexState *ls, expdesc *v) {
        primaryexp { '.' NAME | '[' exp ']' | ':' NAME funcargs | funcargs } */
   FuncState *fs = ls->fs;
   int line = ls->linenumber;
+#if defined(LUAGLM_EXT_VECCONST)
+  int nk = fs->nk;  /* constants before a (possible) vector constructor */
+#endif
   primaryexp(ls, v);
   for (;;) {
     switch (ls->t.token) {
@@ -1295,6 +1472,15 @@ static void suffixedexp (LexState *ls, expdesc *v) {
       case TK_HASH:
 #endif
       case '(': case TK_STRING: case '{': {  /* funcargs */
+#if defined(LUAGLM_EXT_VECCONST)
+        int kind = (ls->t.token == '(') ? vecconstructor(ls, v) : VECC_NONE;
+        if (kind != VECC_NONE) {
+          int pc = fs->pc;
+          luaK_exp2nextreg(fs, v);
+          vecargs(ls, v, kind, pc, nk, line);
+          break;
+        }
+#endif
         luaK_exp2nextreg(fs, v);
         funcargs(ls, v, line);
         break;
@@ -2202,6 +2388,10 @@ static void exprstat (LexState *ls) {
 #endif
   else {  /* stat -> func */
     Instruction *inst;
+#if defined(LUAGLM_EXT_VECCONST)
+    if (v.v.k == VKVEC)  /* folded vector constructor? */
+      return;  /* nothing to do */
+#endif
     check_condition(ls, v.v.k == VCALL, "syntax error");
     inst = &getinstruction(fs, &v.v);
     SETARG_C(*inst, 1);  /* call statement uses no results */
@@ -33,6 +33,9 @@ typedef enum {
   VKINT,  /* integer constant; ival = numerical integer value */
   VKSTR,  /* string constant; strval = TString address;
              (string is fixed by the lexer) */
+#if defined(LUAGLM_EXT_VECCONST)
+  VKVEC,  /* vector constant; kvec.v = value, kvec.tt = vector variant */
+#endif
   VNONRELOC,  /* expression has its value in a fixed register;
                  info = result register */
   VLOCAL,  /* local variable; var.ridx = register index;
@@ -71,6 +74,12 @@ typedef struct expdesc {
     lua_Integer ival;    /* for VKINT */
     lua_Number nval;  /* for VKFLT */
     TString *strval;  /* for VKSTR */
+#if defined(LUAGLM_EXT_VECCONST)
+    struct {  /* for VKVEC */
+      lua_Float4 v;
+      lu_byte tt;
+    } kvec;
+#endif
     int info;  /* for generic use */
     struct {  /* for indexed variables */
       short idx;  /* index (R or "long" K) */
@@ -146,6 +155,9 @@ typedef struct FuncState {
   struct FuncState *prev;  /* enclosing function */
   struct LexState *ls;  /* lexical state */
   struct BlockCnt *bl;  /* chain of current blocks */
+#if defined(LUAGLM_EXT_VECCONST)
+  Table *kcache;  /* cache for reusing constants (see 'addk') */
+#endif
   int pc;  /* next position to code (equivalent to 'ncode') */
   int lasttarget;   /* 'label' of last 'jump label' */
   int previousline;  /* last line that was saved in 'lineinfo' */
@@ -0,0 +1,854 @@
+/*
+** $Id: lserializelib.c $
+** Binary serialization of Lua values
+** See Copyright Notice in lua.h
+*/
+
+#define lserializelib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <limits.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+#include "lgritlib.h"
+
+
+/*
+** Format: a version byte followed by one tagged value. Integers are
+** zigzag-encoded LEB128 varints (non-negative integers smaller than
+** SER_NSMALL are folded into the tag byte); floats are little-endian
+** IEEE doubles; vector and matrix components are little-endian floats
+** or doubles, as given by the width of 'lua_VecF' on the encoding side.
+** Tables are numbered in the order they are first reached, and so are
+** strings at least SER_MINREF bytes long; later occurrences of the same
+** table or string are written as a reference to that number, preserving
+** shared and cyclic structures. Metatables are not serialized. Neither
+** side recurses in C: the nesting of tables is bounded only by memory
+** when encoding and by the size of the Lua stack when decoding.
+*/
+#define SER_VERSION	1
+
+/* value tags */
+#define T_NIL		0
+#define T_FALSE		1
+#define T_TRUE		2
+#define T_INT		3
+#define T_FLT		4
+#define T_STR		5
+#define T_TABLE		6
+#define T_REF		7
+#define T_VECTOR	8
+#define T_MATRIX	9
+#define T_SMALL		64  /* first tag of small integers */
+
+#define SER_NSMALL	(256 - T_SMALL)
+
+/* minimum length of strings that are referenced when repeated */
+#define SER_MINREF	3
+
+/* number of entries of the cache of recently written strings */
+#define SER_NCACHE	64
+
+/* flag for vectors and matrices with double-precision components */
+#define SER_WIDE	0x80
+
+/* quaternion "dimension" of a vector tag */
+#define SER_QUAT	5
+
+#define LUA_SERIALWRITER	"serialize.writer"
+
+
+static const union {
+  int dummy;
+  char little;  /* true iff machine is little endian */
+} serendian = {1};
+
+
+/* copy 'sz' bytes from 'src' to 'dst' in little-endian order */
+static void copyle (char *dst, const char *src, int sz) {
+  if (serendian.little)
+    memcpy(dst, src, sz);
+  else {
+    int i;
+    for (i = 0; i < sz; i++)
+      dst[i] = src[sz - 1 - i];
+  }
+}
+
+
+/* pointer to column 'c' of a matrix with 'rows' rows */
+static lua_VecF *sercolumn (lua_Mat4 *m, int c, int rows) {
+  switch (rows) {
+    case 2: return m->m.m2[c];
+    case 3: return m->m.m3[c];
+    default: return m->m.m4[c];
+  }
+}
+
+
+/*
+** {======================================================
+** Writer
+** =======================================================
+*/
+
+/*
+** Values are encoded into a block owned by a full userdata: a luaL_Buffer
+** keeps its box on the top of the stack, which rules it out while the
+** encoder pushes the contents of nested tables.
+*/
+typedef struct Writer {
+  char *b;  /* encoded bytes */
+  size_t n;  /* number of bytes in use */
+  size_t size;  /* size of the block */
+  lua_Integer count;  /* number of values written */
+} Writer;
+
+
+/*
+** Strings anchored in 'memo' keep their addresses during an encoding, so
+** the numbers of recently written strings (mostly repeated keys) are
+** cached by address, skipping the lookup in 'memo'.
+*/
+typedef struct StrCache {
+  const char *s;
+  lua_Integer id;
+} StrCache;
+
+
+/*
+** Values still to be written are kept in a work list (a table used as a
+** stack, holding the list itself in place of nil): the elements of a
+** table are added in reverse order, so they are written in order.
+*/
+typedef struct SerEncoder {
+  lua_State *L;
+  Writer *W;
+  int memo;  /* index of a table mapping tables and strings to numbers */
+  lua_Integer nrefs;  /* number of tables and strings numbered so far */
+  int work;  /* index of the work list */
+  lua_Integer nwork;  /* number of values in the work list */
+  StrCache cache[SER_NCACHE];
+} SerEncoder;
+
+
+#define checkwriter(L,i)	((Writer *)luaL_checkudata(L, i, LUA_SERIALWRITER))
+
+
+static void freewriter (lua_State *L, Writer *W) {
+  void *ud;
+  lua_Alloc allocf = lua_getallocf(L, &ud);
+  if (W->b != NULL)
+    allocf(ud, W->b, W->size, 0);
+  W->b = NULL;
+  W->n = W->size = 0;
+}
+
+
+static Writer *newwriter (lua_State *L) {
+  Writer *W = (Writer *)lua_newuserdatauv(L, sizeof(Writer), 0);
+  memset(W, 0, sizeof(Writer));
+  luaL_setmetatable(L, LUA_SERIALWRITER);
+  return W;
+}
+
+
+/* make room for 'sz' more bytes and return a pointer to them */
+static char *ser_reserve (lua_State *L, Writer *W, size_t sz) {
+  if (l_unlikely(sz > W->size - W->n)) {
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    size_t newsize = (W->size > 0) ? W->size : 128;
+    char *b;
+    while (newsize - W->n < sz) {
+      if (newsize > ((size_t)~(size_t)0) / 2)
+        luaL_error(L, "serialized data too large");
+      newsize *= 2;
+    }
+    b = (char *)allocf(ud, W->b, W->size, newsize);
+    if (b == NULL)
+      luaL_error(L, "not enough memory");
+    W->b = b;
+    W->size = newsize;
+  }
+  W->n += sz;
+  return W->b + W->n - sz;
+}
+
+
+static void putbyte (SerEncoder *E, int c) {
+  *ser_reserve(E->L, E->W, 1) = (char)c;
+}
+
+
+static void putvarint (SerEncoder *E, lua_Unsigned v) {
+  char buff[(sizeof(lua_Unsigned) * CHAR_BIT + 6) / 7];
+  int n = 0;
+  do {
+    buff[n++] = (char)((v & 0x7f) | (v > 0x7f ? 0x80 : 0));
+    v >>= 7;
+  } while (v != 0);
+  memcpy(ser_reserve(E->L, E->W, n), buff, n);
+}
+
+
+static void putdouble (SerEncoder *E, double d) {
+  copyle(ser_reserve(E->L, E->W, sizeof(double)), (const char *)&d,
+                                              sizeof(double));
+}
+
+
+static void putcomponents (SerEncoder *E, const lua_VecF *v, int n) {
+  char *p = ser_reserve(E->L, E->W, n * sizeof(lua_VecF));
+  int i;
+  for (i = 0; i < n; i++)
+    copyle(p + i * sizeof(lua_VecF), (const char *)&v[i], sizeof(lua_VecF));
+}
+
+
+/*
+** Return the number of the table or string at 'idx' if it was already
+** written; otherwise number it and return zero.
+*/
+static lua_Integer checkref (SerEncoder *E, int idx) {
+  lua_State *L = E->L;
+  lua_Integer id = 0;
+  lua_pushvalue(L, idx);
+  if (lua_rawget(L, E->memo) == LUA_TNUMBER)
+    id = lua_tointeger(L, -1);
+  else {
+    lua_pushvalue(L, idx);
+    lua_pushinteger(L, ++E->nrefs);
+    lua_rawset(L, E->memo);
+  }
+  lua_pop(L, 1);
+  return id;
+}
+
+
+static void putref (SerEncoder *E, lua_Integer id) {
+  putbyte(E, T_REF);
+  putvarint(E, (lua_Unsigned)id);
+}
+
+
+/* move the value on the top to the work list */
+static void pushwork (SerEncoder *E) {
+  lua_State *L = E->L;
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    lua_pushvalue(L, E->work);  /* stands for nil */
+  }
+  lua_rawseti(L, E->work, ++E->nwork);
+}
+
+
+/*
+** Write the header of the table at 'idx' (or a reference to it) and add
+** its elements to the work list: the array part '1 .. n' followed by
+** the other pairs, whose number is only known after traversing it.
+*/
+static void ser_encodetable (SerEncoder *E, int idx) {
+  lua_State *L = E->L;
+  lua_Integer i, n, lo, hi;
+  lua_Unsigned nhash = 0;
+  luaL_checkstack(L, 5, "too many nested values");  /* 'checkref' */
+  i = checkref(E, idx);
+  if (i > 0) {
+    putref(E, i);
+    return;
+  }
+  n = (lua_Integer)lua_rawlen(L, idx);
+  putbyte(E, T_TABLE);
+  putvarint(E, (lua_Unsigned)n);
+  lo = E->nwork + 1;
+  for (i = 1; i <= n; i++) {
+    lua_rawgeti(L, idx, i);
+    pushwork(E);
+  }
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    if (!(lua_isinteger(L, -2) && (lua_Unsigned)lua_tointeger(L, -2) - 1u
+                                  < (lua_Unsigned)n)) {
+      if (l_unlikely(++nhash > 0xffffffffu))
+        luaL_error(L, "table too large to serialize");
+      lua_pushvalue(L, -2);
+      pushwork(E);  /* key */
+      pushwork(E);  /* value */
+    }
+    else
+      lua_pop(L, 1);
+  }
+  for (i = 0; i < 4; i++)
+    putbyte(E, (int)((nhash >> (8 * i)) & 0xff));
+  for (hi = E->nwork; lo < hi; lo++, hi--) {  /* reverse the elements */
+    lua_rawgeti(L, E->work, lo);
+    lua_rawgeti(L, E->work, hi);
+    lua_rawseti(L, E->work, lo);
+    lua_rawseti(L, E->work, hi);
+  }
+}
+
+
+static void encodevector (SerEncoder *E, int idx) {
+  lua_Float4 f4;
+  int variant = lua_tovector(E->L, idx, &f4);
+  int dims;
+  switch (variant) {
+    case LUA_VVECTOR2: dims = 2; break;
+    case LUA_VVECTOR3: dims = 3; break;
+    case LUA_VVECTOR4: dims = 4; break;
+    default: {  /* quaternion: components in (w, x, y, z) order */
+      lua_VecF q[4];
+      lua_checkquat(E->L, idx, &q[0], &q[1], &q[2], &q[3]);
+      putbyte(E, T_VECTOR);
+      putbyte(E, (sizeof(lua_VecF) == sizeof(double) ? SER_WIDE : 0)
+                 | SER_QUAT);
+      putcomponents(E, q, 4);
+      return;
+    }
+  }
+  putbyte(E, T_VECTOR);
+  putbyte(E, (sizeof(lua_VecF) == sizeof(double) ? SER_WIDE : 0) | dims);
+  putcomponents(E, f4.raw, dims);
+}
+
+
+static void encodematrix (SerEncoder *E, int idx) {
+  lua_Mat4 m;
+  int c, cols, rows;
+  lua_tomatrix(E->L, idx, &m);
+  cols = LUAGLM_MATRIX_COLS(m.dimensions);
+  rows = LUAGLM_MATRIX_ROWS(m.dimensions);
+  putbyte(E, T_MATRIX);
+  putbyte(E, (sizeof(lua_VecF) == sizeof(double) ? SER_WIDE : 0)
+             | (cols << 3) | rows);
+  for (c = 0; c < cols; c++)
+    putcomponents(E, sercolumn(&m, c, rows), rows);
+}
+
+
+/* write the value at 'idx'; tables only get their header */
+static void ser_encodevalue (SerEncoder *E, int idx) {
+  lua_State *L = E->L;
+  switch (lua_type(L, idx)) {
+    case LUA_TNIL: putbyte(E, T_NIL); break;
+    case LUA_TBOOLEAN:
+      putbyte(E, lua_toboolean(L, idx) ? T_TRUE : T_FALSE);
+      break;
+    case LUA_TNUMBER: {
+      if (lua_isinteger(L, idx)) {
+        lua_Integer i = lua_tointeger(L, idx);
+        if (0 <= i && i < SER_NSMALL)
+          putbyte(E, T_SMALL + (int)i);
+        else {  /* zigzag: small magnitudes give short varints */
+          lua_Unsigned u = (lua_Unsigned)i;
+          putbyte(E, T_INT);
+          putvarint(E, (u << 1) ^ (i < 0 ? ~(lua_Unsigned)0 : 0));
+        }
+      }
+      else {
+        putbyte(E, T_FLT);
+        putdouble(E, (double)lua_tonumber(L, idx));
+      }
+      break;
+    }
+    case LUA_TSTRING: {
+      size_t len;
+      const char *s = lua_tolstring(L, idx, &len);
+      lua_Integer id = 0;
+      if (len >= SER_MINREF) {
+        StrCache *c = &E->cache[((size_t)s >> 3) % SER_NCACHE];
+        if (c->s == s)
+          id = c->id;
+        else {
+          id = checkref(E, idx);
+          c->s = s;
+          c->id = (id > 0) ? id : E->nrefs;
+        }
+      }
+      if (id > 0)
+        putref(E, id);
+      else {
+        putbyte(E, T_STR);
+        putvarint(E, (lua_Unsigned)len);
+        memcpy(ser_reserve(L, E->W, len), s, len);
+      }
+      break;
+    }
+    case LUA_TTABLE: ser_encodetable(E, idx); break;
+    case LUA_TVECTOR: encodevector(E, idx); break;
+    case LUA_TMATRIX: encodematrix(E, idx); break;
+    default:
+      luaL_error(L, "cannot serialize a %s value", luaL_typename(L, idx));
+  }
+}
+
+
+/* append the value at 'idx' to 'W' */
+static void writevalue (lua_State *L, Writer *W, int idx) {
+  SerEncoder E;
+  idx = lua_absindex(L, idx);
+  E.L = L;
+  E.W = W;
+  E.nrefs = 0;
+  E.nwork = 0;
+  memset(E.cache, 0, sizeof(E.cache));
+  lua_newtable(L);
+  E.memo = lua_gettop(L);
+  lua_newtable(L);
+  E.work = lua_gettop(L);
+  putbyte(&E, SER_VERSION);
+  lua_pushvalue(L, idx);
+  pushwork(&E);
+  while (E.nwork > 0) {
+    lua_rawgeti(L, E.work, E.nwork--);
+    if (lua_rawequal(L, -1, E.work))
+      putbyte(&E, T_NIL);
+    else
+      ser_encodevalue(&E, lua_gettop(L));
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 2);  /* memo and work list */
+  W->count++;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Reader
+** =======================================================
+*/
+
+typedef struct SerDecoder {
+  lua_State *L;
+  const char *p;  /* next byte; the source is read in place */
+  const char *end;
+  int refs;  /* index of the array of numbered tables and strings */
+  lua_Integer nrefs;
+  lua_Unsigned narr, nhash;  /* sizes of the last table read */
+} SerDecoder;
+
+
+static int malformed (SerDecoder *D) {
+  return luaL_error(D->L, "malformed serialized data");
+}
+
+
+#define need(D,sz)	\
+  { if (l_unlikely((size_t)((D)->end - (D)->p) < (size_t)(sz))) malformed(D); }
+
+
+static int getbyte (SerDecoder *D) {
+  need(D, 1);
+  return (unsigned char)*D->p++;
+}
+
+
+static lua_Unsigned getvarint (SerDecoder *D) {
+  lua_Unsigned v = 0;
+  int shift = 0;
+  int c;
+  do {
+    if (l_unlikely(shift >= (int)(sizeof(lua_Unsigned) * CHAR_BIT)))
+      malformed(D);
+    c = getbyte(D);
+    v |= (lua_Unsigned)(c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return v;
+}
+
+
+static double getdouble (SerDecoder *D) {
+  double d;
+  need(D, sizeof(double));
+  copyle((char *)&d, D->p, sizeof(double));
+  D->p += sizeof(double);
+  return d;
+}
+
+
+/* read 'n' components of a vector or matrix with the given width */
+static void getcomponents (SerDecoder *D, lua_VecF *v, int n, int wide) {
+  int i;
+  need(D, (size_t)n * (wide ? sizeof(double) : sizeof(float)));
+  for (i = 0; i < n; i++) {
+    if (wide) {
+      double d;
+      copyle((char *)&d, D->p, sizeof(double));
+      D->p += sizeof(double);
+      v[i] = (lua_VecF)d;
+    }
+    else {
+      float f;
+      copyle((char *)&f, D->p, sizeof(float));
+      D->p += sizeof(float);
+      v[i] = (lua_VecF)f;
+    }
+  }
+}
+
+
+/* number the value on the top of the stack */
+static void addref (SerDecoder *D) {
+  lua_pushvalue(D->L, -1);
+  lua_rawseti(D->L, D->refs, ++D->nrefs);
+}
+
+
+/* remaining bytes, bounding the sizes given by the data */
+#define remaining(D)	((lua_Unsigned)((D)->end - (D)->p))
+
+
+/* read the header of a table and push the table, still empty */
+static void ser_decodetable (SerDecoder *D) {
+  lua_State *L = D->L;
+  lua_Unsigned narr = getvarint(D), nhash = 0;
+  int i;
+  need(D, 4);
+  for (i = 0; i < 4; i++)
+    nhash |= (lua_Unsigned)(unsigned char)D->p[i] << (8 * i);
+  D->p += 4;
+  /* every element takes at least one byte and every pair two */
+  if (l_unlikely(narr > remaining(D) || nhash > remaining(D) / 2
+                 || narr > (lua_Unsigned)INT_MAX
+                 || nhash > (lua_Unsigned)INT_MAX))
+    malformed(D);
+  lua_createtable(L, (int)narr, (int)nhash);
+  addref(D);
+  D->narr = narr;
+  D->nhash = nhash;
+}
+
+
+/*
+** Read a value and push it; return whether it is a table whose
+** contents are still to be read.
+*/
+static int ser_decodevalue (SerDecoder *D) {
+  lua_State *L = D->L;
+  int tag = getbyte(D);
+  if (tag >= T_SMALL) {
+    lua_pushinteger(L, tag - T_SMALL);
+    return 0;
+  }
+  switch (tag) {
+    case T_NIL: lua_pushnil(L); break;
+    case T_FALSE: lua_pushboolean(L, 0); break;
+    case T_TRUE: lua_pushboolean(L, 1); break;
+    case T_INT: {
+      lua_Unsigned u = getvarint(D);
+      lua_pushinteger(L, (lua_Integer)((u >> 1) ^ (0 - (u & 1))));
+      break;
+    }
+    case T_FLT: lua_pushnumber(L, (lua_Number)getdouble(D)); break;
+    case T_STR: {
+      lua_Unsigned len = getvarint(D);
+      if (l_unlikely(len > remaining(D)))
+        malformed(D);
+      lua_pushlstring(L, D->p, (size_t)len);
+      D->p += len;
+      if (len >= SER_MINREF)
+        addref(D);
+      break;
+    }
+    case T_TABLE: ser_decodetable(D); return 1;
+    case T_REF: {
+      lua_Unsigned id = getvarint(D);
+      if (l_unlikely(id - 1u >= (lua_Unsigned)D->nrefs))
+        malformed(D);
+      lua_rawgeti(L, D->refs, (lua_Integer)id);
+      break;
+    }
+    case T_VECTOR: {
+      int fmt = getbyte(D);
+      int dims = fmt & ~SER_WIDE;
+      lua_Float4 f4;
+      if (dims == SER_QUAT) {
+        lua_VecF q[4];
+        getcomponents(D, q, 4, fmt & SER_WIDE);
+        lua_pushquat(L, q[0], q[1], q[2], q[3]);
+        break;
+      }
+      if (l_unlikely(dims < 2 || dims > 4))
+        malformed(D);
+      memset(&f4, 0, sizeof(f4));
+      getcomponents(D, f4.raw, dims, fmt & SER_WIDE);
+      lua_pushvector(L, f4, dims == 2 ? LUA_VVECTOR2
+                          : dims == 3 ? LUA_VVECTOR3 : LUA_VVECTOR4);
+      break;
+    }
+    case T_MATRIX: {
+      int fmt = getbyte(D);
+      int cols = (fmt >> 3) & 0x7, rows = fmt & 0x7;
+      int c;
+      lua_Mat4 m;
+      if (l_unlikely(cols < 2 || cols > 4 || rows < 2 || rows > 4))
+        malformed(D);
+      memset(&m, 0, sizeof(m));
+      m.dimensions = LUAGLM_MATRIX_TYPE(cols, rows);
+      for (c = 0; c < cols; c++)
+        getcomponents(D, sercolumn(&m, c, rows), rows, fmt & SER_WIDE);
+      lua_pushmatrix(L, &m);
+      break;
+    }
+    default: malformed(D);
+  }
+  return 0;
+}
+
+
+/*
+** Tables being filled are kept on the Lua stack, as frames of FRAMESIZE
+** values: the table, the index of its next array element, the size of
+** its array part, the number of pairs left, and the key of the pair
+** whose value is read next (nil before the key is read).
+*/
+#define FRAMESIZE	5
+
+
+/* push the frame of the table just read, on the top of the stack */
+static void pushframe (SerDecoder *D) {
+  lua_State *L = D->L;
+  luaL_checkstack(L, FRAMESIZE + 3, "serialized data too deep");
+  lua_pushinteger(L, 1);
+  lua_pushinteger(L, (lua_Integer)D->narr);
+  lua_pushinteger(L, (lua_Integer)D->nhash);
+  lua_pushnil(L);
+}
+
+
+/* read a value and push it, with the contents of all its tables */
+static void readvalue (SerDecoder *D) {
+  lua_State *L = D->L;
+  int base = lua_gettop(L) + 1;  /* the value */
+  if (!ser_decodevalue(D))
+    return;
+  lua_pushvalue(L, -1);
+  pushframe(D);
+  while (lua_gettop(L) > base) {
+    int t = lua_gettop(L) - FRAMESIZE + 1;  /* table being filled */
+    lua_Integer i = lua_tointeger(L, t + 1);
+    int opened;
+    if (i <= lua_tointeger(L, t + 2)) {  /* element of the array part? */
+      lua_pushinteger(L, i + 1);
+      lua_replace(L, t + 1);
+      if ((opened = ser_decodevalue(D)) != 0)
+        lua_pushvalue(L, -1);  /* keep it for its frame */
+      if (lua_isnil(L, -1))
+        lua_pop(L, 1);
+      else
+        lua_rawseti(L, t, i);
+    }
+    else if (lua_tointeger(L, t + 3) == 0) {  /* table complete? */
+      lua_settop(L, t - 1);
+      continue;
+    }
+    else if (lua_isnil(L, t + 4)) {  /* key of a pair */
+      if ((opened = ser_decodevalue(D)) != 0)
+        lua_pushvalue(L, -1);
+      if (l_unlikely(lua_isnil(L, -1)
+                     || (lua_type(L, -1) == LUA_TNUMBER
+                         && lua_tonumber(L, -1) != lua_tonumber(L, -1))))
+        malformed(D);  /* invalid key */
+      lua_replace(L, t + 4);
+    }
+    else {  /* value of a pair */
+      if ((opened = ser_decodevalue(D)) != 0)
+        lua_pushvalue(L, -1);
+      lua_pushvalue(L, t + 4);
+      lua_insert(L, -2);
+      lua_rawset(L, t);
+      lua_pushnil(L);
+      lua_replace(L, t + 4);
+      lua_pushinteger(L, lua_tointeger(L, t + 3) - 1);
+      lua_replace(L, t + 3);
+    }
+    if (opened)
+      pushframe(D);
+  }
+}
+
+/* }====================================================== */
+
+
+static int ser_encode (lua_State *L) {
+  Writer *W;
+  luaL_checkany(L, 1);
+  lua_settop(L, 3);
+  W = newwriter(L);
+  writevalue(L, W, 1);
+#if defined(LUAGLM_EXT_BLOB)
+  if (!lua_isnoneornil(L, 2)) {  /* write into a blob */
+    size_t len;
+    char *blob;
+    lua_Integer pos;
+    luaL_argexpected(L, lua_isblob(L, 2), 2, "string blob");
+    blob = lua_toblob(L, 2, &len);
+    pos = luaL_optinteger(L, 3, 1);
+    luaL_argcheck(L, 1 <= pos && (size_t)pos - 1 <= len, 3, "out of range");
+    if (W->n > len - ((size_t)pos - 1)) {  /* too small: grow a copy */
+      char *newblob = lua_pushblob(L, (size_t)pos - 1 + W->n);
+      memcpy(newblob, blob, (size_t)pos - 1);
+      blob = newblob;
+    }
+    else
+      lua_pushvalue(L, 2);
+    memcpy(blob + pos - 1, W->b, W->n);
+    lua_pushinteger(L, pos + (lua_Integer)W->n);
+    freewriter(L, W);
+    return 2;
+  }
+#endif
+  lua_pushlstring(L, W->b, W->n);
+  freewriter(L, W);
+  return 1;
+}
+
+
+static int ser_decode (lua_State *L) {
+  SerDecoder D;
+  size_t len;
+  const char *s = luaL_checklstring(L, 1, &len);
+  lua_Integer pos = luaL_optinteger(L, 2, 1);
+  luaL_argcheck(L, 1 <= pos && (size_t)pos - 1 <= len, 2, "out of range");
+  D.L = L;
+  D.p = s + pos - 1;
+  D.end = s + len;
+  D.nrefs = 0;
+  if (getbyte(&D) != SER_VERSION)
+    luaL_error(L, "unsupported serialization format");
+  lua_newtable(L);
+  D.refs = lua_gettop(L);
+  readvalue(&D);
+  lua_pushinteger(L, (lua_Integer)(D.p - s) + 1);
+  return 2;
+}
+
+
+static int ser_writer (lua_State *L) {
+  newwriter(L);
+  return 1;
+}
+
+
+/*
+** {======================================================
+** Writer methods
+** =======================================================
+*/
+
+static int w_write (lua_State *L) {
+  Writer *W = checkwriter(L, 1);
+  int i, n = lua_gettop(L);
+  for (i = 2; i <= n; i++)
+    writevalue(L, W, i);
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+static int w_tostring (lua_State *L) {
+  Writer *W = checkwriter(L, 1);
+  lua_pushlstring(L, (W->b != NULL) ? W->b : "", W->n);
+  return 1;
+}
+
+
+#if defined(LUAGLM_EXT_BLOB)
+static int w_toblob (lua_State *L) {
+  Writer *W = checkwriter(L, 1);
+  if (W->n > 0)
+    memcpy(lua_pushblob(L, W->n), W->b, W->n);
+  else
+    lua_pushblob(L, 0);
+  return 1;
+}
+#endif
+
+
+static int w_reset (lua_State *L) {
+  Writer *W = checkwriter(L, 1);
+  W->n = 0;
+  W->count = 0;
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+static int w_count (lua_State *L) {
+  lua_pushinteger(L, checkwriter(L, 1)->count);
+  return 1;
+}
+
+
+static int w_len (lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)checkwriter(L, 1)->n);
+  return 1;
+}
+
+
+static int w_gc (lua_State *L) {
+  freewriter(L, checkwriter(L, 1));
+  return 0;
+}
+
+
+static const luaL_Reg w_meth[] = {
+  {"write", w_write},
+  {"tostring", w_tostring},
+#if defined(LUAGLM_EXT_BLOB)
+  {"toblob", w_toblob},
+#endif
+  {"reset", w_reset},
+  {"count", w_count},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg w_metameth[] = {
+  {"__index", NULL},  /* place holder */
+  {"__len", w_len},
+  {"__tostring", w_tostring},
+  {"__gc", w_gc},
+  {"__close", w_gc},
+  {NULL, NULL}
+};
+
+/* }====================================================== */
+
+
+static const luaL_Reg ser_funcs[] = {
+  {"encode", ser_encode},
+  {"decode", ser_decode},
+  {"writer", ser_writer},
+  {NULL, NULL}
+};
+
+
+static void createwriter (lua_State *L) {
+  luaL_newmetatable(L, LUA_SERIALWRITER);  /* metatable for writers */
+  luaL_setfuncs(L, w_metameth, 0);  /* add metamethods to new metatable */
+  luaL_newlibtable(L, w_meth);  /* create method table */
+  luaL_setfuncs(L, w_meth, 0);  /* add writer methods to method table */
+  lua_setfield(L, -2, "__index");  /* metatable.__index = method table */
+  lua_pop(L, 1);  /* pop metatable */
+}
+
+
+LUAMOD_API int luaopen_serialize (lua_State *L) {
+  luaL_newlib(L, ser_funcs);
+  createwriter(L);
+  return 1;
+}
+
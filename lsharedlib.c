@@ -0,0 +1,2005 @@
+/*
+** $Id: lsharedlib.c $
+** Read-only snapshots, message channels, and parallel loops between
+** independent states
+** See Copyright Notice in lua.h
+*/
+
+#define lsharedlib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+#include "lgritlib.h"
+
+
+#if defined(LUA_USE_SHARED) || defined(LUA_USE_CHANNELS) \
+                            || defined(LUA_USE_PARALLEL)
+
+#if defined(LUA_USE_SHARED) && !defined(LUAGLM_EXT_READONLY)
+#error "LUA_USE_SHARED requires LUAGLM_EXT_READONLY"
+#endif
+
+#include <pthread.h>
+#include <unistd.h>
+
+
+#if defined(LUAGLM_EXT_READONLY)
+#define isfrozen(L,i)	lua_isreadonly(L, i)
+#define freeze(L,i)	lua_setreadonly(L, i, 1)
+#else
+#define isfrozen(L,i)	0
+#define freeze(L,i)	((void)0)
+#endif
+
+
+/*
+** {======================================================
+** Snapshots
+** =======================================================
+*/
+
+/*
+** A snapshot is a single block, allocated with 'malloc' outside of any
+** state, holding an encoded value and everything reachable from it.
+** Strings, vectors, and matrices are stored once (equal strings are
+** shared) and tables as a header followed by an array part and an
+** open-addressing hash part. All references inside the block are
+** offsets from its start, so it can be read by any state, in any
+** thread, without relocation. Snapshots are immutable and reference
+** counted.
+*/
+
+/* tags of encoded values */
+#define SV_NIL		0
+#define SV_FALSE	1
+#define SV_TRUE		2
+#define SV_INT		3
+#define SV_FLT		4
+#define SV_STR		5
+#define SV_VEC		6
+#define SV_MAT		7
+#define SV_TAB		8
+
+
+typedef struct SValue {
+  union {
+    lua_Integer i;
+    lua_Number n;
+    size_t off;  /* strings, vectors, matrices, and tables */
+  } u;
+  unsigned char tt;  /* SV_* tag */
+  unsigned char variant;  /* vector variant */
+} SValue;
+
+
+typedef struct SString {
+  size_t len;
+  unsigned int hash;
+  char s[1];  /* 'len' bytes and a '\0' */
+} SString;
+
+
+typedef struct SNode {
+  SValue key;
+  SValue val;
+} SNode;
+
+
+typedef struct STable {
+  size_t asize;  /* size of the array part (keys 1..asize) */
+  size_t hsize;  /* size of the hash part (zero or a power of 2) */
+  int frozen;  /* table was read-only */
+} STable;
+
+
+typedef struct Snapshot {
+  size_t refs;  /* number of references (protected by 'slock') */
+  size_t size;  /* size of the block */
+  SValue root;  /* encoded value */
+} Snapshot;
+
+
+/* alignment of every item in a snapshot */
+typedef union SAlign { lua_Integer i; lua_Number n; size_t s; void *p; } SAlign;
+
+#define salign(n)	(((n) + (sizeof(SAlign) - 1)) & ~(sizeof(SAlign) - 1))
+
+#define sitem(s,off)	((const char *)(s) + (off))
+#define stable(s,off)	((const STable *)sitem(s, off))
+#define starray(t)	((SValue *)((char *)(t) + salign(sizeof(STable))))
+#define stnode(t)	((SNode *)(starray(t) + (t)->asize))
+
+/* maximum nesting of encoded tables */
+#if !defined(LUAI_MAXSHAREDDEPTH)
+#define LUAI_MAXSHAREDDEPTH	200
+#endif
+
+#define HASHSEED	2166136261u
+
+
+#if defined(LUA_USE_SHARED) || defined(LUA_USE_CHANNELS)
+/* protects the references to snapshots and the lists of names */
+static pthread_mutex_t slock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+static unsigned int hashbytes (const void *p, size_t l, unsigned int h) {
+  const unsigned char *b = (const unsigned char *)p;
+  for (; l > 0; l--)  /* FNV-1a */
+    h = (h ^ *b++) * 16777619u;
+  return h;
+}
+
+
+static int vecdims (int variant) {
+  switch (variant) {
+    case LUA_VVECTOR2: return 2;
+    case LUA_VVECTOR3: return 3;
+    default: return 4;
+  }
+}
+
+
+/*
+** Hash of a vector key; as vector keys compare by value, negative zero
+** lanes are hashed as positive zero.
+*/
+static unsigned int hashvec (const lua_Float4 *f4, int variant) {
+  lua_VecF lanes[4];
+  int i, d = vecdims(variant);
+  for (i = 0; i < d; i++)
+    lanes[i] = f4->raw[i] + (lua_VecF)0;
+  return hashbytes(lanes, (size_t)d * sizeof(lua_VecF), HASHSEED);
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Encoding
+** =======================================================
+*/
+
+#define LUA_SHAREDENCODER	"SharedEncoder"
+
+
+typedef struct Encoder {
+  lua_State *L;
+  char *b;  /* block being built ('malloc') */
+  size_t n;  /* number of bytes in use */
+  size_t size;  /* size of the block */
+  int memo;  /* index of a table mapping strings and tables to offsets */
+  int depth;  /* current nesting of tables */
+  int plain;  /* accept tables that are not frozen */
+} Encoder;
+
+
+static int encoder_gc (lua_State *L) {
+  Encoder *E = (Encoder *)luaL_checkudata(L, 1, LUA_SHAREDENCODER);
+  free(E->b);
+  E->b = NULL;
+  return 0;
+}
+
+
+static void createencoder (lua_State *L) {
+  if (luaL_newmetatable(L, LUA_SHAREDENCODER)) {
+    lua_pushcfunction(L, encoder_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_pop(L, 1);
+}
+
+
+/*
+** Push a new encoder. Its finalizer releases the block in 'b', so it
+** also anchors blocks being decoded against errors.
+*/
+static Encoder *newencoder (lua_State *L) {
+  Encoder *E = (Encoder *)lua_newuserdatauv(L, sizeof(Encoder), 0);
+  memset(E, 0, sizeof(Encoder));
+  E->L = L;
+  luaL_setmetatable(L, LUA_SHAREDENCODER);
+  return E;
+}
+
+
+/*
+** Reserve 'sz' zeroed bytes in the block and return their offset. The
+** block is released by the encoder's finalizer if encoding fails.
+*/
+static size_t reserve (Encoder *E, size_t sz) {
+  size_t off = salign(E->n);
+  if (sz > E->size - off || off > E->size) {
+    size_t newsize = (E->size > 0) ? E->size : 256;
+    char *b;
+    while (newsize - off < sz || newsize < off) {
+      if (newsize > ((size_t)~(size_t)0) / 2)
+        luaL_error(E->L, "snapshot too large");
+      newsize *= 2;
+    }
+    b = (char *)realloc(E->b, newsize);
+    if (b == NULL)
+      luaL_error(E->L, "not enough memory");
+    E->b = b;
+    E->size = newsize;
+  }
+  memset(E->b + off, 0, sz);
+  E->n = off + sz;
+  return off;
+}
+
+
+/* Return the memoized offset of the value at 'idx' or zero */
+static size_t getmemo (Encoder *E, int idx) {
+  size_t off;
+  lua_pushvalue(E->L, idx);
+  off = (lua_rawget(E->L, E->memo) == LUA_TNUMBER)
+      ? (size_t)lua_tointeger(E->L, -1) : 0;
+  lua_pop(E->L, 1);
+  return off;
+}
+
+
+static void setmemo (Encoder *E, int idx, size_t off) {
+  lua_pushvalue(E->L, idx);
+  lua_pushinteger(E->L, (lua_Integer)off);
+  lua_rawset(E->L, E->memo);
+}
+
+
+static size_t encodestring (Encoder *E, int idx) {
+  size_t len, off = getmemo(E, idx);
+  if (off == 0) {
+    const char *str = lua_tolstring(E->L, idx, &len);
+    SString *ss;
+    off = reserve(E, offsetof(SString, s) + len + 1);
+    ss = (SString *)(E->b + off);
+    ss->len = len;
+    ss->hash = hashbytes(str, len, HASHSEED);
+    memcpy(ss->s, str, len);
+    setmemo(E, idx, off);
+  }
+  return off;
+}
+
+
+static SValue encode (Encoder *E, int idx);
+
+
+static unsigned int hashkey (const char *b, const SValue *k) {
+  switch (k->tt) {
+    case SV_FALSE: case SV_TRUE: return k->tt;
+    case SV_INT: return hashbytes(&k->u.i, sizeof(k->u.i), HASHSEED);
+    case SV_FLT: return hashbytes(&k->u.n, sizeof(k->u.n), HASHSEED);
+    case SV_STR: return ((const SString *)(b + k->u.off))->hash;
+    case SV_VEC: {
+      lua_Float4 f4;
+      memcpy(&f4, b + k->u.off, sizeof(f4));
+      return hashvec(&f4, k->variant);
+    }
+    default: return hashbytes(&k->u.off, sizeof(k->u.off), HASHSEED);
+  }
+}
+
+
+/*
+** Encode the table at 'idx': keys 1..#t go to the array part (holes are
+** nil slots), all others to the hash part, kept at most 3/4 full.
+** Metatables are not encoded.
+*/
+static size_t encodetable (Encoder *E, int idx) {
+  lua_State *L = E->L;
+  size_t asize, hsize, nrec = 0, i, off = getmemo(E, idx);
+  if (off != 0)  /* already encoded? */
+    return off;
+  if (!isfrozen(L, idx) && !E->plain)
+    luaL_error(L, "shared tables must be frozen");
+  if (++E->depth > LUAI_MAXSHAREDDEPTH)
+    luaL_error(L, "table too deep to share");
+  luaL_checkstack(L, 6, "table too deep to share");
+  asize = (size_t)lua_rawlen(L, idx);
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    lua_Integer k;
+    lua_pop(L, 1);  /* value */
+    k = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 0;
+    if (!(k >= 1 && (lua_Unsigned)k <= asize))
+      nrec++;
+  }
+  for (hsize = (nrec > 0); hsize != 0 && hsize * 3 < nrec * 4; hsize *= 2) {}
+  off = reserve(E, salign(sizeof(STable)) + asize * sizeof(SValue)
+                                          + hsize * sizeof(SNode));
+  ((STable *)(E->b + off))->asize = asize;
+  ((STable *)(E->b + off))->hsize = hsize;
+  ((STable *)(E->b + off))->frozen = isfrozen(L, idx);
+  setmemo(E, idx, off);  /* before the contents, for cycles */
+  for (i = 0; i < asize; i++) {
+    SValue v;
+    lua_rawgeti(L, idx, (lua_Integer)i + 1);
+    v = encode(E, lua_gettop(L));
+    lua_pop(L, 1);
+    starray((STable *)(E->b + off))[i] = v;
+  }
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    int top = lua_gettop(L);
+    lua_Integer k = lua_isinteger(L, -2) ? lua_tointeger(L, -2) : 0;
+    if (!(k >= 1 && (lua_Unsigned)k <= asize)) {
+      SValue key = encode(E, top - 1);
+      SValue val = encode(E, top);
+      STable *t = (STable *)(E->b + off);
+      SNode *node = stnode(t);
+      size_t j = hashkey(E->b, &key) & (hsize - 1);
+      while (node[j].key.tt != SV_NIL)  /* keys are unique */
+        j = (j + 1) & (hsize - 1);
+      node[j].key = key;
+      node[j].val = val;
+    }
+    lua_pop(L, 1);
+  }
+  E->depth--;
+  return off;
+}
+
+
+static SValue encode (Encoder *E, int idx) {
+  lua_State *L = E->L;
+  SValue v;
+  memset(&v, 0, sizeof(v));
+  switch (lua_type(L, idx)) {
+    case LUA_TNIL: break;
+    case LUA_TBOOLEAN: v.tt = lua_toboolean(L, idx) ? SV_TRUE : SV_FALSE; break;
+    case LUA_TNUMBER: {
+      if (lua_isinteger(L, idx)) {
+        v.tt = SV_INT;
+        v.u.i = lua_tointeger(L, idx);
+      }
+      else {
+        v.tt = SV_FLT;
+        v.u.n = lua_tonumber(L, idx);
+      }
+      break;
+    }
+    case LUA_TSTRING: {
+      v.tt = SV_STR;
+      v.u.off = encodestring(E, idx);
+      break;
+    }
+    case LUA_TVECTOR: {
+      lua_Float4 f4;
+      v.tt = SV_VEC;
+      v.variant = (unsigned char)lua_tovector(L, idx, &f4);
+      v.u.off = reserve(E, sizeof(f4));
+      memcpy(E->b + v.u.off, &f4, sizeof(f4));
+      break;
+    }
+    case LUA_TMATRIX: {
+      lua_Mat4 m;
+      lua_tomatrix(L, idx, &m);
+      v.tt = SV_MAT;
+      v.u.off = reserve(E, sizeof(m));
+      memcpy(E->b + v.u.off, &m, sizeof(m));
+      break;
+    }
+    case LUA_TTABLE: {
+      v.tt = SV_TAB;
+      v.u.off = encodetable(E, idx);
+      break;
+    }
+    default:
+      luaL_error(L, "cannot share a %s value", luaL_typename(L, idx));
+  }
+  return v;
+}
+
+
+/*
+** Encode the value at 'idx' into a new snapshot with a single reference.
+** Unless 'plain' is true, all tables must be frozen.
+*/
+static Snapshot *snapshot (lua_State *L, int idx, int plain) {
+  Encoder *E;
+  Snapshot *s;
+  SValue root;
+  idx = lua_absindex(L, idx);
+  E = newencoder(L);
+  E->plain = plain;
+  lua_newtable(L);
+  E->memo = lua_gettop(L);
+  reserve(E, sizeof(Snapshot));  /* header at offset 0 */
+  root = encode(E, idx);
+  s = (Snapshot *)E->b;
+  s->refs = 1;
+  s->size = E->n;
+  s->root = root;
+  E->b = NULL;  /* block now belongs to the caller */
+  lua_pop(L, 2);  /* memo and encoder */
+  return s;
+}
+
+/* Push an encoded value other than a table */
+static void pushscalar (lua_State *L, const Snapshot *s, const SValue *v) {
+  switch (v->tt) {
+    case SV_FALSE: lua_pushboolean(L, 0); break;
+    case SV_TRUE: lua_pushboolean(L, 1); break;
+    case SV_INT: lua_pushinteger(L, v->u.i); break;
+    case SV_FLT: lua_pushnumber(L, v->u.n); break;
+    case SV_STR: {
+      const SString *ss = (const SString *)sitem(s, v->u.off);
+      lua_pushlstring(L, ss->s, ss->len);
+      break;
+    }
+    case SV_VEC: {
+      lua_Float4 f4;
+      memcpy(&f4, sitem(s, v->u.off), sizeof(f4));
+      lua_pushvector(L, f4, v->variant);
+      break;
+    }
+    case SV_MAT: {
+      lua_Mat4 m;
+      memcpy(&m, sitem(s, v->u.off), sizeof(m));
+      lua_pushmatrix(L, &m);
+      break;
+    }
+    default: lua_pushnil(L); break;
+  }
+}
+
+/* }====================================================== */
+
+
+#if defined(LUA_USE_SHARED)
+
+/*
+** {======================================================
+** Shared tables
+** =======================================================
+*/
+
+#define LUA_SHAREDHANDLE	"shared table"
+
+/* per-state cache of proxies (weak values), indexed by table address */
+#define proxycache	lua_upvalueindex(1)
+
+
+/*
+** Proxy of an encoded table. Only the proxy of the root holds a
+** reference to the snapshot; the others anchor it as their user value.
+*/
+typedef struct SharedRef {
+  Snapshot *s;
+  size_t off;  /* encoded table */
+  int owner;  /* holds a reference to 's' */
+} SharedRef;
+
+
+#define checkref(L,i)	((SharedRef *)luaL_checkudata(L, i, LUA_SHAREDHANDLE))
+
+
+static void decref (Snapshot *s) {
+  size_t refs;
+  pthread_mutex_lock(&slock);
+  refs = --s->refs;
+  pthread_mutex_unlock(&slock);
+  if (refs == 0)
+    free(s);
+}
+
+
+static int veceq (const lua_Float4 *a, const lua_Float4 *b, int variant) {
+  int i, d = vecdims(variant);
+  for (i = 0; i < d; i++) {
+    if (a->raw[i] != b->raw[i])
+      return 0;
+  }
+  return 1;
+}
+
+
+/*
+** Push the proxy of the table at 'off' of snapshot 's'. 'parent' is the
+** index of a proxy of the same snapshot.
+*/
+static void pushref (lua_State *L, Snapshot *s, size_t off, int parent) {
+  const void *key = sitem(s, off);
+  if (lua_rawgetp(L, proxycache, key) == LUA_TNIL) {  /* not cached? */
+    SharedRef *p = (SharedRef *)lua_touserdata(L, parent);
+    SharedRef *r;
+    lua_pop(L, 1);
+    r = (SharedRef *)lua_newuserdatauv(L, sizeof(SharedRef), 1);
+    r->s = s;
+    r->off = off;
+    r->owner = 0;
+    luaL_setmetatable(L, LUA_SHAREDHANDLE);
+    if (p->owner)  /* anchor the root proxy */
+      lua_pushvalue(L, parent);
+    else
+      lua_getiuservalue(L, parent, 1);
+    lua_setiuservalue(L, -2, 1);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, proxycache, key);
+  }
+}
+
+
+/*
+** Push an encoded value; 'parent' is the index of a proxy of the same
+** snapshot (used for tables).
+*/
+static void pushsvalue (lua_State *L, Snapshot *s, const SValue *v,
+                                                   int parent) {
+  if (v->tt == SV_TAB)
+    pushref(L, s, v->u.off, parent);
+  else
+    pushscalar(L, s, v);
+}
+
+
+/*
+** Find the slot of the value at 'k' in the table of proxy 'r'; NULL if
+** absent.
+*/
+static const SValue *getslot (lua_State *L, const SharedRef *r, int k) {
+  const char *b = (const char *)r->s;
+  const STable *t = stable(r->s, r->off);
+  const SNode *node = stnode(t);
+  const char *str = NULL;
+  lua_Float4 f4;
+  SValue key;
+  unsigned int h;
+  size_t j, len = 0;
+  memset(&key, 0, sizeof(key));
+  switch (lua_type(L, k)) {
+    case LUA_TBOOLEAN: {
+      key.tt = lua_toboolean(L, k) ? SV_TRUE : SV_FALSE;
+      h = key.tt;
+      break;
+    }
+    case LUA_TNUMBER: {
+      int isint;
+      key.u.i = lua_tointegerx(L, k, &isint);
+      if (isint) {  /* integral key (possibly a float)? */
+        if ((lua_Unsigned)key.u.i - 1u < t->asize)
+          return &starray(t)[key.u.i - 1];
+        key.tt = SV_INT;
+        h = hashbytes(&key.u.i, sizeof(key.u.i), HASHSEED);
+      }
+      else {
+        key.tt = SV_FLT;
+        key.u.n = lua_tonumber(L, k);
+        if (key.u.n != key.u.n)  /* NaN? */
+          return NULL;
+        h = hashbytes(&key.u.n, sizeof(key.u.n), HASHSEED);
+      }
+      break;
+    }
+    case LUA_TSTRING: {
+      str = lua_tolstring(L, k, &len);
+      key.tt = SV_STR;
+      h = hashbytes(str, len, HASHSEED);
+      break;
+    }
+    case LUA_TVECTOR: {
+      key.tt = SV_VEC;
+      key.variant = (unsigned char)lua_tovector(L, k, &f4);
+      h = hashvec(&f4, key.variant);
+      break;
+    }
+    case LUA_TUSERDATA: {
+      const SharedRef *kr = (const SharedRef *)luaL_testudata(L, k, LUA_SHAREDHANDLE);
+      if (kr == NULL || kr->s != r->s)
+        return NULL;
+      key.tt = SV_TAB;
+      key.u.off = kr->off;
+      h = hashbytes(&key.u.off, sizeof(key.u.off), HASHSEED);
+      break;
+    }
+    default: return NULL;
+  }
+  if (t->hsize == 0)
+    return NULL;
+  for (j = h & (t->hsize - 1); node[j].key.tt != SV_NIL;
+                               j = (j + 1) & (t->hsize - 1)) {
+    const SValue *nk = &node[j].key;
+    if (nk->tt != key.tt)
+      continue;
+    switch (key.tt) {
+      case SV_FALSE: case SV_TRUE: return &node[j].val;
+      case SV_INT: if (nk->u.i == key.u.i) return &node[j].val; break;
+      case SV_FLT: if (nk->u.n == key.u.n) return &node[j].val; break;
+      case SV_STR: {
+        const SString *ss = (const SString *)(b + nk->u.off);
+        if (ss->hash == h && ss->len == len && memcmp(ss->s, str, len) == 0)
+          return &node[j].val;
+        break;
+      }
+      case SV_VEC: {
+        lua_Float4 nf4;
+        memcpy(&nf4, b + nk->u.off, sizeof(nf4));
+        if (nk->variant == key.variant && veceq(&nf4, &f4, key.variant))
+          return &node[j].val;
+        break;
+      }
+      default: if (nk->u.off == key.u.off) return &node[j].val; break;
+    }
+  }
+  return NULL;
+}
+
+
+static int ref_index (lua_State *L) {
+  SharedRef *r = checkref(L, 1);
+  const SValue *v = getslot(L, r, 2);
+  if (v == NULL)
+    lua_pushnil(L);
+  else
+    pushsvalue(L, r->s, v, 1);
+  return 1;
+}
+
+
+static int ref_newindex (lua_State *L) {
+  return luaL_error(L, "attempt to modify a shared table");
+}
+
+
+static int ref_len (lua_State *L) {
+  SharedRef *r = checkref(L, 1);
+  lua_pushinteger(L, (lua_Integer)stable(r->s, r->off)->asize);
+  return 1;
+}
+
+
+/*
+** Traversal order: the array part, then the slots of the hash part.
+*/
+static int ref_next (lua_State *L) {
+  SharedRef *r = checkref(L, 1);
+  const STable *t = stable(r->s, r->off);
+  size_t i;  /* first slot to visit */
+  lua_settop(L, 2);
+  if (lua_isnil(L, 2))
+    i = 0;
+  else {
+    const SValue *v = getslot(L, r, 2);
+    if (v == NULL)
+      return luaL_error(L, "invalid key to 'next'");
+    else if (v >= starray(t) && v < starray(t) + t->asize)
+      i = (size_t)(v - starray(t)) + 1;
+    else
+      i = t->asize + (size_t)((const SNode *)((const char *)v
+                                 - offsetof(SNode, val)) - stnode(t)) + 1;
+  }
+  for (; i < t->asize; i++) {
+    if (starray(t)[i].tt != SV_NIL) {
+      lua_pushinteger(L, (lua_Integer)i + 1);
+      pushsvalue(L, r->s, &starray(t)[i], 1);
+      return 2;
+    }
+  }
+  for (i -= t->asize; i < t->hsize; i++) {
+    const SNode *node = &stnode(t)[i];
+    if (node->key.tt != SV_NIL) {
+      pushsvalue(L, r->s, &node->key, 1);
+      pushsvalue(L, r->s, &node->val, 1);
+      return 2;
+    }
+  }
+  lua_pushnil(L);
+  return 1;
+}
+
+
+static int ref_pairs (lua_State *L) {
+  checkref(L, 1);
+  lua_pushvalue(L, proxycache);
+  lua_pushcclosure(L, ref_next, 1);
+  lua_pushvalue(L, 1);
+  lua_pushnil(L);
+  return 3;
+}
+
+
+static int ref_tostring (lua_State *L) {
+  lua_pushfstring(L, LUA_SHAREDHANDLE ": %p", lua_topointer(L, 1));
+  return 1;
+}
+
+
+static int ref_gc (lua_State *L) {
+  SharedRef *r = checkref(L, 1);
+  if (r->owner) {
+    r->owner = 0;
+    decref(r->s);
+  }
+  return 0;
+}
+
+
+static const luaL_Reg ref_meth[] = {
+  {"__index", ref_index},
+  {"__newindex", ref_newindex},
+  {"__len", ref_len},
+  {"__pairs", ref_pairs},
+  {"__tostring", ref_tostring},
+  {"__gc", ref_gc},
+  {NULL, NULL}
+};
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Library
+** =======================================================
+*/
+
+/* list of published snapshots (protected by 'slock') */
+typedef struct Published {
+  struct Published *next;
+  Snapshot *s;
+  char name[1];
+} Published;
+
+static Published *published = NULL;
+
+
+static Published **findpublished (const char *name) {
+  Published **p;
+  for (p = &published; *p != NULL; p = &(*p)->next) {
+    if (strcmp((*p)->name, name) == 0)
+      break;
+  }
+  return p;
+}
+
+
+/*
+** shared.publish(name, value): encode a snapshot of 'value' (tables must
+** be frozen) and make it available to every state under 'name',
+** replacing a previous one. Returns the size of the snapshot in bytes.
+*/
+static int shared_publish (lua_State *L) {
+  size_t len;
+  const char *name = luaL_checklstring(L, 1, &len);
+  Snapshot *s, *old = NULL;
+  Published *np, **p;
+  luaL_checkany(L, 2);
+  s = snapshot(L, 2, 0);
+  np = (Published *)malloc(offsetof(Published, name) + len + 1);
+  if (np == NULL) {
+    free(s);
+    return luaL_error(L, "not enough memory");
+  }
+  memcpy(np->name, name, len + 1);
+  np->s = s;
+  pthread_mutex_lock(&slock);
+  p = findpublished(name);
+  if (*p != NULL) {  /* replace previous snapshot */
+    Published *prev = *p;
+    old = prev->s;
+    np->next = prev->next;
+    free(prev);
+  }
+  else
+    np->next = NULL;
+  *p = np;
+  pthread_mutex_unlock(&slock);
+  if (old != NULL)
+    decref(old);
+  lua_pushinteger(L, (lua_Integer)s->size);
+  return 1;
+}
+
+
+/*
+** shared.get(name): value published under 'name' (tables are returned as
+** read-only proxies); nil if there is none. The reference to the
+** snapshot is taken by a new proxy, created beforehand, so that it is
+** released by the finalizer if anything below raises an error.
+*/
+static int shared_get (lua_State *L) {
+  const char *name = luaL_checkstring(L, 1);
+  SharedRef *r = (SharedRef *)lua_newuserdatauv(L, sizeof(SharedRef), 1);
+  Published **p;
+  r->s = NULL;
+  r->off = 0;
+  r->owner = 0;
+  luaL_setmetatable(L, LUA_SHAREDHANDLE);
+  pthread_mutex_lock(&slock);
+  p = findpublished(name);
+  if (*p != NULL) {
+    r->s = (*p)->s;
+    r->s->refs++;
+    r->owner = 1;
+  }
+  pthread_mutex_unlock(&slock);
+  if (r->s == NULL)
+    luaL_pushfail(L);
+  else if (r->s->root.tt == SV_TAB) {
+    const void *key = sitem(r->s, r->s->root.u.off);
+    r->off = r->s->root.u.off;
+    if (lua_rawgetp(L, proxycache, key) == LUA_TNIL) {  /* new root? */
+      lua_pop(L, 1);
+      lua_pushvalue(L, -1);
+      lua_rawsetp(L, proxycache, key);
+    }
+    else {  /* cached proxy already holds the snapshot */
+      r->owner = 0;
+      decref(r->s);
+    }
+  }
+  else {
+    pushscalar(L, r->s, &r->s->root);
+    r->owner = 0;
+    decref(r->s);
+  }
+  return 1;
+}
+
+
+/*
+** shared.release(name): remove the snapshot published under 'name'. Its
+** memory is released when no state references it.
+*/
+static int shared_release (lua_State *L) {
+  const char *name = luaL_checkstring(L, 1);
+  Snapshot *s = NULL;
+  Published **p;
+  pthread_mutex_lock(&slock);
+  p = findpublished(name);
+  if (*p != NULL) {
+    Published *prev = *p;
+    s = prev->s;
+    *p = prev->next;
+    free(prev);
+  }
+  pthread_mutex_unlock(&slock);
+  if (s != NULL)
+    decref(s);
+  lua_pushboolean(L, s != NULL);
+  return 1;
+}
+
+
+/* shared.isshared(v): whether 'v' is a proxy of a shared table */
+static int shared_isshared (lua_State *L) {
+  lua_pushboolean(L, luaL_testudata(L, 1, LUA_SHAREDHANDLE) != NULL);
+  return 1;
+}
+
+
+static const luaL_Reg shared_funcs[] = {
+  {"publish", shared_publish},
+  {"get", shared_get},
+  {"release", shared_release},
+  {"isshared", shared_isshared},
+  {NULL, NULL}
+};
+
+/* }====================================================== */
+
+
+static void shared_createmeta (lua_State *L) {
+  createencoder(L);
+  lua_newtable(L);  /* proxy cache */
+  lua_createtable(L, 0, 1);
+  lua_pushliteral(L, "v");
+  lua_setfield(L, -2, "__mode");
+  lua_setmetatable(L, -2);
+  luaL_newmetatable(L, LUA_SHAREDHANDLE);  /* metatable for proxies */
+  lua_pushvalue(L, -2);
+  luaL_setfuncs(L, ref_meth, 1);
+  lua_pushliteral(L, "shared");
+  lua_setfield(L, -2, "__metatable");
+  lua_pop(L, 1);
+}
+
+
+LUAMOD_API int luaopen_shared (lua_State *L) {
+  luaL_checkversion(L);
+  lua_createtable(L, 0, sizeof(shared_funcs) / sizeof(shared_funcs[0]) - 1);
+  shared_createmeta(L);  /* leaves the proxy cache on the stack */
+  luaL_setfuncs(L, shared_funcs, 1);
+  return 1;
+}
+
+#endif
+
+
+#if defined(LUA_USE_CHANNELS) || defined(LUA_USE_PARALLEL)
+
+/*
+** {======================================================
+** Decoding
+** =======================================================
+*/
+
+static void decode (lua_State *L, const Snapshot *s, const SValue *v,
+                                                     int memo);
+
+
+/*
+** Push a regular copy of the encoded table at 'off'. 'memo' maps the
+** offsets of tables already decoded to their copies, so subtables
+** reached more than once (and cycles) are preserved.
+*/
+static void decodetable (lua_State *L, const Snapshot *s, size_t off,
+                                                          int memo) {
+  const STable *t = stable(s, off);
+  size_t i;
+  if (lua_rawgeti(L, memo, (lua_Integer)off) != LUA_TNIL)
+    return;  /* already decoded */
+  lua_pop(L, 1);
+  luaL_checkstack(L, 4, "message too deep");
+  lua_createtable(L, (t->asize < INT_MAX) ? (int)t->asize : INT_MAX,
+                     (t->hsize < INT_MAX) ? (int)t->hsize : INT_MAX);
+  lua_pushvalue(L, -1);
+  lua_rawseti(L, memo, (lua_Integer)off);
+  for (i = 0; i < t->asize; i++) {
+    if (starray(t)[i].tt != SV_NIL) {
+      decode(L, s, &starray(t)[i], memo);
+      lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+  }
+  for (i = 0; i < t->hsize; i++) {
+    const SNode *node = &stnode(t)[i];
+    if (node->key.tt != SV_NIL) {
+      decode(L, s, &node->key, memo);
+      decode(L, s, &node->val, memo);
+      lua_rawset(L, -3);
+    }
+  }
+  if (t->frozen)
+    freeze(L, -1);
+}
+
+
+static void decode (lua_State *L, const Snapshot *s, const SValue *v,
+                                                     int memo) {
+  if (v->tt == SV_TAB)
+    decodetable(L, s, v->u.off, memo);
+  else
+    pushscalar(L, s, v);
+}
+
+/* }====================================================== */
+
+#endif
+
+
+#if defined(LUA_USE_CHANNELS)
+
+/*
+** {======================================================
+** Channels
+** =======================================================
+*/
+
+#define LUA_CHANNELHANDLE	"channel"
+
+/* default capacity of a channel */
+#if !defined(LUAI_CHANNELSIZE)
+#define LUAI_CHANNELSIZE	256
+#endif
+
+/* maximum capacity of a channel */
+#define MAXCHANNELSIZE	(1 << 24)
+
+/* timeouts (in seconds) from which waits are not limited */
+#define MAXTIMEOUT	1e9
+
+/* keeps the two ends of a channel in different cache lines */
+#define CACHELINE	64
+
+
+/*
+** A channel is a bounded multi-producer/multi-consumer queue of
+** snapshots. Sends and receives are lock free: each cell carries a
+** sequence number telling whether it is ready to be written (equal to
+** the position of the writer) or read (one past it), and writers and
+** readers claim positions with a compare-and-swap on 'tail' and 'head'.
+** The mutex and condition variable are only used by threads blocked on
+** a full or empty channel; they are signaled when 'waiting' is not zero.
+*/
+typedef struct Cell {
+  size_t seq;  /* sequence number (atomic) */
+  Snapshot *msg;
+} Cell;
+
+
+typedef struct Channel {
+  size_t head;  /* next position to read (atomic) */
+  char pad1[CACHELINE - sizeof(size_t)];
+  size_t tail;  /* next position to write (atomic) */
+  char pad2[CACHELINE - sizeof(size_t)];
+  size_t mask;  /* number of cells minus one */
+  int refs;  /* number of handles and names (atomic) */
+  int closed;  /* (atomic) */
+  int waiting;  /* number of blocked threads (atomic) */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  Cell cells[1];
+} Channel;
+
+
+/* Create a channel of at least 'size' cells; NULL if out of memory */
+static Channel *newchannel (lua_Integer size) {
+  Channel *ch;
+  size_t i, n = 2;
+  while ((lua_Integer)n < size)
+    n *= 2;
+  ch = (Channel *)malloc(offsetof(Channel, cells) + n * sizeof(Cell));
+  if (ch == NULL)
+    return NULL;
+  memset(ch, 0, offsetof(Channel, cells));
+  ch->mask = n - 1;
+  ch->refs = 1;
+  for (i = 0; i < n; i++) {
+    ch->cells[i].seq = i;
+    ch->cells[i].msg = NULL;
+  }
+  pthread_mutex_init(&ch->lock, NULL);
+  pthread_cond_init(&ch->cond, NULL);
+  return ch;
+}
+
+
+static void increfch (Channel *ch) {
+  __atomic_add_fetch(&ch->refs, 1, __ATOMIC_RELAXED);
+}
+
+
+static void decrefch (Channel *ch) {
+  if (__atomic_sub_fetch(&ch->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    size_t i;
+    for (i = 0; i <= ch->mask; i++)  /* messages never received */
+      free(ch->cells[i].msg);
+    pthread_mutex_destroy(&ch->lock);
+    pthread_cond_destroy(&ch->cond);
+    free(ch);
+  }
+}
+
+
+/* Append '*msg' to the channel; false if it is full */
+static int trysend (Channel *ch, Snapshot **msg) {
+  size_t pos = __atomic_load_n(&ch->tail, __ATOMIC_RELAXED);
+  Cell *c;
+  for (;;) {
+    size_t seq;
+    c = &ch->cells[pos & ch->mask];
+    seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+    if (seq == pos) {  /* free cell? try to claim it */
+      if (__atomic_compare_exchange_n(&ch->tail, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    }
+    else if ((ptrdiff_t)(seq - pos) < 0)  /* cell not read yet? */
+      return 0;
+    else  /* another writer claimed it */
+      pos = __atomic_load_n(&ch->tail, __ATOMIC_RELAXED);
+  }
+  c->msg = *msg;
+  __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+
+/* Remove the first message of the channel into '*msg'; false if empty */
+static int tryrecv (Channel *ch, Snapshot **msg) {
+  size_t pos = __atomic_load_n(&ch->head, __ATOMIC_RELAXED);
+  Cell *c;
+  for (;;) {
+    size_t seq;
+    c = &ch->cells[pos & ch->mask];
+    seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+    if (seq == pos + 1) {  /* written cell? try to claim it */
+      if (__atomic_compare_exchange_n(&ch->head, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    }
+    else if ((ptrdiff_t)(seq - (pos + 1)) < 0)  /* cell not written yet? */
+      return 0;
+    else  /* another reader claimed it */
+      pos = __atomic_load_n(&ch->head, __ATOMIC_RELAXED);
+  }
+  *msg = c->msg;
+  c->msg = NULL;
+  __atomic_store_n(&c->seq, pos + ch->mask + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+
+static int chclosed (Channel *ch) {
+  return __atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE);
+}
+
+
+/* Wake the threads blocked on the channel, if any */
+static void wakeup (Channel *ch) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ch->waiting, __ATOMIC_RELAXED) > 0) {
+    pthread_mutex_lock(&ch->lock);
+    pthread_cond_broadcast(&ch->cond);
+    pthread_mutex_unlock(&ch->lock);
+  }
+}
+
+
+/*
+** Retry 'op' until it succeeds, the channel is closed, or 'deadline'
+** (if not NULL) passes. A waiter registers itself before its last
+** attempt, so the thread making 'op' possible either lets that attempt
+** succeed or finds it registered and signals it.
+*/
+static int waitfor (Channel *ch, int (*op) (Channel *, Snapshot **),
+                    Snapshot **msg, const struct timespec *deadline) {
+  int res;
+  pthread_mutex_lock(&ch->lock);
+  __atomic_add_fetch(&ch->waiting, 1, __ATOMIC_SEQ_CST);
+  while (!(res = op(ch, msg)) && !chclosed(ch)) {
+    if (deadline == NULL)
+      pthread_cond_wait(&ch->cond, &ch->lock);
+    else if (pthread_cond_timedwait(&ch->cond, &ch->lock, deadline)
+                                                        == ETIMEDOUT) {
+      res = op(ch, msg);
+      break;
+    }
+  }
+  __atomic_sub_fetch(&ch->waiting, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&ch->lock);
+  return res;
+}
+
+
+/*
+** Perform 'op' waiting at most 'timeout' seconds (forever if negative);
+** wakes the other side of the channel on success.
+*/
+static int transfer (Channel *ch, int (*op) (Channel *, Snapshot **),
+                     Snapshot **msg, lua_Number timeout) {
+  int res = op(ch, msg);
+  if (!res && timeout != 0 && !chclosed(ch)) {
+    if (timeout < 0 || !(timeout < MAXTIMEOUT))
+      res = waitfor(ch, op, msg, NULL);
+    else {
+      struct timespec deadline;
+      time_t secs;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      timeout += (lua_Number)deadline.tv_nsec / 1e9;
+      secs = (time_t)timeout;  /* 'timeout' is not negative */
+      deadline.tv_sec += secs;
+      deadline.tv_nsec = (long)((timeout - (lua_Number)secs) * 1e9);
+      if (deadline.tv_nsec > 999999999L)
+        deadline.tv_nsec = 999999999L;
+      res = waitfor(ch, op, msg, &deadline);
+    }
+  }
+  if (res)
+    wakeup(ch);
+  return res;
+}
+
+
+#define checkchannel(L,i) \
+	(*(Channel **)luaL_checkudata(L, i, LUA_CHANNELHANDLE))
+
+
+/* Push the results of a failed transfer */
+static int failed (lua_State *L, Channel *ch) {
+  luaL_pushfail(L);
+  lua_pushstring(L, chclosed(ch) ? "closed" : "timeout");
+  return 2;
+}
+
+
+/* Push a copy of 'msg', anchored in 'box' against errors, and free it */
+static int pushmsg (lua_State *L, Encoder *box, Snapshot *msg) {
+  box->b = (char *)msg;
+  lua_newtable(L);  /* memo */
+  decode(L, msg, &msg->root, lua_gettop(L));
+  free(box->b);
+  box->b = NULL;
+  return 1;
+}
+
+
+/*
+** ch:send(v [, timeout]): append a copy of 'v' (tables are copied
+** deeply, keeping their frozen state but not their metatables). Waits
+** while the channel is full, at most 'timeout' seconds if given. Returns
+** true, or fail and "timeout" or "closed".
+*/
+static int ch_send (lua_State *L) {
+  Channel *ch = checkchannel(L, 1);
+  lua_Number timeout = luaL_optnumber(L, 3, -1);
+  Snapshot *msg;
+  luaL_argexpected(L, !lua_isnoneornil(L, 2), 2, "non-nil value");
+  if (chclosed(ch))
+    return failed(L, ch);
+  msg = snapshot(L, 2, 1);
+  if (!transfer(ch, trysend, &msg, timeout)) {
+    free(msg);
+    return failed(L, ch);
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
+/*
+** ch:recv([timeout]): remove and return the first message, waiting for
+** one at most 'timeout' seconds if given (zero polls the channel).
+** Returns fail and "timeout" or "closed" if there is none.
+*/
+static int ch_recv (lua_State *L) {
+  Channel *ch = checkchannel(L, 1);
+  lua_Number timeout = luaL_optnumber(L, 2, -1);
+  Encoder *box = newencoder(L);
+  Snapshot *msg;
+  if (!transfer(ch, tryrecv, &msg, timeout))
+    return failed(L, ch);
+  return pushmsg(L, box, msg);
+}
+
+
+static int awaitk (lua_State *L, int status, lua_KContext ctx) {
+  Channel *ch = checkchannel(L, 1);
+  Encoder *box;
+  Snapshot *msg;
+  (void)status; (void)ctx;
+  lua_settop(L, 1);  /* discard the values passed to 'resume' */
+  box = newencoder(L);
+  if (tryrecv(ch, &msg)) {
+    wakeup(ch);
+    return pushmsg(L, box, msg);
+  }
+  else if (chclosed(ch))
+    return failed(L, ch);
+  lua_settop(L, 1);
+  lua_pushvalue(L, 1);
+  return lua_yieldk(L, 1, 0, awaitk);  /* yield the channel; retry later */
+}
+
+
+/*
+** ch:await(): like 'ch:recv()', but a coroutine yields (the channel)
+** instead of blocking while the channel is empty, and retries when
+** resumed.
+*/
+static int ch_await (lua_State *L) {
+  luaL_checkudata(L, 1, LUA_CHANNELHANDLE);
+  if (!lua_isyieldable(L)) {
+    lua_settop(L, 1);
+    return ch_recv(L);
+  }
+  return awaitk(L, LUA_OK, 0);
+}
+
+
+/*
+** ch:close(): no more messages are accepted; pending ones can still be
+** received. Blocked threads are woken.
+*/
+static int ch_close (lua_State *L) {
+  Channel *ch = checkchannel(L, 1);
+  __atomic_store_n(&ch->closed, 1, __ATOMIC_RELEASE);
+  pthread_mutex_lock(&ch->lock);
+  pthread_cond_broadcast(&ch->cond);
+  pthread_mutex_unlock(&ch->lock);
+  return 0;
+}
+
+
+/* #ch: number of pending messages (a snapshot of a moving value) */
+static int ch_len (lua_State *L) {
+  Channel *ch = checkchannel(L, 1);
+  size_t tail = __atomic_load_n(&ch->tail, __ATOMIC_ACQUIRE);
+  size_t head = __atomic_load_n(&ch->head, __ATOMIC_ACQUIRE);
+  lua_pushinteger(L, (ptrdiff_t)(tail - head) > 0
+                     ? (lua_Integer)(tail - head) : 0);
+  return 1;
+}
+
+
+static int ch_tostring (lua_State *L) {
+  Channel *ch = checkchannel(L, 1);
+  lua_pushfstring(L, LUA_CHANNELHANDLE " (%s): %p",
+                     chclosed(ch) ? "closed" : "open", (void *)ch);
+  return 1;
+}
+
+
+static int ch_gc (lua_State *L) {
+  Channel **p = (Channel **)luaL_checkudata(L, 1, LUA_CHANNELHANDLE);
+  if (*p != NULL) {
+    decrefch(*p);
+    *p = NULL;
+  }
+  return 0;
+}
+
+
+static const luaL_Reg ch_meth[] = {
+  {"send", ch_send},
+  {"recv", ch_recv},
+  {"await", ch_await},
+  {"close", ch_close},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg ch_metameth[] = {
+  {"__index", NULL},  /* place holder */
+  {"__len", ch_len},
+  {"__tostring", ch_tostring},
+  {"__gc", ch_gc},
+  {NULL, NULL}
+};
+
+
+/* list of named channels (protected by 'slock') */
+typedef struct NamedChannel {
+  struct NamedChannel *next;
+  Channel *ch;
+  char name[1];
+} NamedChannel;
+
+static NamedChannel *namedchannels = NULL;
+
+
+static NamedChannel **findchannel (const char *name) {
+  NamedChannel **p;
+  for (p = &namedchannels; *p != NULL; p = &(*p)->next) {
+    if (strcmp((*p)->name, name) == 0)
+      break;
+  }
+  return p;
+}
+
+
+static lua_Integer chan_checksize (lua_State *L, int arg) {
+  lua_Integer size = luaL_optinteger(L, arg, LUAI_CHANNELSIZE);
+  luaL_argcheck(L, 1 <= size && size <= MAXCHANNELSIZE, arg,
+                   "capacity out of range");
+  return size;
+}
+
+
+/* Push a handle without a channel */
+static Channel **newhandle (lua_State *L) {
+  Channel **p = (Channel **)lua_newuserdatauv(L, sizeof(Channel *), 0);
+  *p = NULL;
+  luaL_setmetatable(L, LUA_CHANNELHANDLE);
+  return p;
+}
+
+
+/* channel.new([capacity]): a new anonymous channel */
+static int chan_new (lua_State *L) {
+  lua_Integer size = chan_checksize(L, 1);
+  Channel **p = newhandle(L);
+  if ((*p = newchannel(size)) == NULL)
+    return luaL_error(L, "not enough memory");
+  return 1;
+}
+
+
+/*
+** channel.open(name [, capacity]): the channel named 'name' in this
+** process, created with the given capacity if it does not exist yet.
+*/
+static int chan_open (lua_State *L) {
+  size_t len;
+  const char *name = luaL_checklstring(L, 1, &len);
+  lua_Integer size = chan_checksize(L, 2);
+  Channel **h = newhandle(L);
+  NamedChannel *nc, **p;
+  nc = (NamedChannel *)malloc(offsetof(NamedChannel, name) + len + 1);
+  if (nc == NULL)
+    return luaL_error(L, "not enough memory");
+  pthread_mutex_lock(&slock);
+  p = findchannel(name);
+  if (*p != NULL) {  /* existing channel? */
+    *h = (*p)->ch;
+    increfch(*h);
+  }
+  else if ((*h = newchannel(size)) != NULL) {
+    nc->ch = *h;
+    nc->next = NULL;
+    memcpy(nc->name, name, len + 1);
+    increfch(nc->ch);  /* reference from the list */
+    *p = nc;
+    nc = NULL;
+  }
+  pthread_mutex_unlock(&slock);
+  free(nc);
+  if (*h == NULL)
+    return luaL_error(L, "not enough memory");
+  return 1;
+}
+
+
+/*
+** channel.release(name): remove 'name' from the channels of the process;
+** the channel itself lives while there are handles to it.
+*/
+static int chan_release (lua_State *L) {
+  const char *name = luaL_checkstring(L, 1);
+  NamedChannel *nc = NULL, **p;
+  pthread_mutex_lock(&slock);
+  p = findchannel(name);
+  if (*p != NULL) {
+    nc = *p;
+    *p = nc->next;
+  }
+  pthread_mutex_unlock(&slock);
+  if (nc != NULL) {
+    decrefch(nc->ch);
+    free(nc);
+  }
+  lua_pushboolean(L, nc != NULL);
+  return 1;
+}
+
+
+static const luaL_Reg chan_funcs[] = {
+  {"new", chan_new},
+  {"open", chan_open},
+  {"release", chan_release},
+  {NULL, NULL}
+};
+
+/* }====================================================== */
+
+
+LUAMOD_API int luaopen_channel (lua_State *L) {
+  luaL_checkversion(L);
+  createencoder(L);
+  luaL_newmetatable(L, LUA_CHANNELHANDLE);
+  luaL_setfuncs(L, ch_metameth, 0);
+  luaL_newlibtable(L, ch_meth);
+  luaL_setfuncs(L, ch_meth, 0);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+  luaL_newlib(L, chan_funcs);
+  return 1;
+}
+
+#endif
+
+
+#if defined(LUA_USE_PARALLEL)
+
+/*
+** {======================================================
+** Parallel loops
+** =======================================================
+*/
+
+#define LUA_PARALLELJOB	"ParallelJob"
+
+/* registry field marking the states of the workers */
+#define PARALLELWORKER	"_PARALLELWORKER"
+
+/* registry field holding the pool for the states using it */
+#define PARALLELUSER	"_PARALLELUSER"
+
+/* maximum number of worker threads */
+#if !defined(LUAI_MAXPARALLEL)
+#define LUAI_MAXPARALLEL	64
+#endif
+
+/* number of chunks per worker when no grain is given */
+#define CHUNKSPERWORKER	8
+
+
+/* a range [lo, hi) of chunks, packed to be updated atomically */
+typedef unsigned long long Deque;
+
+#define MAXCHUNKS	0xffffffffu
+
+#define dqmake(lo,hi)	((Deque)(lo) | ((Deque)(hi) << 32))
+#define dqlo(d)	((size_t)((d) & MAXCHUNKS))
+#define dqhi(d)	((size_t)((d) >> 32))
+
+
+/*
+** A job splits the indices 1..n into 'nchunks' chunks of 'grain'
+** indices. Each worker owns a deque of chunks: it takes them from the
+** bottom and, once its deque is empty, steals the upper half of the
+** deque of another worker. Both ends are moved with a compare-and-swap
+** of the whole deque. The results of each chunk are encoded into a
+** snapshot of their own, decoded by the caller when all are done.
+*/
+typedef struct Job {
+  const char *code;  /* function (binary) or chunk returning it */
+  size_t codelen;
+  int ischunk;  /* 'code' must be called to get the function */
+  int nworkers;
+  int aborted;  /* some call failed (atomic) */
+  char *err;  /* first error ('malloc'; protected by 'pool.lock') */
+  Snapshot *input;  /* array to map over, or NULL for a range */
+  lua_Integer n;  /* number of indices */
+  lua_Integer grain;  /* indices per chunk */
+  size_t nchunks;
+  Deque *deques;  /* one per worker */
+  Snapshot **results;  /* one per chunk */
+} Job;
+
+
+/*
+** Worker threads, each running its own state, are created on the first
+** job and stopped (closing their states) when the last state that used
+** them is closed. Jobs run one at a time.
+*/
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t start;  /* a job was posted, or the pool is stopping */
+  pthread_cond_t done;  /* workers finished a job, or the pool is free */
+  Job *job;  /* current job */
+  unsigned int gen;  /* number of jobs posted */
+  int active;  /* workers still running the current job */
+  int busy;  /* a job is running */
+  int nworkers;
+  int users;  /* number of states using the workers */
+  int stop;  /* workers must exit */
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+           PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0, 0, 0, 0 };
+
+
+/* Take the next chunk for worker 'w' into '*c'; false if none is left */
+static int takechunk (Job *job, int w, size_t *c) {
+  Deque *own = &job->deques[w];
+  Deque old = __atomic_load_n(own, __ATOMIC_ACQUIRE);
+  int i;
+  while (dqlo(old) < dqhi(old)) {
+    Deque rest = dqmake(dqlo(old) + 1, dqhi(old));
+    if (__atomic_compare_exchange_n(own, &old, rest, 0, __ATOMIC_ACQ_REL,
+                                                        __ATOMIC_ACQUIRE)) {
+      *c = dqlo(old);
+      return 1;
+    }
+  }
+  for (i = 1; i < job->nworkers; i++) {  /* steal */
+    Deque *victim = &job->deques[(w + i) % job->nworkers];
+    old = __atomic_load_n(victim, __ATOMIC_ACQUIRE);
+    while (dqlo(old) < dqhi(old)) {
+      size_t lo = dqlo(old), hi = dqhi(old);
+      size_t k = (hi - lo + 1) / 2;  /* upper half, rounded up */
+      if (__atomic_compare_exchange_n(victim, &old, dqmake(lo, hi - k),
+                                      0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* only the owner changes an empty deque */
+        __atomic_store_n(own, dqmake(hi - k + 1, hi), __ATOMIC_RELEASE);
+        *c = hi - k;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+
+/*
+** Call the function (at index 1) for each index of chunk 'c', collecting
+** the results into a table encoded as the snapshot of the chunk.
+*/
+static void runchunk (lua_State *L, Job *job, size_t c) {
+  lua_Integer first = (lua_Integer)c * job->grain;  /* zero based */
+  lua_Integer last = (job->n - first > job->grain) ? first + job->grain
+                                                   : job->n;
+  const STable *t = (job->input != NULL)
+                  ? stable(job->input, job->input->root.u.off) : NULL;
+  lua_Integer i;
+  int res;
+  lua_createtable(L, (last - first < INT_MAX) ? (int)(last - first)
+                                              : INT_MAX, 0);
+  res = lua_gettop(L);
+  lua_newtable(L);  /* memo for decoded tables */
+  for (i = first; i < last; i++) {
+    lua_pushvalue(L, 1);
+    if (t != NULL) {
+      decode(L, job->input, &starray(t)[i], res + 1);
+      lua_pushinteger(L, i + 1);
+      lua_call(L, 2, 1);
+    }
+    else {
+      lua_pushinteger(L, i + 1);
+      lua_call(L, 1, 1);
+    }
+    lua_rawseti(L, res, i - first + 1);
+  }
+  job->results[c] = snapshot(L, res, 1);
+  lua_settop(L, res - 1);
+}
+
+
+static int workerjob (lua_State *L) {
+  Job *job = (Job *)lua_touserdata(L, 1);
+  int w = (int)lua_tointeger(L, 2);
+  size_t c;
+  lua_settop(L, 0);
+  if (luaL_loadbufferx(L, job->code, job->codelen, "=(parallel)",
+                          job->ischunk ? NULL : "b") != LUA_OK)
+    return lua_error(L);
+  if (job->ischunk)
+    lua_call(L, 0, 1);
+  if (!lua_isfunction(L, 1))
+    return luaL_error(L, "parallel chunk must return a function");
+  while (!__atomic_load_n(&job->aborted, __ATOMIC_ACQUIRE)
+         && takechunk(job, w, &c))
+    runchunk(L, job, c);
+  return 0;
+}
+
+
+/* Run the share of worker 'w' in 'job', recording the first error */
+static void runjob (lua_State *L, Job *job, int w) {
+  lua_pushcfunction(L, workerjob);
+  lua_pushlightuserdata(L, job);
+  lua_pushinteger(L, w);
+  if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+    const char *msg = lua_tostring(L, -1);
+    if (msg == NULL)
+      msg = "(error object is not a string)";
+    __atomic_store_n(&job->aborted, 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&pool.lock);
+    if (job->err == NULL && (job->err = (char *)malloc(strlen(msg) + 1)))
+      strcpy(job->err, msg);
+    pthread_mutex_unlock(&pool.lock);
+  }
+  lua_settop(L, 0);
+}
+
+
+static int openworker (lua_State *L) {
+  luaL_openlibs(L);
+  lua_pushboolean(L, 1);
+  lua_setfield(L, LUA_REGISTRYINDEX, PARALLELWORKER);
+  return 0;
+}
+
+
+static void *workermain (void *ud) {
+  int w = (int)(ptrdiff_t)ud;
+  unsigned int seen = 0;  /* workers are created before the first job */
+  lua_State *L = luaL_newstate();
+  if (L != NULL) {
+    lua_pushcfunction(L, openworker);
+    if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+      lua_close(L);
+      L = NULL;  /* others will steal the chunks of this worker */
+    }
+  }
+  pthread_mutex_lock(&pool.lock);
+  for (;;) {
+    Job *job;
+    while (pool.gen == seen && !pool.stop)
+      pthread_cond_wait(&pool.start, &pool.lock);
+    if (pool.stop)
+      break;
+    seen = pool.gen;
+    job = pool.job;
+    pthread_mutex_unlock(&pool.lock);
+    if (L != NULL)
+      runjob(L, job, w);
+    pthread_mutex_lock(&pool.lock);
+    if (--pool.active == 0)
+      pthread_cond_broadcast(&pool.done);
+  }
+  pthread_mutex_unlock(&pool.lock);
+  if (L != NULL)
+    lua_close(L);
+  pthread_mutex_lock(&pool.lock);
+  if (--pool.nworkers == 0)
+    pthread_cond_broadcast(&pool.done);
+  pthread_mutex_unlock(&pool.lock);
+  return NULL;
+}
+
+
+/*
+** Finalizer of the registry entry of a state using the workers: the
+** last one stops them and waits until their states are closed.
+*/
+static int pool_gc (lua_State *L) {
+  (void)L;
+  pthread_mutex_lock(&pool.lock);
+  if (--pool.users == 0 && pool.nworkers > 0) {
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.start);
+    while (pool.nworkers > 0)
+      pthread_cond_wait(&pool.done, &pool.lock);
+    pool.stop = 0;
+    pool.gen = 0;  /* new workers start from the first job again */
+    pthread_cond_broadcast(&pool.done);
+  }
+  pthread_mutex_unlock(&pool.lock);
+  return 0;
+}
+
+
+/* Number of workers, starting them if needed */
+static int startpool (lua_State *L) {
+  int n;
+  if (lua_getfield(L, LUA_REGISTRYINDEX, PARALLELUSER) == LUA_TNIL) {
+    lua_getfield(L, LUA_REGISTRYINDEX, PARALLELWORKER);
+    if (!lua_toboolean(L, -1)) {  /* workers do not keep the pool alive */
+      lua_newuserdatauv(L, 0, 0);
+      lua_createtable(L, 0, 1);
+      lua_pushcfunction(L, pool_gc);
+      lua_setfield(L, -2, "__gc");
+      lua_setmetatable(L, -2);
+      pthread_mutex_lock(&pool.lock);
+      pool.users++;
+      pthread_mutex_unlock(&pool.lock);
+      lua_setfield(L, LUA_REGISTRYINDEX, PARALLELUSER);
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+  pthread_mutex_lock(&pool.lock);
+  while (pool.stop)  /* previous workers still exiting? */
+    pthread_cond_wait(&pool.done, &pool.lock);
+  if (pool.nworkers == 0) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int i, want = (ncpu < 1) ? 1
+                : (ncpu > LUAI_MAXPARALLEL) ? LUAI_MAXPARALLEL : (int)ncpu;
+    for (i = 0; i < want; i++) {
+      pthread_t th;
+      if (pthread_create(&th, NULL, workermain, (void *)(ptrdiff_t)i) != 0)
+        break;
+      pthread_detach(th);
+    }
+    pool.nworkers = i;
+  }
+  n = pool.nworkers;
+  pthread_mutex_unlock(&pool.lock);
+  if (n == 0)
+    luaL_error(L, "cannot create worker threads");
+  return n;
+}
+
+
+/* Post 'job' and wait for the workers to finish it */
+static void submit (Job *job) {
+  pthread_mutex_lock(&pool.lock);
+  while (pool.busy)
+    pthread_cond_wait(&pool.done, &pool.lock);
+  pool.busy = 1;
+  pool.job = job;
+  pool.active = pool.nworkers;
+  pool.gen++;
+  pthread_cond_broadcast(&pool.start);
+  while (pool.active > 0)
+    pthread_cond_wait(&pool.done, &pool.lock);
+  pool.busy = 0;
+  pool.job = NULL;
+  pthread_cond_broadcast(&pool.done);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+
+static int job_gc (lua_State *L) {
+  Job *job = (Job *)luaL_checkudata(L, 1, LUA_PARALLELJOB);
+  size_t c;
+  for (c = 0; c < job->nchunks; c++) {
+    free(job->results[c]);
+    job->results[c] = NULL;
+  }
+  free(job->input);
+  job->input = NULL;
+  free(job->err);
+  job->err = NULL;
+  return 0;
+}
+
+
+static Job *newjob (lua_State *L, int nworkers, size_t nchunks) {
+  size_t dsize = (size_t)nworkers * sizeof(Deque);
+  Job *job = (Job *)lua_newuserdatauv(L, salign(sizeof(Job)) + dsize
+                                         + nchunks * sizeof(Snapshot *), 0);
+  memset(job, 0, sizeof(Job));
+  job->deques = (Deque *)((char *)job + salign(sizeof(Job)));
+  job->results = (Snapshot **)((char *)job->deques + dsize);
+  memset(job->results, 0, nchunks * sizeof(Snapshot *));
+  job->nworkers = nworkers;
+  job->nchunks = nchunks;  /* results are now valid for the finalizer */
+  luaL_setmetatable(L, LUA_PARALLELJOB);
+  return job;
+}
+
+
+struct DumpWriter {
+  int init;
+  luaL_Buffer B;
+};
+
+
+static int dumpwriter (lua_State *L, const void *b, size_t size, void *ud) {
+  struct DumpWriter *state = (struct DumpWriter *)ud;
+  if (!state->init) {  /* keep the function on the top for 'lua_dump' */
+    state->init = 1;
+    luaL_buffinit(L, &state->B);
+  }
+  luaL_addlstring(&state->B, (const char *)b, size);
+  return 0;
+}
+
+
+/*
+** Push the code of the function at 'arg': its binary chunk, if it is a
+** Lua function whose only upvalue is _ENV, or the source of a chunk
+** returning the function. Returns whether the code is such a chunk.
+*/
+static int pushcode (lua_State *L, int arg) {
+  if (lua_type(L, arg) == LUA_TSTRING) {
+    lua_pushvalue(L, arg);
+    return 1;
+  }
+  else {
+    struct DumpWriter state;
+    const char *name;
+    int i;
+    luaL_checktype(L, arg, LUA_TFUNCTION);
+    luaL_argexpected(L, !lua_iscfunction(L, arg), arg, "Lua function");
+    for (i = 1; (name = lua_getupvalue(L, arg, i)) != NULL; i++) {
+      lua_pop(L, 1);
+      luaL_argcheck(L, i == 1 && strcmp(name, "_ENV") == 0, arg,
+                       "function cannot have upvalues other than _ENV");
+    }
+    lua_pushvalue(L, arg);
+    state.init = 0;
+    if (lua_dump(L, dumpwriter, &state, 0) != 0)
+      luaL_error(L, "unable to dump given function");
+    luaL_pushresult(&state.B);
+    lua_remove(L, -2);  /* function copy */
+    return 0;
+  }
+}
+
+
+/*
+** Push the table of the results of chunk 'c', at their indices, into
+** the table at the top of the stack.
+*/
+static void gather (lua_State *L, Job *job, size_t c) {
+  Snapshot *s = job->results[c];
+  const STable *t = stable(s, s->root.u.off);
+  lua_Integer base = (lua_Integer)c * job->grain;
+  size_t i;
+  lua_newtable(L);  /* memo */
+  for (i = 0; i < t->asize; i++) {
+    if (starray(t)[i].tt != SV_NIL) {
+      decode(L, s, &starray(t)[i], lua_gettop(L));
+      lua_rawseti(L, -3, base + (lua_Integer)i + 1);
+    }
+  }
+  for (i = 0; i < t->hsize; i++) {  /* results after a nil */
+    const SNode *node = &stnode(t)[i];
+    if (node->key.tt == SV_INT) {
+      decode(L, s, &node->val, lua_gettop(L));
+      lua_rawseti(L, -3, base + node->key.u.i);
+    }
+  }
+  lua_pop(L, 1);
+  job->results[c] = NULL;
+  free(s);
+}
+
+
+/*
+** Call the function at 'f' for the indices 1..n on the workers, with
+** the values of the array at 't' (if not zero), and return the table of
+** the results. 'g' is the index of the optional grain.
+*/
+static int parallel (lua_State *L, int f, lua_Integer n, int t, int g) {
+  lua_Integer grain = luaL_optinteger(L, g, 0);
+  int ischunk, nworkers, w;
+  size_t nchunks, c;
+  Job *job;
+  luaL_argcheck(L, grain >= 0, g, "negative grain");
+  lua_getfield(L, LUA_REGISTRYINDEX, PARALLELWORKER);
+  if (lua_toboolean(L, -1))
+    return luaL_error(L, "parallel loops cannot be nested");
+  lua_pop(L, 1);
+  ischunk = pushcode(L, f);
+  if (n <= 0) {
+    lua_newtable(L);
+    return 1;
+  }
+  nworkers = startpool(L);
+  if (grain == 0)
+    grain = (n - 1) / ((lua_Integer)nworkers * CHUNKSPERWORKER) + 1;
+  luaL_argcheck(L, (n - 1) / grain < (lua_Integer)MAXCHUNKS, g,
+                   "grain too small");
+  nchunks = (size_t)((n - 1) / grain) + 1;
+  job = newjob(L, nworkers, nchunks);
+  job->code = lua_tolstring(L, -2, &job->codelen);
+  job->ischunk = ischunk;
+  job->n = n;
+  job->grain = grain;
+  if (t != 0)
+    job->input = snapshot(L, t, 1);
+  for (w = 0; w < nworkers; w++)  /* contiguous shares */
+    job->deques[w] = dqmake(nchunks * (size_t)w / (size_t)nworkers,
+                            nchunks * (size_t)(w + 1) / (size_t)nworkers);
+  submit(job);
+  if (job->aborted)
+    return luaL_error(L, "%s", job->err ? job->err : "not enough memory");
+  lua_createtable(L, (n < INT_MAX) ? (int)n : INT_MAX, 0);
+  for (c = 0; c < nchunks; c++)
+    gather(L, job, c);
+  return 1;
+}
+
+
+/*
+** parallel.map(f, t [, grain]): table with the results of f(t[i], i)
+** for i = 1..#t, computed by the worker threads.
+*/
+static int par_map (lua_State *L) {
+  luaL_checktype(L, 2, LUA_TTABLE);
+  return parallel(L, 1, (lua_Integer)lua_rawlen(L, 2), 2, 3);
+}
+
+
+/*
+** parallel.range(n, f [, grain]): table with the results of f(i) for
+** i = 1..n, computed by the worker threads.
+*/
+static int par_range (lua_State *L) {
+  lua_Integer n = luaL_checkinteger(L, 1);
+  return parallel(L, 2, n, 0, 3);
+}
+
+
+/* parallel.workers(): number of worker threads */
+static int par_workers (lua_State *L) {
+  lua_pushinteger(L, startpool(L));
+  return 1;
+}
+
+
+static const luaL_Reg par_funcs[] = {
+  {"map", par_map},
+  {"range", par_range},
+  {"workers", par_workers},
+  {NULL, NULL}
+};
+
+/* }====================================================== */
+
+
+LUAMOD_API int luaopen_parallel (lua_State *L) {
+  luaL_checkversion(L);
+  createencoder(L);
+  if (luaL_newmetatable(L, LUA_PARALLELJOB)) {
+    lua_pushcfunction(L, job_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_pop(L, 1);
+  luaL_newlib(L, par_funcs);
+  return 1;
+}
+
+#endif
+
+#endif
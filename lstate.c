@@ -13,6 +13,11 @@
 #include <stddef.h>
 #include <string.h>
 
+#if defined(LUA_USE_LOCK)
+#include <sched.h>
+#include <time.h>
+#endif
+
 #include "lua.h"
 
 #include "lapi.h"
@@ -210,6 +215,152 @@ static void freestack (lua_State *L) {
 }
 
 
+#if defined(LUA_USE_THREADPOOL)
+/*
+** {==================================================================
+** Thread Pool
+** ===================================================================
+*/
+
+/* maximum number of freed threads kept for reuse */
+#if !defined(LUAI_THREADPOOL)
+#define LUAI_THREADPOOL		64
+#endif
+
+/* threads with larger stacks are released */
+#if !defined(LUAI_THREADPOOLSTACK)
+#define LUAI_THREADPOOLSTACK	(4 * BASIC_STACK_SIZE)
+#endif
+
+/* maximum number of CallInfo structures kept by a pooled thread */
+#if !defined(LUAI_THREADPOOLCI)
+#define LUAI_THREADPOOLCI	16
+#endif
+
+
+/*
+** Keep the memory of a dead thread, including its stack and CallInfo
+** list, for a later 'lua_newthread'. Pooled threads are linked through
+** 'twups' (reset by 'preinit_thread') and their stack is saved in
+** 'tbclist', as 'preinit_thread' clears 'stack'.
+*/
+static int poolthread (lua_State *L1) {
+  global_State *g = G(L1);
+  if (g->nthreadpool >= LUAI_THREADPOOL || g->gcemergency ||
+      L1->stack == NULL || stacksize(L1) > LUAI_THREADPOOLSTACK)
+    return 0;
+  L1->ci = &L1->base_ci;
+  if (L1->nci > LUAI_THREADPOOLCI)
+    luaE_freeCI(L1);
+  L1->tbclist = L1->stack;
+  L1->twups = g->threadpool;
+  g->threadpool = L1;
+  g->nthreadpool++;
+  return 1;
+}
+
+
+/*
+** Restore the stack of a thread taken from the pool (after
+** 'preinit_thread') and bring it to the state of 'stack_init'.
+*/
+static void stack_reuse (lua_State *L1) {
+  int i; CallInfo *ci;
+  L1->stack = L1->tbclist;
+  for (i = 0; i < stacksize(L1) + EXTRA_STACK; i++)
+    setnilvalue(s2v(L1->stack + i));  /* erase old stack */
+  for (ci = L1->base_ci.next; ci != NULL; ci = ci->next)
+    L1->nci++;  /* kept CallInfo structures */
+  L1->top = L1->stack;
+  ci = &L1->base_ci;
+  ci->previous = NULL;
+  ci->callstatus = CIST_C;
+  ci->func = L1->top;
+  ci->u.c.k = NULL;
+  ci->nresults = 0;
+  setnilvalue(s2v(L1->top));  /* 'function' entry for this 'ci' */
+  L1->top++;
+  ci->top = L1->top + LUA_MINSTACK;
+  L1->ci = ci;
+}
+
+
+/*
+** Release all pooled threads. Called by full collections and when
+** closing the state.
+*/
+void luaE_freethreadpool (lua_State *L) {
+  global_State *g = G(L);
+  while (g->threadpool != NULL) {
+    lua_State *L1 = g->threadpool;
+    g->threadpool = L1->twups;
+    g->nthreadpool--;
+    freestack(L1);
+    luaM_free(L, fromstate(L1));
+  }
+  lua_assert(g->nthreadpool == 0);
+}
+
+/* }================================================================== */
+#endif
+
+
+#if defined(LUA_USE_LOCK)
+/*
+** {==================================================================
+** State Lock
+** ===================================================================
+*/
+
+/* attempts to take a busy lock before blocking on it */
+#if !defined(LUAI_LOCKSPIN)
+#define LUAI_LOCKSPIN		100
+#endif
+
+
+static lu_mem locknow (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return cast(lu_mem, ts.tv_sec) * 1000000000u + cast(lu_mem, ts.tv_nsec);
+}
+
+
+/*
+** Slow path of 'lua_lock': the lock is held by another thread. Most
+** critical sections are short, so spin for a while before blocking.
+*/
+void luaE_lockwait (l_Lock *lk) {
+  lu_mem start;
+  int i;
+  for (i = 0; i < LUAI_LOCKSPIN; i++) {
+    if (pthread_mutex_trylock(&lk->m) == 0) {
+      lk->ncontended++;
+      return;
+    }
+  }
+  start = locknow();
+  __atomic_add_fetch(&lk->waiting, 1, __ATOMIC_RELAXED);
+  pthread_mutex_lock(&lk->m);
+  __atomic_sub_fetch(&lk->waiting, 1, __ATOMIC_RELAXED);
+  lk->ncontended++;
+  lk->waitns += locknow() - start;
+}
+
+
+/*
+** Called at yield points of the interpreter ('luai_threadyield') when
+** other threads are blocked on the lock: release it and let them run.
+*/
+void luaE_lockyield (lua_State *L) {
+  lua_unlock(L);
+  sched_yield();
+  lua_lock(L);
+}
+
+/* }================================================================== */
+#endif
+
+
 /*
 ** Create registry table and its predefined values
 */
@@ -276,8 +427,20 @@ static void close_state (lua_State *L) {
     luaC_freeallobjects(L);  /* collect all objects */
     luai_userstateclose(L);
   }
+#if defined(LUA_USE_THREADPOOL)
+  luaE_freethreadpool(L);
+#endif
   luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
   freestack(L);
+#if defined(LUA_USE_ASYNCFREE)
+  luaC_asyncfree(L, 0);  /* release deferred blocks and stop the thread */
+#endif
+#if defined(LUA_USE_LOCK)
+#if defined(LUAI_STATELOCK)
+  lua_unlock(L);  /* locked by 'lua_close' (or 'lua_newstate') */
+#endif
+  pthread_mutex_destroy(&g->lock.m);
+#endif
   lua_assert(gettotalbytes(g) == sizeof(LG));
   (*g->frealloc)(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
 }
@@ -286,10 +449,21 @@ static void close_state (lua_State *L) {
 LUA_API lua_State *lua_newthread (lua_State *L) {
   global_State *g;
   lua_State *L1;
+#if defined(LUA_USE_THREADPOOL)
+  int pooled = 0;
+#endif
   lua_lock(L);
   g = G(L);
   luaC_checkGC(L);
   /* create new thread */
+#if defined(LUA_USE_THREADPOOL)
+  if ((L1 = g->threadpool) != NULL) {  /* reuse a freed thread? */
+    g->threadpool = L1->twups;
+    g->nthreadpool--;
+    pooled = 1;
+  }
+  else
+#endif
   L1 = &cast(LX *, luaM_newobject(L, LUA_TTHREAD, sizeof(LX)))->l;
   L1->marked = luaC_white(g);
   L1->tt = LUA_VTHREAD;
@@ -308,6 +482,11 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
   memcpy(lua_getextraspace(L1), lua_getextraspace(g->mainthread),
          LUA_EXTRASPACE);
   luai_userstatethread(L, L1);
+#if defined(LUA_USE_THREADPOOL)
+  if (pooled)
+    stack_reuse(L1);  /* reuse stack */
+  else
+#endif
   stack_init(L1, L);  /* init stack */
   lua_unlock(L);
   return L1;
@@ -319,6 +498,10 @@ void luaE_freethread (lua_State *L, lua_State *L1) {
   luaF_closeupval(L1, L1->stack);  /* close all upvalues */
   lua_assert(L1->openupval == NULL);
   luai_userstatefree(L, L1);
+#if defined(LUA_USE_THREADPOOL)
+  if (poolthread(L1))
+    return;
+#endif
   freestack(L1);
   luaM_free(L, l);
 }
@@ -382,6 +565,27 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->gckind = KGC_INC;
   g->gcstopem = 0;
   g->gcemergency = 0;
+#if defined(LUAGLM_EXT_API)
+  g->tabrehash = g->tabgrow = 0;
+#endif
+#if defined(LUAGLM_EXT_GCBUDGET)
+  g->gcbudget = 0;
+  g->gcpausecount = g->gcpausetotal = 0;
+  g->gcpauselast = g->gcpausemax = 0;
+#endif
+#if defined(LUA_USE_THREADPOOL)
+  g->threadpool = NULL;
+  g->nthreadpool = 0;
+#endif
+#if defined(LUA_USE_ASYNCFREE)
+  g->gcdeferfree = 0;
+  g->asyncfree = NULL;
+#endif
+#if defined(LUA_USE_LOCK)
+  pthread_mutex_init(&g->lock.m, NULL);
+  g->lock.waiting = 0;
+  g->lock.nlock = g->lock.ncontended = g->lock.waitns = 0;
+#endif
   g->finobj = g->tobefnz = g->fixedgc = NULL;
   g->firstold1 = g->survival = g->old1 = g->reallyold = NULL;
   g->finobjsur = g->finobjold1 = g->finobjrold = NULL;
@@ -401,6 +605,9 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   for (i=0; i < LUA_NUMTAGS; i++) g->mt[i] = NULL;
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {
     /* memory allocation error: free partial state */
+#if defined(LUAI_STATELOCK)
+    lua_lock(L);  /* 'close_state' releases the lock */
+#endif
     close_state(L);
     L = NULL;
   }
@@ -417,8 +624,16 @@ LUA_API void lua_close (lua_State *L) {
 
 void luaE_warning (lua_State *L, const char *msg, int tocont) {
   lua_WarnFunction wf = G(L)->warnf;
-  if (wf != NULL)
+  if (wf != NULL) {
+#if defined(LUAI_STATELOCK)
+    void *ud = G(L)->ud_warn;
+    lua_unlock(L);  /* warning functions may call 'lua_setwarnf' */
+    wf(ud, msg, tocont);
+    lua_lock(L);
+#else
     wf(G(L)->ud_warn, msg, tocont);
+#endif
+  }
 }
 
 
@@ -127,6 +127,23 @@ struct lua_longjmp;  /* defined in ldo.c */
 #endif
 
 
+/*
+** Lock of a global state driven by several OS threads (LUA_USE_LOCK).
+** The counters are only updated while holding the lock.
+*/
+#if defined(LUA_USE_LOCK)
+#include <pthread.h>
+
+typedef struct l_Lock {
+  pthread_mutex_t m;
+  int waiting;  /* number of threads blocked on 'm' (atomic) */
+  lu_mem nlock;  /* number of acquisitions */
+  lu_mem ncontended;  /* acquisitions that found the lock taken */
+  lu_mem waitns;  /* time spent blocked on the lock, in nanoseconds */
+} l_Lock;
+#endif
+
+
 /*
 ** Extra stack space to handle TM calls and some other extras. This
 ** space is not included in 'stack_last'. It is used only to avoid stack
@@ -268,6 +285,28 @@ typedef struct global_State {
   lu_byte gcpause;  /* size of pause between successive GCs */
   lu_byte gcstepmul;  /* GC "speed" */
   lu_byte gcstepsize;  /* (log2 of) GC granularity */
+#if defined(LUAGLM_EXT_API)
+  lu_mem tabrehash;  /* number of table rehashes (full key counts) */
+  lu_mem tabgrow;  /* number of array parts grown by appends */
+#endif
+#if defined(LUAGLM_EXT_GCBUDGET)
+  lu_mem gcbudget;  /* time limit (microseconds) of a step; 0 to disable */
+  lu_mem gcpausecount;  /* number of measured collector steps */
+  lu_mem gcpausetotal;  /* accumulated duration of measured steps */
+  lu_mem gcpauselast;  /* duration of the last measured step */
+  lu_mem gcpausemax;  /* duration of the longest measured step */
+#endif
+#if defined(LUA_USE_THREADPOOL)
+  struct lua_State *threadpool;  /* list of freed threads kept for reuse */
+  int nthreadpool;  /* number of threads in 'threadpool' */
+#endif
+#if defined(LUA_USE_ASYNCFREE)
+  lu_byte gcdeferfree;  /* true while a sweep defers its frees */
+  struct AsyncFree *asyncfree;  /* background release of swept blocks */
+#endif
+#if defined(LUA_USE_LOCK)
+  l_Lock lock;  /* see 'lua_lock' */
+#endif
   GCObject *allgc;  /* list of all collectable objects */
   GCObject **sweepgc;  /* current position of sweep in list */
   GCObject *finobj;  /* list of collectable objects with finalizers */
@@ -400,6 +439,24 @@ LUAI_FUNC void luaE_incCstack (lua_State *L);
 LUAI_FUNC void luaE_warning (lua_State *L, const char *msg, int tocont);
 LUAI_FUNC void luaE_warnerror (lua_State *L, const char *where);
 LUAI_FUNC int luaE_resetthread (lua_State *L, int status);
+#if defined(LUA_USE_THREADPOOL)
+LUAI_FUNC void luaE_freethreadpool (lua_State *L);
+#endif
+#if defined(LUA_USE_LOCK)
+LUAI_FUNC void luaE_lockwait (l_Lock *lk);
+LUAI_FUNC void luaE_lockyield (lua_State *L);
+
+/* the uncontended path takes the lock with a single 'trylock' */
+#define luaE_lock(L)  \
+	((void)(l_likely(pthread_mutex_trylock(&G(L)->lock.m) == 0) || \
+	        (luaE_lockwait(&G(L)->lock), 1)), G(L)->lock.nlock++)
+#define luaE_unlock(L)	((void)pthread_mutex_unlock(&G(L)->lock.m))
+
+/* give the lock away, at yield points, only if some thread waits for it */
+#define luaE_threadyield(L)  \
+	{ if (__atomic_load_n(&G(L)->lock.waiting, __ATOMIC_RELAXED) > 0) \
+	    luaE_lockyield(L); }
+#endif
 
 
 #endif
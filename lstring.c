@@ -266,6 +266,73 @@ TString *luaS_toblob (lua_State *L, TString *str) {
 }
 #endif
 
+#if defined(LUAGLM_EXT_STRBUF)
+/* block of a string buffer, from the address of its contents */
+#define buffblock(b)	(cast_charp(b) - offsetof(TString, contents))
+
+/*
+** (Re)allocate a string buffer with room for 'nsize' characters (plus the
+** ending zero); 'nsize' == 0 frees it.
+*/
+char *luaS_reallocbuff (lua_State *L, char *buff, size_t osize,
+                                                  size_t nsize) {
+  char *block = (buff == NULL) ? NULL : buffblock(buff);
+  if (nsize == 0) {
+    if (block != NULL)
+      luaM_freemem(L, block, sizelstring(osize));
+    return NULL;
+  }
+  if (l_unlikely(nsize >= (MAX_SIZE - sizeof(TString))/sizeof(char)))
+    luaM_toobig(L);
+  block = cast_charp(luaM_saferealloc_(L, block,
+                     (block == NULL) ? 0 : sizelstring(osize),
+                     sizelstring(nsize)));
+  return block + offsetof(TString, contents);
+}
+
+
+/*
+** Create a string (with variant 'tag') from the first 'l' characters of
+** a string buffer of 'size' characters, consuming the buffer. A long
+** string takes over the block, shrunk to its length; short strings are
+** interned, and a shrink that fails falls back to a copy. If this raises
+** an error, the buffer is left untouched.
+*/
+TString *luaS_newbuffstr (lua_State *L, char *buff, size_t size, size_t l,
+                                        int tag) {
+  char *block = buffblock(buff);
+  TString *ts;
+  lua_assert(l <= size);
+  if (tag == LUA_VLNGSTR && l <= LUAI_MAXSHORTLEN)
+    ts = luaS_newlstr(L, buff, l);
+#if defined(LUAGLM_EXT_BLOB)
+  else if (tag == LUA_VBLOBSTR && l <= LUAI_MAXSHORTLEN) {
+    ts = luaS_newblob(L, l);  /* blobs have a minimum length */
+    memcpy(getstr(ts), buff, l * sizeof(char));
+  }
+#endif
+  else {
+    char *nblock = (l == size) ? block
+                 : cast_charp(luaM_realloc_(L, block, sizelstring(size),
+                                                      sizelstring(l)));
+    if (nblock != NULL) {
+      GCObject *o = luaC_adoptobj(L, tag, nblock);
+      ts = gco2ts(o);
+      ts->hash = G(L)->seed;
+      ts->extra = 0;
+      ts->u.lnglen = l;
+      getstr(ts)[l] = '\0';  /* ending 0 */
+      return ts;
+    }
+    ts = createstrobj(L, l, tag, G(L)->seed);
+    ts->u.lnglen = l;
+    memcpy(getstr(ts), buff, l * sizeof(char));
+  }
+  luaM_freemem(L, block, sizelstring(size));
+  return ts;
+}
+#endif
+
 /*
 ** Create or reuse a zero-terminated string, first checking in the
 ** cache (using the string address as a key). The cache can contain
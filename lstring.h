@@ -64,4 +64,15 @@ LUAI_FUNC TString *luaS_newblob (lua_State *L, size_t l);
 LUAI_FUNC TString *luaS_toblob (lua_State *L, TString *str);
 #endif
 
+#if defined(LUAGLM_EXT_STRBUF)
+/*
+** String buffers: blocks with the layout of a long string, addressed by
+** their contents, that become strings without copying those contents.
+*/
+LUAI_FUNC char *luaS_reallocbuff (lua_State *L, char *buff, size_t osize,
+                                                            size_t nsize);
+LUAI_FUNC TString *luaS_newbuffstr (lua_State *L, char *buff, size_t size,
+                                                  size_t l, int tag);
+#endif
+
 #endif
@@ -392,6 +392,15 @@ static int writer (lua_State *L, const void *b, size_t size, void *ud) {
 static int str_dump (lua_State *L) {
   struct str_Writer state;
   int strip = lua_toboolean(L, 2);
+  if (lua_type(L, 2) == LUA_TSTRING) {  /* strip line information only? */
+    static const char *const opts[] = {"lines", NULL};
+    luaL_checkoption(L, 2, NULL, opts);
+    strip = LUA_DUMPNOLINES;
+  }
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  if (lua_toboolean(L, 3))  /* nested functions decoded on first use? */
+    strip |= LUA_DUMPLAZY;
+#endif
   luaL_checktype(L, 1, LUA_TFUNCTION);
   lua_settop(L, 1);  /* ensure function is on the top of the stack */
   state.init = 0;
@@ -2063,6 +2072,231 @@ static int str_blobunpack (lua_State *L) {
 /* }====================================================== */
 
 
+#if defined(LUAGLM_EXT_STRBUF)
+/*
+** {======================================================
+** STRING BUFFERS
+** =======================================================
+*/
+
+#define LUA_STRBUF	"strbuf"
+
+
+/*
+** A growable string: appending costs amortized constant time per
+** character, instead of the copy of the whole prefix done by each '..'
+** of a loop building a string. The contents live in a buffer allocated
+** by 'lua_reallocbuff', so 'take' can turn them into a string without
+** copying.
+*/
+typedef struct StrBuf {
+  char *b;  /* contents ('lua_reallocbuff') */
+  size_t n;  /* number of characters in use */
+  size_t size;  /* capacity of 'b' */
+} StrBuf;
+
+
+#define checkstrbuf(L,i)	((StrBuf *)luaL_checkudata(L, i, LUA_STRBUF))
+
+
+/* make room for 'sz' more characters and return a pointer to them */
+static char *sb_prep (lua_State *L, StrBuf *sb, size_t sz) {
+  if (sz > sb->size - sb->n) {
+    size_t newsize = (sb->size < LUAL_BUFFERSIZE) ? LUAL_BUFFERSIZE
+                                                  : sb->size;
+    if (l_unlikely(MAX_SIZET - sz < sb->n))
+      luaL_error(L, "string buffer too large");
+    while (newsize - sb->n < sz)
+      newsize = (newsize <= MAX_SIZET / 2) ? newsize * 2 : sb->n + sz;
+    sb->b = lua_reallocbuff(L, sb->b, sb->size, newsize);
+    sb->size = newsize;
+  }
+  return sb->b + sb->n;
+}
+
+
+static void sb_addlstring (lua_State *L, StrBuf *sb, const char *s,
+                                                     size_t l) {
+  if (l > 0) {
+    memcpy(sb_prep(L, sb, l), s, l * sizeof(char));
+    sb->n += l;
+  }
+}
+
+
+/* append the value at the top of the stack and pop it */
+static void sb_addvalue (lua_State *L, StrBuf *sb) {
+  size_t l;
+  const char *s = lua_tolstring(L, -1, &l);
+  sb_addlstring(L, sb, s, l);
+  lua_pop(L, 1);
+}
+
+
+static int sb_new (lua_State *L) {
+  lua_Integer size = luaL_optinteger(L, 1, 0);
+  StrBuf *sb;
+  luaL_argcheck(L, 0 <= size && (lua_Unsigned)size < MAXSIZE, 1,
+                   "invalid capacity");
+  sb = (StrBuf *)lua_newuserdatauv(L, sizeof(StrBuf), 0);
+  sb->b = NULL;
+  sb->n = sb->size = 0;
+  luaL_setmetatable(L, LUA_STRBUF);
+  if (size > 0)
+    sb_prep(L, sb, (size_t)size);
+  return 1;
+}
+
+
+/*
+** sb:append(v1, v2, ...): strings are added as they are and other values
+** as by 'tostring'.
+*/
+static int sb_append (lua_State *L) {
+  StrBuf *sb = checkstrbuf(L, 1);
+  int i, n = lua_gettop(L);
+  for (i = 2; i <= n; i++) {
+    if (lua_type(L, i) == LUA_TSTRING) {
+      size_t l;
+      const char *s = lua_tolstring(L, i, &l);
+      sb_addlstring(L, sb, s, l);
+    }
+    else {
+      luaL_tolstring(L, i, NULL);
+      sb_addvalue(L, sb);
+    }
+  }
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+/* call 'f' with the arguments following the buffer and append its result */
+static int sb_call (lua_State *L, lua_CFunction f) {
+  StrBuf *sb = checkstrbuf(L, 1);
+  lua_pushcfunction(L, f);
+  lua_rotate(L, 2, 1);
+  lua_call(L, lua_gettop(L) - 2, 1);
+  sb_addvalue(L, sb);
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+/* sb:format(fmt, ...) */
+static int sb_format (lua_State *L) {
+  return sb_call(L, str_format);
+}
+
+
+/* sb:pack(fmt, v1, v2, ...) */
+static int sb_pack (lua_State *L) {
+  return sb_call(L, str_pack);
+}
+
+
+static int sb_tostring (lua_State *L) {
+  StrBuf *sb = checkstrbuf(L, 1);
+  lua_pushlstring(L, (sb->b != NULL) ? sb->b : "", sb->n);
+  return 1;
+}
+
+
+/*
+** sb:take([blob]): return the contents as a string (a blob when 'blob' is
+** true) and empty the buffer. Contents longer than a short string become
+** the result without being copied.
+*/
+static int sb_take (lua_State *L) {
+  StrBuf *sb = checkstrbuf(L, 1);
+  int blob = 0;
+#if defined(LUAGLM_EXT_BLOB)
+  blob = lua_toboolean(L, 2);
+#endif
+  if (sb->b != NULL) {
+    lua_pushbuffstring(L, sb->b, sb->size, sb->n, blob);
+    sb->b = NULL;  /* buffer now belongs to the string */
+    sb->n = sb->size = 0;
+  }
+#if defined(LUAGLM_EXT_BLOB)
+  else if (blob)
+    lua_pushblob(L, 0);
+#endif
+  else
+    lua_pushliteral(L, "");
+  return 1;
+}
+
+
+/* sb:reserve(n): make room for 'n' more characters */
+static int sb_reserve (lua_State *L) {
+  StrBuf *sb = checkstrbuf(L, 1);
+  lua_Integer n = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, 0 <= n && (lua_Unsigned)n < MAXSIZE, 2,
+                   "invalid capacity");
+  sb_prep(L, sb, (size_t)n);
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+static int sb_reset (lua_State *L) {
+  checkstrbuf(L, 1)->n = 0;
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+static int sb_len (lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)checkstrbuf(L, 1)->n);
+  return 1;
+}
+
+
+static int sb_gc (lua_State *L) {
+  StrBuf *sb = checkstrbuf(L, 1);
+  sb->b = lua_reallocbuff(L, sb->b, sb->size, 0);
+  sb->n = sb->size = 0;
+  return 0;
+}
+
+
+static const luaL_Reg sb_meth[] = {
+  {"append", sb_append},
+  {"format", sb_format},
+  {"pack", sb_pack},
+  {"tostring", sb_tostring},
+  {"take", sb_take},
+  {"reserve", sb_reserve},
+  {"reset", sb_reset},
+  {"len", sb_len},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg sb_metameth[] = {
+  {"__index", NULL},  /* place holder */
+  {"__len", sb_len},
+  {"__tostring", sb_tostring},
+  {"__gc", sb_gc},
+  {"__close", sb_gc},
+  {NULL, NULL}
+};
+
+
+static void createstrbufmeta (lua_State *L) {
+  luaL_newmetatable(L, LUA_STRBUF);  /* metatable for string buffers */
+  luaL_setfuncs(L, sb_metameth, 0);  /* add metamethods to new metatable */
+  luaL_newlibtable(L, sb_meth);  /* create method table */
+  luaL_setfuncs(L, sb_meth, 0);  /* add methods to method table */
+  lua_setfield(L, -2, "__index");  /* metatable.__index = method table */
+  lua_pop(L, 1);  /* pop metatable */
+}
+
+/* }====================================================== */
+#endif
+
+
 static const luaL_Reg strlib[] = {
   {"byte", str_byte},
   {"char", str_char},
@@ -2100,6 +2334,9 @@ static const luaL_Reg strlib[] = {
   {"isblob", str_isblob},
   {"blob_pack", str_blobpack},
   {"blob_unpack", str_blobunpack},
+#endif
+#if defined(LUAGLM_EXT_STRBUF)
+  {"strbuf", sb_new},
 #endif
   {NULL, NULL}
 };
@@ -2125,6 +2362,9 @@ static void createmetatable (lua_State *L) {
 LUAMOD_API int luaopen_string (lua_State *L) {
   luaL_newlib(L, strlib);
   createmetatable(L);
+#if defined(LUAGLM_EXT_STRBUF)
+  createstrbufmeta(L);
+#endif
   return 1;
 }
 
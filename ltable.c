@@ -628,11 +628,50 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
   totaluse++;
   /* compute new size for array part */
   asize = computesizes(nums, &na);
+#if defined(LUAGLM_EXT_TABLEHINT)
+  if (asize < t->asizehint)  /* keep the requested array size */
+    asize = t->asizehint;  /* (hash part may be a bit larger than needed) */
+#endif
+#if defined(LUAGLM_EXT_API)
+  G(L)->tabrehash++;
+#endif
   /* resize the table to new computed sizes */
   luaH_resize(L, t, asize, totaluse - na);
 }
 
 
+/*
+** Appending right after the last slot of the array part (e.g.,
+** 't[#t + 1] = v') grows the array part to the next power of 2 without
+** counting the keys of the hash part. As in 'computesizes', the new
+** size must be more than half full: counting only the array part and
+** the new key, so a rehash (which also counts integer keys in the hash
+** part) would choose at least that size. The hash part keeps its size.
+** Returns false if 'key' is not such an append, which then needs a
+** rehash.
+*/
+static int appendgrow (lua_State *L, Table *t, const TValue *key) {
+  unsigned int asize = luaH_realasize(t);
+  if (ttisinteger(key) && asize > 0 && asize < MAXASIZE / 2 &&
+      l_castS2U(ivalue(key)) == cast(lua_Unsigned, asize) + 1u &&
+      !isempty(&t->array[asize - 1])) {  /* appending after last slot? */
+    unsigned int size = 1u << luaO_ceillog2(asize + 1);
+    unsigned int maxnils = asize - size / 2;  /* keep 'size / 2' slots used */
+    unsigned int i, nils = 0;
+    for (i = 0; i < asize - 1; i++) {
+      if (isempty(&t->array[i]) && ++nils > maxnils)
+        return 0;  /* too sparse */
+    }
+    luaH_resize(L, t, size, allocsizenode(t));
+#if defined(LUAGLM_EXT_API)
+    G(L)->tabgrow++;
+#endif
+    return 1;
+  }
+  return 0;
+}
+
+
 
 /*
 ** }=============================================================
@@ -649,6 +688,9 @@ Table *luaH_new (lua_State *L) {
 #endif
   t->array = NULL;
   t->alimit = 0;
+#if defined(LUAGLM_EXT_TABLEHINT)
+  t->asizehint = 0;
+#endif
   setnodevector(L, t, 0);
   return t;
 }
@@ -708,7 +750,8 @@ void luaH_newkey (lua_State *L, Table *t, const TValue *key, TValue *value) {
     Node *othern;
     Node *f = getfreepos(t);  /* get a free place */
     if (f == NULL) {  /* cannot find a free place? */
-      rehash(L, t, key);  /* grow table */
+      if (!appendgrow(L, t, key))
+        rehash(L, t, key);  /* grow table */
       /* whatever called 'newkey' takes care of TM cache */
       luaH_set(L, t, key, value);  /* insert key into grown table */
       return;
@@ -1025,12 +1068,23 @@ void luaH_wipetable (lua_State *L, Table *t) {
   UNUSED(L);
 }
 
+void luaH_reserve (lua_State *L, Table *t, unsigned int nasize) {
+#if defined(LUAGLM_EXT_TABLEHINT)
+  t->asizehint = nasize;
+#endif
+  if (luaH_realasize(t) < nasize)
+    luaH_resizearray(L, t, nasize);
+}
+
 void luaH_compact(lua_State *L, Table *t) {
   unsigned int oldasize = setlimittosize(t);
   unsigned int newasize = cast_uint(luaH_getn(t)); /* t->alimit; */
+#if defined(LUAGLM_EXT_TABLEHINT)
+  t->asizehint = 0;  /* compacting drops the size hint */
+#endif
   if (oldasize != newasize) {
     TValue *array = luaM_reallocvector(L, t->array, oldasize, newasize, TValue);
-    if (l_likely(array != NULL)) {
+    if (l_likely(array != NULL || newasize == 0)) {  /* (NULL when freed) */
       t->array = array;
       t->alimit = newasize;
       setrealasize(t);
@@ -1086,6 +1140,9 @@ void luaH_clonetable (lua_State *L, const Table *from, Table *to) {
   to->node = newt.node;
   to->lastfree = newt.lastfree;
   to->lsizenode = newt.lsizenode;
+#if defined(LUAGLM_EXT_TABLEHINT)
+  to->asizehint = from->asizehint;
+#endif
   to->flags = ((to->flags & ~BITRAS) | (from->flags & BITRAS));
 #if defined(LUAGLM_EXT_READONLY)
   to->readonly = 0;
@@ -1099,6 +1156,464 @@ void luaH_clonetable (lua_State *L, const Table *from, Table *to) {
     luaC_checkfinalizer(L, obj2gco(to), from_mt);
   }
 }
+
+
+/*
+** {=============================================================
+** Sorting
+** ==============================================================
+*/
+
+/* sort orders */
+#define SORT_INT	0  /* integers, by value */
+#define SORT_FLT	1  /* floats (no NaN), by value */
+#define SORT_STR	2  /* strings, as 'l_strcmp' */
+#define SORT_FUNC	3  /* a Lua comparator */
+
+/*
+** Ranges up to this size are sorted by insertion. Ranges sorted with a
+** comparator are partitioned down to 3 elements, as the partitions are
+** what detects invalid order functions.
+*/
+#if !defined(LUAI_SORTMINRUN)
+#define LUAI_SORTMINRUN		16
+#endif
+
+#define sortminrun(s)	((s)->order == SORT_FUNC ? 3 : LUAI_SORTMINRUN)
+
+/* numeric arrays from this size are sorted by radix */
+#if !defined(LUAI_SORTRADIX)
+#define LUAI_SORTRADIX		256
+#endif
+
+
+typedef struct SortState {
+  lua_State *L;
+  Table *t;
+  unsigned int n;  /* number of elements being sorted */
+  int order;
+  ptrdiff_t func;  /* comparator (SORT_FUNC) */
+  unsigned int *perm;  /* sorted instead of 't', ordered by 'keys' */
+  const TValue *keys;
+  int stable;  /* break ties of 'keys' by position */
+} SortState;
+
+
+/* copy an element, keeping empty slots empty */
+#define setelem(L,o,e)  \
+	{ if (isempty(e)) setempty(o); else setobj(L, o, e); }
+
+/* push an element, with empty slots as a regular nil */
+#define setelem2s(L,o,e)  \
+	{ if (isempty(e)) setnilvalue(s2v(o)); else setobj2s(L, o, e); }
+
+/*
+** Call the comparator with 't[i]' and 't[j]'. The array part can be
+** reallocated by the call, so elements are always accessed through
+** their indices.
+*/
+static int sortcall (SortState *s, const TValue *a, const TValue *b) {
+  lua_State *L = s->L;
+  StkId top = L->top;
+  int res;
+  setobj2s(L, top, s2v(restorestack(L, s->func)));
+  setelem2s(L, top + 1, a);
+  setelem2s(L, top + 2, b);
+  L->top = top + 3;
+  luaD_callnoyield(L, top, 1);
+  res = !l_isfalse(s2v(L->top - 1));
+  L->top--;
+  if (l_unlikely(luaH_realasize(s->t) < s->n))
+    luaG_runerror(L, "array changed by the order function");
+  return res;
+}
+
+
+/*
+** keys[perm[i]] < keys[perm[j]]; the keys are all numbers or all
+** strings, so the comparison neither fails nor calls metamethods.
+*/
+static int permlt (SortState *s, unsigned int i, unsigned int j) {
+  unsigned int pi = s->perm[i], pj = s->perm[j];
+  const TValue *a = &s->keys[pi];
+  const TValue *b = &s->keys[pj];
+  if (luaV_lessthan(s->L, a, b))
+    return 1;
+  return s->stable && pi < pj && !luaV_lessthan(s->L, b, a);
+}
+
+
+/* t[i] < t[j] */
+static int sortlt (SortState *s, unsigned int i, unsigned int j) {
+  const TValue *a, *b;
+  if (s->perm != NULL)
+    return permlt(s, i, j);
+  a = &s->t->array[i];
+  b = &s->t->array[j];
+  switch (s->order) {
+    case SORT_INT: return ivalue(a) < ivalue(b);
+    case SORT_FLT: return luai_numlt(fltvalue(a), fltvalue(b));
+    case SORT_STR: return tsvalue(a) != tsvalue(b) && luaV_lessthan(s->L, a, b);
+    default: return sortcall(s, a, b);
+  }
+}
+
+
+static void sortswap (SortState *s, unsigned int i, unsigned int j) {
+  TValue *arr = s->t->array;
+  TValue temp;
+  if (s->perm != NULL) {
+    unsigned int p = s->perm[i];
+    s->perm[i] = s->perm[j];
+    s->perm[j] = p;
+    return;
+  }
+  setelem(s->L, &temp, &arr[i]);
+  setelem(s->L, &arr[i], &arr[j]);
+  setelem(s->L, &arr[j], &temp);
+}
+
+
+static l_noret invalidorder (lua_State *L) {
+  luaG_runerror(L, "invalid order function for sorting");
+}
+
+
+static void insertionsort (SortState *s, unsigned int lo, unsigned int hi) {
+  unsigned int i, j;
+  for (i = lo + 1; i < hi; i++) {
+    for (j = i; j > lo && sortlt(s, j, j - 1); j--)
+      sortswap(s, j, j - 1);
+  }
+}
+
+
+/* restore the max-heap property below node 'i' of the heap 't[lo .. lo+n-1]' */
+static void siftdown (SortState *s, unsigned int lo, unsigned int i,
+                                    unsigned int n) {
+  for (;;) {
+    unsigned int c = 2 * i + 1;  /* left child */
+    if (c >= n)
+      break;
+    if (c + 1 < n && sortlt(s, lo + c, lo + c + 1))
+      c++;  /* right child is larger */
+    if (!sortlt(s, lo + i, lo + c))
+      break;
+    sortswap(s, lo + i, lo + c);
+    i = c;
+  }
+}
+
+
+static void heapsort (SortState *s, unsigned int lo, unsigned int hi) {
+  unsigned int n = hi - lo;
+  unsigned int i;
+  for (i = n / 2; i-- > 0; )
+    siftdown(s, lo, i, n);
+  for (i = n - 1; i > 0; i--) {
+    sortswap(s, lo, lo + i);
+    siftdown(s, lo, 0, i);
+  }
+}
+
+
+/*
+** Introsort of 't[lo .. hi-1]': quicksort with a median-of-three pivot,
+** falling back to heapsort when the recursion gets deeper than 'depth'
+** (too many unbalanced partitions) and to insertion sort for short
+** ranges.
+*/
+static void introsort (SortState *s, unsigned int lo, unsigned int hi,
+                                     int depth) {
+  while (hi - lo > sortminrun(s)) {  /* loop for tail recursion */
+    unsigned int up = hi - 1;
+    unsigned int mid = lo + (hi - lo) / 2;
+    unsigned int i, j;
+    if (depth-- == 0) {  /* too many bad pivots? */
+      heapsort(s, lo, hi);
+      return;
+    }
+    /* order 't[lo]', 't[mid]', and 't[up]' */
+    if (sortlt(s, mid, lo))
+      sortswap(s, mid, lo);
+    if (sortlt(s, up, mid)) {
+      sortswap(s, up, mid);
+      if (sortlt(s, mid, lo))
+        sortswap(s, mid, lo);
+    }
+    sortswap(s, lo, mid);  /* pivot P at 'lo'; t[mid] <= P <= t[up] */
+    i = lo;
+    j = hi;
+    for (;;) {
+      while (sortlt(s, ++i, lo)) {  /* repeat ++i while t[i] < P */
+        if (l_unlikely(i == up))  /* t[up] < P ?? */
+          invalidorder(s->L);
+      }
+      while (sortlt(s, lo, --j)) {  /* repeat --j while P < t[j] */
+        if (l_unlikely(j == lo))  /* P < P ?? */
+          invalidorder(s->L);
+      }
+      if (j <= i)
+        break;
+      sortswap(s, i, j);
+    }
+    sortswap(s, lo, j);  /* t[lo .. j-1] <= t[j] == P <= t[j+1 .. up] */
+    if (j - lo < hi - j) {  /* recurse into the smaller interval */
+      introsort(s, lo, j, depth);
+      lo = j + 1;
+    }
+    else {
+      introsort(s, j + 1, hi, depth);
+      hi = j;
+    }
+  }
+  insertionsort(s, lo, hi);
+}
+
+
+#define RADIXBITS	8
+#define RADIXPASSES	cast_int(sizeof(lua_Unsigned) * CHAR_BIT / RADIXBITS)
+#define RADIXSIGN	(~(~(lua_Unsigned)0 >> 1))
+
+/* floats are sorted by radix when their bits fit a 'lua_Unsigned' */
+#define radixfloat	(sizeof(lua_Number) == sizeof(lua_Unsigned))
+
+
+/* unsigned key with the same order as the number 'o' */
+static lua_Unsigned radixkey (const TValue *o) {
+  lua_Unsigned u = 0;
+  if (ttisinteger(o))
+    return l_castS2U(ivalue(o)) ^ RADIXSIGN;
+  else {
+    lua_Number f = fltvalue(o);
+    memcpy(&u, &f, sizeof(f));
+    return (u & RADIXSIGN) ? ~u : (u | RADIXSIGN);
+  }
+}
+
+
+/*
+** LSD radix sort of the 'n' numbers (all integers or all floats) of
+** 'arr', on copies of their keys in 'buff' (room for 2n keys). Passes
+** in which all keys have the same digit are skipped. When 'perm' (room
+** for 2n indices) is given, 'arr' is left untouched and 'perm[0 .. n-1]'
+** receives the positions of its numbers in increasing order, ties kept
+** in their original order; otherwise 'arr' is rewritten sorted.
+*/
+static void radixsort (TValue *arr, unsigned int n, int order,
+                       lua_Unsigned *buff, unsigned int *perm) {
+  lua_Unsigned *src = buff, *dst = buff + n;
+  unsigned int *psrc = perm, *pdst = (perm != NULL) ? perm + n : NULL;
+  unsigned int count[RADIXPASSES][1 << RADIXBITS];
+  unsigned int i;
+  int p;
+  memset(count, 0, sizeof(count));
+  for (i = 0; i < n; i++) {
+    lua_Unsigned k = src[i] = radixkey(&arr[i]);
+    for (p = 0; p < RADIXPASSES; p++)
+      count[p][(k >> (p * RADIXBITS)) & ((1 << RADIXBITS) - 1)]++;
+    if (perm != NULL)
+      psrc[i] = i;
+  }
+  for (p = 0; p < RADIXPASSES; p++) {
+    unsigned int *c = count[p];
+    unsigned int sum = 0;
+    int shift = p * RADIXBITS;
+    if (c[(src[0] >> shift) & ((1 << RADIXBITS) - 1)] == n)
+      continue;  /* all keys share this digit */
+    for (i = 0; i < (1 << RADIXBITS); i++) {  /* digit -> first position */
+      unsigned int ci = c[i];
+      c[i] = sum;
+      sum += ci;
+    }
+    for (i = 0; i < n; i++) {
+      unsigned int pos = c[(src[i] >> shift) & ((1 << RADIXBITS) - 1)]++;
+      dst[pos] = src[i];
+      if (perm != NULL)
+        pdst[pos] = psrc[i];
+    }
+    { lua_Unsigned *temp = src; src = dst; dst = temp; }
+    if (perm != NULL) {
+      unsigned int *temp = psrc; psrc = pdst; pdst = temp;
+    }
+  }
+  if (perm != NULL) {
+    if (psrc != perm)
+      memcpy(perm, psrc, n * sizeof(unsigned int));
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    lua_Unsigned k = src[i];
+    if (order == SORT_INT) {
+      setivalue(&arr[i], l_castU2S(k ^ RADIXSIGN));
+    }
+    else {
+      lua_Number f;
+      k = (k & RADIXSIGN) ? (k ^ RADIXSIGN) : ~k;
+      memcpy(&f, &k, sizeof(f));
+      setfltvalue(&arr[i], f);
+    }
+  }
+}
+
+
+/*
+** Order of the first 'n' elements of the array part when sorted with
+** '<': -1 unless they are all integers, all floats (without NaN), or
+** all strings, for which '<' neither fails nor calls metamethods.
+*/
+static int sortorder (const Table *t, unsigned int n) {
+  const TValue *arr = t->array;
+  unsigned int i;
+  if (ttisinteger(&arr[0])) {
+    for (i = 1; i < n; i++)
+      if (!ttisinteger(&arr[i])) return -1;
+    return SORT_INT;
+  }
+  else if (ttisfloat(&arr[0])) {
+    for (i = 0; i < n; i++)
+      if (!ttisfloat(&arr[i]) || luai_numisnan(fltvalue(&arr[i]))) return -1;
+    return SORT_FLT;
+  }
+  else if (ttisstring(&arr[0])) {
+    for (i = 1; i < n; i++)
+      if (!ttisstring(&arr[i])) return -1;
+    return SORT_STR;
+  }
+  return -1;
+}
+
+
+/*
+** Sort the first 'n' elements of the array part of 't' (all within it)
+** in place, by the comparator at 'func' or, when it is NULL, by '<'.
+** Returns 0 (leaving the table untouched) when the generic sort must
+** be used instead: '<' on values other than integers, floats, and
+** strings, or a comparator on a table with holes that a metatable
+** could fill.
+*/
+int luaH_sort (lua_State *L, Table *t, unsigned int n, StkId func) {
+  SortState s;
+  int depth = 0;
+  unsigned int i;
+  lua_assert(n <= luaH_realasize(t));
+  if (n < 2)
+    return 1;
+  if (func == NULL) {
+    s.order = sortorder(t, n);
+    if (s.order < 0)
+      return 0;
+    if (n >= LUAI_SORTRADIX && (s.order == SORT_INT ||
+                                (s.order == SORT_FLT && radixfloat))) {
+      lua_Unsigned *buff = luaM_newvector(L, 2 * cast_sizet(n), lua_Unsigned);
+      radixsort(t->array, n, s.order, buff, NULL);
+      luaM_freearray(L, buff, 2 * cast_sizet(n));
+      return 1;
+    }
+    s.func = 0;
+  }
+  else {
+    if (t->metatable != NULL) {  /* '__index' could fill holes */
+      for (i = 0; i < n; i++)
+        if (isempty(&t->array[i])) return 0;
+    }
+    s.order = SORT_FUNC;
+    s.func = savestack(L, func);
+    luaD_checkstack(L, 3);  /* comparator and its arguments */
+  }
+  s.L = L;
+  s.t = t;
+  s.n = n;
+  s.perm = NULL;
+  for (i = n; i > 1; i >>= 1)
+    depth += 2;  /* 2 * log2(n) */
+  introsort(&s, 0, n, depth);  /* only permutes values: no barrier */
+  return 1;
+}
+
+
+/*
+** Move 't[perm[i]]' to 't[i]' for all 'i', following the cycles of the
+** permutation (which is consumed).
+*/
+static void permute (lua_State *L, Table *t, unsigned int *perm,
+                                   unsigned int n) {
+  TValue *arr = t->array;
+  unsigned int i;
+  for (i = 0; i < n; i++) {
+    if (perm[i] != i) {  /* start of a cycle? */
+      TValue temp;
+      unsigned int j = i;
+      setelem(L, &temp, &arr[i]);
+      for (;;) {
+        unsigned int k = perm[j];
+        perm[j] = j;  /* mark as placed */
+        if (k == i) {  /* closed the cycle? */
+          setelem(L, &arr[j], &temp);
+          break;
+        }
+        setelem(L, &arr[j], &arr[k]);
+        j = k;
+      }
+    }
+  }
+}
+
+
+/*
+** Sort the first 'n' elements of the array part of 't' by the elements
+** at the same positions of the array part of 'keys' (all numbers
+** without NaN, or all strings), ties kept in their original order when
+** 'stable'. The positions are sorted first, with radix sort for integer
+** or float keys, and then 't' is permuted once. Returns 0 (leaving the
+** table untouched) when 't' has holes that a metatable could fill.
+*/
+int luaH_sortby (lua_State *L, Table *t, const Table *keys, unsigned int n,
+                                int stable) {
+  SortState s;
+  int order, radix;
+  unsigned int i;
+  size_t size;
+  char *buff;
+  lua_assert(n <= luaH_realasize(t) && n <= luaH_realasize(keys));
+  if (t->metatable != NULL) {  /* '__index' could fill holes */
+    for (i = 0; i < n; i++)
+      if (isempty(&t->array[i])) return 0;
+  }
+  if (n < 2)
+    return 1;
+  order = sortorder(keys, n);  /* -1 for mixed integers and floats */
+  radix = (n >= LUAI_SORTRADIX &&
+           (order == SORT_INT || (order == SORT_FLT && radixfloat)));
+  /* room for the permutation and, for radix sort, its copy and the keys */
+  size = radix ? 2 * cast_sizet(n) * (sizeof(lua_Unsigned) + sizeof(unsigned int))
+               : cast_sizet(n) * sizeof(unsigned int);
+  buff = cast_charp(luaM_malloc_(L, size, 0));
+  if (radix) {
+    s.perm = cast(unsigned int *, buff + 2 * cast_sizet(n) * sizeof(lua_Unsigned));
+    radixsort(keys->array, n, order, cast(lua_Unsigned *, buff), s.perm);
+  }
+  else {
+    int depth = 0;
+    s.L = L;
+    s.t = t;
+    s.n = n;
+    s.order = order;
+    s.perm = cast(unsigned int *, buff);
+    s.keys = keys->array;
+    s.stable = stable;
+    for (i = 0; i < n; i++)
+      s.perm[i] = i;
+    for (i = n; i > 1; i >>= 1)
+      depth += 2;  /* 2 * log2(n) */
+    introsort(&s, 0, n, depth);
+  }
+  permute(L, t, s.perm, n);
+  luaM_freemem(L, buff, size);
+  return 1;
+}
+
+/* }============================================================= */
 #endif
 
 #if defined(LUA_DEBUG)
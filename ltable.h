@@ -61,8 +61,12 @@ LUAI_FUNC void luaH_setreadonly (Table *t, int readonly);
 #if defined(LUAGLM_EXT_API)
 LUAI_FUNC int luaH_type (const Table *t);
 LUAI_FUNC void luaH_wipetable (lua_State *L, Table *t);
+LUAI_FUNC void luaH_reserve (lua_State *L, Table *t, unsigned int nasize);
 LUAI_FUNC void luaH_compact (lua_State *L, Table *t);
 LUAI_FUNC void luaH_clonetable (lua_State *L, const Table *t, Table *t2);
+LUAI_FUNC int luaH_sort (lua_State *L, Table *t, unsigned int n, StkId func);
+LUAI_FUNC int luaH_sortby (lua_State *L, Table *t, const Table *keys,
+                           unsigned int n, int stable);
 #endif
 
 
@@ -418,11 +418,115 @@ static int sort (lua_State *L) {
     if (!lua_isnoneornil(L, 2))  /* is there a 2nd argument? */
       luaL_checktype(L, 2, LUA_TFUNCTION);  /* must be a function */
     lua_settop(L, 2);  /* make sure there are two arguments */
+#if defined(LUAGLM_EXT_API)
+    /* sort the array part in place when '<' (or the function) allows */
+    if (lua_type(L, 1) == LUA_TTABLE &&
+        lua_sortarray(L, 1, n, lua_isnil(L, 2) ? 0 : 2))
+      return 0;
+#endif
     auxsort(L, 1, (IdxT)n, 0);
   }
   return 0;
 }
 
+#if defined(LUAGLM_EXT_API)
+
+/* maximum number of nested fields in a 'sortby' key path */
+#define MAXSORTFIELDS	16
+
+/*
+** Push the fields of the key path at index 2 ("pos.x" -> "pos", "x")
+** and return their number.
+*/
+static int sortfields (lua_State *L) {
+  size_t l;
+  const char *path = lua_tolstring(L, 2, &l);
+  const char *end = path + l;
+  int nf = 0;
+  for (;;) {
+    const char *dot = (const char *)memchr(path, '.', end - path);
+    const char *e = (dot != NULL) ? dot : end;
+    luaL_argcheck(L, e > path && nf < MAXSORTFIELDS, 2, "invalid key path");
+    lua_pushlstring(L, path, e - path);
+    nf++;
+    if (dot == NULL)
+      return nf;
+    path = dot + 1;
+  }
+}
+
+
+/*
+** Replace the value on the top by its sort key: the result of the
+** function at index 2 or, when 'nf' > 0, the value of the nested fields
+** at 'fields' .. 'fields' + 'nf' - 1.
+*/
+static void sortkey (lua_State *L, int fields, int nf) {
+  int f;
+  if (nf == 0) {  /* key function */
+    lua_pushvalue(L, 2);
+    lua_insert(L, -2);
+    lua_call(L, 1, 1);
+  }
+  for (f = 0; f < nf; f++) {
+    lua_pushvalue(L, fields + f);
+    lua_gettable(L, -2);
+    lua_remove(L, -2);  /* remove container */
+  }
+}
+
+
+/*
+** table.sortby(t, key [, stable]): sort 't[1 .. #t]' by a key computed
+** once per element, by a function or a key path (see 'sortfields'). Keys
+** must be all numbers (not NaN) or all strings. The keys are gathered in
+** an array, the positions sorted by them, and 't' permuted once.
+*/
+static int sortby (lua_State *L) {
+  lua_Integer n = aux_getn(L, 1, TAB_RW);
+  int stable = lua_toboolean(L, 3);
+  int fields, nf = 0, keys;
+  lua_Integer i, nstr = 0;
+  if (lua_type(L, 2) != LUA_TFUNCTION && lua_type(L, 2) != LUA_TSTRING)
+    return luaL_typeerror(L, 2, "function or string");
+  if (n <= 1)
+    return 0;
+  luaL_argcheck(L, n < INT_MAX, 1, "array too big");
+  lua_settop(L, 3);
+  fields = 4;
+  if (lua_type(L, 2) == LUA_TSTRING)
+    nf = sortfields(L);
+  lua_createtable(L, (int)n, 0);  /* keys */
+  keys = lua_gettop(L);
+  for (i = 1; i <= n; i++) {
+    lua_geti(L, 1, i);
+    sortkey(L, fields, nf);
+    if (lua_type(L, -1) == LUA_TSTRING)
+      nstr++;
+    else if (lua_type(L, -1) != LUA_TNUMBER || (!lua_isinteger(L, -1) &&
+             lua_tonumber(L, -1) != lua_tonumber(L, -1)))  /* not a number or NaN? */
+      return luaL_error(L, "invalid key (%s) at index %I for 'sortby'",
+                           luaL_typename(L, -1), (LUAI_UACINT)i);
+    lua_rawseti(L, keys, i);
+  }
+  if (nstr != 0 && nstr != n)
+    return luaL_error(L, "keys for 'sortby' mix strings and numbers");
+  if (!lua_sortby(L, 1, keys, n, stable)) {  /* not in the array part? */
+    lua_createtable(L, (int)n, 0);  /* sort a copy */
+    for (i = 1; i <= n; i++) {
+      lua_geti(L, 1, i);
+      lua_rawseti(L, -2, i);
+    }
+    lua_sortby(L, -1, keys, n, stable);
+    for (i = 1; i <= n; i++) {
+      lua_rawgeti(L, -1, i);
+      lua_seti(L, 1, i);
+    }
+  }
+  return 0;
+}
+#endif
+
 #if defined(LUAGLM_EXT_READONLY)
 static int tfreeze(lua_State *L) {
   luaL_checktype(L, 1, LUA_TTABLE);
@@ -466,9 +570,20 @@ static int tcreate (lua_State *L) {
   luaL_argcheck(L, 0 <= narray && narray < INT_MAX, 1, "invalid narray size");
   luaL_argcheck(L, 0 <= nhash && nhash < INT_MAX, 2, "invalid nrec size");
   lua_createtable(L, (int)narray, (int)nhash);
+#if defined(LUAGLM_EXT_TABLEHINT)
+  lua_reservetable(L, -1, (int)narray);  /* keep 'narray' on rehashes */
+#endif
   return 1;
 }
 
+static int tstats (lua_State *L) {
+  lua_Integer nrehash, ngrow;
+  lua_tablestats(L, &nrehash, &ngrow, lua_toboolean(L, 1));
+  lua_pushinteger(L, nrehash);
+  lua_pushinteger(L, ngrow);
+  return 2;
+}
+
 static int treset (lua_State *L) {
   luaL_checktype(L, 1, LUA_TTABLE);
 #if defined(LUAGLM_EXT_READONLY)
@@ -501,8 +616,297 @@ static int tclone (lua_State *L) {
 }
 #endif
 
+
 /* }====================================================== */
 
+#if defined(LUAGLM_EXT_API)
+/*
+** {======================================================
+** Deep copy and comparison
+** =======================================================
+*/
+
+#if defined(LUAGLM_EXT_READONLY)
+#define isfrozen(L,i)	lua_isreadonly(L, i)
+#else
+#define isfrozen(L,i)	0
+#endif
+
+
+/*
+** Tables still to be walked are kept in a work list (a table used as a
+** stack) instead of the C stack, so the nesting of tables is not
+** limited.
+*/
+typedef struct Deep {
+  int visited;  /* stack index of the table of walked values */
+  int multi;  /* 'deepequal': tables matched with more than one table */
+  int work;  /* stack index of the work list */
+  lua_Integer nwork;  /* number of values in the work list */
+  int frozen;  /* copy frozen tables instead of sharing them */
+  int freeze;  /* freeze all copies */
+  int metatable;  /* keep metatables */
+} Deep;
+
+
+/* move the value on the top to the work list */
+#define pushwork(L,D)	lua_rawseti(L, (D)->work, ++(D)->nwork)
+
+/* push the last value of the work list */
+#define popwork(L,D)	lua_rawgeti(L, (D)->work, (D)->nwork--)
+
+
+static int deepopt (lua_State *L, int arg, const char *k, int def) {
+  int res = def;
+  if (lua_type(L, arg) == LUA_TTABLE) {
+    if (lua_getfield(L, arg, k) != LUA_TNIL)
+      res = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+  }
+  return res;
+}
+
+
+/*
+** Push a shallow clone (array and hash parts copied as blocks) of the
+** table at 'idx' and add it to the work list, followed by whether it
+** must be frozen once its values are copied.
+*/
+static void clonetable (lua_State *L, Deep *D, int idx) {
+  int frozen = isfrozen(L, idx);
+  if (l_unlikely(luaL_getmetafield(L, idx, "__metatable") != LUA_TNIL)) {
+    if (D->metatable)
+      luaL_error(L, "cannot clone table with a protected metatable");
+    lua_pop(L, 1);  /* metatable is dropped anyway */
+  }
+  lua_newtable(L);
+  lua_clonetable(L, idx, lua_gettop(L));
+  if (!D->metatable) {
+    lua_pushnil(L);
+    lua_setmetatable(L, -2);
+  }
+  lua_pushvalue(L, -1);
+  pushwork(L, D);
+  lua_pushboolean(L, frozen || D->freeze);
+  pushwork(L, D);
+}
+
+
+/*
+** Push the copy of the value at 'idx'. Tables and matrices copied
+** before are taken from 'visited', preserving shared references and
+** cycles; frozen tables are shared unless 'D->frozen'; vectors and
+** other values are pushed as they are.
+*/
+static void deepcopy (lua_State *L, Deep *D, int idx) {
+  int tt = lua_type(L, idx);
+  idx = lua_absindex(L, idx);
+  if (tt != LUA_TTABLE && tt != LUA_TMATRIX) {
+    lua_pushvalue(L, idx);
+    return;
+  }
+  lua_pushvalue(L, idx);
+  if (lua_rawget(L, D->visited) != LUA_TNIL)
+    return;  /* already copied */
+  lua_pop(L, 1);
+  if (tt == LUA_TMATRIX) {
+    lua_Mat4 m;
+    lua_tomatrix(L, idx, &m);
+    lua_pushmatrix(L, &m);
+  }
+  else if (isfrozen(L, idx) && !D->frozen)
+    lua_pushvalue(L, idx);  /* cannot change: share it */
+  else
+    clonetable(L, D, idx);
+  lua_pushvalue(L, idx);
+  lua_pushvalue(L, -2);
+  lua_rawset(L, D->visited);  /* visited[v] = copy */
+}
+
+
+/*
+** Replace the tables and matrices of the clone at 'clone' by their
+** copies. Keys are kept.
+*/
+static void copyvalues (lua_State *L, Deep *D, int clone) {
+  lua_pushnil(L);
+  while (lua_next(L, clone)) {
+    int tt = lua_type(L, -1);
+    if (tt == LUA_TTABLE || tt == LUA_TMATRIX) {
+      deepcopy(L, D, -1);
+      lua_remove(L, -2);  /* remove original value */
+      lua_pushvalue(L, -2);
+      lua_insert(L, -2);  /* key, key, copy */
+      lua_rawset(L, clone);  /* assignment to an existing field */
+    }
+    else
+      lua_pop(L, 1);  /* keep value */
+  }
+}
+
+
+static int tdeepclone (lua_State *L) {
+  Deep D;
+  luaL_checktype(L, 1, LUA_TTABLE);
+  D.frozen = deepopt(L, 2, "frozen", 0);
+  D.freeze = deepopt(L, 2, "freeze", 0);
+  D.metatable = deepopt(L, 2, "metatable", 1);
+  lua_settop(L, 1);
+  lua_newtable(L);
+  lua_newtable(L);
+  D.visited = 2;
+  D.work = 3;
+  D.nwork = 0;
+  deepcopy(L, &D, 1);  /* result */
+  while (D.nwork > 0) {
+    int freeze;
+    popwork(L, &D);
+    freeze = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    popwork(L, &D);
+    copyvalues(L, &D, lua_gettop(L));
+#if defined(LUAGLM_EXT_READONLY)
+    if (freeze)
+      lua_setreadonly(L, -1, 1);
+#else
+    (void)freeze;
+#endif
+    lua_pop(L, 1);
+  }
+  return 1;
+}
+
+
+/*
+** Check whether the pair of tables at 'a' and 'b' is being (or was)
+** compared, and mark it otherwise. A table is usually matched with a
+** single table of the other side, kept in 'visited'; the others go to
+** a set in 'multi'.
+*/
+static int deepvisited (lua_State *L, Deep *D, int a, int b) {
+  int res = 0;
+  lua_pushvalue(L, a);
+  if (lua_rawget(L, D->visited) == LUA_TNIL) {
+    lua_pushvalue(L, a);
+    lua_pushvalue(L, b);
+    lua_rawset(L, D->visited);  /* visited[a] = b */
+  }
+  else if (lua_rawequal(L, -1, b))
+    res = 1;
+  else {
+    lua_pushvalue(L, a);
+    if (lua_rawget(L, D->multi) == LUA_TNIL) {  /* first other match? */
+      lua_pop(L, 1);
+      lua_newtable(L);
+      lua_pushvalue(L, a);
+      lua_pushvalue(L, -2);
+      lua_rawset(L, D->multi);  /* multi[a] = {} */
+    }
+    lua_pushvalue(L, b);
+    if (lua_rawget(L, -2) != LUA_TNIL)
+      res = 1;
+    else {
+      lua_pushvalue(L, b);
+      lua_pushboolean(L, 1);
+      lua_rawset(L, -4);  /* multi[a][b] = true */
+    }
+    lua_pop(L, 2);
+  }
+  lua_pop(L, 1);
+  return res;
+}
+
+
+/*
+** Compare the tables at 'a' and 'b' one level deep: the same metatable
+** and the same keys (raw equal) mapped to raw equal values or to pairs
+** of tables, which are added to the work list. Pairs met again (cycles)
+** are taken as equal.
+*/
+static int shalloweq (lua_State *L, Deep *D, int a, int b) {
+  lua_Integer n = 0;
+  int res = 1;
+  if (lua_getmetatable(L, a)) {
+    res = lua_getmetatable(L, b) && lua_rawequal(L, -1, -2);
+    lua_pop(L, 1 + res);
+  }
+  else if (lua_getmetatable(L, b)) {
+    lua_pop(L, 1);
+    res = 0;
+  }
+  if (!res || deepvisited(L, D, a, b))
+    return res;
+  lua_pushnil(L);
+  while (lua_next(L, a)) {  /* every field of 'a' must be in 'b'... */
+    lua_pushvalue(L, -2);
+    if (lua_rawget(L, b) == LUA_TNIL)
+      res = 0;
+    else if (!lua_rawequal(L, -2, -1)) {
+      if (lua_type(L, -2) != LUA_TTABLE || lua_type(L, -1) != LUA_TTABLE)
+        res = 0;
+      else {  /* compare them later */
+        pushwork(L, D);
+        pushwork(L, D);
+        n++;
+        continue;
+      }
+    }
+    if (!res) {
+      lua_pop(L, 3);
+      return 0;
+    }
+    lua_pop(L, 2);
+    n++;
+  }
+  lua_pushnil(L);
+  while (lua_next(L, b)) {  /* ...and 'b' have no other fields */
+    lua_pop(L, 1);
+    if (--n < 0) {
+      lua_pop(L, 1);
+      break;
+    }
+  }
+  return (n == 0);
+}
+
+
+/*
+** Structural equality of the values at 1 and 2: raw equality (vectors
+** and matrices compare by value) or tables equal by 'shalloweq', along
+** with all the pairs of tables it finds.
+*/
+static int tdeepequal (lua_State *L) {
+  Deep D;
+  int res = 1;
+  luaL_checkany(L, 1);
+  luaL_checkany(L, 2);
+  lua_settop(L, 2);
+  lua_newtable(L);
+  lua_newtable(L);
+  lua_newtable(L);
+  D.visited = 3;
+  D.multi = 4;
+  D.work = 5;
+  D.nwork = 0;
+  lua_pushvalue(L, 2);
+  pushwork(L, &D);
+  lua_pushvalue(L, 1);
+  pushwork(L, &D);
+  while (res && D.nwork > 0) {
+    popwork(L, &D);  /* a */
+    popwork(L, &D);  /* b */
+    if (!lua_rawequal(L, -2, -1))
+      res = lua_type(L, -2) == LUA_TTABLE && lua_type(L, -1) == LUA_TTABLE
+            && shalloweq(L, &D, lua_absindex(L, -2), lua_absindex(L, -1));
+    lua_pop(L, 2);
+  }
+  lua_pushboolean(L, res);
+  return 1;
+}
+
+/* }====================================================== */
+#endif
+
 
 static const luaL_Reg tab_funcs[] = {
   {"concat", tconcat},
@@ -512,6 +916,9 @@ static const luaL_Reg tab_funcs[] = {
   {"remove", tremove},
   {"move", tmove},
   {"sort", sort},
+#if defined(LUAGLM_EXT_API)
+  {"sortby", sortby},
+#endif
 #if defined(LUAGLM_EXT_READONLY)
   {"freeze", tfreeze},
   {"isfrozen", tisfrozen},
@@ -522,6 +929,9 @@ static const luaL_Reg tab_funcs[] = {
   {"wipe", treset}, {"clear", treset},
   {"compact", tcompact},
   {"clone", tclone},
+  {"deepclone", tdeepclone},
+  {"deepequal", tdeepequal},
+  {"stats", tstats},
 #endif
   {NULL, NULL}
 };
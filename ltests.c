@@ -208,8 +208,8 @@ static void freeblock (Memcontrol *mc, Header *block) {
 }
 
 
-void *debug_realloc (void *ud, void *b, size_t oldsize, size_t size) {
-  Memcontrol *mc = cast(Memcontrol *, ud);
+static void *controlledrealloc (Memcontrol *mc, void *b, size_t oldsize,
+                                                     size_t size) {
   Header *block = cast(Header *, b);
   int type;
   if (mc->memlimit == 0) {  /* first time? */
@@ -270,6 +270,28 @@ void *debug_realloc (void *ud, void *b, size_t oldsize, size_t size) {
 }
 
 
+#if defined(LUA_USE_ASYNCFREE)
+#include <pthread.h>
+
+/* swept blocks may be released by the collector's background thread */
+static pthread_mutex_t memlock = PTHREAD_MUTEX_INITIALIZER;
+#define lockmem()	pthread_mutex_lock(&memlock)
+#define unlockmem()	pthread_mutex_unlock(&memlock)
+#else
+#define lockmem()	((void)0)
+#define unlockmem()	((void)0)
+#endif
+
+
+void *debug_realloc (void *ud, void *b, size_t oldsize, size_t size) {
+  void *nb;
+  lockmem();
+  nb = controlledrealloc(cast(Memcontrol *, ud), b, oldsize, size);
+  unlockmem();
+  return nb;
+}
+
+
 /* }====================================================================== */
 
 
@@ -394,6 +416,9 @@ static void checkproto (global_State *g, Proto *f) {
   int i;
   GCObject *fgc = obj2gco(f);
   checkobjrefN(g, fgc, f->source);
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  checkobjrefN(g, fgc, f->lazychunk);
+#endif
   for (i=0; i<f->sizek; i++) {
     if (iscollectable(f->k + i))
       checkobjref(g, fgc, gcvalue(f->k + i));
@@ -978,6 +1003,44 @@ static int gc_state (lua_State *L) {
 }
 
 
+#if defined(LUA_USE_ASYNCFREE)
+static int gc_async (lua_State *L) {
+  lua_pushboolean(L, lua_gc(L, LUA_GCASYNC, lua_toboolean(L, 1)));
+  return 1;
+}
+
+
+/* number of calls to 'countrealloc' */
+static unsigned long ncountrealloc = 0;
+
+/* allocator counting its calls, possibly from the background thread */
+static void *countrealloc (void *ud, void *b, size_t oldsize, size_t size) {
+  lockmem();
+  ncountrealloc++;
+  unlockmem();
+  return debug_realloc(ud, b, oldsize, size);
+}
+
+
+/*
+** Install 'countrealloc' (true) or 'debug_realloc' (false); return the
+** number of calls to 'countrealloc' since the previous change.
+*/
+static int set_allocf (lua_State *L) {
+  void *ud;
+  unsigned long n;
+  lua_getallocf(L, &ud);
+  lua_setallocf(L, lua_toboolean(L, 1) ? countrealloc : debug_realloc, ud);
+  lockmem();
+  n = ncountrealloc;
+  ncountrealloc = 0;
+  unlockmem();
+  lua_pushinteger(L, (lua_Integer)n);
+  return 1;
+}
+#endif
+
+
 static int hash_query (lua_State *L) {
   if (lua_isnone(L, 2)) {
     luaL_argcheck(L, lua_type(L, 1) == LUA_TSTRING, 1, "string expected");
@@ -1173,10 +1236,16 @@ static int num2int (lua_State *L) {
 }
 
 
+/*
+** T.newstate(true) creates the state with the real 'luaL_newstate'
+** (not the macro in ltests.h), so that it uses the allocator of the
+** auxiliary library (e.g., LUA_USE_POOLALLOC) instead of 'debug_realloc'.
+*/
 static int newstate (lua_State *L) {
   void *ud;
   lua_Alloc f = lua_getallocf(L, &ud);
-  lua_State *L1 = lua_newstate(f, ud);
+  lua_State *L1 = lua_toboolean(L, 1) ? (luaL_newstate)()
+                                      : lua_newstate(f, ud);
   if (L1) {
     lua_atpanic(L1, tpanic);
     lua_pushlightuserdata(L, L1);
@@ -2052,6 +2121,10 @@ static const struct luaL_Reg tests_funcs[] = {
   {"gccolor", gc_color},
   {"gcage", gc_age},
   {"gcstate", gc_state},
+#if defined(LUA_USE_ASYNCFREE)
+  {"gcasync", gc_async},
+  {"setallocf", set_allocf},
+#endif
   {"pobj", gc_printobj},
   {"getref", getref},
   {"hash", hash_query},
@@ -289,6 +289,12 @@ LUA_API void  (lua_wipetable) (lua_State *L, int idx);
 LUA_API void  (lua_compacttable) (lua_State *L, int idx);
 LUA_API void  (lua_clonetable) (lua_State *L, int fromidx, int toidx);
 LUA_API int   (lua_tabletype) (lua_State *L, int idx);
+LUA_API void  (lua_reservetable) (lua_State *L, int idx, int narray);
+LUA_API void  (lua_tablestats) (lua_State *L, lua_Integer *nrehash,
+                                lua_Integer *ngrow, int reset);
+LUA_API int   (lua_sortarray) (lua_State *L, int idx, lua_Integer n, int comp);
+LUA_API int   (lua_sortby) (lua_State *L, int idx, int keys, lua_Integer n,
+                            int stable);
 #endif
 
 /*
@@ -299,6 +305,15 @@ LUA_API int   (lua_isreadonly) (lua_State *L, int idx);
 LUA_API void  (lua_setreadonly) (lua_State *L, int idx, int value);
 #endif
 
+/*
+** state lock API
+*/
+#if defined(LUA_USE_LOCK)
+LUA_API void  (lua_lockstats) (lua_State *L, lua_Integer *nlock,
+                               lua_Integer *ncontended, lua_Integer *waitns,
+                               int reset);
+#endif
+
 /*
 ** string blob API
 */
@@ -313,6 +328,24 @@ LUA_API char *(lua_toblob) (lua_State *L, int idx, size_t *len);
 LUA_API char *(lua_pushblob) (lua_State *L, size_t len);
 #endif
 
+/*
+** string buffer API: buffers allocated with lua_reallocbuff (nsize == 0
+** frees) become strings without copying their contents.
+*/
+#if defined(LUAGLM_EXT_STRBUF)
+/* (Re)allocate a buffer of 'nsize' characters, keeping its contents. */
+LUA_API char *(lua_reallocbuff) (lua_State *L, char *buff, size_t osize,
+                                                           size_t nsize);
+
+/*
+** Push the first 'len' characters of a buffer of 'size' characters as a
+** string (a blob when 'blob' is set), consuming the buffer. On errors the
+** buffer is left untouched.
+*/
+LUA_API const char *(lua_pushbuffstring) (lua_State *L, char *buff,
+                                          size_t size, size_t len, int blob);
+#endif
+
 /*
 ** 'load' and 'call' functions (load and run Lua code)
 */
@@ -329,6 +362,15 @@ LUA_API int   (lua_load) (lua_State *L, lua_Reader reader, void *dt,
 
 LUA_API int (lua_dump) (lua_State *L, lua_Writer writer, void *data, int strip);
 
+/*
+** 'strip' flags of lua_dump. Any other nonzero bit strips all debug
+** information, as a plain true value does.
+*/
+#define LUA_DUMPSTRIP		1  /* drop debug information */
+#define LUA_DUMPNOLINES		0x10000  /* drop line information only */
+#define LUA_DUMPLAZY		0x20000  /* decode nested functions on first use */
+#define LUA_DUMPFLAGS		(LUA_DUMPNOLINES | LUA_DUMPLAZY)
+
 
 /*
 ** coroutine functions
@@ -365,6 +407,12 @@ LUA_API void (lua_warning)  (lua_State *L, const char *msg, int tocont);
 #define LUA_GCISRUNNING		9
 #define LUA_GCGEN		10
 #define LUA_GCINC		11
+#define LUA_GCASYNC		12
+#if defined(LUAGLM_EXT_GCBUDGET)
+#define LUA_GCBUDGET		13
+#define LUA_GCIDLE		14
+#define LUA_GCPAUSES		15
+#endif
 
 LUA_API int (lua_gc) (lua_State *L, int what, ...);
 
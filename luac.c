@@ -19,12 +19,18 @@
 #include "lauxlib.h"
 
 #include "ldebug.h"
+#include "lglm_core.h"
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lopnames.h"
 #include "lstate.h"
 #include "lundump.h"
 
+#if defined(LUA_USE_LUACJOBS)
+#include <pthread.h>
+#include <time.h>
+#endif
+
 static void PrintFunction(const Proto* f, int full);
 #define luaU_print	PrintFunction
 
@@ -34,10 +40,15 @@ static void PrintFunction(const Proto* f, int full);
 static int listing=0;			/* list bytecodes? */
 static int dumping=1;			/* dump bytecodes? */
 static int stripping=0;			/* strip debug information? */
+static const char* mode=NULL;		/* load mode ("btO" optimizes) */
 static char Output[]={ OUTPUT };	/* default output file name */
 static const char* output=Output;	/* actual output file name */
 static const char* progname=PROGNAME;	/* actual program name */
 static TString **tmname;
+#if defined(LUA_USE_LUACJOBS)
+static int jobs=1;			/* number of worker threads */
+static int statistics=0;		/* print per-file statistics? */
+#endif
 
 static l_noret fatal(const char* message)
 {
@@ -62,8 +73,19 @@ static l_noret usage(const char* message)
   "Available options are:\n"
   "  -l       list (use -l -l for full listing)\n"
   "  -o name  output to file 'name' (default is \"%s\")\n"
+#if defined(LUAGLM_EXT_OPTIMIZE)
+  "  -O       optimize\n"
+#endif
   "  -p       parse only\n"
   "  -s       strip debug information\n"
+  "  -S       strip line information only\n"
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  "  -z       load nested functions lazily (on first use)\n"
+#endif
+#if defined(LUA_USE_LUACJOBS)
+  "  -j n     compile input files on 'n' threads\n"
+  "  -t       print compile time and memory of each file\n"
+#endif
   "  -v       show version information\n"
   "  --       stop handling options\n"
   "  -        stop handling options and process stdin\n"
@@ -99,10 +121,29 @@ static int doargs(int argc, char* argv[])
     usage("'-o' needs argument");
    if (IS("-")) output=NULL;
   }
+#if defined(LUAGLM_EXT_OPTIMIZE)
+  else if (IS("-O"))			/* optimize */
+   mode="btO";
+#endif
   else if (IS("-p"))			/* parse only */
    dumping=0;
   else if (IS("-s"))			/* strip debug information */
-   stripping=1;
+   stripping|=LUA_DUMPSTRIP;
+  else if (IS("-S"))			/* strip line information */
+   stripping|=LUA_DUMPNOLINES;
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  else if (IS("-z"))			/* lazily loaded nested functions */
+   stripping|=LUA_DUMPLAZY;
+#endif
+#if defined(LUA_USE_LUACJOBS)
+  else if (IS("-j"))			/* worker threads */
+  {
+   const char* n=argv[++i];
+   if (n==NULL || (jobs=atoi(n))<1) usage("'-j' needs a positive argument");
+  }
+  else if (IS("-t"))			/* statistics */
+   statistics=1;
+#endif
   else if (IS("-v"))			/* show version */
    ++version;
   else					/* unknown option */
@@ -168,6 +209,141 @@ static int writer(lua_State* L, const void* p, size_t size, void* u)
  return (fwrite(p,size,1,(FILE*)u)!=1) && (size!=0);
 }
 
+#if defined(LUA_USE_LUACJOBS)
+/*
+** Parallel compilation: each input file is parsed by a worker thread in a
+** state of its own and dumped (unstripped) into memory. The main state then
+** undumps these chunks in input order, so the combined output does not
+** depend on the order in which workers finish.
+*/
+
+typedef struct Job {
+ const char* filename;			/* NULL for stdin */
+ char* chunk;				/* binary chunk, if compiled */
+ size_t size;
+ char* error;				/* error message, if any */
+ double time;				/* wall clock time (seconds) */
+ size_t memory;				/* bytes used by the parsed function */
+} Job;
+
+typedef struct JobQueue {
+ Job* job;
+ int n;
+ int next;				/* next job to be taken */
+ pthread_mutex_t lock;
+} JobQueue;
+
+static double now(void)
+{
+ struct timespec ts;
+ clock_gettime(CLOCK_MONOTONIC,&ts);
+ return (double)ts.tv_sec+(double)ts.tv_nsec*1e-9;
+}
+
+static size_t memused(lua_State* L)
+{
+ if (statistics) lua_gc(L,LUA_GCCOLLECT);
+ return (size_t)lua_gc(L,LUA_GCCOUNT,0)*1024+(size_t)lua_gc(L,LUA_GCCOUNTB,0);
+}
+
+static void printstatistics(const char* filename, double time, size_t memory)
+{
+ fprintf(stderr,"%s: %.3f ms, %.1f KB\n",(filename==NULL) ? "stdin" : filename,
+  time*1e3,(double)memory/1024.0);
+}
+
+static int bufwriter(lua_State* L, const void* p, size_t size, void* u)
+{
+ Job* j=(Job*)u;
+ char* b=(char*)realloc(j->chunk,j->size+size);
+ UNUSED(L);
+ if (b==NULL) return 1;
+ memcpy(b+j->size,p,size);
+ j->chunk=b;
+ j->size+=size;
+ return 0;
+}
+
+static char* copystring(const char* s)
+{
+ size_t l=strlen(s)+1;
+ char* c=(char*)malloc(l);
+ if (c!=NULL) memcpy(c,s,l);
+ return c;
+}
+
+static void compilejob(Job* j)
+{
+ lua_State* L=luaL_newstate();
+ if (L==NULL)
+ {
+  j->error=copystring("cannot create state: not enough memory");
+  return;
+ }
+ else
+ {
+  size_t m=memused(L);
+  double t=now();
+  if (luaL_loadfilex(L,j->filename,mode)!=LUA_OK)
+   j->error=copystring(lua_tostring(L,-1));
+  else
+  {
+   j->time=now()-t;
+   j->memory=memused(L)-m;
+   if (lua_dump(L,bufwriter,j,0)!=0 || j->chunk==NULL)
+    j->error=copystring("cannot dump: not enough memory");
+  }
+  lua_close(L);
+ }
+}
+
+static void* worker(void* ud)
+{
+ JobQueue* q=(JobQueue*)ud;
+ for (;;)
+ {
+  int i;
+  pthread_mutex_lock(&q->lock);
+  i=q->next++;
+  pthread_mutex_unlock(&q->lock);
+  if (i>=q->n) break;
+  compilejob(&q->job[i]);
+ }
+ return NULL;
+}
+
+static void loadjobs(lua_State* L, int argc, char* argv[])
+{
+ JobQueue q;
+ pthread_t* threads;
+ int i,nthreads=(jobs<argc) ? jobs : argc;
+ q.job=(Job*)calloc(argc,sizeof(Job));
+ threads=(pthread_t*)malloc(nthreads*sizeof(pthread_t));
+ if (q.job==NULL || threads==NULL) fatal("not enough memory");
+ for (i=0; i<argc; i++) q.job[i].filename=IS("-") ? NULL : argv[i];
+ q.n=argc;
+ q.next=0;
+ pthread_mutex_init(&q.lock,NULL);
+ for (i=0; i<nthreads; i++)
+  if (pthread_create(&threads[i],NULL,worker,&q)!=0)
+   break;
+ if (i==0) worker(&q);			/* no thread: compile here */
+ while (i-->0) pthread_join(threads[i],NULL);
+ pthread_mutex_destroy(&q.lock);
+ for (i=0; i<argc; i++)			/* first error in input order */
+ {
+  Job* j=&q.job[i];
+  if (j->error!=NULL) fatal(j->error);
+  if (luaL_loadbufferx(L,j->chunk,j->size,"=?","b")!=LUA_OK)
+   fatal(lua_tostring(L,-1));
+  free(j->chunk);
+  if (statistics) printstatistics(j->filename,j->time,j->memory);
+ }
+ free(threads);
+ free(q.job);
+}
+#endif
+
 static int pmain(lua_State* L)
 {
  int argc=(int)lua_tointeger(L,1);
@@ -176,10 +352,23 @@ static int pmain(lua_State* L)
  int i;
  tmname=G(L)->tmname;
  if (!lua_checkstack(L,argc)) fatal("too many input files");
+#if defined(LUA_USE_LUACJOBS)
+ if (jobs>1 && argc>1)
+  loadjobs(L,argc,argv);
+ else
+#endif
  for (i=0; i<argc; i++)
  {
   const char* filename=IS("-") ? NULL : argv[i];
-  if (luaL_loadfile(L,filename)!=LUA_OK) fatal(lua_tostring(L,-1));
+#if defined(LUA_USE_LUACJOBS)
+  size_t m=memused(L);
+  double t=now();
+  if (luaL_loadfilex(L,filename,mode)!=LUA_OK) fatal(lua_tostring(L,-1));
+  t=now()-t;
+  if (statistics) printstatistics(filename,t,memused(L)-m);
+#else
+  if (luaL_loadfilex(L,filename,mode)!=LUA_OK) fatal(lua_tostring(L,-1));
+#endif
  }
  f=combine(L,argc);
  if (listing) luaU_print(f,listing>1);
@@ -287,6 +476,12 @@ static void PrintType(const Proto* f, int i)
   case LUA_VLNGSTR:
 	printf("S");
 	break;
+  case LUA_VVECTOR2:
+  case LUA_VVECTOR3:
+  case LUA_VVECTOR4:
+  case LUA_VQUAT:
+	printf("V");
+	break;
   default:				/* cannot happen */
 	printf("?%d",ttypetag(o));
 	break;
@@ -323,6 +518,22 @@ static void PrintConstant(const Proto* f, int i)
   case LUA_VLNGSTR:
 	PrintString(tsvalue(o));
 	break;
+  case LUA_VVECTOR2:
+  case LUA_VVECTOR3:
+  case LUA_VVECTOR4:
+  case LUA_VQUAT:
+	{
+	char buff[100];
+	grit_length_t j,n=glm_dimensions(ttypetag(o));
+	if (ttisquat(o)) printf("quat("); else printf("vec%d(",(int)n);
+	for (j=0; j<n; j++)
+	{
+	 lua_number2str(buff,sizeof(buff),cast_num(vvalue(o).raw[j]));
+	 printf("%s%s",(j>0) ? ", " : "",buff);
+	}
+	printf(")");
+	break;
+	}
   default:				/* cannot happen */
 	printf("?%d",ttypetag(o));
 	break;
@@ -44,6 +44,24 @@ LUAMOD_API int (luaopen_debug) (lua_State *L);
 #define LUA_LOADLIBNAME	"package"
 LUAMOD_API int (luaopen_package) (lua_State *L);
 
+#define LUA_ARRAYLIBNAME	"array"
+LUAMOD_API int (luaopen_array) (lua_State *L);
+
+#define LUA_JSONLIBNAME	"json"
+LUAMOD_API int (luaopen_json) (lua_State *L);
+
+#define LUA_SERIALIZELIBNAME	"serialize"
+LUAMOD_API int (luaopen_serialize) (lua_State *L);
+
+#define LUA_SHAREDLIBNAME	"shared"
+LUAMOD_API int (luaopen_shared) (lua_State *L);
+
+#define LUA_CHANNELLIBNAME	"channel"
+LUAMOD_API int (luaopen_channel) (lua_State *L);
+
+#define LUA_PARALLELLIBNAME	"parallel"
+LUAMOD_API int (luaopen_parallel) (lua_State *L);
+
 
 /* open all previous libraries */
 LUALIB_API void (luaL_openlibs) (lua_State *L);
@@ -43,6 +43,10 @@ typedef struct {
   lua_State *L;
   ZIO *Z;
   const char *name;
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  int lazy;  /* nested functions are length-prefixed */
+  TString *chunk;  /* string being decoded by 'luaU_loadlazy', if any */
+#endif
 } LoadState;
 
 
@@ -231,6 +235,37 @@ static void loadConstants (LoadState *S, Proto *f) {
 }
 
 
+#if defined(LUAGLM_EXT_LAZYLOAD)
+/*
+** Create a placeholder for a length-prefixed nested function, keeping
+** its dump undecoded: nested functions of a string being decoded refer
+** to a range of that string; others are read into a new string.
+*/
+static void loadLazyProto (LoadState *S, Proto *f) {
+  lua_State *L = S->L;
+  size_t size = loadSize(S);
+  f->source = NULL;
+  if (S->chunk != NULL) {  /* decoding from memory? */
+    ZIO *Z = S->Z;
+    if (Z->n < size)
+      error(S, "truncated chunk");
+    f->lazychunk = S->chunk;
+    f->lazyoff = cast_sizet(Z->p - getstr(S->chunk));
+    Z->p += size;  /* skip it */
+    Z->n -= size;
+  }
+  else {
+    TString *ts = luaS_createlngstrobj(L, size);
+    f->lazychunk = ts;  /* anchor it ('loadVector' can GC) */
+    loadVector(S, getstr(ts), size);
+    f->lazyoff = 0;
+  }
+  f->lazylen = size;
+  luaC_objbarrier(L, f, f->lazychunk);
+}
+#endif
+
+
 static void loadProtos (LoadState *S, Proto *f) {
   int i;
   int n = loadInt(S);
@@ -241,6 +276,13 @@ static void loadProtos (LoadState *S, Proto *f) {
   for (i = 0; i < n; i++) {
     f->p[i] = luaF_newproto(S->L);
     luaC_objbarrier(S->L, f, f->p[i]);
+#if defined(LUAGLM_EXT_LAZYLOAD)
+    if (S->lazy) {
+      loadLazyProto(S, f->p[i]);
+      f->p[i]->source = f->source;  /* until decoded */
+      continue;
+    }
+#endif
     loadFunction(S, f->p[i], f->source);
   }
 }
@@ -335,8 +377,16 @@ static void checkHeader (LoadState *S) {
   checkliteral(S, &LUA_SIGNATURE[1], "not a binary chunk");
   if (loadByte(S) != LUAC_VERSION)
     error(S, "version mismatch");
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  switch (loadByte(S)) {
+    case LUAC_FORMAT: S->lazy = 0; break;
+    case LUAC_FORMAT_LAZY: S->lazy = 1; break;
+    default: error(S, "format mismatch");
+  }
+#else
   if (loadByte(S) != LUAC_FORMAT)
     error(S, "format mismatch");
+#endif
   checkliteral(S, LUAC_DATA, "corrupted chunk");
   checksize(S, Instruction);
   checksize(S, lua_Integer);
@@ -362,6 +412,9 @@ LClosure *luaU_undump(lua_State *L, ZIO *Z, const char *name) {
     S.name = name;
   S.L = L;
   S.Z = Z;
+#if defined(LUAGLM_EXT_LAZYLOAD)
+  S.chunk = NULL;
+#endif
   checkHeader(&S);
   cl = luaF_newLclosure(L, loadByte(&S));
   setclLvalue2s(L, L->top, cl);
@@ -373,5 +426,101 @@ LClosure *luaU_undump(lua_State *L, ZIO *Z, const char *name) {
   luai_verifycode(L, cl->p);
   return cl;
 }
+
+
+#if defined(LUAGLM_EXT_LAZYLOAD)
+typedef struct LoadLazy {
+  const char *s;
+  size_t size;
+} LoadLazy;
+
+
+static const char *getLazy (lua_State *L, void *ud, size_t *size) {
+  LoadLazy *ll = (LoadLazy *)ud;
+  UNUSED(L);
+  if (ll->size == 0) return NULL;
+  *size = ll->size;
+  ll->size = 0;
+  return ll->s;
+}
+
+
+/*
+** 'f' may be old: as prototypes are not kept in 'grayagain' lists, use
+** forward barriers for everything it now refers to.
+*/
+static void barrierproto (lua_State *L, Proto *f) {
+  int i;
+  if (f->source) luaC_objbarrier(L, f, f->source);
+  for (i = 0; i < f->sizek; i++)
+    luaC_barrier(L, f, &f->k[i]);
+  for (i = 0; i < f->sizeupvalues; i++)
+    if (f->upvalues[i].name) luaC_objbarrier(L, f, f->upvalues[i].name);
+  for (i = 0; i < f->sizep; i++)
+    luaC_objbarrier(L, f, f->p[i]);
+  for (i = 0; i < f->sizelocvars; i++)
+    if (f->locvars[i].varname) luaC_objbarrier(L, f, f->locvars[i].varname);
+}
+
+
+/*
+** Decode the dump kept by a placeholder prototype. The function is
+** decoded into a new prototype whose contents are then moved into 'f',
+** so an error (e.g., memory) leaves 'f' as a valid placeholder.
+*/
+void luaU_loadlazy (lua_State *L, Proto *f) {
+  LoadState S;
+  ZIO z;
+  LoadLazy ll;
+  LClosure *cl;
+  Proto *np;
+  TString *chunk = f->lazychunk;
+  lua_assert(chunk != NULL);
+  ll.s = getstr(chunk) + f->lazyoff;
+  ll.size = f->lazylen;
+  luaZ_init(L, &z, getLazy, &ll);
+  S.L = L;
+  S.Z = &z;
+  S.name = (f->source != NULL) ? getstr(f->source) : "?";
+  if (*S.name == '@' || *S.name == '=')
+    S.name++;
+  S.lazy = 1;
+  S.chunk = chunk;
+  setsvalue2s(L, L->top, chunk);  /* anchor chunk */
+  luaD_inctop(L);
+  cl = luaF_newLclosure(L, 0);  /* anchor for the new prototype */
+  setclLvalue2s(L, L->top, cl);
+  luaD_inctop(L);
+  cl->p = np = luaF_newproto(L);
+  luaC_objbarrier(L, cl, np);
+  loadFunction(&S, np, f->source);
+  luai_verifycode(L, np);
+  /* move contents of 'np' into 'f' */
+  f->numparams = np->numparams;
+  f->is_vararg = np->is_vararg;
+  f->maxstacksize = np->maxstacksize;
+  f->linedefined = np->linedefined;
+  f->lastlinedefined = np->lastlinedefined;
+  f->source = np->source;
+  f->k = np->k; f->sizek = np->sizek;
+  f->code = np->code; f->sizecode = np->sizecode;
+  f->p = np->p; f->sizep = np->sizep;
+  f->upvalues = np->upvalues; f->sizeupvalues = np->sizeupvalues;
+  f->lineinfo = np->lineinfo; f->sizelineinfo = np->sizelineinfo;
+  f->abslineinfo = np->abslineinfo; f->sizeabslineinfo = np->sizeabslineinfo;
+  f->locvars = np->locvars; f->sizelocvars = np->sizelocvars;
+  f->lazychunk = NULL;
+  np->k = NULL; np->sizek = 0;
+  np->code = NULL; np->sizecode = 0;
+  np->p = NULL; np->sizep = 0;
+  np->upvalues = NULL; np->sizeupvalues = 0;
+  np->lineinfo = NULL; np->sizelineinfo = 0;
+  np->abslineinfo = NULL; np->sizeabslineinfo = 0;
+  np->locvars = NULL; np->sizelocvars = 0;
+  np->source = NULL;
+  barrierproto(L, f);
+  L->top -= 2;
+}
+#endif
 #endif
 
@@ -26,9 +26,19 @@
 
 #define LUAC_FORMAT	0	/* this is the official format */
 
+#if defined(LUAGLM_EXT_LAZYLOAD)
+/* nested functions are length-prefixed and decoded on first use */
+#define LUAC_FORMAT_LAZY	1
+#endif
+
 /* load one chunk; from lundump.c */
 LUAI_FUNC LClosure* luaU_undump (lua_State* L, ZIO* Z, const char* name);
 
+#if defined(LUAGLM_EXT_LAZYLOAD)
+/* decode a lazily loaded prototype; from lundump.c */
+LUAI_FUNC void luaU_loadlazy (lua_State *L, Proto *f);
+#endif
+
 /* dump one chunk; from ldump.c */
 LUAI_FUNC int luaU_dump (lua_State* L, const Proto* f, lua_Writer w,
                          void* data, int strip);
@@ -29,6 +29,7 @@
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
+#include "lundump.h"
 #include "lvm.h"
 
 
@@ -1023,6 +1024,105 @@ void luaV_finishOp (lua_State *L) {
   op_arith_aux(L, v1, v2, iop, fop); }
 
 
+#if defined(LUAGLM_EXT_VECFAST)
+/*
+** @LuaGLM: Type-specialized paths for the component-wise vector operators
+** (+, -, *, /). Guarded on the operand tags: a vector and a vector of the same
+** dimension, or a vector and a number (in either order). Quaternions are
+** excluded as their products are not component-wise. On success the following
+** OP_MMBIN is skipped; otherwise it falls through to 'luaT_trybinTM', which
+** computes the same results for these operand pairs.
+*/
+#define ttisvecfast(o)	(ttisvector(o) && !ttisquat(o))
+
+static l_inline int tovecfast (const TValue *v1, const TValue *v2,
+                               lua_Float4 *f1, lua_Float4 *f2, lu_byte *tt) {
+  int n;
+  if (ttisvecfast(v1)) {
+    *tt = ttypetag(v1);
+    *f1 = vvalue_(v1);
+    if (checktag(v2, *tt))
+      *f2 = vvalue_(v2);
+    else if (ttisnumber(v2)) {
+      lua_VecF s = cast(lua_VecF, nvalue(v2));
+      for (n = 0; n < 4; n++) f2->raw[n] = s;
+    }
+    else
+      return 0;
+    return 1;
+  }
+  else if (ttisnumber(v1) && ttisvecfast(v2)) {
+    lua_VecF s = cast(lua_VecF, nvalue(v1));
+    *tt = ttypetag(v2);
+    *f2 = vvalue_(v2);
+    for (n = 0; n < 4; n++) f1->raw[n] = s;
+    return 1;
+  }
+  return 0;
+}
+
+
+/*
+** Component-wise operation over vector operands; 'ra' must be in scope.
+*/
+#define op_vector_aux(L,v1,v2,fop) {  \
+  lua_Float4 f1; lua_Float4 f2; lu_byte tt;  \
+  if (tovecfast(v1, v2, &f1, &f2, &tt)) {  \
+    int n;  \
+    for (n = 0; n < 4; n++) f1.raw[n] = fop(L, f1.raw[n], f2.raw[n]);  \
+    pc++; setvvalue(s2v(ra), f1, tt);  \
+  }}
+
+
+#define op_arithfv_aux(L,v1,v2,fop) {  \
+  lua_Number n1; lua_Number n2;  \
+  if (tonumberns(v1, n1) && tonumberns(v2, n2)) {  \
+    pc++; setfltvalue(s2v(ra), fop(L, n1, n2));  \
+  }  \
+  else op_vector_aux(L, v1, v2, fop); }
+
+
+#define op_arithv_aux(L,v1,v2,iop,fop) {  \
+  StkId ra = RA(i); \
+  if (ttisinteger(v1) && ttisinteger(v2)) {  \
+    lua_Integer i1 = ivalue(v1); lua_Integer i2 = ivalue(v2);  \
+    pc++; setivalue(s2v(ra), iop(L, i1, i2));  \
+  }  \
+  else op_arithfv_aux(L, v1, v2, fop); }
+
+
+/*
+** Arithmetic operations (register and K operands) with vector fast paths.
+*/
+#define op_arithv(L,iop,fop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  op_arithv_aux(L, v1, v2, iop, fop); }
+
+#define op_arithvK(L,iop,fop) {  \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = KC(i); lua_assert(ttisnumber(v2));  \
+  op_arithv_aux(L, v1, v2, iop, fop); }
+
+#define op_arithfv(L,fop) {  \
+  StkId ra = RA(i); \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = vRC(i);  \
+  op_arithfv_aux(L, v1, v2, fop); }
+
+#define op_arithfvK(L,fop) {  \
+  StkId ra = RA(i); \
+  TValue *v1 = vRB(i);  \
+  TValue *v2 = KC(i); lua_assert(ttisnumber(v2));  \
+  op_arithfv_aux(L, v1, v2, fop); }
+#else
+#define op_arithv(L,iop,fop)	op_arith(L,iop,fop)
+#define op_arithvK(L,iop,fop)	op_arithK(L,iop,fop)
+#define op_arithfv(L,fop)	op_arithf(L,fop)
+#define op_arithfvK(L,fop)	op_arithfK(L,fop)
+#endif
+
+
 /*
 ** Bitwise operations with constant operand.
 */
@@ -1497,15 +1597,15 @@ LUA_JUMPTABLE_ATTRIBUTE void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_ADDK) {
-        op_arithK(L, l_addi, luai_numadd);
+        op_arithvK(L, l_addi, luai_numadd);
         vmbreak;
       }
       vmcase(OP_SUBK) {
-        op_arithK(L, l_subi, luai_numsub);
+        op_arithvK(L, l_subi, luai_numsub);
         vmbreak;
       }
       vmcase(OP_MULK) {
-        op_arithK(L, l_muli, luai_nummul);
+        op_arithvK(L, l_muli, luai_nummul);
         vmbreak;
       }
       vmcase(OP_MODK) {
@@ -1517,7 +1617,7 @@ LUA_JUMPTABLE_ATTRIBUTE void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_DIVK) {
-        op_arithfK(L, luai_numdiv);
+        op_arithfvK(L, luai_numdiv);
         vmbreak;
       }
       vmcase(OP_IDIVK) {
@@ -1557,15 +1657,15 @@ LUA_JUMPTABLE_ATTRIBUTE void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_ADD) {
-        op_arith(L, l_addi, luai_numadd);
+        op_arithv(L, l_addi, luai_numadd);
         vmbreak;
       }
       vmcase(OP_SUB) {
-        op_arith(L, l_subi, luai_numsub);
+        op_arithv(L, l_subi, luai_numsub);
         vmbreak;
       }
       vmcase(OP_MUL) {
-        op_arith(L, l_muli, luai_nummul);
+        op_arithv(L, l_muli, luai_nummul);
         vmbreak;
       }
       vmcase(OP_MOD) {
@@ -1577,7 +1677,7 @@ LUA_JUMPTABLE_ATTRIBUTE void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_DIV) {  /* float division (always with floats) */
-        op_arithf(L, luai_numdiv);
+        op_arithfv(L, luai_numdiv);
         vmbreak;
       }
       vmcase(OP_IDIV) {  /* floor division */
@@ -1645,6 +1745,14 @@ LUA_JUMPTABLE_ATTRIBUTE void luaV_execute (lua_State *L, CallInfo *ci) {
         else if (tonumberns(rb, nb)) {
           setfltvalue(s2v(ra), luai_numunm(L, nb));
         }
+#if defined(LUAGLM_EXT_VECFAST)
+        else if (ttisvecfast(rb)) {
+          lua_Float4 f = vvalue_(rb);
+          int n;
+          for (n = 0; n < 4; n++) f.raw[n] = luai_numunm(L, f.raw[n]);
+          setvvalue(s2v(ra), f, ttypetag(rb));
+        }
+#endif
         else
           Protect(luaT_trybinTM(L, rb, rb, ra, TM_UNM));
         vmbreak;
@@ -1981,6 +2089,13 @@ LUA_JUMPTABLE_ATTRIBUTE void luaV_execute (lua_State *L, CallInfo *ci) {
       vmcase(OP_CLOSURE) {
         StkId ra = RA(i);
         Proto *p = cl->p->p[GETARG_Bx(i)];
+#if defined(LUAGLM_EXT_LAZYLOAD)
+        if (l_unlikely(p->lazychunk != NULL)) {  /* not decoded yet? */
+          Protect(luaU_loadlazy(L, p));
+          updatebase(ci);  /* stack may have been reallocated */
+          ra = RA(i);
+        }
+#endif
         halfProtect(pushclosure(L, p, cl->upvals, base, ra));
         checkGC(L, ra + 1);
         vmbreak;
@@ -100,13 +100,17 @@
 
 /* standard library  -- not used by luac */
 #ifndef MAKE_LUAC
+#include "larraylib.c"
 #include "lbaselib.c"
 #include "lcorolib.c"
 #include "ldblib.c"
 #include "liolib.c"
+#include "ljsonlib.c"
 #include "lmathlib.c"
 #include "loadlib.c"
 #include "loslib.c"
+#include "lserializelib.c"
+#include "lsharedlib.c"
 #include "lstrlib.c"
 #include "ltablib.c"
 #include "lutf8lib.c"
@@ -23,6 +23,8 @@ _soft = rawget(_G, "_soft") or false
 _port = rawget(_G, "_port") or false
 -- Make true to avoid messages about tests not performed
 _nomsg = rawget(_G, "_nomsg") or false
+-- Make true to load test files with the optimizer (load mode "O")
+_optimize = rawget(_G, "_optimize") or false
 
 
 local usertests = rawget(_G, "_U")
@@ -146,7 +148,7 @@ local dofile = function (n, strip)
   print(string.format("time: %g (+%g)", c - initclock, c - lastclock))
   lastclock = c
   report(n)
-  local f = assert(loadfile(n))
+  local f = assert(loadfile(n, _optimize and "tO" or nil))
   local b = string.dump(f, strip)
   f = assert(load(b))
   return f()
@@ -158,7 +160,7 @@ dofile('main.lua')
 require"tracegc".start()
 
 report"gc.lua"
-local f = assert(loadfile('gc.lua'))
+local f = assert(loadfile('gc.lua', _optimize and "tO" or nil))
 f()
 
 dofile('db.lua')
@@ -186,6 +188,8 @@ assert(dofile('events.lua') == 12)
 dofile('vararg.lua')
 dofile('closure.lua')
 dofile('coroutine.lua')
+dofile('shared.lua')
+dofile('json.lua')
 dofile('goto.lua', true)
 dofile('errors.lua')
 dofile('math.lua')
@@ -959,6 +959,8 @@ print'+'
 
 
 -- testing changing hooks during hooks
+-- (counts instructions; the optimizer removes the repeated loads)
+if not _optimize then
 _G.t = {}
 T.sethook([[
   # set a line hook after 3 count hooks
@@ -979,6 +981,7 @@ line = t[2]
 assert(t[3] == "line" and t[4] == line + 1)
 assert(t[5] == "line" and t[6] == line + 2)
 assert(t[7] == nil)
+end
 
 
 -------------------------------------------------------------------------
@@ -1064,6 +1067,32 @@ assert(T.doremote(L1, "return a.x") == "1")
 
 T.closestate(L1)
 
+-- state created by the auxiliary library (its allocator, e.g., the pool)
+L1 = T.newstate(true)
+T.loadlib(L1)
+a, b = T.doremote(L1, [[
+  require'_G'; string = require'string'
+  local t = {}
+  for n = 1, 3 do
+    for i = 1, 2000 do    -- blocks of all sizes, moving between classes
+      local x = {}
+      for j = 1, i % 40 do x[j] = j; x["k" .. j] = string.rep("a", j) end
+      t[i % 500 + 1] = x
+      t[-i] = function () return x, i end
+      if i % 3 == 0 then t[-i] = nil end
+    end
+    collectgarbage()
+  end
+  local s = 0
+  for i = 1, 500 do
+    local x = t[i]
+    for j = 1, #x do s = s + x[j] + #x["k" .. j] end
+  end
+  return s, #t[2]
+]])
+assert(a == "274080" and b == "21")
+T.closestate(L1)
+
 L1 = nil
 
 print('+')
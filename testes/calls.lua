@@ -477,5 +477,114 @@ do
   end
 end
 
+do   -- strip line information only
+  local f = load(string.dump(load[[
+    local a, debug = ...
+    local b = a + 1
+    return b, debug.getinfo(1, "l").currentline
+  ]], "lines"))
+  local b, l = f(1, debug)
+  assert(b == 2 and l == -1)
+  assert(debug.getupvalue(f, 1) == "_ENV")    -- other debug info kept
+  local st, msg = pcall(string.dump, f, "all")
+  assert(not st and string.find(msg, "invalid option"))
+end
+
+
+do   -- lazily decoded nested functions
+  local function dumplazy (f, strip)
+    return string.dump(f, strip, true)
+  end
+  if string.byte(dumplazy(function () end), 6) ~= 0 then   -- format byte
+    print("testing lazy binary chunks")
+    local x = [[
+      local k = 10
+      return function (x)
+        return function (y)
+          return function (z) return x + y + z + k end
+        end
+      end, function () return "unused" end
+    ]]
+    local a = assert(load(dumplazy(assert(load(x)))))
+    assert(a()(2)(3)(10) == 25)
+    -- dump again functions that were never decoded
+    a = assert(load(dumplazy(a, true)))
+    local f, g = a()
+    assert(f(2)(3)(10) == 25 and g() == "unused")
+    a = assert(load(string.dump(assert(load(dumplazy(assert(load(x))))))))
+    assert(a()(2)(3)(10) == 25)
+
+    -- deeply nested functions are dumped only once
+    local depth = 60
+    x = string.rep("return function () ", depth) .. "return 'deep'" ..
+        string.rep(" end", depth)
+    local t = os.clock()
+    a = assert(load(dumplazy(assert(load(x)))))
+    assert(os.clock() - t < 1)
+    for i = 1, depth do a = a() end
+    assert(a() == "deep")
+  end
+end
+
+do   -- chunk cache of 'loadfile'
+  local file = os.tmpname()
+  local dir = string.match(file, "^(.*)[/\\]")
+  local function hash (s)   -- FNV-1a of the file name names its entry
+    local h = -3750763034362895579   -- 14695981039346656037
+    for i = 1, #s do h = (h ~ string.byte(s, i)) * 1099511628211 end
+    return string.format("%016x", h)
+  end
+  local function write (name, s)
+    local f = assert(io.open(name, "wb"))
+    f:write(s)
+    assert(f:close())
+  end
+  local reg = debug.getregistry()
+  write(file, "return ..., 'v1'")
+  reg._CHUNKCACHE = dir
+  local a, b = assert(loadfile(file))(1)
+  assert(a == 1 and b == 'v1')
+  local entry = dir and math.maxinteger == 0x7fffffffffffffff and
+                io.open(dir .. "/" .. hash(file) .. ".luac", "rb")
+  if entry then
+    print("testing chunk cache")
+    local s = entry:read("a")
+    entry:close()
+    entry = dir .. "/" .. hash(file) .. ".luac"
+    assert(string.sub(s, 1, 8) == "LUACACHE")
+    local _, e = string.find(s, "\n" .. file .. "\n", 1, true)
+    local header = string.sub(s, 1, e)
+    -- a matching entry is loaded instead of the source
+    write(entry, header .. string.dump(load("return 'cached'")))
+    assert(loadfile(file)() == 'cached')
+    assert(select(2, loadfile(file, "t")()) == 'v1')   -- text only: no cache
+    -- a damaged entry is rewritten
+    write(entry, header .. "\27Lua")
+    a, b = assert(loadfile(file))(2)
+    assert(a == 2 and b == 'v1')
+    assert(loadfile(file)(3) == 3)
+    -- a long name (header longer than a read buffer on some systems)
+    local long = dir .. string.rep("/.", 1000) .. string.sub(file, #dir + 1)
+    local lentry = dir .. "/" .. hash(long) .. ".luac"
+    assert(loadfile(long)(5) == 5)
+    local f = assert(io.open(lentry, "rb"))
+    s = f:read("a")
+    f:close()
+    _, e = string.find(s, "\n" .. long .. "\n", 1, true)
+    header = string.sub(s, 1, e)
+    assert(#header > 2000)
+    write(lentry, header .. string.dump(load("return 'cached'")))
+    assert(loadfile(long)() == 'cached')
+    assert(os.remove(lentry))
+    -- a changed source does not match its entry
+    write(file, "return ..., 'v2'")
+    a, b = assert(loadfile(file))(4)
+    assert(a == 4 and b == 'v2')
+    assert(os.remove(entry))
+  end
+  reg._CHUNKCACHE = nil
+  assert(os.remove(file))
+end
+
 print('OK')
 return deep
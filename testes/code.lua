@@ -445,5 +445,97 @@ do   -- string constants
   assert(T.listk(f2)[1] == nil)
 end
 
+if type(T.listk(function () return vec3(1, 2, 3) end)[1]) == "vector3" then
+  print "testing vector constants"
+  check(function () return vec3(1, 2, 3) end, 'LOADK', 'RETURN1')
+  check(function () return -vec2(1, 2) * 2 + vec2(1) end, 'LOADK', 'RETURN1')
+  check(function (x) return vec3(1, x, 3) end,
+    'GETTABUP', 'LOADI', 'MOVE', 'LOADI', 'TAILCALL', 'RETURN')
+  -- folded calls leave no constants behind
+  checkKlist(function () return vec3(1, 2, 3), vec2(4) * 2 end,
+             {vec3(1, 2, 3), vec2(8)})
+  local function outer (g)
+    local a = g(vec3)
+    local function inner ()
+      local b = g(vec3(1, 2, 3))
+      return g("vec3")
+    end
+    return vec3
+  end
+  local n = 0
+  for _, k in ipairs(T.listk(outer)) do
+    if k == "vec3" then n = n + 1 end
+  end
+  assert(n == 1)
+end
+
+do   -- optimizer (load mode "O")
+  local function opt (s) return assert(load(s, "=opt", "tO")) end
+  local function nhoisted (f)   -- number of globals loaded by 'FORPREP'
+    local c, n = T.listcode(f), 0
+    for i = 1, #c do
+      if string.find(c[i], "FORPREP") then
+        while string.find(c[i + n + 1], "GETTABUP") do n = n + 1 end
+        return n
+      end
+    end
+  end
+  local src = "local x; for i = 1, 3 do x = K end; return x"
+  if #T.listcode(opt(src)) > #T.listcode(load(src)) then
+    print "testing optimizer"
+    local f = opt(src)
+    check(f, 'VARARGPREP', 'LOADNIL', 'LOADI', 'LOADI', 'LOADI', 'FORPREP',
+      'GETTABUP', 'MOVE', 'FORLOOP', 'RETURN', 'RETURN')
+    K = 10; assert(f() == 10); K = nil
+    -- globals are not hoisted from loops that may change them
+    for _, s in ipairs{"g()", "x = x .. 's'", "x = {}", "K = 1",
+                       "t.K = 1", "t[x] = 1", "_ENV = _ENV",
+                       "x = function () end"} do
+      s = "local x, t = 1, {}; for i = 1, 3 do x = K; " .. s ..
+          " end; return x"
+      checkequal(opt(s), load(s))
+    end
+    -- arithmetic, comparisons, and table accesses do not prevent it
+    for _, s in ipairs{"x = t.y", "x = x + 1", "x = #t", "x = x < 1",
+                       "x = -x", "t[1] = x", "t.y = K", "L = 1"} do
+      s = "local x, t = 1, {y = 2}; for i = 1, 3 do x = K; " .. s ..
+          " end; return x"
+      local f = opt(s)
+      assert(nhoisted(f) == 1)
+      K = 10; assert(f() == load(s)()); K = nil; L = nil
+    end
+    -- a numeric loop of a renderer: both globals are read once
+    local src = [[
+      local n, dir, cx, cy = ...
+      local r = dir * 0
+      for s = 1, n do
+        local d = cx * (s / n - 0.5) + cy * (0.5 - s / n) + dir
+        if d.x < EPS then d = -d end
+        r = r + d * (1 / n) * math.pi
+      end
+      return r
+    ]]
+    f = opt(src)
+    assert(nhoisted(f) == 2)
+    EPS = 0.5
+    local args = {10, vec3(1, 2, 3), vec3(1, 0, 0), vec3(0, 1, 0)}
+    assert(f(table.unpack(args)) == load(src)(table.unpack(args)))
+    EPS = nil
+    -- a move only read by the next instruction
+    check(opt"local a = {}; local b = a; b = b.x; return b", 'VARARGPREP',
+      'NEWTABLE', 'EXTRAARG', 'GETFIELD', 'RETURN', 'RETURN')
+    -- a global redefined by a function called in the loop
+    f = opt[[
+      local n = 0
+      for i = 1, 3 do
+        load(string.format("function temp () return %d end", i))()
+        n = n + temp()
+      end
+      return n
+    ]]
+    assert(f() == 6); temp = nil
+  end
+end
+
 print 'OK'
 
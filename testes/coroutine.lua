@@ -960,6 +960,91 @@ assert(run(function ()
 
 
 
+do   -- rearming dead coroutines (thread pool)
+  local co = coroutine.create(function (...) return ... end)
+  assert(coroutine.resume(co, 1))
+  if coroutine.create(function () end, co) == co then
+    print("testing reuse of coroutines")
+    assert(coroutine.resume(co) and coroutine.status(co) == "dead")
+    local function checkerr (msg, f, ...)
+      local st, err = pcall(f, ...)
+      assert(not st and string.find(err, msg))
+    end
+    assert(coroutine.create(function (a) return a * 2 end, co) == co)
+    assert(coroutine.status(co) == "suspended")
+    local _, a = coroutine.resume(co, 10)
+    assert(a == 20 and coroutine.status(co) == "dead")
+
+    -- only dead coroutines can be rearmed
+    co = coroutine.create(function () coroutine.yield() end)
+    checkerr("suspended", coroutine.create, print, co)   -- not started
+    coroutine.resume(co)
+    checkerr("suspended", coroutine.create, print, co)
+    co = coroutine.create(function ()
+      return pcall(coroutine.create, print, coroutine.running())
+    end)
+    local _, st, msg = coroutine.resume(co)
+    assert(not st and string.find(msg, "running"))
+    checkerr("thread expected", coroutine.create, print, {})
+
+    -- pending to-be-closed variables are closed when rearmed
+    local closed = false
+    co = coroutine.create(function ()
+      local x <close> = func2close(function () closed = true end)
+      error("x")
+    end)
+    assert(not coroutine.resume(co) and not closed)
+    coroutine.create(print, co)
+    assert(closed and coroutine.status(co) == "suspended")
+
+    -- wrapped coroutines
+    local w = coroutine.wrap(function () return 1 end)
+    assert(w() == 1)
+    assert(coroutine.wrap(function (x) coroutine.yield(x); return 3 end, w) == w)
+    assert(w(2) == 2 and w() == 3)
+    co = coroutine.create(function () return 4 end)
+    coroutine.resume(co)
+    w = coroutine.wrap(function () return 5 end, co)   -- from a dead thread
+    assert(w() == 5 and coroutine.status(co) == "dead")
+    checkerr("wrap function or thread expected", coroutine.wrap, print, 10)
+    checkerr("wrap function or thread expected", coroutine.wrap, print, print)
+    w = coroutine.wrap(function () coroutine.yield() end)
+    w()
+    checkerr("suspended", coroutine.wrap, print, w)
+
+    -- pooled threads, including ones with big stacks
+    local function deep (n) if n > 0 then return deep(n - 1) + 1 end return 0 end
+    for i = 1, 200 do
+      local co = coroutine.wrap(function (n) return deep(n) end)
+      assert(co(i % 2 == 0 and 5000 or 10) == (i % 2 == 0 and 5000 or 10))
+      if i % 50 == 0 then collectgarbage() end
+    end
+    for i = 1, 200 do
+      co = coroutine.create(function (a) coroutine.yield(a); return a + 1 end)
+      assert(select(2, coroutine.resume(co, i)) == i)
+      collectgarbage("step")
+    end
+  end
+end
+
+if debug.lockstats and not T then   -- 'ltests.h' has its own lock
+  print("testing state lock")
+  local n0 = debug.lockstats(true)   -- reset counters
+  assert(math.type(n0) == "integer")
+  local n, nc, w = debug.lockstats()
+  assert(n >= 0 and n < 10 and nc == 0 and w == 0)
+  -- coroutines and C calls all go through the lock
+  local co = coroutine.wrap(function (a)
+    while true do a = coroutine.yield(math.abs(a)) end
+  end)
+  for i = 1, 100 do assert(co(-i) == i) end
+  local n1, nc1, w1 = debug.lockstats()
+  assert(n1 > n + 100)
+  assert(nc1 == 0 and w1 == 0)   -- nothing else runs on this state
+  assert(debug.lockstats() >= n1)
+  assert(debug.lockstats(true) >= n1 and debug.lockstats() < n1)
+end
+
 -- tests for coroutine API
 if T==nil then
   (Message or print)('\n >>> testC not active: skipping coroutine API tests <<<\n')
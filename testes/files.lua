@@ -772,6 +772,124 @@ f:write("alo")
 f:seek("set")
 assert(f:read"a" == "alo")
 
+
+if io.mmap then
+  print("testing mapped files")
+  local data = "first line\nsecond\n\n123 4.5 0x10\nlast"
+  do
+    local f = assert(io.open(file, "wb"))
+    f:write(data)
+    assert(f:close())
+  end
+  local m = assert(io.mmap(file))
+  assert(io.type(m) == "mapped file" and #m == #data)
+  local t = {}
+  for l in m:lines() do t[#t + 1] = l end
+  assert(table.concat(t, "|") == "first line|second||123 4.5 0x10|last")
+  assert(m:seek("set") == 0)
+  local a, b, c, x, y, z, r = m:read("l", "L", "l", "n", "n", "n", "a")
+  assert(a == "first line" and b == "second\n" and c == "")
+  assert(x == 123 and y == 4.5 and z == 16 and r == "\nlast")
+  assert(m:read("a") == "" and m:read("l") == nil and m:read(0) == nil)
+  assert(m:seek("set", 3) == 3 and m:read(4) == "st l")
+  assert(m:seek("cur") == 7 and m:seek("end") == #data)
+  assert(m:sub(1, 5) == "first" and m:sub(-4) == "last" and m:sub(100) == "")
+  assert(m:seek("cur") == #data)   -- 'sub' does not move the position
+  local i, j = m:find("second")
+  assert(i == 12 and j == 17)
+  assert(m:find("\n", 12) == 18 and m:find("zz") == nil)
+  assert(m:close())
+  checkerr("closed mapped file", m.read, m)
+  m = assert(io.open(file, "m"))
+  assert(m:read("a") == data)
+  m:close()
+  local f, msg, code = io.mmap(otherfile .. "/nofile")
+  assert(f == nil and type(msg) == "string" and math.type(code) == "integer")
+  -- an empty file
+  assert(io.open(otherfile, "w")):close()
+  m = assert(io.mmap(otherfile))
+  assert(#m == 0 and m:read("a") == "" and m:read("l") == nil)
+  m:close()
+  assert(os.remove(otherfile))
+end
+
+
+if io.stdout.writevec then
+  print("testing vector i/o")
+  local f = assert(io.open(file, "wb"))
+  assert(f:writevec(vec3(1, 2, 3)) == f)
+  assert(f:writevec({vec3(4, 5, 6), vec3(7, 8, 9)}) == f)
+  checkerr("vec3 expected", f.writevec, f, {vec3(1, 2, 3), vec2(1, 2)})
+  checkerr("invalid option", f.writevec, f, {}, "vec5")
+  assert(f:close())
+  f = assert(io.open(file, "rb"))
+  local s = f:read("a")
+  assert(#s == 3 * 12)
+  assert(s:sub(1, 12) == string.pack("<fff", 1, 2, 3))
+  assert(f:seek("set") == 0)
+  local t, n = f:readvec(2, "vec3")
+  assert(n == 2 and #t == 2 and t[1] == vec3(1, 2, 3) and t[2] == vec3(4, 5, 6))
+  local t2 = {}
+  local r, n = f:readvec(10, "vec3", t2)
+  assert(r == t2 and n == 1 and t2[1] == vec3(7, 8, 9))
+  assert(f:readvec(1, "vec3") == nil)   -- end of file
+  assert(f:close())
+
+  f = io.tmpfile()
+  local q = quat(1, 2, 3, 4)
+  local m = mat3x3(vec3(1, 2, 3), vec3(4, 5, 6), vec3(7, 8, 9))
+  f:writevec({q, q}):writevec(m):writevec({vec2(-1, 0.5)}, "vec2")
+  assert(f:seek("cur") == 2 * 16 + 36 + 8)
+  f:seek("set")
+  t = f:readvec(2, "quat")
+  assert(t[1] == q and t[2] == q)
+  assert(f:readvec(1, "mat3x3")[1] == m)
+  assert(f:readvec(1, "vec2")[1] == vec2(-1, 0.5))
+  f:close()
+end
+
+
+if io.async then
+  print("testing asynchronous i/o")
+  local async = io.async
+  -- outside a coroutine, requests are synchronous
+  assert(async.write(file, "hello ") and async.write(file, "world", true))
+  assert(async.read(file) == "hello world")
+  assert(async.read(file, 6) == "world" and async.read(file, 2, 3) == "llo")
+  -- 'n' bounds the result; the buffer grows with the data read
+  assert(async.read(file, 0, math.maxinteger) == "hello world")
+  local big = string.rep("abcdefgh", 5000)
+  assert(async.write(file, big))
+  assert(async.read(file, 1, 30000) == string.sub(big, 2, 30001))
+  assert(async.read(file, 0, math.maxinteger) == big)
+  local r, msg = async.read(otherfile .. "/nofile")
+  assert(r == nil and type(msg) == "string")
+  assert(async.pending() == 0 and async.poll() == 0)
+
+  local res = {}
+  local co = coroutine.wrap(function ()
+    res[1] = async.write(file, "abc")
+    res[2] = async.read(file)
+    res[3] = async.read(otherfile .. "/nofile")
+    return "done"
+  end)
+  assert(co() == nil)   -- suspended on the first request
+  local n = 0
+  while async.pending() > 0 do n = n + async.poll() end
+  assert(n == 3 and res[1] == true and res[2] == "abc" and res[3] == nil)
+
+  -- errors in resumed coroutines are propagated by 'poll'
+  co = coroutine.wrap(function () async.read(file); error("boom") end)
+  co()
+  local ok, msg = pcall(function ()
+    while async.pending() > 0 do async.poll() end
+  end)
+  assert(not ok and string.find(msg, "boom"))
+  assert(async.pending() == 0)
+end
+
+assert(os.remove(file))
+
 end --}
 
 print'+'
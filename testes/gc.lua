@@ -631,6 +631,82 @@ if T then
 end
 
 
+if pcall(collectgarbage, "budget") then
+  print("time-bounded steps")
+  local old = collectgarbage("budget", 300)
+  assert(collectgarbage("budget") == 300)
+  assert(collectgarbage("budget", 200) == 300)
+  collectgarbage("pausestats", true)   -- reset statistics
+  assert(collectgarbage("pausestats") == 0)
+  local a = {}
+  for i = 1, 50000 do a[i % 1000 + 1] = {i} end
+  local count, last, max, avg = collectgarbage("pausestats")
+  assert(count > 0 and last <= max and avg <= max)
+  assert(math.type(last) == "integer" and math.type(avg) == "integer")
+  assert(collectgarbage("pausestats", true) == count)
+  assert(collectgarbage("pausestats") == 0)
+
+  -- idle work drives a stopped collector through a whole cycle
+  collectgarbage("stop")
+  a = nil
+  local n = 0
+  if not collectgarbage("step", 0) then   -- cycle in progress?
+    collectgarbage("pausestats", true)
+    repeat n = n + 1 until collectgarbage("idle", 100) or n > 1e6
+    assert(n <= 1e6 and collectgarbage("pausestats") == n)
+  end
+  assert(not collectgarbage("isrunning"))
+  assert(collectgarbage("idle", 0))   -- no pending work
+
+  collectgarbage("generational")
+  for i = 1, 10000 do local b = {} end
+  repeat until collectgarbage("idle", 1000)
+  collectgarbage("incremental")
+  collectgarbage("restart")
+  assert(collectgarbage("budget", old) == 200)
+end
+
+
+if T and T.gcasync then
+  print("asynchronous free")
+  assert(T.gcasync(true) and T.gcasync(true))
+  for _, mode in ipairs{"incremental", "generational", "incremental"} do
+    collectgarbage(mode)
+    local a = {}
+    for i = 1, 20000 do
+      a[i % 500 + 1] = {i, tostring(i) .. "x", function () return i end}
+    end
+    a = nil
+    collectgarbage()
+    T.checkmemory()
+  end
+  do   -- emergency collections release their blocks before returning
+    local a = {}
+    for i = 1, 1000 do a[i] = {} end
+    a = nil
+    T.totalmem(T.totalmem() + 2000)
+    for i = 1, 100 do local b = {} end
+    T.totalmem(0)
+  end
+  do   -- changing the allocator while blocks are queued
+    local a = {}
+    for i = 1, 20000 do a[i % 500 + 1] = {i, {}} end
+    collectgarbage("step")
+    T.setallocf(true)
+    assert(T.gcasync(true))   -- still active
+    a = nil
+    collectgarbage()
+    assert(T.setallocf(false) > 0)   -- swept blocks went to the new one
+    T.checkmemory()
+  end
+  assert(not T.gcasync(false))
+  -- with the queue drained, every released block was really freed
+  collectgarbage()
+  assert(T.totalmem() == math.floor(collectgarbage("count") * 1024))
+  T.checkmemory()
+end
+
+
 -- create an object to be collected when state is closed
 do
   local setmetatable,assert,type,print,getmetatable =
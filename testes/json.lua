@@ -0,0 +1,126 @@
+-- $Id: testes/json.lua $
+-- See Copyright Notice in file all.lua
+
+if not json then
+  (Message or print)('\n >>> json library not active: skipping json tests <<<\n')
+  return
+end
+
+print "testing json"
+
+local function checkerror (msg, f, ...)
+  local s, err = pcall(f, ...)
+  assert(not s and string.find(err, msg))
+end
+
+local function same (a, b)
+  if type(a) ~= "table" or type(b) ~= "table" then
+    return a == b and math.type(a) == math.type(b)
+  end
+  for k, v in pairs(a) do
+    if not same(v, b[k]) then return false end
+  end
+  for k in pairs(b) do
+    if a[k] == nil then return false end
+  end
+  return true
+end
+
+
+-- scalars
+assert(json.encode(true) == "true" and json.encode(false) == "false")
+assert(json.encode(nil) == "null" and json.encode(json.null) == "null")
+assert(json.encode(0) == "0" and json.encode(-12) == "-12")
+assert(json.encode(math.mininteger) == tostring(math.mininteger))
+assert(json.encode(2.0) == "2.0" and json.encode(-0.5) == "-0.5")
+assert(json.encode(0.0) == "0.0" and json.encode(-0.0) == "-0.0")
+assert(json.encode(1.25e-3) == "0.00125")
+assert(json.encode("a\"b\\c\n\0") == '"a\\"b\\\\c\\n\\u0000"')
+checkerror("NaN", json.encode, 0/0)
+checkerror("infinity", json.encode, 1/0)
+checkerror("function", json.encode, print)
+checkerror("userdata", json.encode, io.stdout)
+
+assert(json.decode("true") == true and json.decode(" false ") == false)
+assert(json.decode("null") == json.null)
+assert(same(json.decode("-12"), -12) and same(json.decode("2.0"), 2.0))
+assert(same(json.decode("1e2"), 100.0) and same(json.decode("-1.5E-1"), -0.15))
+assert(same(json.decode("123456789012345678901"), 123456789012345678901.0))
+assert(1/json.decode("-0.0") == -1/0 and 1/json.decode("0.0") == 1/0)
+assert(1/json.decode("-0e1") == -1/0)
+assert(json.decode('"\\u00e1\\ud83d\\ude00\\/"') == "\u{e1}\u{1F600}/")
+
+-- floats read back as the same value
+for _, x in ipairs{0.1, 1/3, -2/3, 1e300, 5e-324, 123.456, 2^53, -1e-7,
+                   math.pi, 1e15 + 0.5, 0.1 + 0.2} do
+  local s = json.encode(x)
+  assert(json.decode(s) == x and math.type(json.decode(s)) == "float")
+end
+
+-- containers
+assert(json.encode({}) == "{}")
+assert(json.encode({1, 2, "x"}) == '[1,2,"x"]')
+assert(json.encode({a = 1}) == '{"a":1}')
+assert(json.encode({[1] = 1, [3] = 3}):find('"3":3'))
+assert(json.encode({[2.5] = true}) == '{"2.5":true}')
+checkerror("table key", json.encode, {[true] = 1})
+do
+  local t = {1, {2, {3}}, {x = "y", z = {}}, json.null, "s"}
+  assert(same(json.decode(json.encode(t)), t))
+  local s = '  { "a" : [ 1 , 2 ] , "b" : { } , "c" : [ ] , "d" : null } '
+  t = json.decode(s)
+  assert(same(t.a, {1, 2}) and next(t.b) == nil and next(t.c) == nil)
+  assert(t.d == json.null)
+  -- long arrays and objects
+  t = {}
+  for i = 1, 1000 do t[i] = {i, tostring(i)} end
+  assert(same(json.decode(json.encode(t)), t))
+  t = {}
+  for i = 1, 1000 do t["k" .. i] = i / 4 end
+  assert(same(json.decode(json.encode(t)), t))
+end
+
+-- nesting
+do
+  local t = {}
+  for i = 1, 100 do t = {t} end
+  assert(json.encode(t) == string.rep("[", 100) .. "{}" .. string.rep("]", 100))
+  local c = {}; c[1] = c
+  checkerror("too deep", json.encode, c)
+  checkerror("too deep", json.decode, string.rep("[", 1000))
+end
+
+-- syntax errors
+for _, s in ipairs{"", "[", "[1,]", "{\"a\"}", "{1:2}", "01", "1.", ".5",
+                   "-", "1e", "+1", "tru", "\"abc", "\"\\x\"", "\"\\u12\"",
+                   "\"a\nb\"", "[1] 2", "[1 2]", "{\"a\":1,}", "nil"} do
+  local ok, err = pcall(json.decode, s)
+  assert(not ok and string.find(err, "at position %d+"))
+end
+checkerror("at position 4", json.decode, "[1,]")
+checkerror("trailing", json.decode, "1 2")
+
+-- vectors
+assert(json.encode(vec3(1, 2, 3)) == "[1.0,2.0,3.0]")
+assert(json.encode(vec2(0.5, -1), {vectors = "object"}) ==
+       '{"x":0.5,"y":-1.0}')
+assert(json.decode("[1,2,3]", {vectors = "array"}) == vec3(1, 2, 3))
+assert(json.decode("[1,2,3,4]", {vectors = "array"}) == vec4(1, 2, 3, 4))
+assert(same(json.decode("[1,2,3]"), {1, 2, 3}))
+assert(same(json.decode("[1]", {vectors = "array"}), {1}))
+assert(same(json.decode('[1,"a"]', {vectors = "array"}), {1, "a"}))
+assert(json.decode('{"y":2,"x":1}', {vectors = "object"}) == vec2(1, 2))
+assert(same(json.decode('{"x":1,"x":2}', {vectors = "object"}), {x = 2}))
+assert(same(json.decode('{"x":1,"z":2}', {vectors = "object"}), {x = 1, z = 2}))
+do
+  local t = {vec2(1, 2), {p = vec4(1, 2, 3, 4)}}
+  for _, mode in ipairs{"array", "object"} do
+    local s = json.encode(t, {vectors = mode})
+    assert(same(json.decode(s, {vectors = mode}), t))
+  end
+  assert(json.encode(mat2x2(vec2(1, 2), vec2(3, 4))) == "[[1.0,2.0],[3.0,4.0]]")
+end
+checkerror("invalid 'vectors'", json.decode, "1", {vectors = "x"})
+checkerror("must be encoded", json.encode, 1, {vectors = "none"})
+
+print "OK"
@@ -250,3 +250,61 @@ do
   assert(T.testC("rawgeti 2 0; return 1", m) == nil)
   assert(T.testC("rawgeti 2 -1; return 1", m) == nil)
 end
+
+---------------------------------------
+---------- vector arithmetic ----------
+---------------------------------------
+
+print("vector arithmetic")
+do -- vector (op) vector of the same dimension
+  local function map(d, f)  -- vector of 'd' components f(1), ..., f(d)
+    local t = {}
+    for i = 1, d do t[i] = f(i) end
+    return vec(table.unpack(t))
+  end
+  local function check(d, a, b)
+    assert(_eq(a + b, map(d, function (i) return a[i] + b[i] end)))
+    assert(_eq(a - b, map(d, function (i) return a[i] - b[i] end)))
+    assert(_eq(a * b, map(d, function (i) return a[i] * b[i] end)))
+    assert(_eq(a / b, map(d, function (i) return a[i] / b[i] end)))
+    assert(_eq(-a, map(d, function (i) return -a[i] end)))
+  end
+  check(2, vec(1, 2), vec(4, 0.5))
+  check(3, vec(1, 2, 3), vec(4, 0.5, -8))
+  check(4, vec(1, 2, 3, 4), vec(4, 0.5, -8, 16))
+  local p, v = vec(0, 0, 0), vec(1, 2, 3)
+  for i = 1, 4 do p = p + v * 0.5 end
+  assert(p == vec(2, 4, 6))
+end
+
+do -- vector (op) number and number (op) vector
+  local v, n, f = vec(1, 2, 4), 2, 0.5
+  assert(v + f == vec(1.5, 2.5, 4.5) and f + v == vec(1.5, 2.5, 4.5))  -- ADDK
+  assert(v - f == vec(0.5, 1.5, 3.5) and f - v == vec(-0.5, -1.5, -3.5))
+  assert(v * f == vec(0.5, 1, 2) and f * v == vec(0.5, 1, 2))  -- MULK
+  assert(v / f == vec(2, 4, 8) and f / v == vec(0.5, 0.25, 0.125))
+  assert(v + n == vec(3, 4, 6) and n + v == vec(3, 4, 6))  -- integer operands
+  assert(v - n == vec(-1, 0, 2) and n - v == vec(1, 0, -2))
+  assert(v * n == vec(2, 4, 8) and n * v == vec(2, 4, 8))
+  assert(v / n == vec(0.5, 1, 2) and n / v == vec(2, 1, 0.5))
+  assert(v + 1 == vec(2, 3, 5) and v - 1 == vec(0, 1, 3))  -- ADDI
+  assert(v + 2^53 == vec(2^53, 2^53, 2^53))  -- ADDK, integer constant
+  assert((v * 2 + 1) / 0.5 - v == vec(5, 8, 14))
+end
+
+do -- operands without a vector fast path
+  local v = vec(1, 2, 3)
+  local mt = {}
+  for _, e in ipairs({"__add", "__sub", "__mul", "__div", "__unm"}) do
+    mt[e] = function (a, b) return e end
+  end
+  local t = setmetatable({}, mt)
+  assert(v + t == "__add" and t + v == "__add" and v - t == "__sub")
+  assert(v * t == "__mul" and t / v == "__div" and -t == "__unm")
+  for _, x in ipairs({true, {}, print}) do
+    assert(not pcall(function () return v + x end))
+    assert(not pcall(function () return x * v end))
+    assert(not pcall(function () return v / x end))
+  end
+  assert(not pcall(function () return -v + {} end))
+end
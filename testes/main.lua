@@ -473,6 +473,50 @@ do
   assert(string.find(msg, "string expected"))
 end
 
+do   -- stand-alone compiler, when built next to the interpreter
+  local luac = string.gsub(progname, "lua$", "luac")
+  local f = (luac ~= progname) and io.open(luac)
+  if f then
+    f:close()
+    print("testing 'luac'")
+    local chunk = os.tmpname()
+    local function LUAC (p, ...)
+      return os.execute(string.format('"%s" ' .. p, luac, ...))
+    end
+    local function readchunk ()
+      local f = assert(io.open(chunk, "rb"))
+      local s = f:read("a")
+      f:close()
+      return s
+    end
+    prepfile("X = (X or '') .. 'a'")
+    prepfile("X = X .. 'b'", otherprog)
+    assert(LUAC("-o %s %s %s", chunk, prog, otherprog))
+    X = nil; dofile(chunk); assert(X == "ab")
+    local seq = readchunk()
+
+    -- options that may not be compiled in
+    for _, opt in ipairs{"-s", "-S", "-z", "-O"} do
+      if LUAC("%s -p %s 2> /dev/null", opt, prog) then
+        assert(LUAC("%s -o %s %s %s", opt, chunk, prog, otherprog))
+        X = nil; dofile(chunk); assert(X == "ab")
+      end
+    end
+
+    if LUAC("-j 2 -p %s 2> /dev/null", prog) then   -- parallel compilation?
+      assert(LUAC("-j 2 -o %s %s %s", chunk, prog, otherprog))
+      assert(readchunk() == seq)   -- same output as sequential compilation
+      assert(LUAC("-j 2 -t -o %s %s %s 2> %s", chunk, prog, otherprog, out))
+      local t = getoutput()
+      assert(string.find(t, prog, 1, true) and string.find(t, otherprog, 1, true))
+      prepfile("X = ", otherprog)   -- syntax error in the second file
+      assert(not LUAC("-j 2 -o %s %s %s 2> %s", chunk, prog, otherprog, out))
+      assert(string.find(getoutput(), "unexpected symbol", 1, true))
+    end
+    assert(os.remove(chunk))
+  end
+end
+
 print('+')
 
 print('testing Ctrl C')
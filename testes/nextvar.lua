@@ -196,6 +196,67 @@ assert(select(4, T.querytab(a)) == 50)  -- this is the limit now
 -- but the size is larger (and still inside the array part)
 assert(#a == 51)
 
+
+-- appending to a full array part doubles it without a rehash
+do
+  local t = {1, 2, 3, 4, x = 1}
+  check(t, 4, 1)
+  if table.stats then table.stats(true) end
+  for i = 5, 1000 do t[i] = i end
+  check(t, 1024, 1)
+  if table.stats then
+    local rehashes, grows = table.stats(true)
+    assert(rehashes == 0 and grows == 8)   -- 8, 16, ..., 1024
+    assert(table.stats() == 0)
+  end
+  for i = 1, 1000 do assert(t[i] == i) end
+  assert(#t == 1000 and t.x == 1)
+end
+
+
+-- an append that would leave the array part half empty rehashes instead
+do
+  local t = {1, 2, 3, 4, 5, 6, 7, 8}
+  t[1] = nil   -- 8 of 16 slots used: not more than half
+  if table.stats then table.stats(true) end
+  t[9] = 9
+  if table.stats then assert(select(2, table.stats(true)) == 0) end
+  check(t, 8, 1)
+  t = {1, 2, 3, 4, 5}
+  t[1] = nil   -- 5 of 8 slots used
+  t[6] = 6
+  check(t, 8, 0)
+  if table.stats then assert(select(2, table.stats(true)) == 1) end
+  t = {1, 2, 3, 4, 5}
+  t[1] = nil; t[2] = nil   -- 4 of 8 slots used
+  t[6] = 6
+  check(t, 0, 4)
+  if table.stats then assert(select(2, table.stats(true)) == 0) end
+  for i = 3, 6 do assert(t[i] == i) end
+end
+
+
+if table.create then   -- the array size given to 'create'
+  local t = table.create(100)
+  check(t, 100, 0)
+  t.a = 1; t.b = 2; t.c = 3
+  if T.querytab(t) == 0 then   -- not kept (no LUAGLM_EXT_TABLEHINT)
+    check(t, 0, 4)
+  else   -- rehashes do not shrink the array part
+    check(t, 100, 4)
+    t[1] = 1; t[100] = 100
+    assert(#t == 1 or #t == 100)
+    local c = table.clone(t)
+    check(c, 100, 4)
+    t[1] = nil; t[100] = nil
+    table.compact(t)   -- discards the hint
+    check(t, 0, 4)
+    t.d = 1; t.e = 2
+    check(t, 0, 8)
+    assert(t.a == 1 and t.c == 3 and t.e == 2)
+  end
+end
+
 end  --]
 
 
@@ -802,4 +863,141 @@ do
   
 end
 
+if rawget(_G, "array") then
+  print("testing typed arrays")
+  local a = array.new("int32", 3, 7)
+  assert(#a == 3 and a[1] == 7 and a[3] == 7 and a[0] == nil and a[4] == nil)
+  assert(array.type(a) == "int32" and array.type({}) == nil)
+  a[4] = 10; table.insert(a, 11); table.insert(a, 1, -1)
+  assert(table.concat(a, ",") == "-1,7,7,7,10,11")
+  assert(table.remove(a, 2) == 7 and table.concat(a, ",") == "-1,7,7,10,11")
+  table.sort(a, function (x, y) return x > y end)
+  assert(table.concat(a, ",") == "11,10,7,7,-1")
+  local i = 0
+  for k, v in ipairs(a) do i = i + 1; assert(k == i and v == a[i]) end
+  assert(i == #a)
+  i = 0
+  for k, v in pairs(a) do i = i + 1; assert(k == i and v == a[i]) end
+  assert(i == #a)
+  assert(select("#", table.unpack(a)) == 5)
+
+  a[1] = 2^31   -- truncated to the element width
+  assert(a[1] == -2^31 and math.type(a[1]) == "integer")
+  a[2.0] = 3; assert(a[2] == 3 and a[2.0] == 3)
+  assert(a["2"] == nil and type(a.resize) == "function")
+
+  -- only the last element can be removed; absent elements are ignored
+  a[#a] = nil; assert(#a == 4)
+  a[10] = nil; a[0] = nil; a[-1] = nil; assert(#a == 4)
+  checkerror("only the last", function () a[1] = nil end)
+  checkerror("out of bounds", function () a[10] = 1 end)
+  checkerror("out of bounds", function () a[0] = 1 end)
+  checkerror("invalid key", function () a["1"] = 1 end)
+  checkerror("invalid key", function () a[1.5] = 1 end)
+
+  -- removing from an empty array leaves it empty
+  local e = array.new("int8")
+  e[0] = nil; e[1] = nil
+  assert(#e == 0)
+  checkerror("out of bounds", function () e[0] = 7 end)
+  e[1] = 7; assert(#e == 1 and e[1] == 7 and e[0] == nil)
+
+  local f = array.from("float32", {1.5, 2.25, 0.1})
+  assert(#f == 3 and f[1] == 1.5 and f[2] == 2.25 and f[3] ~= 0.1)
+  assert(math.abs(f[3] - 0.1) < 1e-6)
+  f = array.from("int16", {1, 2, 3, 4, 5}, 2, 4)
+  assert(table.concat(f:totable(), ",") == "2,3,4")
+  assert(table.concat(f:totable(2), ",") == "3,4")
+
+  local v = array.new("vec3", 2, vec3(1, 2, 3))
+  assert(#v == 2 and v[2] == vec3(1, 2, 3))
+  v[3] = vec3(4, 5, 6)
+  assert(v:totable()[3] == vec3(4, 5, 6))
+  checkerror("vector", function () v[1] = 1 end)
+
+  local big = array.new("float64")
+  for i = 1, 10000 do big[#big + 1] = i end
+  assert(#big == 10000 and big[10000] == 10000.0)
+  assert(big:resize(5, 3) == big and #big == 5 and big[5] == 5.0)
+  big:resize(8, 3)
+  assert(big[6] == 3.0 and big[8] == 3.0 and big[9] == nil)
+  assert(big:reserve() == big and big:reserve(100) == big)
+  big:fill(9, 2, 3)
+  assert(big[1] == 1 and big[2] == 9 and big[3] == 9 and big[4] == 4)
+
+  local m = table.move(array.from("int8", {1, 2, 3}), 1, 3, 2,
+                       array.new("int8", 1))
+  assert(table.concat(m, ",") == "0,1,2,3")
+end
+
+if table.deepclone then
+  print("testing deepclone and deepequal")
+  local t = {1, {2, {3}}, x = vec3(1, 2, 3), [{}] = "k", f = print}
+  t.self = t; t.sub = t[2]
+  local c = table.deepclone(t)
+  assert(c ~= t and c[2] ~= t[2] and c[2][2] ~= t[2][2])
+  assert(c.self == c and c.sub == c[2])   -- shared references and cycles
+  assert(c.x == vec3(1, 2, 3) and c.f == print and c[2][2][1] == 3)
+  for key in pairs(t) do   -- keys are kept
+    if type(key) == "table" then assert(c[key] == "k") end
+  end
+  assert(table.deepequal(t, c) and table.deepequal(c, t))
+  c[2][2][1] = 4
+  assert(not table.deepequal(t, c))
+
+  -- metatables
+  local mt = {__index = function () return 0 end}
+  c = table.deepclone(setmetatable({{}}, mt))
+  assert(getmetatable(c) == mt and getmetatable(c[1]) == nil and c.z == 0)
+  c = table.deepclone(setmetatable({}, mt), {metatable = false})
+  assert(getmetatable(c) == nil)
+  checkerror("protected metatable", table.deepclone,
+             {setmetatable({}, {__metatable = false})})
+  assert(not table.deepequal(setmetatable({}, mt), {}))
+  assert(table.deepequal(setmetatable({1}, mt), setmetatable({1}, mt)))
+
+  -- frozen tables
+  if table.freeze then
+    local f = table.freeze{1, {2}}
+    c = table.deepclone{f, f}
+    assert(c[1] == f and c[2] == f)   -- shared
+    c = table.deepclone({f, f}, {frozen = true})
+    assert(c[1] ~= f and c[1] == c[2] and table.isfrozen(c[1]))
+    assert(table.deepequal(c[1], f))
+    c = table.deepclone({{}}, {freeze = true})
+    assert(table.isfrozen(c) and table.isfrozen(c[1]))
+  end
+
+  -- structural equality
+  assert(table.deepequal(1, 1) and not table.deepequal(1, 1.5))
+  assert(table.deepequal(vec3(1), vec3(1)) and table.deepequal("a", "a"))
+  assert(not table.deepequal({}, 1) and not table.deepequal(1, {}))
+  assert(table.deepequal({}, {}) and not table.deepequal({1}, {}))
+  assert(not table.deepequal({}, {1}) and not table.deepequal({a = {}}, {a = 1}))
+  assert(not table.deepequal({1, {2}}, {1, {2}, 3}))
+  assert(not table.deepequal({1, {2}, 3}, {1, {2}}))
+  local a, b = {}, {}
+  a.x = a; b.x = b
+  assert(table.deepequal(a, b))
+  local b2 = {x = {x = {}}}
+  b2.x.x.x = b2
+  assert(table.deepequal(a, b2) and table.deepequal(b2, a))
+  local s = {}
+  assert(table.deepequal({s, s}, {{}, {}}) and table.deepequal({{}, {}}, {s, s}))
+  assert(not table.deepequal({s, s}, {{}, {1}}))
+
+  -- long chains do not use the C stack
+  local l1, l2
+  for i = 1, 100000 do l1 = {next = l1, v = i}; l2 = {next = l2, v = i} end
+  c = table.deepclone(l1)
+  assert(table.deepequal(c, l1) and table.deepequal(l1, l2))
+  local n = c
+  for i = 1, 99999 do n = n.next end
+  assert(n.v == 1 and n.next == nil)
+  n.v = 0
+  assert(not table.deepequal(c, l1))
+  c = table.deepclone({l1, l1})
+  assert(c[1] == c[2] and c[1] ~= l1)
+end
+
 print"OK"
@@ -0,0 +1,239 @@
+-- $Id: testes/shared.lua $
+-- See Copyright Notice in file all.lua
+
+if not (shared or channel or parallel) then
+  (Message or print)('\n >>> shared libraries not active: skipping shared tests <<<\n')
+  return
+end
+
+local function checkerror (msg, f, ...)
+  local s, err = pcall(f, ...)
+  assert(not s and string.find(err, msg))
+end
+
+
+if shared then
+  print "testing shared tables"
+
+  -- scalars
+  for _, v in ipairs{true, false, 0, -1, math.maxinteger, 2.5, -0.0, 1/0,
+                     "", "abc", string.rep("x", 1000), "a\0b"} do
+    assert(shared.publish("x", v) > 0)
+    local r = shared.get("x")
+    assert(r == v and math.type(r) == math.type(v))
+  end
+  assert(shared.publish("x", nil) and shared.get("x") == nil)
+  local nan = 0/0
+  shared.publish("x", nan)
+  assert(shared.get("x") ~= shared.get("x"))
+  shared.publish("x", vec3(1, 2, 3))
+  assert(shared.get("x") == vec3(1, 2, 3))
+  assert(shared.release("x") and not shared.release("x"))
+  assert(shared.get("x") == nil)
+
+  -- values that cannot be shared
+  checkerror("frozen", shared.publish, "x", {})
+  checkerror("frozen", shared.publish, "x", table.freeze{{}})
+  checkerror("function", shared.publish, "x", print)
+  checkerror("thread", shared.publish, "x", coroutine.running())
+  assert(shared.get("x") == nil)
+  -- metatables are not part of the snapshot
+  shared.publish("x", table.freeze(setmetatable({}, {__index = print})))
+  assert(shared.get("x").y == nil)
+  assert(shared.release("x"))
+
+  -- tables
+  do
+    local sub = table.freeze{k = vec3(1, 2, 3), 10, 20}
+    local t = table.freeze{1, 2, 3, x = "a", sub = sub, sub2 = sub,
+                           [2.5] = true, [true] = "t"}
+    assert(shared.publish("t", t) > 0)
+    local p = shared.get("t")
+    assert(shared.isshared(p) and not shared.isshared(t))
+    assert(not shared.isshared(1) and not shared.isshared(nil))
+    assert(type(p) == "userdata" and getmetatable(p) == "shared")
+    assert(string.find(tostring(p), "^shared table: "))
+    assert(p == shared.get("t"))   -- proxies are reused
+    assert(#p == 3 and p[1] == 1 and p[3] == 3 and p[4] == nil)
+    assert(p.x == "a" and p[2.5] == true and p[true] == "t" and p.y == nil)
+    assert(p.sub == p.sub2 and shared.isshared(p.sub))   -- same table
+    assert(p.sub.k == vec3(1, 2, 3) and #p.sub == 2 and p.sub[2] == 20)
+    checkerror("shared table", function () p.x = 1 end)
+    checkerror("shared table", function () p.sub[1] = 1 end)
+
+    local n = 0
+    for k, v in pairs(p) do
+      n = n + 1
+      if shared.isshared(v) then assert(v == p.sub) else assert(t[k] == v) end
+    end
+    assert(n == 8)
+    n = 0
+    for i, v in ipairs(p) do n = n + 1; assert(v == i) end
+    assert(n == 3)
+
+    -- proxies keep their snapshots after a release or republication
+    local sub = p.sub
+    assert(shared.publish("t", table.freeze{1}) > 0)
+    assert(shared.get("t") ~= p and #shared.get("t") == 1)
+    assert(shared.release("t"))
+    p = nil
+    collectgarbage()
+    assert(sub.k == vec3(1, 2, 3) and sub[1] == 10)
+  end
+
+  -- many gets and collections of the same snapshot
+  do
+    local t = {}
+    for i = 1, 100 do t[i] = table.freeze{i, tostring(i)} end
+    shared.publish("t", table.freeze(t))
+    for i = 1, 100 do
+      local p = shared.get("t")
+      assert(p[i][1] == i and p[i][2] == tostring(i))
+      if i % 10 == 0 then p = nil; collectgarbage() end
+    end
+    assert(shared.release("t"))
+    collectgarbage()
+  end
+end
+
+
+if channel then
+  print "testing channels"
+
+  local ch = channel.new(3)   -- rounded up to 4
+  assert(#ch == 0 and string.find(tostring(ch), "^channel %(open%): "))
+  for i = 1, 4 do assert(ch:send(i, 0)) end
+  local ok, err = ch:send(5, 0)
+  assert(not ok and err == "timeout" and #ch == 4)
+  ok, err = ch:send(5, 0.01)
+  assert(not ok and err == "timeout")
+  for i = 1, 4 do assert(ch:recv() == i) end
+  local v, err = ch:recv(0)
+  assert(v == nil and err == "timeout" and #ch == 0)
+  v, err = ch:recv(0.01)
+  assert(v == nil and err == "timeout")
+
+  -- messages are deep copies
+  local t = {1, {2}, x = vec3(1, 2, 3), [2.5] = "f", [true] = false}
+  t.self = t; t.a = t[2]; t.b = t[2]
+  setmetatable(t, {__index = print})
+  assert(ch:send(t))
+  local c = ch:recv()
+  assert(c ~= t and c.self == c and c.a == c.b and c.a ~= t[2])
+  assert(c[1] == 1 and c[2][1] == 2 and c.x == vec3(1, 2, 3))
+  assert(c[2.5] == "f" and c[true] == false)
+  assert(getmetatable(c) == nil)
+  for _, v in ipairs{true, 0, -1, 2.5, "", string.rep("a", 1000), "\0"} do
+    ch:send(v)
+    local r = ch:recv()
+    assert(r == v and math.type(r) == math.type(v))
+  end
+  checkerror("non%-nil", ch.send, ch, nil)
+  checkerror("function", ch.send, ch, print)
+  checkerror("function", ch.send, ch, {{print}})
+  assert(#ch == 0)
+
+  -- ordering across a wrap around
+  for i = 1, 100 do
+    assert(ch:send(i) and ch:send(-i) and ch:recv() == i and ch:recv() == -i)
+  end
+
+  -- await
+  local co = coroutine.wrap(function () return ch:await() end)
+  assert(co() == ch)   -- nothing yet
+  assert(co() == ch)
+  ch:send("hi")
+  assert(co() == "hi")
+  assert(ch:recv(0) == nil)
+
+  -- closing
+  ch:send(10)
+  ch:close()
+  ok, err = ch:send(20)
+  assert(not ok and err == "closed")
+  assert(ch:recv() == 10)   -- pending messages are still delivered
+  v, err = ch:recv()
+  assert(v == nil and err == "closed")
+  v, err = coroutine.wrap(function () return ch:await() end)()
+  assert(v == nil and err == "closed")
+  assert(string.find(tostring(ch), "^channel %(closed%): "))
+
+  -- named channels
+  local a = channel.open("test", 4)
+  local b = channel.open("test")
+  assert(a:send("x") and #b == 1 and b:recv() == "x")
+  assert(channel.release("test") and not channel.release("test"))
+  assert(a:send("y") and b:recv() == "y")   -- handles remain valid
+  local d = channel.open("test")   -- a new channel
+  assert(d:send(1) and b:recv(0) == nil and d:recv() == 1)
+  assert(channel.release("test"))
+
+  assert(#channel.new() == 0)
+  checkerror("out of range", channel.new, 0)
+  checkerror("out of range", channel.new, -1)
+  checkerror("out of range", channel.new, math.maxinteger)
+  a, b, c, ch, t = nil
+  collectgarbage()
+end
+
+if parallel then
+  print "testing parallel loops"
+
+  local nw = parallel.workers()
+  assert(math.type(nw) == "integer" and nw >= 1 and parallel.workers() == nw)
+
+  local r = parallel.range(1000, function (i) return i * i end)
+  assert(#r == 1000)
+  for i = 1, 1000 do assert(r[i] == i * i) end
+  for _, g in ipairs{1, 3, 7, 1000, 5000} do   -- explicit grains
+    r = parallel.range(100, function (i) return -i end, g)
+    for i = 1, 100 do assert(r[i] == -i) end
+  end
+  r = parallel.map(function (v, i) return v .. i end, {"a", "b", "c"})
+  assert(#r == 3 and r[1] == "a1" and r[3] == "c3")
+  r = parallel.map(function (v) return {v, vec3(v)} end, {1, 2, 3})
+  assert(r[3][1] == 3 and r[3][2] == vec3(3))
+  assert(next(parallel.range(0, function () end)) == nil)
+  assert(next(parallel.map(function () end, {})) == nil)
+
+  -- nil results leave holes
+  r = parallel.range(6, function (i) if i % 2 == 1 then return i end end, 1)
+  assert(r[1] == 1 and r[2] == nil and r[5] == 5 and r[6] == nil)
+
+  -- chunks returning the function
+  r = parallel.range(4, "local k = 10; return function (i) return i + k end")
+  assert(r[1] == 11 and r[4] == 14)
+  checkerror("must return a function", parallel.range, 4, "return 1")
+  checkerror("syntax error", parallel.range, 4, "x x")
+
+  -- errors
+  checkerror("boom", parallel.range, 100,
+             function (i) if i == 70 then error("boom") end return i end)
+  local x = 1
+  checkerror("upvalues", parallel.range, 4, function () return x end)
+  checkerror("Lua function", parallel.range, 4, print)
+  checkerror("negative grain", parallel.range, 4, function () end, -1)
+  checkerror("function", parallel.range, 4, function () return print end)
+  checkerror("nested", parallel.range, 4,
+             function () return parallel.range(2, function () end) end)
+  -- the pool still works after errors
+  assert(parallel.range(3, function (i) return i end)[3] == 3)
+
+  -- workers see shared tables and channels
+  if shared then
+    shared.publish("ptest", table.freeze{5, 6, 7})
+    r = parallel.range(3, function (i) return shared.get("ptest")[i] end)
+    assert(r[1] == 5 and r[3] == 7)
+    assert(shared.release("ptest"))
+  end
+  if channel then
+    local ch = channel.open("ptest", 64)
+    parallel.range(50, function (i) channel.open("ptest"):send(i) end)
+    local s = 0
+    for i = 1, 50 do s = s + ch:recv() end
+    assert(s == 50 * 51 // 2 and #ch == 0)
+    assert(channel.release("ptest"))
+  end
+end
+
+print "OK"
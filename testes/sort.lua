@@ -307,4 +307,135 @@ table.sort(a)
 check(a, tt.__lt)
 check(a)
 
+do print "testing sort fast paths"
+  local function checksorted (a, n, lt)
+    lt = lt or function (x, y) return x < y end
+    for i = 2, n do assert(not lt(a[i], a[i - 1])) end
+  end
+
+  -- radix sort of integers and floats, introsort of strings
+  for _, n in ipairs{2, 3, 17, 255, 256, 1000} do
+    local ai, af, as = {}, {}, {}
+    for i = 1, n do
+      ai[i] = math.random(-n, n)
+      af[i] = math.random() * n - n / 2
+      as[i] = tostring(math.random(n))
+    end
+    ai[1] = math.mininteger; ai[n] = math.maxinteger
+    af[1] = -1/0; af[n] = 1/0
+    if n > 3 then af[2] = -0.0; af[3] = 0.0 end
+    local si = {}
+    for i = 1, n do si[ai[i]] = (si[ai[i]] or 0) + 1 end
+    table.sort(ai); table.sort(af); table.sort(as)
+    checksorted(ai, n); checksorted(af, n); checksorted(as, n)
+    assert(math.type(af[n]) == "float" and af[1] == -1/0 and af[n] == 1/0)
+    for i = 1, n do si[ai[i]] = si[ai[i]] - 1 end   -- same elements
+    for _, c in pairs(si) do assert(c == 0) end
+    table.sort(ai, function (x, y) return x > y end)
+    checksorted(ai, n, function (x, y) return x > y end)
+  end
+
+  -- mixed integers and floats, and NaN, use the generic sort
+  local a = {3, 1.5, 2, -1, 0.5}
+  table.sort(a)
+  checksorted(a, #a)
+  a = {}
+  for i = 1, 300 do a[i] = (i % 2 == 0) and i or i + 0.5 end
+  table.sort(a, function (x, y) return x > y end)
+  checksorted(a, #a, function (x, y) return x > y end)
+  checkerror("compare", table.sort, {1, "a", 2})
+  checkerror("compare", table.sort, {1, 0/0, {}})
+
+  -- comparators see real nils for empty slots
+  local u = {}; u[1] = 5; u[2] = 3; u[4] = 1
+  local function nillast (x, y)
+    if x == nil then return false elseif y == nil then return true end
+    return x < y
+  end
+  table.sort(u, nillast)
+  assert(u[1] == 1 and u[2] == 3 and u[3] == 5 and u[4] == nil)
+  u = table.create and table.create(8) or {}
+  for i = 1, 8, 2 do u[i] = i end
+  u[8] = 0
+  table.sort(u, nillast)
+  assert(u[1] == 0 and u[2] == 1 and u[5] == 7 and u[6] == nil)
+
+  -- holes that a metatable fills go through '__index'
+  u = setmetatable({3, nil, 1, 2}, {__index = function () return 10 end})
+  table.sort(u, function (x, y) return x < y end)
+  assert(rawget(u, 4) == 10 and rawget(u, 1) == 1)
+
+  -- comparators that change the array
+  a = {}
+  for i = 1, 20 do a[i] = 21 - i end
+  checkerror("array changed", table.sort, a, function (x, y)
+    for i = 1, 20 do a[i] = nil end
+    for i = 1, 100 do a["k" .. i] = i end   -- rehash shrinks the array
+    return false
+  end)
+  a = {}
+  for i = 1, 20 do a[i] = 21 - i end
+  table.sort(a, function (x, y) a[5] = a[5]; return x < y end)
+  checksorted(a, 20)
+  checkerror("invalid order", table.sort, {5, 4, 3, 2, 1, 6, 7, 8, 9, 1, 2,
+             3, 4, 5, 6, 7, 8, 9, 10, 11}, function () return true end)
+end
+
+if table.sortby then print "testing sortby"
+  local function checkby (a, key)
+    for i = 2, #a do assert(key(a[i - 1]) <= key(a[i])) end
+  end
+  for _, n in ipairs{0, 1, 2, 10, 255, 256, 1000} do
+    local a = {}
+    for i = 1, n do
+      a[i] = {id = i, d = math.random(n // 4 + 1), f = math.random(),
+              s = tostring(math.random(n)), pos = vec3(math.random(n), 0, 0)}
+    end
+    table.sortby(a, "d", true)
+    checkby(a, function (v) return v.d end)
+    for i = 2, n do   -- stable
+      assert(a[i - 1].d < a[i].d or a[i - 1].id < a[i].id)
+    end
+    table.sortby(a, "f")
+    checkby(a, function (v) return v.f end)
+    table.sortby(a, "s")
+    checkby(a, function (v) return v.s end)
+    table.sortby(a, "pos.x")
+    checkby(a, function (v) return v.pos.x end)
+    local calls = 0
+    table.sortby(a, function (v) calls = calls + 1; return -v.id end)
+    assert(calls == (n > 1 and n or 0))   -- once per element
+    for i = 1, n do assert(a[i].id == n - i + 1) end
+  end
+
+  -- mixed integer and float keys
+  local a = {1, 2.5, -3, 4.25, 0}
+  table.sortby(a, function (v) return v end)
+  assert(a[1] == -3 and a[2] == 0 and a[5] == 4.25)
+
+  -- holes
+  local u = {}; u[1] = 5; u[2] = 3; u[4] = 1
+  table.sortby(u, function (v) return v or math.huge end)
+  assert(u[1] == 1 and u[2] == 3 and u[3] == 5 and u[4] == nil)
+
+  -- tables whose elements are not in the array part
+  a = setmetatable({}, {__index = function (_, k)
+                          if k <= 3 then return 4 - k end end,
+                        __len = function () return 3 end})
+  table.sortby(a, function (v) return v end)
+  assert(rawget(a, 1) == 1 and rawget(a, 3) == 3)
+
+  checkerror("invalid key path", table.sortby, {1, 2}, "")
+  checkerror("invalid key path", table.sortby, {1, 2}, "a..b")
+  checkerror("invalid key path", table.sortby, {1, 2}, "a.")
+  checkerror("invalid key %(nil%)", table.sortby, {{}, {}}, "x")
+  checkerror("invalid key %(number%)", table.sortby, {1, 2},
+             function () return 0/0 end)
+  checkerror("invalid key %(table%)", table.sortby, {1, 2},
+             function () return {} end)
+  checkerror("mix", table.sortby, {1, 2},
+             function (v) return v == 1 and "a" or 2 end)
+  checkerror("function or string", table.sortby, {1, 2}, 10)
+end
+
 print"OK"
@@ -514,5 +514,150 @@ else
 end
 
 
+if serialize then
+  print("testing serialize")
+  local E, D = serialize.encode, serialize.decode
+  local function rt (v)
+    local s = E(v)
+    local r, n = D(s)
+    assert(n == #s + 1)
+    return r
+  end
+
+  -- scalars
+  for _, v in ipairs{true, false, 0, 1, 191, 192, -1, math.maxinteger,
+                     math.mininteger, 0.5, -0.0, 1/0, -1/0, "", "ab", "abc",
+                     string.rep("x", 1000), "\0\255"} do
+    local r = rt(v)
+    assert(r == v and math.type(r) == math.type(v))
+  end
+  assert(rt(nil) == nil and rt(0/0) ~= rt(0/0))
+  assert(1/rt(-0.0) == -1/0)
+  assert(#E(5) == 2 and #E(1000) > 2)   -- small integers in the tag
+  assert(rt(vec3(1, 2, 3)) == vec3(1, 2, 3) and rt(vec2(1, 2)) == vec2(1, 2))
+  assert(rt(vec4(1, 2, 3, 4)) == vec4(1, 2, 3, 4))
+  assert(rt(quat(1, 0, 0, 0)) == quat(1, 0, 0, 0))
+  local m = mat2x2(vec2(1, 2), vec2(3, 4))
+  assert(rt(m) == m)
+
+  -- tables, shared references and cycles
+  local t = {1, nil, 3, x = {y = {z = "deep"}}, [2.5] = true, [false] = 0,
+             [vec3(1)] = "v"}
+  t.self = t; t.a = t.x; t.b = t.x
+  setmetatable(t, {__index = print})
+  local r = rt(t)
+  assert(r[1] == 1 and r[2] == nil and r[3] == 3 and r.x.y.z == "deep")
+  assert(r.self == r and r.a == r.b and r.a == r.x and r.x ~= t.x)
+  assert(r[2.5] == true and r[false] == 0 and r[vec3(1)] == "v")
+  assert(getmetatable(r) == nil)
+  local k = {}
+  r = rt{[k] = k}
+  local rk = next(r)
+  assert(r[rk] == rk and rk ~= k)
+  local s = {}
+  r = rt{s, s, {s}}
+  assert(r[1] == r[2] and r[3][1] == r[1])
+  local str = string.rep("abc", 10)
+  assert(#E{str, str, str} < 3 * #str)   -- repeated strings once
+
+  -- nesting is not limited by the C stack
+  local nest = {}
+  local c = nest
+  for i = 1, 8 do c[1] = {"x", tostring(i)}; c = c[1] end
+  r = rt(nest)
+  for i = 1, 8 do r = r[1]; assert(r[2] == tostring(i)) end
+  local l
+  for i = 1, 1000 do l = {l, i} end
+  r = rt(l)
+  for i = 1000, 1, -1 do assert(r[2] == i); r = r[1] end
+  assert(r == nil)
+  for i = 1001, 100000 do l = {l, i} end
+  s = E(l)   -- decoding is bounded by the size of the stack
+  local ok, r = pcall(D, s)
+  assert(ok and r[2] == 100000 or string.find(r, "too deep"))
+
+  -- errors
+  checkerror("cannot serialize a function", E, print)
+  checkerror("cannot serialize a function", E, {1, {print}})
+  checkerror("cannot serialize a thread", E, {x = coroutine.running()})
+  checkerror("malformed", D, "\1")
+  checkerror("malformed", D, "\1\20")   -- unknown tag
+  checkerror("malformed", D, "\1\6\1\0\0\0\0")   -- truncated table
+  checkerror("malformed", D, "\1\7\1")   -- unknown reference
+  checkerror("malformed", D, "\1\6\0\1\0\0\0\0\1")   -- nil key
+  checkerror("unsupported", D, "\2\0")
+  checkerror("out of range", D, "\1\0", 4)
+
+  -- positions and writers
+  local w = serialize.writer()
+  assert(w:write(1, {2}, "abc") == w and w:count() == 3)
+  s = w:tostring()
+  assert(#w == #s and tostring(w) == s)
+  local a, p = D(s)
+  local b, p = D(s, p)
+  local c, p = D(s, p)
+  assert(a == 1 and b[1] == 2 and c == "abc" and p == #s + 1)
+  assert(w:reset() == w and w:count() == 0 and #w == 0)
+  do local w1 <close> = serialize.writer(); w1:write({}) end
+end
+
+
+if string.strbuf then
+  print("testing string buffers")
+  local sb = string.strbuf()
+  assert(#sb == 0 and sb:len() == 0 and tostring(sb) == "" and sb:take() == "")
+  assert(sb:append("ab", 1, 2.5, true, nil) == sb)
+  assert(sb:tostring() == "ab12.5truenil" and #sb == 13)
+  assert(sb:append() == sb and #sb == 13)
+  assert(sb:format("%d-%s", 10, "x") == sb and sb:tostring():sub(-4) == "10-x")
+  assert(sb:take() == "ab12.5truenil10-x" and #sb == 0 and tostring(sb) == "")
+  sb:append(setmetatable({}, {__tostring = function () return "obj" end}))
+  assert(sb:tostring() == "obj")
+  assert(sb:reset() == sb and #sb == 0 and sb:tostring() == "")
+
+  -- embedded zeros and pack
+  sb:append("a\0b"):pack("i4", 7)
+  assert(#sb == 7 and string.unpack("i4", sb:tostring(), 4) == 7)
+  assert(sb:take() == "a\0b" .. string.pack("i4", 7))
+
+  -- long contents are moved out; the buffer can be reused
+  local t = {}
+  for i = 1, 10000 do sb:append(i, ","); t[i] = i .. "," end
+  local s = table.concat(t)
+  assert(#sb == #s and sb:tostring() == s)
+  assert(sb:take() == s and #sb == 0)
+  sb:append("again")
+  assert(sb:take() == "again")
+
+  -- capacities
+  local sb2 <close> = string.strbuf(1000)
+  assert(#sb2 == 0 and sb2:reserve(100000) == sb2 and #sb2 == 0)
+  sb2:append(string.rep("x", 100000))
+  assert(sb2:tostring() == string.rep("x", 100000))
+  checkerror("invalid capacity", string.strbuf, -1)
+  checkerror("invalid capacity", sb.reserve, sb, -1)
+  checkerror("invalid capacity", string.strbuf, math.maxinteger)
+  checkerror("strbuf expected", sb.append, {}, "x")
+  checkerror("bad argument", sb.format, sb, "%d", "x")
+
+  -- closing releases the contents
+  do
+    local sb3 <close> = string.strbuf()
+    sb3:append("abc")
+    sb = sb3
+  end
+  assert(#sb == 0 and sb:tostring() == "")
+  assert(sb:append("x"):take() == "x")   -- still usable
+
+  if string.isblob then
+    local sb4 = string.strbuf()
+    local b = sb4:append("abc"):take(true)   -- blobs have a minimum size
+    assert(string.isblob(b) and string.sub(b, 1, 4) == "abc\0")
+    b = sb4:append(string.rep("y", 100)):take(true)
+    assert(string.isblob(b) and string.sub(b, 1) == string.rep("y", 100))
+  end
+end
+
+
 print('OK')
 